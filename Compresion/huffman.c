@@ -10,50 +10,12 @@
 #include "huffman.h"
 #include "../common.h"
 #include "../posix_utils.h"
+#include "../metadata.h"
+#include "../container.h"
 
 #define MAX_TREE_HT 512
 #define MAX_CHARS 256
 
-// ===== BitWriter para POSIX =====
-typedef struct {
-    int fd;              // File descriptor en lugar de FILE*
-    uint8_t buffer;      // Buffer de 1 byte
-    int bitCount;        // Bits usados en el buffer (0-7)
-    int totalBits;       // Total de bits escritos
-} BitWriter_POSIX;
-
-// Inicializar BitWriter con file descriptor
-static void bitwriter_init_posix(BitWriter_POSIX* bw, int fd) {
-    bw->fd = fd;
-    bw->buffer = 0;
-    bw->bitCount = 0;
-    bw->totalBits = 0;
-}
-
-// Escribir un bit
-static void bitwriter_write_bit_posix(BitWriter_POSIX* bw, int bit) {
-    bw->buffer <<= 1;
-    if (bit) bw->buffer |= 1;
-    bw->bitCount++;
-    bw->totalBits++;
-    
-    if (bw->bitCount == 8) {
-        posix_write_full(bw->fd, &bw->buffer, 1);
-        bw->buffer = 0;
-        bw->bitCount = 0;
-    }
-}
-
-// Flush bits pendientes
-static void bitwriter_flush_posix(BitWriter_POSIX* bw) {
-    if (bw->bitCount > 0) {
-        bw->buffer <<= (8 - bw->bitCount);
-        posix_write_full(bw->fd, &bw->buffer, 1);
-        bw->buffer = 0;
-        bw->bitCount = 0;
-    }
-}
-
 // ----- Node structure -----
 struct MinHeapNode* newNode(char data, unsigned freq) {
     struct MinHeapNode* temp = (struct MinHeapNode*)malloc(sizeof(struct MinHeapNode));
@@ -244,155 +206,107 @@ void HuffmanCodes(char data[], int freq[], int size, char codes[][MAX_TREE_HT])
     freeHuffmanTree(root);
 }
 
-//(POSIX VERSION)
-void writeHuffman(char inputFile[], char outputFile[]) {
-    // Abrir archivo de entrada con POSIX
-    int fd_input = posix_open_read(inputFile);
-    if (fd_input == -1) return;
-
-    // Obtener tamaño del archivo
-    off_t fileSize = posix_get_file_size(fd_input);
-    if (fileSize <= 0) {
-        fprintf(stderr, "Archivo '%s' está vacío o es inválido\n", inputFile);
-        posix_close(fd_input);
-        return;
-    }
-
-    // Allocar buffer para todo el archivo
-    char* arr = (char*)malloc(fileSize);
-    if (!arr) {
-        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
-        posix_close(fd_input);
-        return;
-    }
-    
-    ssize_t bytes_read = posix_read_full(fd_input, arr, fileSize);
-    posix_close(fd_input);
-
-    if (bytes_read != fileSize) {
-        fprintf(stderr, "Falló lectura desde '%s'\n", inputFile);
-        free(arr);
-        return;
+// Codifica un bloque en memoria con su propia tabla de frecuencias:
+// [uint32 nsym][nsym x (char, uint32 freq)][uint32 totalBits][bits]
+int huffman_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) {
+    if (len == 0 || len > HUFFMAN_MAX_BLOCK) {
+        fprintf(stderr, "Bloque inválido para Huffman: %zu bytes\n", len);
+        return -1;
     }
 
     uint32_t freq[MAX_CHARS] = {0};
-
-    for (ssize_t i = 0; i < bytes_read; i++)
-        freq[(unsigned char)arr[i]]++;
+    for (size_t i = 0; i < len; i++)
+        freq[src[i]]++;
 
     char chars[MAX_CHARS];
     uint32_t freqs[MAX_CHARS];
+    int freqs_int[MAX_CHARS];
     uint32_t size = 0;
-
     for (int i = 0; i < MAX_CHARS; i++) {
         if (freq[i] > 0) {
             chars[size] = (char)i;
-            freqs[size] = (uint32_t)freq[i];
+            freqs[size] = freq[i];
+            freqs_int[size] = (int)freq[i];
             size++;
         }
     }
 
-    if (size == 0) {
-        fprintf(stderr, "Sin caracteres para codificar\n");
-        free(arr);
-        return;
-    }
-
     char codes[256][MAX_TREE_HT] = {{0}};
-    // Convert uint32_t to int for HuffmanCodes
-    int freqs_int[MAX_CHARS];
-    for (uint32_t i = 0; i < size; i++) {
-        freqs_int[i] = (int)freqs[i];
-    }
     HuffmanCodes(chars, freqs_int, size, codes);
 
-    // Abrir archivo de salida con POSIX
-    int fd_output = posix_open_write(outputFile);
-    if (fd_output == -1) {
-        free(arr);
-        return;
+    // Tamaño exacto: tabla + bits de cada símbolo según la longitud de su código
+    uint8_t codeLen[MAX_CHARS] = {0};
+    uint64_t encodedBits = 0;
+    for (int i = 0; i < MAX_CHARS; i++) {
+        if (freq[i] > 0) {
+            codeLen[i] = (uint8_t)strlen(codes[i]);
+            encodedBits += (uint64_t)freq[i] * codeLen[i];
+        }
     }
-
-    // Escribir metadata header
-    FileMetadata meta = {0};
-    meta.magic = METADATA_MAGIC;
-    meta.originalSize = (uint64_t)bytes_read;
-    meta.flags = 0;
-    strncpy(meta.originalName, get_basename(inputFile), MAX_FILENAME_LEN-1);
-    meta.originalName[MAX_FILENAME_LEN-1] = '\0';
-    
-    if (posix_write_full(fd_output, &meta, sizeof(meta)) != sizeof(meta)) {
-        fprintf(stderr, "Falló escritura de metadatos\n");
-        posix_close(fd_output);
-        free(arr);
-        return;
+    if (encodedBits > UINT32_MAX) {
+        fprintf(stderr, "Bloque demasiado grande para Huffman\n");
+        return -1;
     }
 
-    // Escribir header con tipos de tamaño fijo
-    if (posix_write_full(fd_output, &size, sizeof(uint32_t)) != sizeof(uint32_t)) {
-        fprintf(stderr, "Falló escritura de tamaño\n");
-        posix_close(fd_output);
-        free(arr);
-        return;
-    }
-    
-    for (uint32_t i = 0; i < size; i++) {
-        if (posix_write_full(fd_output, &chars[i], sizeof(char)) != sizeof(char) ||
-            posix_write_full(fd_output, &freqs[i], sizeof(uint32_t)) != sizeof(uint32_t)) {
-            fprintf(stderr, "Falló escritura de car/freq\n");
-            posix_close(fd_output);
-            free(arr);
-            return;
-        }
+    size_t headerLen = 2 * sizeof(uint32_t) + size * (sizeof(char) + sizeof(uint32_t));
+    size_t total = headerLen + (size_t)((encodedBits + 7) / 8);
+    unsigned char* out = (unsigned char*)calloc(total, 1);
+    if (!out) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        return -1;
     }
 
-    // Guardar posición para totalBits (lo sobreescribiremos después)
-    off_t bitCountPos = lseek(fd_output, 0, SEEK_CUR);
-    uint32_t placeholder = 0;
-    posix_write_full(fd_output, &placeholder, sizeof(uint32_t));
-
-    // Inicializar BitWriter con POSIX
-    BitWriter_POSIX bw;
-    bitwriter_init_posix(&bw, fd_output);
-
-    // Codificar texto en bits
-    for (ssize_t i = 0; i < bytes_read; i++) {
-        char* code = codes[(unsigned char)arr[i]];
-        for (int j = 0; code[j] != '\0'; j++) {
-            bitwriter_write_bit_posix(&bw, code[j] == '1' ? 1 : 0);
+    size_t pos = 0;
+    memcpy(out + pos, &size, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    for (uint32_t i = 0; i < size; i++) {
+        out[pos++] = (unsigned char)chars[i];
+        memcpy(out + pos, &freqs[i], sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+    }
+    uint32_t totalBits = (uint32_t)encodedBits;
+    memcpy(out + pos, &totalBits, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+
+    // Empaquetar los bits (MSB primero, como el BitWriter original)
+    unsigned char* bits = out + pos;
+    uint64_t bitPos = 0;
+    for (size_t i = 0; i < len; i++) {
+        const char* code = codes[src[i]];
+        for (int j = 0; j < codeLen[src[i]]; j++, bitPos++) {
+            if (code[j] == '1') bits[bitPos >> 3] |= (unsigned char)(0x80 >> (bitPos & 7));
         }
     }
 
-    // Flush bits pendientes
-    bitwriter_flush_posix(&bw);
-    int totalBits = bw.totalBits;
-
-    // Escribir totalBits en la posición reservada
-    lseek(fd_output, bitCountPos, SEEK_SET);
-    posix_write_full(fd_output, &totalBits, sizeof(uint32_t));
+    *dst = out;
+    *dstLen = total;
+    return 0;
+}
 
-    posix_close(fd_output);
-    free(arr);
+// Comprime un archivo en el contenedor por bloques con Huffman
+void writeHuffman(char inputFile[], char outputFile[]) {
+    container_compress_file(inputFile, outputFile, CODEC_ID_HUFFMAN, CIPHER_ID_NONE, NULL, NULL);
 }
 
 // ---- Decompress function ----
-// ---- Decompress function (POSIX VERSION) ----
-void decodeHuffman(struct MinHeapNode* root, unsigned char* data, int dataSizeBits, int fd_output) {
-    if (!root) return;
-    
+// Decodifica a un buffer en memoria; devuelve los bytes producidos (como máximo outCap)
+static size_t decodeHuffmanBuffer(struct MinHeapNode* root, const unsigned char* data, uint32_t dataSizeBits,
+                                  unsigned char* out, size_t outCap) {
+    if (!root) return 0;
+    size_t outPos = 0;
+
     // Handle single character case
     if (!root->left && !root->right) {
-        for (int i = 0; i < dataSizeBits; i++) {
-            unsigned char ch = (unsigned char)root->data;
-            posix_write_full(fd_output, &ch, 1);
+        for (uint32_t i = 0; i < dataSizeBits && outPos < outCap; i++) {
+            out[outPos++] = (unsigned char)root->data;
         }
-        return;
+        return outPos;
     }
-    
+
     struct MinHeapNode* current = root;
 
-    for (int i = 0; i < dataSizeBits; i++) {
-        int byteIndex = i / 8;
+    for (uint32_t i = 0; i < dataSizeBits && outPos < outCap; i++) {
+        uint32_t byteIndex = i / 8;
         int bitIndex = 7 - (i % 8);
         int bit = (data[byteIndex] >> bitIndex) & 1;
 
@@ -403,15 +317,60 @@ void decodeHuffman(struct MinHeapNode* root, unsigned char* data, int dataSizeBi
 
         if (!current) {
             fprintf(stderr, "Error de decodificación: travesía de árbol inválida\n");
-            return;
+            return outPos;
         }
 
         if (isLeaf(current)) {
-            unsigned char ch = (unsigned char)current->data;
-            posix_write_full(fd_output, &ch, 1);
+            out[outPos++] = (unsigned char)current->data;
             current = root;
         }
     }
+    return outPos;
+}
+
+// ---- Decompress function (POSIX VERSION) ----
+void decodeHuffman(struct MinHeapNode* root, unsigned char* data, int dataSizeBits, int fd_output) {
+    if (!root || dataSizeBits <= 0) return;
+    // Cada bit produce como máximo un símbolo
+    unsigned char* out = (unsigned char*)malloc((size_t)dataSizeBits);
+    if (!out) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        return;
+    }
+    size_t produced = decodeHuffmanBuffer(root, data, (uint32_t)dataSizeBits, out, (size_t)dataSizeBits);
+    posix_write_full(fd_output, out, produced);
+    free(out);
+}
+
+// Decodifica un bloque producido por huffman_encode_buffer; dstLen es el tamaño original exacto
+int huffman_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen) {
+    uint32_t size;
+    if (srcLen < 2 * sizeof(uint32_t)) return -1;
+    memcpy(&size, src, sizeof(uint32_t));
+    if (size == 0 || size > MAX_CHARS) return -1;
+
+    size_t pos = sizeof(uint32_t);
+    if (srcLen < pos + size * (sizeof(char) + sizeof(uint32_t)) + sizeof(uint32_t)) return -1;
+
+    char chars[MAX_CHARS];
+    int freqs_int[MAX_CHARS];
+    for (uint32_t i = 0; i < size; i++) {
+        uint32_t f;
+        chars[i] = (char)src[pos++];
+        memcpy(&f, src + pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        freqs_int[i] = (int)f;
+    }
+    uint32_t totalBits;
+    memcpy(&totalBits, src + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    if ((uint64_t)(srcLen - pos) * 8 < totalBits) return -1;
+
+    struct MinHeapNode* root = buildHuffmanTree(chars, freqs_int, size);
+    if (!root) return -1;
+    size_t produced = decodeHuffmanBuffer(root, src + pos, totalBits, dst, dstLen);
+    freeHuffmanTree(root);
+    return produced == dstLen ? 0 : -1;
 }
 
 int readHuffman(char inputFile[], char outputFile[]) {
@@ -421,48 +380,61 @@ int readHuffman(char inputFile[], char outputFile[]) {
 
     // Leer metadata header
     FileMetadata meta;
-    if (posix_read_full(fd_input, &meta, sizeof(meta)) != sizeof(meta) ||
-        meta.magic != METADATA_MAGIC) {
+    if (metadata_read(fd_input, &meta) != 0) {
         fprintf(stderr, "Metadatos faltantes o inválidos en archivo comprimido\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
         return 1;
     }
 
+    // Formato por bloques: lo resuelve el contenedor. Lo que sigue es el formato monolítico heredado
+    if (meta.flags & META_FLAG_BLOCKED) {
+        posix_close_input(fd_input);
+        return container_extract_file(inputFile, outputFile, NULL, NULL) == 0 ? 0 : 1;
+    }
+
+    // Mapa de huecos (solo archivos dispersos); sin él, los datos cubren todo originalSize
+    PosixSparseMap sparse = {0};
+    if ((meta.flags & META_FLAG_SPARSE) && posix_read_sparse_map(fd_input, &sparse, meta.originalSize) != 0) {
+        posix_close_input(fd_input);
+        return 1;
+    }
+    uint64_t dataBytes = sparse.count > 0 ? sparse.dataBytes : meta.originalSize;
+
     uint32_t size;
     if (posix_read_full(fd_input, &size, sizeof(uint32_t)) != sizeof(uint32_t)) {
         fprintf(stderr, "Falló lectura de tamaño\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
-    if (size == 0 || size > MAX_CHARS) {
+    // Un archivo disperso sin datos reales no tiene tabla de símbolos
+    if ((size == 0 && dataBytes != 0) || size > MAX_CHARS) {
         fprintf(stderr, "Tamaño inválido en archivo comprimido: %u\n", size);
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
-    char* chars = (char*)malloc(size);
-    uint32_t* freqs = (uint32_t*)malloc(size * sizeof(uint32_t));
+    char* chars = (char*)malloc(size + 1);
+    uint32_t* freqs = (uint32_t*)malloc((size + 1) * sizeof(uint32_t));
     
     if (!chars || !freqs) {
         fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
         free(chars);
         free(freqs);
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
     for (uint32_t i = 0; i < size; i++) {
-        if (posix_read_full(fd_input, &chars[i], sizeof(char)) != sizeof(char)) {
-            fprintf(stderr, "Falló lectura de carácter\n");
-            posix_close(fd_input);
-            free(chars); free(freqs);
-            return 1;
-        }
-        if (posix_read_full(fd_input, &freqs[i], sizeof(uint32_t)) != sizeof(uint32_t)) {
-            fprintf(stderr, "Falló lectura de frecuencia\n");
-            posix_close(fd_input);
+        if (posix_read_full(fd_input, &chars[i], sizeof(char)) != sizeof(char) ||
+            posix_read_full(fd_input, &freqs[i], sizeof(uint32_t)) != sizeof(uint32_t)) {
+            fprintf(stderr, "Falló lectura de car/freq\n");
+            posix_close_input(fd_input);
             free(chars); free(freqs);
+            posix_free_sparse_map(&sparse);
             return 1;
         }
     }
@@ -471,68 +443,90 @@ int readHuffman(char inputFile[], char outputFile[]) {
     uint32_t totalBits;
     if (posix_read_full(fd_input, &totalBits, sizeof(uint32_t)) != sizeof(uint32_t)) {
         fprintf(stderr, "Falló lectura de totalBits\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
         free(chars); free(freqs);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
     // Calcular cuántos bytes de datos codificados quedan
     off_t fileSize = posix_get_file_size(fd_input);
-    off_t dataStart = sizeof(meta) + sizeof(uint32_t) + size * (sizeof(char) + sizeof(uint32_t)) + sizeof(uint32_t);
+    off_t dataStart = lseek(fd_input, 0, SEEK_CUR);
     off_t bytesToRead = fileSize - dataStart;
     
-    if (bytesToRead <= 0) {
+    if (bytesToRead < 0 || (bytesToRead == 0 && dataBytes != 0) || (uint64_t)bytesToRead * 8 < totalBits) {
         fprintf(stderr, "Formato de archivo comprimido inválido\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
         free(chars); free(freqs);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
-    unsigned char* encodedData = (unsigned char*)malloc(bytesToRead);
-    if (!encodedData) {
+    unsigned char* encodedData = (unsigned char*)malloc(bytesToRead > 0 ? bytesToRead : 1);
+    unsigned char* decoded = (unsigned char*)malloc(dataBytes > 0 ? dataBytes : 1);
+    if (!encodedData || !decoded) {
         fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
-        posix_close(fd_input);
-        free(chars); free(freqs);
+        posix_close_input(fd_input);
+        free(chars); free(freqs); free(encodedData); free(decoded);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
     
     ssize_t bytes_read = posix_read_full(fd_input, encodedData, bytesToRead);
-    posix_close(fd_input);
+    posix_close_input(fd_input);
     
     if (bytes_read != bytesToRead) {
         fprintf(stderr, "Falló lectura de datos codificados\n");
-        free(chars); free(freqs); free(encodedData);
+        free(chars); free(freqs); free(encodedData); free(decoded);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
     // Reconstruir árbol - convertir uint32_t a int
-    int freqs_int[MAX_CHARS];
-    for (uint32_t i = 0; i < size; i++) {
-        freqs_int[i] = (int)freqs[i];
+    size_t produced = 0;
+    if (size > 0) {
+        int freqs_int[MAX_CHARS];
+        for (uint32_t i = 0; i < size; i++) {
+            freqs_int[i] = (int)freqs[i];
+        }
+        struct MinHeapNode* root = buildHuffmanTree(chars, freqs_int, size);
+
+        if (!root) {
+            fprintf(stderr, "Falló reconstrucción de árbol de Huffman\n");
+            free(chars); free(freqs); free(encodedData); free(decoded);
+            posix_free_sparse_map(&sparse);
+            return 1;
+        }
+
+        // Decodificar usando totalBits
+        produced = decodeHuffmanBuffer(root, encodedData, totalBits, decoded, (size_t)dataBytes);
+        freeHuffmanTree(root);
     }
-    struct MinHeapNode* root = buildHuffmanTree(chars, freqs_int, size);
-    
-    if (!root) {
-        fprintf(stderr, "Falló reconstrucción de árbol de Huffman\n");
-        free(chars); free(freqs); free(encodedData);
+
+    if (produced != dataBytes) {
+        fprintf(stderr, "Discrepancia de tamaño: esperado %llu, obtenido %zu bytes\n",
+                (unsigned long long)dataBytes, produced);
+        free(chars); free(freqs); free(encodedData); free(decoded);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
     // Abrir archivo de salida con POSIX
     int fd_output = posix_open_write(outputFile);
     if (fd_output == -1) {
-        freeHuffmanTree(root);
-        free(chars); free(freqs); free(encodedData);
+        free(chars); free(freqs); free(encodedData); free(decoded);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
-    
-    // Decodificar usando totalBits
-    decodeHuffman(root, encodedData, totalBits, fd_output);
+
+    // Escribir datos en sus posiciones lógicas (recrea huecos si el original era disperso)
+    int result = posix_store_data(fd_output, &sparse, decoded, produced, meta.originalSize);
     posix_close(fd_output);
 
-    freeHuffmanTree(root);
     free(chars);
     free(freqs);
     free(encodedData);
-    return 0;
+    free(decoded);
+    posix_free_sparse_map(&sparse);
+    return result == 0 ? 0 : 1;
 }
\ No newline at end of file
@@ -4,11 +4,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #ifndef MAX_TREE_HT
 #define MAX_TREE_HT 512
 #endif
 
+// Bloque máximo por llamada: totalBits se guarda en 32 bits
+#define HUFFMAN_MAX_BLOCK (64u * 1024 * 1024)
+
 // Nodo del árbol de Huffman
 struct MinHeapNode {
     char data;               // carácter
@@ -40,4 +44,18 @@ void writeHuffman(char inputFile[], char outputFile[]);
 void decodeHuffman(struct MinHeapNode*, unsigned char*, int, int);
 int readHuffman(char inputFile[], char outputFile[]);
 
+/**
+ * Codifica un bloque en memoria (tabla de frecuencias propia + bits)
+ * @param dst Buffer reservado con malloc que recibe el bloque codificado
+ * @return 0 en éxito, -1 en error
+ */
+int huffman_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen);
+
+/**
+ * Decodifica un bloque de huffman_encode_buffer
+ * @param dstLen Tamaño original exacto del bloque
+ * @return 0 en éxito, -1 si el bloque es inválido
+ */
+int huffman_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen);
+
 #endif
\ No newline at end of file
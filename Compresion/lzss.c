@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "lzss.h"
+#include "../common.h"
+#include "../posix_utils.h"
+#include "../metadata.h"
+#include "../container.h"
+
+#define LZSS_HASH_MIN_BITS 10          // Bloques chicos: tabla chica, para no limpiar 256 KB por archivo
+#define LZSS_HASH_MAX_BITS 16
+#define LZSS_WINDOW_MASK   0xFFFF      // prev[] guarda un eslabón por posición de la ventana
+
+// Parámetros de cada nivel
+typedef struct {
+    unsigned depth;     // Candidatos a revisar por posición (1 = solo la tabla hash, sin cadenas)
+    int lazy;           // Probar si en la posición siguiente empieza una coincidencia mejor
+    unsigned skip;      // Tras 2^skip posiciones sin coincidencia el paso crece en 1 (0 = sin saltos)
+} LzssLevel;
+
+static const LzssLevel levels[] = {
+    { 1, 0, 6 },        // LZSS_LEVEL_FAST
+    { 16, 0, 7 },       // LZSS_LEVEL_DEFAULT
+    { 128, 1, 0 },      // LZSS_LEVEL_MAX
+};
+
+// Estado del buscador de coincidencias
+typedef struct {
+    const unsigned char* src;
+    size_t len;
+    unsigned bits;
+    uint32_t* head;     // Última posición vista con cada hash
+    uint16_t* prev;     // Distancia a la posición anterior con el mismo hash (0 = fin de la cadena)
+    size_t next;        // Primera posición todavía sin insertar en las cadenas
+} LzssFinder;
+
+static inline uint32_t load32(const unsigned char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t load64(const unsigned char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash4(const unsigned char* p, unsigned bits) {
+    return (load32(p) * 2654435761u) >> (32 - bits);
+}
+
+// Bytes iguales desde a y b, sin que a pase de limit (b siempre va detrás de a)
+static inline size_t match_length(const unsigned char* a, const unsigned char* b, const unsigned char* limit) {
+    const unsigned char* start = a;
+    while (a + 8 <= limit && load64(a) == load64(b)) {
+        a += 8;
+        b += 8;
+    }
+    while (a < limit && *a == *b) {
+        a++;
+        b++;
+    }
+    return (size_t)(a - start);
+}
+
+size_t lzss_bound(size_t rawLen) {
+    return rawLen + rawLen / 255 + 16;
+}
+
+// ---- Compresión ----
+
+static unsigned char* put_length(unsigned char* op, size_t n) {
+    while (n >= 255) {
+        *op++ = 255;
+        n -= 255;
+    }
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+// Emite una secuencia; matchLen = 0 emite la secuencia final, solo con literales
+static unsigned char* put_sequence(unsigned char* op, const unsigned char* lit, size_t litLen,
+                                   size_t offset, size_t matchLen) {
+    unsigned char* token = op++;
+    if (litLen >= 15) {
+        *token = 15 << 4;
+        op = put_length(op, litLen - 15);
+    } else {
+        *token = (unsigned char)(litLen << 4);
+    }
+    memcpy(op, lit, litLen);
+    op += litLen;
+    if (matchLen == 0) return op;
+
+    op[0] = (unsigned char)offset;
+    op[1] = (unsigned char)(offset >> 8);
+    op += 2;
+    size_t m = matchLen - LZSS_MIN_MATCH;
+    if (m >= 15) {
+        *token |= 15;
+        op = put_length(op, m - 15);
+    } else {
+        *token |= (unsigned char)m;
+    }
+    return op;
+}
+
+// Inserta en las cadenas las posiciones pendientes hasta pos (sin incluirla)
+static void finder_insert(LzssFinder* f, size_t pos) {
+    for (size_t p = f->next; p < pos; p++) {
+        uint32_t h = hash4(f->src + p, f->bits);
+        size_t d = p - f->head[h];
+        f->prev[p & LZSS_WINDOW_MASK] = d > LZSS_MAX_OFFSET ? 0 : (uint16_t)d;
+        f->head[h] = (uint32_t)p;
+    }
+    if (pos > f->next) f->next = pos;
+}
+
+// Mejor coincidencia en ip recorriendo hasta depth candidatos; 0 si no hay ninguna de LZSS_MIN_MATCH
+static size_t finder_search(LzssFinder* f, size_t ip, unsigned depth, size_t* matchPos) {
+    finder_insert(f, ip);
+    const unsigned char* src = f->src;
+    const unsigned char* end = src + f->len;
+    uint32_t cur = load32(src + ip);
+    size_t best = 0;
+    size_t cand = f->head[hash4(src + ip, f->bits)];
+
+    while (depth-- > 0 && cand < ip && ip - cand <= LZSS_MAX_OFFSET) {
+        // El byte en best decide rápido si el candidato puede mejorar lo que ya se tiene
+        if ((best == 0 || src[cand + best] == src[ip + best]) && load32(src + cand) == cur) {
+            size_t m = LZSS_MIN_MATCH + match_length(src + ip + LZSS_MIN_MATCH, src + cand + LZSS_MIN_MATCH, end);
+            if (m > best) {
+                best = m;
+                *matchPos = cand;
+                if (ip + m == f->len) break;
+            }
+        }
+        uint16_t d = f->prev[cand & LZSS_WINDOW_MASK];
+        if (d == 0) break;
+        cand -= d;
+    }
+    return best;
+}
+
+int lzss_encode_level(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen, int level) {
+    if (level < LZSS_LEVEL_FAST || level > LZSS_LEVEL_MAX || len > UINT32_MAX) return -1;
+    const LzssLevel* lv = &levels[level - 1];
+
+    unsigned char* out = (unsigned char*)malloc(lzss_bound(len));
+    if (!out) {
+        perror("malloc lzss block");
+        return -1;
+    }
+    unsigned char* op = out;
+    size_t anchor = 0;
+
+    // Con menos bytes no hay dónde buscar: todo va como literales
+    if (len >= 2 * LZSS_MIN_MATCH) {
+        LzssFinder f = { src, len, LZSS_HASH_MIN_BITS, NULL, NULL, 0 };
+        while (f.bits < LZSS_HASH_MAX_BITS && ((size_t)1 << f.bits) < len) f.bits++;
+        f.head = (uint32_t*)calloc((size_t)1 << f.bits, sizeof(uint32_t));
+        if (lv->depth > 1) {
+            f.prev = (uint16_t*)calloc(len < LZSS_WINDOW_MASK + 1 ? len : LZSS_WINDOW_MASK + 1, sizeof(uint16_t));
+        }
+        if (!f.head || (lv->depth > 1 && !f.prev)) {
+            perror("malloc lzss tables");
+            free(f.head);
+            free(f.prev);
+            free(out);
+            return -1;
+        }
+
+        size_t limit = len - LZSS_MIN_MATCH;    // Última posición con 4 bytes para el hash
+        size_t ip = 0;
+        unsigned misses = 0;
+        while (ip <= limit) {
+            size_t cand = 0;
+            size_t mlen = 0;
+            if (!f.prev) {
+                // Nivel rápido: un solo candidato, el último con el mismo hash
+                uint32_t h = hash4(src + ip, f.bits);
+                cand = f.head[h];
+                f.head[h] = (uint32_t)ip;
+                if (cand < ip && ip - cand <= LZSS_MAX_OFFSET && load32(src + cand) == load32(src + ip)) {
+                    mlen = LZSS_MIN_MATCH + match_length(src + ip + LZSS_MIN_MATCH, src + cand + LZSS_MIN_MATCH, src + len);
+                }
+            } else {
+                mlen = finder_search(&f, ip, lv->depth, &cand);
+                while (lv->lazy && mlen > 0 && ip + 1 <= limit) {
+                    size_t cand2 = 0;
+                    size_t mlen2 = finder_search(&f, ip + 1, lv->depth, &cand2);
+                    if (mlen2 <= mlen) break;
+                    ip++;
+                    cand = cand2;
+                    mlen = mlen2;
+                }
+            }
+            if (mlen == 0) {
+                size_t step = 1 + (lv->skip ? misses++ >> lv->skip : 0);
+                if (f.prev && step > 1) {
+                    // Lo que se saltea tampoco entra en las cadenas
+                    finder_insert(&f, ip + 1);
+                    f.next = ip + step;
+                }
+                ip += step;
+                continue;
+            }
+            misses = 0;
+
+            // Extender hacia atrás sobre los literales pendientes
+            while (ip > anchor && cand > 0 && src[ip - 1] == src[cand - 1]) {
+                ip--;
+                cand--;
+                mlen++;
+            }
+            op = put_sequence(op, src + anchor, ip - anchor, ip - cand, mlen);
+            ip += mlen;
+            anchor = ip;
+            // En el nivel rápido se registra al menos una posición del final de la coincidencia
+            if (!f.prev && ip >= 2 && ip - 2 <= limit) f.head[hash4(src + ip - 2, f.bits)] = (uint32_t)(ip - 2);
+        }
+        free(f.head);
+        free(f.prev);
+    }
+
+    op = put_sequence(op, src + anchor, len - anchor, 0, 0);
+    *dst = out;
+    *dstLen = (size_t)(op - out);
+    return 0;
+}
+
+int lzss_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) {
+    return lzss_encode_level(src, len, dst, dstLen, LZSS_LEVEL_DEFAULT);
+}
+
+// ---- Descompresión ----
+
+// Copia de a 16 bytes hasta cubrir end; puede escribir hasta 15 bytes de más
+static inline void wildcopy16(unsigned char* d, const unsigned char* s, const unsigned char* end) {
+    do {
+        memcpy(d, s, 16);
+        d += 16;
+        s += 16;
+    } while (d < end);
+}
+
+static inline void wildcopy8(unsigned char* d, const unsigned char* s, const unsigned char* end) {
+    do {
+        memcpy(d, s, 8);
+        d += 8;
+        s += 8;
+    } while (d < end);
+}
+
+static int get_length(const unsigned char** ip, const unsigned char* iend, size_t* len) {
+    unsigned char b;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lzss_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen) {
+    const unsigned char* ip = src;
+    const unsigned char* iend = src + srcLen;
+    unsigned char* op = dst;
+    unsigned char* oend = dst + dstLen;
+
+    for (;;) {
+        if (ip >= iend) return -1;
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        size_t mlen = token & 15;
+
+        if (lit < 15 && (size_t)(iend - ip) >= 32 && (size_t)(oend - op) >= 32) {
+            // Caso típico lejos de los finales: hasta 14 literales, copiados con largo fijo
+            memcpy(op, ip, 16);
+        } else {
+            if (lit == 15 && get_length(&ip, iend, &lit) != 0) return -1;
+            if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+            // Lejos de los dos finales se copia de a 16 bytes sin mirar el largo exacto
+            if ((size_t)(iend - ip) - lit >= 16 && (size_t)(oend - op) - lit >= 16) {
+                wildcopy16(op, ip, op + lit);
+            } else {
+                memcpy(op, ip, lit);
+            }
+        }
+        ip += lit;
+        op += lit;
+        if (ip == iend) break;          // Secuencia final: solo literales
+
+        if (iend - ip < 2) return -1;
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (mlen == 15 && get_length(&ip, iend, &mlen) != 0) return -1;
+        mlen += LZSS_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || mlen > (size_t)(oend - op)) return -1;
+
+        const unsigned char* match = op - offset;
+        if (mlen <= 18 && offset >= 8 && (size_t)(oend - op) >= 18) {
+            // Coincidencia corta: tres copias de largo fijo
+            memcpy(op, match, 8);
+            memcpy(op + 8, match + 8, 8);
+            memcpy(op + 16, match + 16, 2);
+            op += mlen;
+            continue;
+        }
+        unsigned char* end = op + mlen;
+        int room = (size_t)(oend - end) >= 16;
+        if (room && offset >= 16) {
+            wildcopy16(op, match, end);
+        } else if (room && offset >= 8) {
+            wildcopy8(op, match, end);
+        } else if (offset == 1) {
+            memset(op, *match, mlen);
+        } else if (room && mlen > 16) {
+            // Patrón corto: los primeros 16 bytes uno a uno; desde ahí el patrón se repite a una
+            // distancia múltiplo de offset de al menos 16 y se puede copiar de a 16
+            for (int i = 0; i < 16; i++) op[i] = match[i];
+            size_t step = offset * ((16 + offset - 1) / offset);
+            wildcopy16(op + 16, op + 16 - step, end);
+        } else {
+            for (size_t i = 0; i < mlen; i++) op[i] = match[i];
+        }
+        op = end;
+    }
+    return op == oend ? 0 : -1;
+}
+
+// Comprime un archivo en el contenedor por bloques con LZSS
+void writeLZSS(char inputFile[], char outputFile[]) {
+    container_compress_file(inputFile, outputFile, CODEC_ID_LZSS, CIPHER_ID_NONE, NULL, NULL);
+}
+
+int readLZSS(char inputFile[], char outputFile[]) {
+    int fd_input = posix_open_read(inputFile);
+    if (fd_input == -1) return 1;
+
+    FileMetadata meta;
+    if (metadata_read(fd_input, &meta) != 0) {
+        fprintf(stderr, "Metadatos faltantes o inválidos en archivo comprimido\n");
+        posix_close_input(fd_input);
+        return 1;
+    }
+    posix_close_input(fd_input);
+
+    // LZSS nació con el contenedor: no hay formato monolítico heredado
+    if (!(meta.flags & META_FLAG_BLOCKED)) {
+        fprintf(stderr, "%s no está en el formato por bloques de LZSS\n", inputFile);
+        return 1;
+    }
+    return container_extract_file(inputFile, outputFile, NULL, NULL) == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+#ifndef LZSS_H
+#define LZSS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// LZSS rápido (familia LZ77) con ventana de 64 KB. Cada bloque es una serie de secuencias:
+//
+//   token (literales << 4 | coincidencia - 4) | literales extra | literales |
+//   offset u16 LE | coincidencia extra
+//
+// Un 15 en cualquiera de las dos mitades del token indica que siguen bytes extra (255 = sigue
+// otro). La última secuencia solo lleva literales y termina el bloque. El offset va de 1 a 65535
+// y la coincidencia mínima es de 4 bytes; todo está alineado a byte para que descomprimir sea
+// copiar memoria.
+
+#define LZSS_MIN_MATCH   4
+#define LZSS_MAX_OFFSET  65535
+
+// Niveles: el 1 mira un solo candidato por posición y salta más rápido sobre datos sin
+// repeticiones; los siguientes recorren cadenas de candidatos más largas y el máximo además
+// posterga cada coincidencia un byte si ahí empieza una mejor. Cada nivel tiene su CODEC_ID_*
+// (lzss-fast, lzss, lzss-max), pero todos se leen con el mismo decodificador.
+#define LZSS_LEVEL_FAST     1
+#define LZSS_LEVEL_DEFAULT  2
+#define LZSS_LEVEL_MAX      3
+
+/**
+ * Comprime un archivo con LZSS (nivel por defecto)
+ * Formato: contenedor por bloques; cada bloque es una serie de secuencias LZSS
+ *
+ * @param inputFile Ruta del archivo de entrada
+ * @param outputFile Ruta del archivo de salida
+ */
+void writeLZSS(char inputFile[], char outputFile[]);
+
+/**
+ * Descomprime un archivo comprimido con LZSS
+ *
+ * @param inputFile Ruta del archivo .lzs comprimido
+ * @param outputFile Ruta del archivo de salida
+ * @return 0 en éxito, 1 en error
+ */
+int readLZSS(char inputFile[], char outputFile[]);
+
+/**
+ * Codifica un bloque en memoria con el nivel por defecto
+ * @param dst Buffer reservado con malloc que recibe el bloque codificado
+ * @return 0 en éxito, -1 en error
+ */
+int lzss_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen);
+
+/**
+ * Codifica un bloque en memoria con un nivel dado
+ * @param level LZSS_LEVEL_FAST a LZSS_LEVEL_MAX
+ * @return 0 en éxito, -1 en error
+ */
+int lzss_encode_level(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen, int level);
+
+/**
+ * Decodifica un bloque de lzss_encode_buffer (de cualquier nivel)
+ * @param dstLen Tamaño original exacto del bloque
+ * @return 0 en éxito, -1 si el bloque es inválido
+ */
+int lzss_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen);
+
+/**
+ * Tamaño máximo de un bloque codificado: datos sin coincidencias más sus tokens
+ */
+size_t lzss_bound(size_t rawLen);
+
+#endif
@@ -10,6 +10,8 @@
 #include "lzw.h"
 #include "../common.h"
 #include "../posix_utils.h"
+#include "../metadata.h"
+#include "../container.h"
 
 #define LZW_MAX_DICT 4096
 // Estructura de cualquier entrada del diccionario LZW
@@ -46,51 +48,25 @@ static int findInDict(LZWEntry *dic, int dictSize, const unsigned char* data, si
     return -1;
 }
 
-void writeLZW(char inputFile[], char outputFile[]) {
-    // Abrir archivo con POSIX
-    int fd_input = posix_open_read(inputFile);
-    if (fd_input == -1) return;
-
-    // Obtener tamaño con fstat
-    off_t fileSize = posix_get_file_size(fd_input);
-    if (fileSize < 0) {
-        fprintf(stderr, "Tamaño de archivo inválido para '%s'\n", inputFile);
-        posix_close(fd_input);
-        return;
-    }
-    // Reservar espacio en memoria para almacenar bytes del archivo
-    unsigned char* buf = (unsigned char*)malloc(fileSize);
-    if (!buf) {
-        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
-        posix_close(fd_input);
-        return;
-    }
-    // Se leen todos los bytes del archivo en el buffer
-    ssize_t bytes_read = posix_read_full(fd_input, buf, fileSize);
-    posix_close(fd_input);
-    
-    if (bytes_read != fileSize) {
-        fprintf(stderr, "Falló lectura de archivo completo\n");
-        free(buf);
-        return;
-    }
+// Comprime un bloque en memoria y devuelve los codigos LZW generados (reservados con malloc)
+int lzw_compress(const unsigned char *input, size_t len, uint16_t **outCodes, size_t *outCount) {
     // Se crea el diccionario inicial con sus 256 entradas preestablecidas.
     LZWEntry dict[LZW_MAX_DICT];
     int dictSize = crearDiccionario(dict);
-    if (dictSize < 0) { free(buf); fprintf(stderr, "Falló inicialización de diccionario\n"); return; }
+    if (dictSize < 0) { fprintf(stderr, "Falló inicialización de diccionario\n"); return -1; }
     // Se reserva espacio para los codigos LZW generados
-    uint16_t *codes = (uint16_t*)malloc(sizeof(uint16_t) * (bytes_read + 16));
-    if (!codes) { perror("malloc codes"); free(buf); freeDictionary(dict, dictSize); return; }
-    size_t outCount = 0;
+    uint16_t *codes = (uint16_t*)malloc(sizeof(uint16_t) * (len + 16));
+    if (!codes) { perror("malloc codes"); freeDictionary(dict, dictSize); return -1; }
+    size_t count = 0;
     // Variables para la secuencia actual, w siendo la secuencia actual y wlen su longitud
     unsigned char *w = NULL;
     size_t wlen = 0;
-    // Se recorre el archivo de entrada byte por byte
-    for (size_t i = 0; i < (size_t)bytes_read; i++) {
-        unsigned char k = buf[i];
+    // Se recorre la entrada byte por byte
+    for (size_t i = 0; i < len; i++) {
+        unsigned char k = input[i];
         // Se crea una cadena, que concatena la actual con la siguiente
         unsigned char *wk = (unsigned char*)malloc(wlen + 1);
-        if (!wk) { perror("malloc wk"); free(buf); free(codes); freeDictionary(dict, dictSize); return; }
+        if (!wk) { perror("malloc wk"); free(w); free(codes); freeDictionary(dict, dictSize); return -1; }
         if (wlen > 0) memcpy(wk, w, wlen);
         wk[wlen] = k;
         // Se busca la nueva secuencia wk en el diccionario actual
@@ -101,13 +77,13 @@ void writeLZW(char inputFile[], char outputFile[]) {
             wlen = wlen + 1;
         } else { // Si no se encuentra, el codigo de w es emitido y wk se añade al diccionario
             if (wlen == 0) {
-                codes[outCount++] = (uint16_t)k;
+                codes[count++] = (uint16_t)k;
             } else {
                 int codeW = findInDict(dict, dictSize, w, wlen);
                 if (codeW == -1) {
                     codeW = (unsigned char)w[0];
                 }
-                codes[outCount++] = (uint16_t)codeW;
+                codes[count++] = (uint16_t)codeW;
             }
 
             if (dictSize < LZW_MAX_DICT) {
@@ -120,159 +96,75 @@ void writeLZW(char inputFile[], char outputFile[]) {
             }
             if (w) free(w);
             w = (unsigned char*)malloc(1);
-            if (!w) { perror("malloc w"); free(buf); free(codes); freeDictionary(dict, dictSize); return; }
+            if (!w) { perror("malloc w"); free(codes); freeDictionary(dict, dictSize); return -1; }
             w[0] = k; wlen = 1;
         }
     }
     // Si se llega al final, se emite el codigo de w pendiente
     if (wlen > 0) {
         int codeW = findInDict(dict, dictSize, w, wlen);
-        if (codeW != -1) codes[outCount++] = (uint16_t)codeW;
-    }
-
-    // Abrir archivo de salida con POSIX
-    int fd_output = posix_open_write(outputFile);
-    if (fd_output == -1) {
-        free(buf); free(codes); freeDictionary(dict, dictSize);
-        if (w) free(w);
-        return;
-    }
-    // Se escribe el metadata header del archivo comprimido, que incluye tamaño original y nombre
-    FileMetadata meta = {0};
-    meta.magic = METADATA_MAGIC;
-    meta.originalSize = (uint64_t)bytes_read;
-    meta.flags = 0;
-    strncpy(meta.originalName, get_basename(inputFile), MAX_FILENAME_LEN-1);
-    meta.originalName[MAX_FILENAME_LEN-1] = '\0';
-    
-    if (posix_write_full(fd_output, &meta, sizeof(meta)) != sizeof(meta)) {
-        fprintf(stderr, "Falló escritura de metadatos\n");
-        posix_close(fd_output);
-        free(buf); free(codes); freeDictionary(dict, dictSize);
-        if (w) free(w);
-        return;
-    }
-    // Se escribe el numero de codigos generados
-    uint32_t count = (uint32_t)outCount;
-    if (posix_write_full(fd_output, &count, sizeof(uint32_t)) != sizeof(uint32_t)) {
-        fprintf(stderr, "Falló escritura de conteo\n");
-        posix_close(fd_output);
-        free(buf); free(codes); freeDictionary(dict, dictSize);
-        if (w) free(w);
-        return;
-    }
-    // Se escriben los codigos generados
-    size_t codes_bytes = sizeof(uint16_t) * outCount;
-    if (posix_write_full(fd_output, codes, codes_bytes) != (ssize_t)codes_bytes) {
-        fprintf(stderr, "Falló escritura de códigos\n");
-        posix_close(fd_output);
-        free(buf); free(codes); freeDictionary(dict, dictSize);
-        if (w) free(w);
-        return;
+        if (codeW != -1) codes[count++] = (uint16_t)codeW;
     }
 
-    posix_close(fd_output);
-    // Se liberan los recursos (como la memoria reservada) y se cierra el archivo
-    free(buf);
-    free(codes);
     if (w) free(w);
     freeDictionary(dict, dictSize);
+    *outCodes = codes;
+    *outCount = count;
+    return 0;
 }
 
-int readLZW(char inputFile[], char outputFile[]) {
-    // Abrir archivo con POSIX
-    int fd_input = posix_open_read(inputFile);
-    if (fd_input == -1) return 1;
-
-    // Leer metadata header
-    FileMetadata meta;
-    if (posix_read_full(fd_input, &meta, sizeof(meta)) != sizeof(meta) ||
-        meta.magic != METADATA_MAGIC) {
-        fprintf(stderr, "Metadatos faltantes o inválidos en archivo comprimido\n");
-        posix_close(fd_input);
-        return 1;
-    }
-    uint64_t origSize = meta.originalSize;
-    // Se leen los codigos y los datos comprimidos
-    uint32_t count;
-    if (posix_read_full(fd_input, &count, sizeof(uint32_t)) != sizeof(uint32_t)) {
-        fprintf(stderr, "Falló lectura de conteo\n");
-        posix_close(fd_input);
-        return 1;
-    }
-
-    if (count == 0) {
-        fprintf(stderr, "Sin códigos en archivo comprimido\n");
-        posix_close(fd_input);
-        return 1;
-    }
-    // Se cargan los codigos comprimidos en memoria
-    uint16_t *codes = (uint16_t*)malloc(sizeof(uint16_t) * count);
-    if (!codes) {
-        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
-        posix_close(fd_input);
-        return 1;
-    }
-    
-    size_t codes_bytes = sizeof(uint16_t) * count;
-    if (posix_read_full(fd_input, codes, codes_bytes) != (ssize_t)codes_bytes) {
-        fprintf(stderr, "Falló lectura de códigos\n");
-        free(codes);
-        posix_close(fd_input);
-        return 1;
-    }
-    posix_close(fd_input);
+// Descomprime una secuencia de codigos; devuelve un buffer reservado con malloc y su longitud
+unsigned char* lzw_decompress(const uint16_t *codes, size_t count, size_t *outLen) {
+    if (count == 0) return NULL;
     // Se recrea el diccionario inicial
     LZWEntry dict[LZW_MAX_DICT];
     int dictSize = crearDiccionario(dict);
-    if (dictSize < 0) { free(codes); fprintf(stderr, "Falló inicialización de diccionario\n"); return 1; }
-    // Buffer de salida para los datos descomprimidos
-    unsigned char *outBuf = (unsigned char*)malloc(origSize > 0 ? origSize : 1);
-    if (!outBuf) { perror("malloc outBuf"); free(codes); freeDictionary(dict, dictSize); return 1; }
-    uint64_t outPos = 0;
-
-    // Se procesa el primer codigo
-    if (codes[0] >= (uint16_t)dictSize) { fprintf(stderr, "Primer código inválido\n"); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
-    unsigned char *entry = dict[codes[0]].data;
-    size_t entryLen = dict[codes[0]].len;
-    if (outPos + entryLen > origSize) { fprintf(stderr, "Desbordamiento de salida\n"); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
-    memcpy(outBuf + outPos, entry, entryLen);
-    outPos += entryLen;
+    if (dictSize < 0) { fprintf(stderr, "Falló inicialización de diccionario\n"); return NULL; }
+    // Buffer de salida que crece segun se necesite
+    size_t outCap = count * 2 + 16, outPos = 0;
+    unsigned char *outBuf = (unsigned char*)malloc(outCap);
+    if (!outBuf) { perror("malloc outBuf"); freeDictionary(dict, dictSize); return NULL; }
 
-    // Se guarda la secuencia previamente decodificada
-    unsigned char *prev = (unsigned char*)malloc(entryLen);
-    if (!prev) { perror("malloc prev"); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
-    memcpy(prev, entry, entryLen);
-    size_t prevLen = entryLen;
+    unsigned char *prev = NULL;
+    size_t prevLen = 0;
     // Bucle que recorre todos los codigos
-    for (uint32_t i = 1; i < count; i++) {
+    for (size_t i = 0; i < count; i++) {
         uint16_t code = codes[i];
         unsigned char *current = NULL;
         size_t curLen = 0;
         // Se copia la secuencia si el codigo ya existe en el diccionario
         if (code < (uint16_t)dictSize) {
-            current = (unsigned char*)malloc(dict[code].len);
-            if (!current) { perror("malloc current"); free(prev); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
-            memcpy(current, dict[code].data, dict[code].len);
             curLen = dict[code].len;
-        } else {
+            current = (unsigned char*)malloc(curLen);
+            if (!current) { perror("malloc current"); goto fail; }
+            memcpy(current, dict[code].data, curLen);
+        } else if (prev && code == (uint16_t)dictSize) {
             // Si el codigo aun no existe, se crea con la regla de LZW: la cadena anterior + primer byte de la cadena anterior
             curLen = prevLen + 1;
             current = (unsigned char*)malloc(curLen);
-            if (!current) { perror("malloc special"); free(prev); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
+            if (!current) { perror("malloc special"); goto fail; }
             memcpy(current, prev, prevLen);
             current[curLen-1] = prev[0];
+        } else {
+            fprintf(stderr, "Código LZW inválido\n");
+            goto fail;
+        }
+        // Se agrega la secuencia decodificada a la salida
+        if (outPos + curLen > outCap) {
+            size_t newCap = (outPos + curLen) * 2;
+            unsigned char *grown = (unsigned char*)realloc(outBuf, newCap);
+            if (!grown) { perror("realloc outBuf"); free(current); goto fail; }
+            outBuf = grown;
+            outCap = newCap;
         }
-        // Se agrega la secuencia decodificada al nuevo archivo de salida
-        if (outPos + curLen > origSize) { fprintf(stderr, "Desbordamiento de salida durante escritura\n"); free(current); free(prev); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
         memcpy(outBuf + outPos, current, curLen);
         outPos += curLen;
 
         // Se añade el byte previo + el primer byte de la secuencia actual al diccionario
-        if (dictSize < LZW_MAX_DICT) {
+        if (prev && dictSize < LZW_MAX_DICT) {
             size_t newLen = prevLen + 1;
             dict[dictSize].data = (unsigned char*)malloc(newLen);
-            if (!dict[dictSize].data) { perror("malloc dict entry"); free(current); free(prev); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1; }
+            if (!dict[dictSize].data) { perror("malloc dict entry"); free(current); goto fail; }
             memcpy(dict[dictSize].data, prev, prevLen);
             dict[dictSize].data[prevLen] = current[0];
             dict[dictSize].len = newLen;
@@ -285,26 +177,154 @@ int readLZW(char inputFile[], char outputFile[]) {
         prevLen = curLen;
     }
 
-    if (outPos != origSize) {
-        if (outPos > origSize) {
-            fprintf(stderr, "Discrepancia de tamaño descomprimido: esperado %llu obtenido %llu\n", (unsigned long long)origSize, (unsigned long long)outPos);
-            free(prev); free(codes); free(outBuf); freeDictionary(dict, dictSize); return 1;
+    free(prev);
+    freeDictionary(dict, dictSize);
+    *outLen = outPos;
+    return outBuf;
+
+fail:
+    free(prev);
+    free(outBuf);
+    freeDictionary(dict, dictSize);
+    return NULL;
+}
+
+// Bloque del contenedor: [uint32 count][count x uint16 codigos]
+int lzw_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) {
+    uint16_t *codes;
+    size_t count;
+    if (lzw_compress(src, len, &codes, &count) != 0) return -1;
+    if (count > UINT32_MAX) { free(codes); return -1; }
+
+    size_t total = sizeof(uint32_t) + count * sizeof(uint16_t);
+    unsigned char* out = (unsigned char*)malloc(total);
+    if (!out) { perror("malloc lzw block"); free(codes); return -1; }
+    uint32_t count32 = (uint32_t)count;
+    memcpy(out, &count32, sizeof(uint32_t));
+    memcpy(out + sizeof(uint32_t), codes, count * sizeof(uint16_t));
+    free(codes);
+
+    *dst = out;
+    *dstLen = total;
+    return 0;
+}
+
+int lzw_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen) {
+    uint32_t count;
+    if (srcLen < sizeof(uint32_t)) return -1;
+    memcpy(&count, src, sizeof(uint32_t));
+    if (srcLen != sizeof(uint32_t) + (size_t)count * sizeof(uint16_t)) return -1;
+
+    // Los codigos pueden no estar alineados dentro del bloque: copiarlos
+    uint16_t *codes = (uint16_t*)malloc(count * sizeof(uint16_t) + 1);
+    if (!codes) return -1;
+    memcpy(codes, src + sizeof(uint32_t), count * sizeof(uint16_t));
+
+    size_t outLen = 0;
+    unsigned char* out = lzw_decompress(codes, count, &outLen);
+    free(codes);
+    if (!out) return -1;
+
+    int rc = outLen == dstLen ? 0 : -1;
+    if (rc == 0) memcpy(dst, out, outLen);
+    free(out);
+    return rc;
+}
+
+// Comprime un archivo en el contenedor por bloques con LZW
+void writeLZW(char inputFile[], char outputFile[]) {
+    container_compress_file(inputFile, outputFile, CODEC_ID_LZW, CIPHER_ID_NONE, NULL, NULL);
+}
+
+int readLZW(char inputFile[], char outputFile[]) {
+    // Abrir archivo con POSIX
+    int fd_input = posix_open_read(inputFile);
+    if (fd_input == -1) return 1;
+
+    // Leer metadata header
+    FileMetadata meta;
+    if (metadata_read(fd_input, &meta) != 0) {
+        fprintf(stderr, "Metadatos faltantes o inválidos en archivo comprimido\n");
+        posix_close_input(fd_input);
+        return 1;
+    }
+
+    // Formato por bloques: lo resuelve el contenedor. Lo que sigue es el formato monolítico heredado
+    if (meta.flags & META_FLAG_BLOCKED) {
+        posix_close_input(fd_input);
+        return container_extract_file(inputFile, outputFile, NULL, NULL) == 0 ? 0 : 1;
+    }
+
+    // En archivos dispersos solo se codificaron las regiones con datos
+    PosixSparseMap sparse = {0};
+    if ((meta.flags & META_FLAG_SPARSE) && posix_read_sparse_map(fd_input, &sparse, meta.originalSize) != 0) {
+        posix_close_input(fd_input);
+        return 1;
+    }
+    uint64_t origSize = sparse.count > 0 ? sparse.dataBytes : meta.originalSize;
+    // Se leen los codigos y los datos comprimidos
+    uint32_t count;
+    if (posix_read_full(fd_input, &count, sizeof(uint32_t)) != sizeof(uint32_t)) {
+        fprintf(stderr, "Falló lectura de conteo\n");
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
+        return 1;
+    }
+
+    if (count == 0) {
+        posix_close_input(fd_input);
+        // Archivo disperso sin datos reales: solo hay que recrear el hueco
+        if (sparse.count > 0 && origSize == 0) {
+            int fd_output = posix_open_write(outputFile);
+            int rc = (fd_output == -1 || posix_finish_sparse(fd_output, meta.originalSize) != 0) ? 1 : 0;
+            posix_close(fd_output);
+            posix_free_sparse_map(&sparse);
+            return rc;
         }
+        fprintf(stderr, "Sin códigos en archivo comprimido\n");
+        posix_free_sparse_map(&sparse);
+        return 1;
+    }
+    // Se cargan los codigos comprimidos en memoria
+    uint16_t *codes = (uint16_t*)malloc(sizeof(uint16_t) * count);
+    if (!codes) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
+        return 1;
+    }
+    
+    size_t codes_bytes = sizeof(uint16_t) * count;
+    if (posix_read_full(fd_input, codes, codes_bytes) != (ssize_t)codes_bytes) {
+        fprintf(stderr, "Falló lectura de códigos\n");
+        free(codes);
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
+        return 1;
+    }
+    posix_close_input(fd_input);
+
+    size_t outPos = 0;
+    unsigned char *outBuf = lzw_decompress(codes, count, &outPos);
+    free(codes);
+    if (!outBuf || outPos > origSize) {
+        fprintf(stderr, "Discrepancia de tamaño descomprimido: esperado %llu obtenido %llu\n", (unsigned long long)origSize, (unsigned long long)outPos);
+        free(outBuf); posix_free_sparse_map(&sparse); return 1;
     }
 
     // Escribir salida con POSIX
     int fd_output = posix_open_write(outputFile);
     if (fd_output == -1) {
-        free(prev); free(codes); free(outBuf); freeDictionary(dict, dictSize);
+        free(outBuf);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
     
-    ssize_t written = posix_write_full(fd_output, outBuf, outPos);
+    // Los huecos del original se recrean al escribir en posiciones lógicas
+    int written = posix_store_data(fd_output, &sparse, outBuf, outPos, meta.originalSize);
     posix_close(fd_output);
+    posix_free_sparse_map(&sparse);
 
-    free(prev);
-    free(codes);
     free(outBuf);
-    freeDictionary(dict, dictSize);
-    return (written == (ssize_t)outPos) ? 0 : 1;
-}
\ No newline at end of file
+    return (written == 0) ? 0 : 1;
+}
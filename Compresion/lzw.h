@@ -10,4 +10,21 @@ int lzw_compress(const unsigned char *input, size_t len,
 unsigned char* lzw_decompress(const uint16_t *codes, size_t count,
                               size_t *outLen);
 
+/**
+ * Codifica un bloque en memoria como [uint32 count][count x uint16 codigos]
+ * @param dst Buffer reservado con malloc que recibe el bloque codificado
+ * @return 0 en éxito, -1 en error
+ */
+int lzw_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen);
+
+/**
+ * Decodifica un bloque de lzw_encode_buffer
+ * @param dstLen Tamaño original exacto del bloque
+ * @return 0 en éxito, -1 si el bloque es inválido
+ */
+int lzw_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen);
+
+void writeLZW(char inputFile[], char outputFile[]);
+int readLZW(char inputFile[], char outputFile[]);
+
 #endif
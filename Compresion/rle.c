@@ -10,110 +10,77 @@
 #include "rle.h"
 #include "../common.h"
 #include "../posix_utils.h"
+#include "../metadata.h"
+#include "../container.h"
 
 #define MAX_RUN_LENGTH 0xFFFFFFFF  // Longitud de ejecución máxima para uint32_t
 
+#define RLE_PAIR_SIZE (sizeof(uint32_t) + 1)
+#define RLE_STREAM_WINDOW (1u << 16)  // Ventana de lectura y de escritura del formato heredado
+
 /**
- * Codificación de Longitud de Ejecución Compresión (VERSIÓN POSIX)
+ * Codificación de Longitud de Ejecución de un bloque en memoria
  * Codifica ejecuciones consecutivas del mismo byte como pares [count][byte]
  * Usa uint32_t para contar para manejar ejecuciones largas de manera eficiente
  */
-void writeRLE(char inputFile[], char outputFile[]) {
-    // Abrir archivo de entrada con POSIX
-    int fd_input = posix_open_read(inputFile);
-    if (fd_input == -1) {
-        return;
+int rle_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) {
+    // Contar ejecuciones para reservar el tamaño exacto
+    size_t runs = len > 0 ? 1 : 0;
+    for (size_t j = 1; j < len; j++) {
+        if (src[j] != src[j - 1]) runs++;
     }
 
-    // Obtener tamaño del archivo con fstat
-    off_t fileSize = posix_get_file_size(fd_input);
-    if (fileSize <= 0) {
-        fprintf(stderr, "Archivo '%s' está vacío o es inválido\n", inputFile);
-        posix_close(fd_input);
-        return;
-    }
-
-    // Verificar que es archivo regular
-    if (posix_is_regular_file(fd_input) != 1) {
-        fprintf(stderr, "'%s' no es un archivo regular\n", inputFile);
-        posix_close(fd_input);
-        return;
-    }
-
-    // Allocar buffer para todo el archivo
-    unsigned char* data = (unsigned char*)malloc(fileSize);
-    if (!data) {
+    unsigned char* out = (unsigned char*)malloc(runs * RLE_PAIR_SIZE > 0 ? runs * RLE_PAIR_SIZE : 1);
+    if (!out) {
         fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
-        posix_close(fd_input);
-        return;
-    }
-    
-    // Leer archivo completo con posix_read_full
-    ssize_t bytes_read = posix_read_full(fd_input, data, fileSize);
-    posix_close(fd_input);
-
-    if (bytes_read != fileSize) {
-        fprintf(stderr, "Falló lectura de archivo completo: esperado %ld, obtenido %ld bytes\n",
-                (long)fileSize, (long)bytes_read);
-        free(data);
-        return;
+        return -1;
     }
 
-    // Abrir archivo de salida con POSIX
-    int fd_output = posix_open_write(outputFile);
-    if (fd_output == -1) {
-        free(data);
-        return;
-    }
-
-    // Escribir metadata header
-    FileMetadata meta = {0};
-    meta.magic = METADATA_MAGIC;
-    meta.originalSize = (uint64_t)bytes_read;
-    meta.flags = 0;
-    strncpy(meta.originalName, get_basename(inputFile), MAX_FILENAME_LEN-1);
-    meta.originalName[MAX_FILENAME_LEN-1] = '\0';
-    
-    if (posix_write_full(fd_output, &meta, sizeof(meta)) != sizeof(meta)) {
-        fprintf(stderr, "Falló escritura de metadatos\n");
-        posix_close(fd_output);
-        free(data);
-        return;
-    }
-
-    // RLE encoding
-    size_t i = 0;
-    while (i < (size_t)bytes_read) {
-        unsigned char currentByte = data[i];
+    size_t i = 0, pos = 0;
+    while (i < len) {
+        unsigned char currentByte = src[i];
         uint32_t count = 1;
-        
+
         // Contar ocurrencias consecutivas del mismo byte
-        while (i + count < (size_t)bytes_read && 
-               data[i + count] == currentByte && 
-               count < MAX_RUN_LENGTH) {
+        while (i + count < len && src[i + count] == currentByte && count < MAX_RUN_LENGTH) {
             count++;
         }
-        
-        // Escribir par [count][byte] usando POSIX
-        if (posix_write_full(fd_output, &count, sizeof(uint32_t)) != sizeof(uint32_t)) {
-            fprintf(stderr, "Falló escritura de conteo\n");
-            posix_close(fd_output);
-            free(data);
-            return;
-        }
-        
-        if (posix_write_full(fd_output, &currentByte, sizeof(unsigned char)) != sizeof(unsigned char)) {
-            fprintf(stderr, "Falló escritura de byte\n");
-            posix_close(fd_output);
-            free(data);
-            return;
-        }
-        
+
+        memcpy(out + pos, &count, sizeof(uint32_t));
+        out[pos + sizeof(uint32_t)] = currentByte;
+        pos += RLE_PAIR_SIZE;
         i += count;
     }
 
-    posix_close(fd_output);
-    free(data);
+    *dst = out;
+    *dstLen = pos;
+    return 0;
+}
+
+/**
+ * Expande los pares [count][byte] de un bloque; dstLen es el tamaño original exacto
+ */
+int rle_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen) {
+    if (srcLen % RLE_PAIR_SIZE != 0) return -1;
+
+    size_t outputPos = 0;
+    for (size_t pos = 0; pos < srcLen; pos += RLE_PAIR_SIZE) {
+        uint32_t count;
+        memcpy(&count, src + pos, sizeof(uint32_t));
+        // Validar que count no exceda el espacio restante
+        if (count > dstLen - outputPos) {
+            fprintf(stderr, "Corrupción de datos RLE: ejecución excede tamaño original\n");
+            return -1;
+        }
+        memset(dst + outputPos, src[pos + sizeof(uint32_t)], count);
+        outputPos += count;
+    }
+    return outputPos == dstLen ? 0 : -1;
+}
+
+// Comprime un archivo en el contenedor por bloques con RLE
+void writeRLE(char inputFile[], char outputFile[]) {
+    container_compress_file(inputFile, outputFile, CODEC_ID_RLE, CIPHER_ID_NONE, NULL, NULL);
 }
 
 /**
@@ -129,93 +96,119 @@ int readRLE(char inputFile[], char outputFile[]) {
 
     // Leer metadata header
     FileMetadata meta;
-    if (posix_read_full(fd_input, &meta, sizeof(meta)) != sizeof(meta) || 
-        meta.magic != METADATA_MAGIC) {
+    if (metadata_read(fd_input, &meta) != 0) {
         fprintf(stderr, "Metadatos faltantes o inválidos en archivo comprimido\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        return 1;
+    }
+
+    // Formato por bloques: lo resuelve el contenedor. Lo que sigue es el formato monolítico heredado
+    if (meta.flags & META_FLAG_BLOCKED) {
+        posix_close_input(fd_input);
+        return container_extract_file(inputFile, outputFile, NULL, NULL) == 0 ? 0 : 1;
+    }
+
+    // Mapa de huecos (solo archivos dispersos): se expanden únicamente los datos reales
+    PosixSparseMap sparse = {0};
+    if ((meta.flags & META_FLAG_SPARSE) && posix_read_sparse_map(fd_input, &sparse, meta.originalSize) != 0) {
+        posix_close_input(fd_input);
         return 1;
     }
 
-    uint64_t originalSize = meta.originalSize;
-    if (originalSize == 0 || originalSize > 1024ULL * 1024 * 1024 * 10) { // Max 10GB sanity check
-        fprintf(stderr, "Tamaño original inválido o demasiado grande: %llu\n", 
-                (unsigned long long)originalSize);
-        posix_close(fd_input);
+    uint64_t originalSize = sparse.count > 0 ? sparse.dataBytes : meta.originalSize;
+    if (originalSize == 0 && sparse.count == 0) {
+        fprintf(stderr, "Tamaño original inválido: %llu\n", (unsigned long long)originalSize);
+        posix_close_input(fd_input);
         return 1;
     }
 
-    // Allocar buffer de salida
-    unsigned char* output = (unsigned char*)malloc(originalSize);
-    if (!output) {
+    int fd_output = posix_open_write(outputFile);
+    if (fd_output == -1) {
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
+        return 1;
+    }
+
+    // Se decodifica por ventanas de tamaño fijo: la memoria no depende del tamaño del archivo
+    unsigned char* in = (unsigned char*)malloc(RLE_STREAM_WINDOW);
+    unsigned char* out = (unsigned char*)malloc(RLE_STREAM_WINDOW);
+    if (!in || !out) {
         fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
-        posix_close(fd_input);
+        free(in); free(out);
+        posix_close_input(fd_input);
+        posix_close(fd_output);
+        posix_free_sparse_map(&sparse);
         return 1;
     }
 
-    // Descomprimir datos RLE
-    size_t outputPos = 0;
-    while (outputPos < originalSize) {
-        uint32_t count;
-        unsigned char byte;
-        
-        // Leer count
-        ssize_t n = posix_read_full(fd_input, &count, sizeof(uint32_t));
-        if (n == 0) break;  // EOF alcanzado
-        if (n != sizeof(uint32_t)) {
-            fprintf(stderr, "Falló lectura de conteo\n");
-            free(output);
-            posix_close(fd_input);
-            return 1;
+    int rc = 1;
+    uint64_t outputPos = 0;     // Bytes ya escritos
+    size_t outLen = 0;          // Bytes pendientes en out
+    size_t inLen = 0;           // Bytes sin procesar en in
+    while (outputPos + outLen < originalSize) {
+        if (inLen < RLE_PAIR_SIZE) {
+            ssize_t n = posix_read_full(fd_input, in + inLen, RLE_STREAM_WINDOW - inLen);
+            if (n < 0) {
+                fprintf(stderr, "Falló lectura de datos RLE\n");
+                goto done;
+            }
+            inLen += (size_t)n;
+            if (n == 0) break;  // EOF alcanzado
+            continue;
         }
-        
-        // Leer byte
-        if (posix_read_full(fd_input, &byte, sizeof(unsigned char)) != sizeof(unsigned char)) {
-            fprintf(stderr, "Falló lectura de byte\n");
-            free(output);
-            posix_close(fd_input);
-            return 1;
-        }
-        
-        // Validar que count no exceda el espacio restante
-        if (outputPos + count > originalSize) {
-            fprintf(stderr, "Corrupción de datos RLE: ejecución excede tamaño original\n");
-            free(output);
-            posix_close(fd_input);
-            return 1;
-        }
-        
-        // Expandir el run
-        for (uint32_t i = 0; i < count; i++) {
-            output[outputPos++] = byte;
+
+        // Expandir todos los pares completos de la ventana de entrada
+        size_t pos = 0;
+        while (inLen - pos >= RLE_PAIR_SIZE) {
+            uint32_t count;
+            memcpy(&count, in + pos, sizeof(uint32_t));
+            unsigned char byte = in[pos + sizeof(uint32_t)];
+            pos += RLE_PAIR_SIZE;
+
+            // Validar que count no exceda el espacio restante
+            if (outputPos + outLen + count > originalSize) {
+                fprintf(stderr, "Corrupción de datos RLE: ejecución excede tamaño original\n");
+                goto done;
+            }
+            while (count > 0) {
+                size_t chunk = RLE_STREAM_WINDOW - outLen < count ? RLE_STREAM_WINDOW - outLen : count;
+                memset(out + outLen, byte, chunk);
+                outLen += chunk;
+                count -= (uint32_t)chunk;
+                if (outLen == RLE_STREAM_WINDOW) {
+                    if (posix_store_chunk(fd_output, &sparse, outputPos, out, outLen) != 0) {
+                        fprintf(stderr, "Falló escritura de salida\n");
+                        goto done;
+                    }
+                    outputPos += outLen;
+                    outLen = 0;
+                }
+            }
         }
+        memmove(in, in + pos, inLen - pos);
+        inLen -= pos;
+    }
+
+    if (outLen > 0 && posix_store_chunk(fd_output, &sparse, outputPos, out, outLen) != 0) {
+        fprintf(stderr, "Falló escritura de salida\n");
+        goto done;
     }
-    
-    posix_close(fd_input);
+    outputPos += outLen;
 
     // Verificar que obtuvimos la cantidad esperada de datos
     if (outputPos != originalSize) {
-        fprintf(stderr, "Discrepancia de tamaño: esperado %llu, obtenido %zu bytes\n", 
-                (unsigned long long)originalSize, outputPos);
-        free(output);
-        return 1;
+        fprintf(stderr, "Discrepancia de tamaño: esperado %llu, obtenido %llu bytes\n",
+                (unsigned long long)originalSize, (unsigned long long)outputPos);
+        goto done;
     }
+    // En archivos dispersos los huecos se recrean con ftruncate
+    rc = (sparse.count > 0 && posix_finish_sparse(fd_output, meta.originalSize) != 0) ? 1 : 0;
 
-    // Escribir datos descomprimidos al archivo de salida con POSIX
-    int fd_output = posix_open_write(outputFile);
-    if (fd_output == -1) {
-        free(output);
-        return 1;
-    }
-    
-    ssize_t written = posix_write_full(fd_output, output, originalSize);
+done:
+    free(in);
+    free(out);
+    posix_close_input(fd_input);
     posix_close(fd_output);
-    
-    if (written != (ssize_t)originalSize) {
-        fprintf(stderr, "Falló escritura de salida completa\n");
-        free(output);
-        return 1;
-    }
-
-    free(output);
-    return 0;
+    posix_free_sparse_map(&sparse);
+    return rc;
 }
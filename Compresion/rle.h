@@ -4,13 +4,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stddef.h>
 
 // RLE (Codificación de Longitud de Ejecución) Funciones de Compresión
 // Simple y eficiente para datos con muchas secuencias repetidas
 
 /**
  * Comprime un archivo usando Codificación de Longitud de Ejecución
- * Formato: pares [count][byte] donde count es uint32_t
+ * Formato: contenedor por bloques; cada bloque son pares [count][byte] donde count es uint32_t
  * 
  * @param inputFile Ruta del archivo de entrada
  * @param outputFile Ruta del archivo de salida
@@ -26,4 +27,18 @@ void writeRLE(char inputFile[], char outputFile[]);
  */
 int readRLE(char inputFile[], char outputFile[]);
 
+/**
+ * Codifica un bloque en memoria como pares [count][byte]
+ * @param dst Buffer reservado con malloc que recibe el bloque codificado
+ * @return 0 en éxito, -1 en error
+ */
+int rle_encode_buffer(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen);
+
+/**
+ * Decodifica un bloque de rle_encode_buffer
+ * @param dstLen Tamaño original exacto del bloque
+ * @return 0 en éxito, -1 si el bloque es inválido
+ */
+int rle_decode_buffer(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen);
+
 #endif
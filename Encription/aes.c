@@ -8,12 +8,16 @@
 #include <errno.h>
 #include "aes.h"
 #include "../posix_utils.h"
+#include "../metadata.h"
+#include "../container.h"
 
 // constantes AES-256
 #define Nb 4  // Numero de columnas (palabras de 32 bits) en el estado, 4 para AES
 #define Nk 8  // Tamaño de la clave (en palabras de 32 bits), 8 para AES-256
 #define Nr 14 // Numero de rondas del algoritmo, 14 para AES-256
 
+#define AES_STREAM_WINDOW (1u << 16)  // Ventana de descifrado del formato heredado (múltiplo de 16)
+
 // S-box: Tablas de sustitucion que hacen el paso a SubBytes
 static const uint8_t sbox[256] = {
     0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
@@ -387,99 +391,55 @@ static size_t remove_padding(const uint8_t* data, size_t dataLen) {
     return dataLen - paddingLen;
 }
 
-// Encriptar archivo (VERSION POSIX)
-int aes_encrypt_file(const char* inputPath, const char* outputPath, const char* password) {
-    // Abrir archivo de entrada con POSIX
-    int fd_input = posix_open_read(inputPath);
-    if (fd_input == -1) return -1;
-    
-    off_t fileSize = posix_get_file_size(fd_input);
-    if (fileSize < 0) {
-        posix_close(fd_input);
-        return -1;
-    }
-    
-    uint8_t* fileData = (uint8_t*)malloc(fileSize + AES_BLOCK_SIZE);
-    if (!fileData) {
-        fprintf(stderr, "Falló asignación de memoria\n");
-        posix_close(fd_input);
-        return -1;
-    }
-    
-    if (posix_read_full(fd_input, fileData, fileSize) != fileSize) {
-        fprintf(stderr, "Falló lectura de archivo\n");
-        free(fileData);
-        posix_close(fd_input);
-        return -1;
-    }
-    posix_close(fd_input);
-    
-    size_t paddedSize = add_padding(fileData, fileSize, fileSize + AES_BLOCK_SIZE);
-    if (paddedSize == 0) {
-        fprintf(stderr, "Falló relleno\n");
-        free(fileData);
-        return -1;
-    }
-    
+void aes_init(AesContext* ctx, const char* password) {
     uint8_t key[AES_KEY_SIZE];
     derive_key_from_password(password, key);
-    
-    uint8_t expandedKey[Nb * (Nr + 1) * 4];
-    KeyExpansion(key, expandedKey);
-    
-    uint8_t* encrypted = (uint8_t*)malloc(paddedSize);
-    if (!encrypted) {
-        fprintf(stderr, "Falló asignación de memoria\n");
-        free(fileData);
-        return -1;
-    }
-    
-    for (size_t i = 0; i < paddedSize; i += AES_BLOCK_SIZE) {
-        AES_Encrypt_Block(fileData + i, encrypted + i, expandedKey);
-    }
-    
-    // Abrir archivo de salida con POSIX
-    int fd_output = posix_open_write(outputPath);
-    if (fd_output == -1) {
-        free(fileData);
-        free(encrypted);
-        return -1;
-    }
-    
-    FileMetadata meta = {
-        .magic = METADATA_MAGIC,
-        .originalSize = fileSize,
-        .flags = 0x02
-    };
-    strncpy(meta.originalName, get_basename(inputPath), MAX_FILENAME_LEN - 1);
-    meta.originalName[MAX_FILENAME_LEN - 1] = '\0';
-    
-    if (posix_write_full(fd_output, &meta, sizeof(meta)) != sizeof(meta)) {
-        fprintf(stderr, "Falló escritura de metadatos\n");
-        posix_close(fd_output);
-        free(fileData);
-        free(encrypted);
-        return -1;
-    }
-    
-    if (posix_write_full(fd_output, encrypted, paddedSize) != (ssize_t)paddedSize) {
-        fprintf(stderr, "Falló escritura de datos encriptados\n");
-        posix_close(fd_output);
-        free(fileData);
-        free(encrypted);
-        return -1;
-    }
-    
-    posix_close(fd_output);
-    free(fileData);
-    free(encrypted);
-    
+    KeyExpansion(key, ctx->roundKeys);
     memset(key, 0, sizeof(key));
-    memset(expandedKey, 0, sizeof(expandedKey));
-    
+}
+
+size_t aes_encrypt_buffer(const AesContext* ctx, const uint8_t* src, size_t len, uint8_t* dst) {
+    // Los bloques completos se cifran directamente; el último lleva el relleno
+    size_t full = len - (len % AES_BLOCK_SIZE);
+    for (size_t i = 0; i < full; i += AES_BLOCK_SIZE) {
+        AES_Encrypt_Block(src + i, dst + i, ctx->roundKeys);
+    }
+    uint8_t last[AES_BLOCK_SIZE];
+    size_t rest = len - full;
+    memcpy(last, src + full, rest);
+    add_padding(last, rest, AES_BLOCK_SIZE);
+    AES_Encrypt_Block(last, dst + full, ctx->roundKeys);
+    return full + AES_BLOCK_SIZE;
+}
+
+int aes_decrypt_buffer(const AesContext* ctx, const uint8_t* src, size_t len, uint8_t* dst, size_t* outLen) {
+    if (len == 0 || len % AES_BLOCK_SIZE != 0) return -1;
+    for (size_t i = 0; i < len; i += AES_BLOCK_SIZE) {
+        AES_Decrypt_Block(src + i, dst + i, ctx->roundKeys);
+    }
+    size_t plain = remove_padding(dst, len);
+    // remove_padding devuelve 0 también en error: solo es válido si todo el bloque era relleno
+    if (plain == 0) {
+        if (len != AES_BLOCK_SIZE) return -1;
+        for (size_t i = 0; i < len; i++) {
+            if (dst[i] != AES_BLOCK_SIZE) return -1;
+        }
+    }
+    *outLen = plain;
     return 0;
 }
 
+void aes_clear(AesContext* ctx) {
+    volatile uint8_t* p = ctx->roundKeys;
+    for (size_t i = 0; i < sizeof(ctx->roundKeys); i++) p[i] = 0;
+}
+
+// Encriptar archivo: contenedor por bloques sin compresor, cada bloque de 1 MiB con su
+// propio relleno. La memoria usada no depende del tamaño del archivo
+int aes_encrypt_file(const char* inputPath, const char* outputPath, const char* password) {
+    return container_compress_file(inputPath, outputPath, CODEC_ID_NONE, CIPHER_ID_AES, password, NULL);
+}
+
 // Decriptar archivo
 int aes_decrypt_file(const char* inputPath, const char* outputPath, const char* password) {
     int fd_input = posix_open_read(inputPath);
@@ -489,89 +449,100 @@ int aes_decrypt_file(const char* inputPath, const char* outputPath, const char*
     }
     
     FileMetadata meta;
-    if (posix_read_full(fd_input, &meta, sizeof(meta)) != sizeof(meta) || meta.magic != METADATA_MAGIC) {
+    if (metadata_read(fd_input, &meta) != 0) {
         fprintf(stderr, "Archivo encriptado inválido o corrupto\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        return -1;
+    }
+    
+    // Contenedor por bloques (p. ej. generado con -ce): cada bloque lleva su propio relleno
+    if (meta.flags & META_FLAG_BLOCKED) {
+        posix_close_input(fd_input);
+        return container_extract_file(inputPath, outputPath, password, NULL);
+    }
+    
+    // Mapa de huecos del original (si era disperso)
+    PosixSparseMap sparse = {0};
+    if ((meta.flags & META_FLAG_SPARSE) && posix_read_sparse_map(fd_input, &sparse, meta.originalSize) != 0) {
+        posix_close_input(fd_input);
         return -1;
     }
     
     off_t totalSize = posix_get_file_size(fd_input);
     if (totalSize < 0) {
         fprintf(stderr, "Falló obtención de tamaño de archivo\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
         return -1;
     }
     
-    long encryptedSize = totalSize - sizeof(meta);
+    off_t encryptedSize = totalSize - lseek(fd_input, 0, SEEK_CUR);
     
     if (encryptedSize <= 0 || encryptedSize % AES_BLOCK_SIZE != 0) {
         fprintf(stderr, "Tamaño de datos encriptados inválido\n");
-        posix_close(fd_input);
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
         return -1;
     }
     
-    uint8_t* encrypted = (uint8_t*)malloc(encryptedSize);
-    if (!encrypted) {
-        fprintf(stderr, "Falló asignación de memoria\n");
-        posix_close(fd_input);
-        return -1;
-    }
-    
-    if (posix_read_full(fd_input, encrypted, encryptedSize) != encryptedSize) {
-        fprintf(stderr, "Falló lectura de datos encriptados\n");
-        free(encrypted);
-        posix_close(fd_input);
+    int fd_output = posix_open_write(outputPath);
+    if (fd_output < 0) {
+        fprintf(stderr, "No se puede crear archivo de salida '%s': %s\n", outputPath, strerror(errno));
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
         return -1;
     }
-    posix_close(fd_input);
-    
-    uint8_t key[AES_KEY_SIZE];
-    derive_key_from_password(password, key);
-    
-    uint8_t expandedKey[Nb * (Nr + 1) * 4];
-    KeyExpansion(key, expandedKey);
     
-    uint8_t* decrypted = (uint8_t*)malloc(encryptedSize);
-    if (!decrypted) {
+    AesContext ctx;
+    aes_init(&ctx, password);
+    uint8_t* buffer = (uint8_t*)malloc(AES_STREAM_WINDOW);
+    int rc = -1;
+    if (!buffer) {
         fprintf(stderr, "Falló asignación de memoria\n");
-        free(encrypted);
-        return -1;
-    }
-    
-    for (size_t i = 0; i < (size_t)encryptedSize; i += AES_BLOCK_SIZE) {
-        AES_Decrypt_Block(encrypted + i, decrypted + i, expandedKey);
+        goto done;
+    }
+    
+    // ECB descifra cada bloque de 16 bytes por separado: se procesa por ventanas y solo
+    // la última lleva el relleno PKCS7
+    uint64_t remaining = (uint64_t)encryptedSize;
+    uint64_t written = 0;
+    while (remaining > 0) {
+        size_t chunk = remaining < AES_STREAM_WINDOW ? (size_t)remaining : AES_STREAM_WINDOW;
+        if (posix_read_full(fd_input, buffer, chunk) != (ssize_t)chunk) {
+            fprintf(stderr, "Falló lectura de datos encriptados\n");
+            goto done;
+        }
+        remaining -= chunk;
+        
+        size_t plain = chunk;
+        if (remaining > 0) {
+            for (size_t i = 0; i < chunk; i += AES_BLOCK_SIZE) {
+                AES_Decrypt_Block(buffer + i, buffer + i, ctx.roundKeys);
+            }
+        } else if (aes_decrypt_buffer(&ctx, buffer, chunk, buffer, &plain) != 0) {
+            fprintf(stderr, "Falló desencriptación (contraseña incorrecta o archivo corrupto)\n");
+            goto done;
+        }
+        
+        if (posix_store_chunk(fd_output, &sparse, written, buffer, plain) != 0) {
+            fprintf(stderr, "Falló escritura de datos desencriptados\n");
+            goto done;
+        }
+        written += plain;
     }
     
-    size_t originalSize = remove_padding(decrypted, encryptedSize);
-    if (originalSize == 0) {
+    if (sparse.count > 0 && written != sparse.dataBytes) {
         fprintf(stderr, "Falló desencriptación (contraseña incorrecta o archivo corrupto)\n");
-        free(encrypted);
-        free(decrypted);
-        return -1;
-    }
-    
-    int fd_output = posix_open_write(outputPath);
-    if (fd_output < 0) {
-        fprintf(stderr, "No se puede crear archivo de salida '%s': %s\n", outputPath, strerror(errno));
-        free(encrypted);
-        free(decrypted);
-        return -1;
-    }
-    
-    if (posix_write_full(fd_output, decrypted, originalSize) != (ssize_t)originalSize) {
-        fprintf(stderr, "Falló escritura de datos desencriptados\n");
-        posix_close(fd_output);
-        free(encrypted);
-        free(decrypted);
-        return -1;
+        goto done;
     }
+    rc = (sparse.count > 0 && posix_finish_sparse(fd_output, meta.originalSize) != 0) ? -1 : 0;
     
+done:
+    aes_clear(&ctx);
+    free(buffer);
+    posix_close_input(fd_input);
     posix_close(fd_output);
-    free(encrypted);
-    free(decrypted);
-    
-    memset(key, 0, sizeof(key));
-    memset(expandedKey, 0, sizeof(expandedKey));
-    
-    return 0;
+    posix_free_sparse_map(&sparse);
+    if (rc != 0) unlink(outputPath);
+    return rc;
 }
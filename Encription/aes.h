@@ -11,14 +11,22 @@
 // Modo: ECB (Electronic Codebook) - implementación sencilla
 // Relleno: PKCS7
 // Formato del archivo:
-// FileMetadata (272 bytes)
+// Encabezado de metadatos (compacto, ver metadata.h)
 // Bloques de datos cifrados (múltiplos de 16 bytes)
 
 #define AES_BLOCK_SIZE 16
 #define AES_KEY_SIZE 32    // 256 bits
+#define AES_EXPANDED_KEY_SIZE 240
+
+// Clave expandida lista para cifrar/descifrar buffers sin volver a derivarla
+typedef struct {
+    uint8_t roundKeys[AES_EXPANDED_KEY_SIZE];
+} AesContext;
 
 /**
  * Cifra un archivo usando AES-256-ECB
+ * Escribe el contenedor por bloques (bloques de 1 MiB cifrados por separado), así que
+ * la memoria usada no depende del tamaño del archivo
  * 
  * @param inputPath Ruta del archivo de entrada
  * @param outputPath Ruta del archivo cifrado de salida
@@ -37,4 +45,40 @@ int aes_encrypt_file(const char* inputPath, const char* outputPath, const char*
  */
 int aes_decrypt_file(const char* inputPath, const char* outputPath, const char* password);
 
+/**
+ * Deriva la clave de la contraseña y la expande en el contexto
+ *
+ * @param ctx Contexto a inicializar
+ * @param password Contraseña (la misma derivación que usan los archivos)
+ */
+void aes_init(AesContext* ctx, const char* password);
+
+/**
+ * Cifra un buffer con relleno PKCS7
+ *
+ * @param ctx Contexto inicializado con aes_init
+ * @param src Datos en claro
+ * @param len Longitud de los datos
+ * @param dst Destino, con capacidad para al menos len + AES_BLOCK_SIZE bytes
+ * @return Longitud cifrada (múltiplo de 16)
+ */
+size_t aes_encrypt_buffer(const AesContext* ctx, const uint8_t* src, size_t len, uint8_t* dst);
+
+/**
+ * Descifra un buffer y retira el relleno PKCS7
+ *
+ * @param ctx Contexto inicializado con aes_init
+ * @param src Datos cifrados (múltiplo de 16)
+ * @param len Longitud de los datos cifrados
+ * @param dst Destino, con capacidad para len bytes
+ * @param outLen Longitud de los datos en claro
+ * @return 0 si tiene éxito, -1 si el tamaño o el relleno son inválidos
+ */
+int aes_decrypt_buffer(const AesContext* ctx, const uint8_t* src, size_t len, uint8_t* dst, size_t* outLen);
+
+/**
+ * Borra la clave expandida del contexto
+ */
+void aes_clear(AesContext* ctx);
+
 #endif
@@ -8,12 +8,16 @@
 #include <errno.h>
 #include "vigenere.h"
 #include "../posix_utils.h"
+#include "../metadata.h"
+#include "../container.h"
 
 #define BUFFER_SIZE 8192
 
-static void process_bytes(unsigned char* data, size_t length, const unsigned char* key, size_t keyLen, int encrypt) {
+// 'pos' es la posición del bloque dentro del flujo de datos. La clave se reinicia
+// cada BUFFER_SIZE bytes, igual que cuando cada lectura procesaba un buffer completo
+static void process_bytes(unsigned char* data, size_t length, uint64_t pos, const unsigned char* key, size_t keyLen, int encrypt) {
     for (size_t i = 0; i < length; i++) {
-        unsigned char k = key[i % keyLen];
+        unsigned char k = key[((pos + i) % BUFFER_SIZE) % keyLen];
         if (encrypt) {
             // Cifrado: (byte + clave) mod 256
             data[i] = (data[i] + k) % 256;
@@ -24,7 +28,16 @@ static void process_bytes(unsigned char* data, size_t length, const unsigned cha
     }
 }
 
-static int process_file(const char* inputPath, const char* outputPath, const char* key, int encrypt) {
+void vigenere_apply(unsigned char* data, size_t length, uint64_t pos, const char* key, int encrypt) {
+    size_t keyLen = strlen(key);
+    if (keyLen == 0) return;
+    process_bytes(data, length, pos, (const unsigned char*)key, keyLen, encrypt);
+}
+
+// Descifra un archivo. Los del contenedor por bloques pasan a container_extract_file; aquí solo
+// se lee el formato anterior (encabezado, mapa disperso opcional y los datos cifrados de corrido,
+// sin CRC), que se conserva para archivos viejos
+static int decrypt_file(const char* inputPath, const char* outputPath, const char* key) {
     // Abrir archivo de entrada con POSIX
     int fd_input = posix_open_read(inputPath);
     if (fd_input == -1) return 1;
@@ -32,80 +45,91 @@ static int process_file(const char* inputPath, const char* outputPath, const cha
     // Obtener tamaño del archivo
     off_t fileSize = posix_get_file_size(fd_input);
     if (fileSize < 0) {
-        posix_close(fd_input);
+        posix_close_input(fd_input);
         return 1;
     }
 
     // Abrir archivo de salida con POSIX
     int fd_output = posix_open_write(outputPath);
     if (fd_output == -1) {
-        posix_close(fd_input);
+        posix_close_input(fd_input);
         return 1;
     }
 
-    if (encrypt) {
-        // Escribir metadata para archivos encriptados
-        FileMetadata meta = {
-            .magic = METADATA_MAGIC,
-            .originalSize = fileSize,
-            .flags = 0  // Podría agregar flags para método de encriptación
-        };
-        strncpy(meta.originalName, get_basename(inputPath), MAX_FILENAME_LEN-1);
-        meta.originalName[MAX_FILENAME_LEN-1] = '\0';
-        
-        if (posix_write_full(fd_output, &meta, sizeof(meta)) != sizeof(meta)) {
-            fprintf(stderr, "Falló escritura de metadatos\n");
-            posix_close(fd_input);
-            posix_close(fd_output);
-            return 1;
-        }
-    } else {
-        // Leer y verificar metadata para desencriptación
-        FileMetadata meta;
-        if (posix_read_full(fd_input, &meta, sizeof(meta)) != sizeof(meta) ||
-            meta.magic != METADATA_MAGIC) {
-            fprintf(stderr, "Archivo encriptado inválido o corrupto\n");
-            posix_close(fd_input);
-            posix_close(fd_output);
-            return 1;
-        }
-        fileSize -= sizeof(meta);  // Ajustar por tamaño de metadata
+    // El mapa disperso dice dónde escribir los datos del original
+    PosixSparseMap sparse = {0};
+    FileMetadata meta;
+    if (metadata_read(fd_input, &meta) != 0) {
+        fprintf(stderr, "Archivo encriptado inválido o corrupto\n");
+        posix_close_input(fd_input);
+        posix_close(fd_output);
+        return 1;
+    }
+    // Contenedor por bloques (todos los de -e y -ce actuales): se descifra bloque a bloque
+    if (meta.flags & META_FLAG_BLOCKED) {
+        posix_close_input(fd_input);
+        posix_close(fd_output);
+        return container_extract_file(inputPath, outputPath, key, NULL) == 0 ? 0 : 1;
     }
+    if ((meta.flags & META_FLAG_SPARSE) &&
+        posix_read_sparse_map(fd_input, &sparse, meta.originalSize) != 0) {
+        posix_close_input(fd_input);
+        posix_close(fd_output);
+        return 1;
+    }
+    fileSize -= lseek(fd_input, 0, SEEK_CUR);  // Ajustar por tamaño de metadata
+
+    // Solo se reservan las extensiones con datos de un original disperso
+    posix_preallocate_map(fd_output, &sparse, fileSize);
 
     // Procesar archivo en bloques
     unsigned char buffer[BUFFER_SIZE];
     size_t keyLen = strlen(key);
+    uint64_t pos = 0;
+    int writePacked = sparse.count > 0;
     
     while (1) {
         ssize_t bytes_read = read(fd_input, buffer, BUFFER_SIZE);
+        if (bytes_read == -1 && errno == EINTR) continue;
         if (bytes_read == -1) {
-            if (errno == EINTR) continue;
             fprintf(stderr, "Error de lectura: %s\n", strerror(errno));
-            posix_close(fd_input);
+            posix_close_input(fd_input);
             posix_close(fd_output);
+            posix_free_sparse_map(&sparse);
             return 1;
         }
         if (bytes_read == 0) break;  // EOF
         
-        process_bytes(buffer, bytes_read, (const unsigned char*)key, keyLen, encrypt);
+        process_bytes(buffer, bytes_read, pos, (const unsigned char*)key, keyLen, 0);
         
-        if (posix_write_full(fd_output, buffer, bytes_read) != bytes_read) {
+        ssize_t written = writePacked ? posix_write_packed(fd_output, &sparse, pos, buffer, bytes_read)
+                                      : posix_write_full(fd_output, buffer, bytes_read);
+        if (written != bytes_read) {
             fprintf(stderr, "Error de escritura\n");
-            posix_close(fd_input);
+            posix_close_input(fd_input);
             posix_close(fd_output);
+            posix_free_sparse_map(&sparse);
             return 1;
         }
+        pos += (uint64_t)bytes_read;
     }
 
-    posix_close(fd_input);
+    // Recrear el hueco final del archivo disperso original
+    int rc = 0;
+    if (writePacked && posix_finish_sparse(fd_output, meta.originalSize) != 0) rc = 1;
+
+    posix_close_input(fd_input);
     posix_close(fd_output);
-    return 0;
+    posix_free_sparse_map(&sparse);
+    return rc;
 }
 
+// Encriptar archivo: contenedor por bloques sin compresor, como AES. Cada bloque lleva su CRC32C,
+// así que una clave incorrecta se detecta al desencriptar
 int vigenere_encrypt_file(const char* inputPath, const char* outputPath, const char* key) {
-    return process_file(inputPath, outputPath, key, 1);
+    return container_compress_file(inputPath, outputPath, CODEC_ID_NONE, CIPHER_ID_VIGENERE, key, NULL) == 0 ? 0 : 1;
 }
 
 int vigenere_decrypt_file(const char* inputPath, const char* outputPath, const char* key) {
-    return process_file(inputPath, outputPath, key, 0);
+    return decrypt_file(inputPath, outputPath, key);
 }
@@ -2,10 +2,22 @@
 #define VIGENERE_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "../common.h"
 
 // Nuevas funciones que trabajan con bytes en lugar de texto
 int vigenere_encrypt_file(const char* inputPath, const char* outputPath, const char* key);
 int vigenere_decrypt_file(const char* inputPath, const char* outputPath, const char* key);
 
+/**
+ * Cifra o descifra un buffer en memoria con Vigenère
+ *
+ * @param data Datos a transformar (se modifican en sitio)
+ * @param length Cantidad de bytes
+ * @param pos Posición del buffer dentro del flujo (la clave se reinicia cada 8192 bytes)
+ * @param key Clave de cifrado
+ * @param encrypt 1 para cifrar, 0 para descifrar
+ */
+void vigenere_apply(unsigned char* data, size_t length, uint64_t pos, const char* key, int encrypt);
+
 #endif
\ No newline at end of file
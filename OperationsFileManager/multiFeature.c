@@ -1,4 +1,14 @@
 #include "multiFeature.h"
+#include "../posix_utils.h"
+#include "../metadata.h"
+#include "../registry.h"
+#include "../archive.h"
+#include "../manifest.h"
+#include "../checksum.h"
+#include "../dedup.h"
+#include "../chunkstore.h"
+#include "../autocodec.h"
+#include "workDeque.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
@@ -7,53 +17,37 @@
 // Declaraciones anticipadas
 static int read_original_name_from_compressed(const char* compressed_path, char* out_name, size_t out_size);
 static double get_elapsed_time(struct timespec start_time);
+static int read_header(const char* path, FileMetadata* meta);
 
+// Con --delta-base se escribe el delta contra la versión anterior; sin ella, el contenedor completo
+static int encode_file(const ThreadArgs* args, const char* in, const char* out) {
+    if (args->deltaBase) return mcpf_delta_file(args->ctx, args->deltaBase, in, out, args->op_c);
+    return args->op_c ? mcpf_compress_file(args->ctx, in, out) : mcpf_encrypt_file(args->ctx, in, out);
+}
 
 void* operationOneFile(void* arg) {
     struct ThreadArgs* args = (struct ThreadArgs*)arg;
     
     // Capturar tiempo de inicio
     clock_gettime(CLOCK_MONOTONIC, &args->start_time);
+    args->succeeded = false;
     
     bool op_c = args->op_c;
     bool op_d = args->op_d;
     bool op_e = args->op_e; 
     bool op_u = args->op_u;
     const char* compAlg = args->compAlg;
-    const char* encAlg  = args->encAlg;
     const char* inPath = args->inPath;
     const char* outPath = args->outPath;
-    const char* key = args->key;
+    const McpfContext* ctx = args->ctx;
+    ContainerRange range = { args->range_offset, args->range_length };
 
     // Ejecutar operación individual o combinación
     if (op_c && op_e) {
         // Combinación -ce: comprimir primero, luego encriptar
-        if (!key) { fprintf(stderr, "-k [clave] es obligatorio para -ce\n"); return NULL; }
-        
-        // Generar nombre único temporal para el archivo comprimido usando thread ID
-        pthread_t tid = pthread_self();
-        char compressedFile[512];
-        
-        if (strcmp(compAlg, "huffman") == 0) {
-            snprintf(compressedFile, sizeof(compressedFile), "File_Manager/temp_%lu.bin", (unsigned long)tid);
-            writeHuffman((char*)inPath, compressedFile);
-        } else if (strcmp(compAlg, "rle") == 0) {
-            snprintf(compressedFile, sizeof(compressedFile), "File_Manager/temp_%lu.rle", (unsigned long)tid);
-            writeRLE((char*)inPath, compressedFile);
-        } else if (strcmp(compAlg, "lzw") == 0) {
-            snprintf(compressedFile, sizeof(compressedFile), "File_Manager/temp_%lu.lzw", (unsigned long)tid);
-            writeLZW((char*)inPath, compressedFile);
-        } else {
-            fprintf(stderr, "Algoritmo desconocido: %s\n", compAlg);
-            return NULL;
-        }
+        if (!args->key) { fprintf(stderr, "-k [clave] es obligatorio para -ce\n"); return NULL; }
         
-        if (!file_exists(compressedFile)) {
-            fprintf(stderr, "Error en compresión: %s\n", compressedFile);
-            return NULL;
-        }
-        
-        // Ahora encriptar el archivo comprimido
+        // Cada bloque se comprime y luego se cifra dentro del contenedor (sin archivo temporal)
         char encryptedFile[512];
         if (outPath) {
             // Si outPath parece una ruta (contiene '/'), usarla tal cual; de lo contrario tratarla como nombre base en File_Manager
@@ -67,108 +61,55 @@ void* operationOneFile(void* arg) {
             snprintf(encryptedFile, sizeof(encryptedFile), "File_Manager/output.enc");
         }
         
-        // Encriptar según el algoritmo seleccionado
-        int encResult;
-        if (strcmp(encAlg, "vigenere") == 0) {
-            encResult = vigenere_encrypt_file(compressedFile, encryptedFile, key);
-        } else if (strcmp(encAlg, "aes") == 0) {
-            encResult = aes_encrypt_file(compressedFile, encryptedFile, key);
-        } else {
-            fprintf(stderr, "Algoritmo de encriptación desconocido: %s\n", encAlg);
-            return NULL;
-        }
-        
-        if (encResult != 0) {
-            fprintf(stderr, "Error encriptando archivo comprimido\n");
+        if (encode_file(args, inPath, encryptedFile) != 0) {
+            fprintf(stderr, "Error comprimiendo y encriptando archivo\n");
             return NULL;
         }
         
-        // Limpiar archivo temporal
-        remove(compressedFile);
-        
         double elapsed = get_elapsed_time(args->start_time);
         printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+        args->succeeded = true;
         return NULL;
     }
     
     if (op_u && op_d) {
         // Combinación -ud: desencriptar primero, luego descomprimir (inverso de -ce)
-        if (!key) { fprintf(stderr, "-k [clave] es obligatorio para -ud\n"); return NULL; }
+        if (!args->key) { fprintf(stderr, "-k [clave] es obligatorio para -ud\n"); return NULL; }
         if (!file_exists(inPath)) {
             fprintf(stderr, "Entrada no encontrada: %s\n", inPath);
             return NULL;
         }
         
-        // Paso 1: Desencriptar
-        const char* decryptedFile = "File_Manager/temp_decrypted.tmp";
-        
-        int decResult;
-        if (strcmp(encAlg, "vigenere") == 0) {
-            decResult = vigenere_decrypt_file(inPath, decryptedFile, key);
-        } else if (strcmp(encAlg, "aes") == 0) {
-            decResult = aes_decrypt_file(inPath, decryptedFile, key);
-        } else {
-            fprintf(stderr, "Algoritmo de encriptación desconocido: %s\n", encAlg);
-            return NULL;
-        }
-        
-        if (decResult != 0) {
-            fprintf(stderr, "Error desencriptando archivo\n");
-            return NULL;
-        }
-        
-        if (!file_exists(decryptedFile)) {
-            fprintf(stderr, "Error en desencriptación: %s\n", decryptedFile);
-            return NULL;
-        }
-        
-        // Paso 2: Descomprimir el archivo desencriptado usando nombre temporal único
-        pthread_t tid = pthread_self();
-        char decompressedFile[512];
-        snprintf(decompressedFile, sizeof(decompressedFile), "File_Manager/temp_%lu_decomp.txt", (unsigned long)tid);
-        
-        int result;
-        if (strcmp(compAlg, "huffman") == 0) {
-            result = readHuffman((char*)decryptedFile, decompressedFile);
-        } else if (strcmp(compAlg, "rle") == 0) {
-            result = readRLE((char*)decryptedFile, decompressedFile);
-        } else if (strcmp(compAlg, "lzw") == 0) {
-            result = readLZW((char*)decryptedFile, decompressedFile);
+        // Sin -o, la salida queda en un nombre temporal único por hilo
+        char dest[512];
+        if (outPath) {
+            if (strchr(outPath, '/') != NULL) {
+                snprintf(dest, sizeof(dest), "%s", outPath);
+            } else {
+                const char* base = get_basename(outPath);
+                snprintf(dest, sizeof(dest), "File_Manager/%s", base);
+            }
         } else {
-            fprintf(stderr, "Algoritmo desconocido: %s\n", compAlg);
-            remove(decryptedFile);
-            return NULL;
+            snprintf(dest, sizeof(dest), "File_Manager/temp_%lu_decomp.txt", (unsigned long)pthread_self());
         }
         
-        // Limpiar archivo temporal
-        remove(decryptedFile);
-        
-        if (result != 0) {
+        // El encabezado indica el cifrado y el compresor; el contenedor se procesa bloque a bloque
+        int rc = args->deltaBase ? mcpf_patch_file(ctx, args->deltaBase, inPath, dest)
+                                 : mcpf_unpack_file(ctx, inPath, dest, args->has_range ? &range : NULL);
+        if (rc != 0) {
             fprintf(stderr, "Fallo al descomprimir\n");
-            remove(decompressedFile);
+            remove(dest);
             return NULL;
         }
         
-        if (!file_exists(decompressedFile)) {
-            fprintf(stderr, "No se encontró salida de descompresión: %s\n", decompressedFile);
+        if (!file_exists(dest)) {
+            fprintf(stderr, "No se encontró salida de descompresión: %s\n", dest);
             return NULL;
         }
         
-        if (outPath) {
-            char dest[512];
-            if (strchr(outPath, '/') != NULL) {
-                snprintf(dest, sizeof(dest), "%s", outPath);
-            } else {
-                const char* base = get_basename(outPath);
-                snprintf(dest, sizeof(dest), "File_Manager/%s", base);
-            }
-            if (strcmp(dest, decompressedFile) != 0) {
-                if (move_file(decompressedFile, dest) != 0) return NULL;
-            }
-        }
-        
         double elapsed = get_elapsed_time(args->start_time);
         printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+        args->succeeded = true;
         return NULL;
     }
     
@@ -193,33 +134,20 @@ void* operationOneFile(void* arg) {
             char* dot = strrchr(name_noext, '.');
             if (dot) *dot = '\0';
             
-            const char* ext = "";
-            if (strcmp(compAlg, "huffman") == 0) ext = "bin";
-            else if (strcmp(compAlg, "rle") == 0) ext = "rle";
-            else if (strcmp(compAlg, "lzw") == 0) ext = "lzw";
+            const char* ext = autocodec_extension(compAlg);
             
             snprintf(final_dest, sizeof(final_dest), "File_Manager/%s.%s", name_noext, ext);
         }
         
         // Comprimir directamente al destino final (sin mutex, sin archivos temporales compartidos)
-        if (strcmp(compAlg, "huffman") == 0) {
-            writeHuffman((char*)inPath, final_dest);
-        } else if (strcmp(compAlg, "rle") == 0) {
-            writeRLE((char*)inPath, final_dest);
-        } else if (strcmp(compAlg, "lzw") == 0) {
-            writeLZW((char*)inPath, final_dest);
-        } else {
-            fprintf(stderr, "Algoritmo desconocido: %s\n", compAlg);
-            return NULL;
-        }
-        
-        if (!file_exists(final_dest)) {
+        if (encode_file(args, inPath, final_dest) != 0 || !file_exists(final_dest)) {
             fprintf(stderr, "[Thread] No se encontró salida de compresión: %s\n", final_dest);
             return NULL;
         }
         
         double elapsed = get_elapsed_time(args->start_time);
         printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+        args->succeeded = true;
         return NULL;
     }
 
@@ -280,19 +208,10 @@ void* operationOneFile(void* arg) {
         }
         
         // Descomprimir directamente al destino final (sin mutex)
-        int result;
-        if (strcmp(compAlg, "huffman") == 0) {
-            result = readHuffman((char*)inPath, final_dest);
-        } else if (strcmp(compAlg, "rle") == 0) {
-            result = readRLE((char*)inPath, final_dest);
-        } else if (strcmp(compAlg, "lzw") == 0) {
-            result = readLZW((char*)inPath, final_dest);
-        } else {
-            fprintf(stderr, "Algoritmo desconocido: %s\n", compAlg);
-            return NULL;
-        }
-        
-        if (result != 0) {
+        // El encabezado indica el decodificador; --comp-alg solo se usa con el formato heredado
+        int rc = args->deltaBase ? mcpf_patch_file(ctx, args->deltaBase, inPath, final_dest)
+                                 : mcpf_decompress_file(ctx, inPath, final_dest, args->has_range ? &range : NULL);
+        if (rc != 0) {
             fprintf(stderr, "Fallo al descomprimir %s\n", inPath);
             return NULL;
         }
@@ -304,6 +223,7 @@ void* operationOneFile(void* arg) {
         
         double elapsed = get_elapsed_time(args->start_time);
         printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+        args->succeeded = true;
         return NULL;
     }
 
@@ -326,23 +246,14 @@ void* operationOneFile(void* arg) {
             snprintf(dest, sizeof(dest), "File_Manager/output.enc");
         }
         
-        int encResult;
-        if (strcmp(encAlg, "vigenere") == 0) {
-            encResult = vigenere_encrypt_file(inPath, dest, key);
-        } else if (strcmp(encAlg, "aes") == 0) {
-            encResult = aes_encrypt_file(inPath, dest, key);
-        } else {
-            fprintf(stderr, "Algoritmo de encriptación desconocido: %s\n", encAlg);
-            return NULL;
-        }
-        
-        if (encResult != 0) {
+        if (encode_file(args, inPath, dest) != 0) {
             fprintf(stderr, "Error encriptando archivo\n");
             return NULL;
         }
         
         double elapsed = get_elapsed_time(args->start_time);
         printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+        args->succeeded = true;
         return NULL;
     }
 
@@ -365,17 +276,47 @@ void* operationOneFile(void* arg) {
             snprintf(dest, sizeof(dest), "File_Manager/output.txt");
         }
         
-        int decResult;
-        if (strcmp(encAlg, "vigenere") == 0) {
-            decResult = vigenere_decrypt_file(inPath, dest, key);
-        } else if (strcmp(encAlg, "aes") == 0) {
-            decResult = aes_decrypt_file(inPath, dest, key);
-        } else {
-            fprintf(stderr, "Algoritmo de encriptación desconocido: %s\n", encAlg);
+        FileMetadata header;
+        if (read_header(inPath, &header) != 0) {
+            fprintf(stderr, "Encabezado faltante o inválido: %s\n", inPath);
             return NULL;
         }
         
-        if (decResult != 0) {
+        // Contenedor por bloques o receta de fragmentos (salida de -ce): se recupera el original directamente
+        if (header.flags & (META_FLAG_BLOCKED | META_FLAG_CHUNKED)) {
+            char dest_final[1536];
+            if (header.codec != CODEC_ID_NONE) {
+                // Como antes: el original se restaura con su nombre en la carpeta de salida
+                char folder[1024];
+                if (outPath && strchr(outPath, '/') != NULL) {
+                    size_t len = strrchr(outPath, '/') - outPath;
+                    if (len >= sizeof(folder)) len = sizeof(folder) - 1;
+                    strncpy(folder, outPath, len);
+                    folder[len] = '\0';
+                } else {
+                    strncpy(folder, "File_Manager", sizeof(folder)); folder[sizeof(folder)-1] = '\0';
+                }
+                snprintf(dest_final, sizeof(dest_final), "%s/%s", folder, get_basename(header.originalName));
+            } else {
+                snprintf(dest_final, sizeof(dest_final), "%s", dest);
+            }
+            int rc = args->deltaBase ? mcpf_patch_file(ctx, args->deltaBase, inPath, dest_final)
+                                     : mcpf_decompress_file(ctx, inPath, dest_final, args->has_range ? &range : NULL);
+            if (rc != 0) {
+                fprintf(stderr, "Error desencriptando archivo\n");
+                return NULL;
+            }
+            double elapsed = get_elapsed_time(args->start_time);
+            printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+            args->succeeded = true;
+            return NULL;
+        }
+        if (args->has_range) {
+            fprintf(stderr, "--range requiere un archivo en formato por bloques: %s\n", inPath);
+            return NULL;
+        }
+        
+        if (mcpf_decrypt_file(ctx, inPath, dest) != 0) {
             fprintf(stderr, "Error desencriptando archivo\n");
             return NULL;
         }
@@ -385,28 +326,13 @@ void* operationOneFile(void* arg) {
         int is_compressed = read_original_name_from_compressed(dest, original_name, sizeof(original_name)) == 0;
 
         if (is_compressed) {
-            // Intentar determinar el algoritmo de compresión desde el nombre del archivo o probando todos los descompresores
+            // El encabezado interno indica el compresor: un solo intento, sin probar decodificadores
             // Generar archivo temporal único para descompresión
             pthread_t tid = pthread_self();
             char decompressed_temp[512];
             snprintf(decompressed_temp, sizeof(decompressed_temp), "File_Manager/temp_%lu_decomp.txt", (unsigned long)tid);
             
-            const char* comp_ext = get_extension(inPath);
-            int decomp_result = 1;
-            if (comp_ext && strcmp(comp_ext, "rle") == 0) {
-                decomp_result = readRLE((char*)dest, decompressed_temp);
-            } else if (comp_ext && strcmp(comp_ext, "lzw") == 0) {
-                decomp_result = readLZW((char*)dest, decompressed_temp);
-            } else if (comp_ext && (strcmp(comp_ext, "bin") == 0 || strcmp(comp_ext, "huff") == 0)) {
-                decomp_result = readHuffman((char*)dest, decompressed_temp);
-            } else {
-                // Probar descompresores hasta que uno funcione
-                if (readRLE((char*)dest, decompressed_temp) == 0) decomp_result = 0;
-                else if (readLZW((char*)dest, decompressed_temp) == 0) decomp_result = 0;
-                else if (readHuffman((char*)dest, decompressed_temp) == 0) decomp_result = 0;
-            }
-
-            if (decomp_result != 0) {
+            if (mcpf_decompress_file(ctx, dest, decompressed_temp, NULL) != 0) {
                 fprintf(stderr, "Fallo al descomprimir archivo desencriptado: %s\n", dest);
                 remove(decompressed_temp);
                 return NULL;
@@ -440,6 +366,7 @@ void* operationOneFile(void* arg) {
         
         double elapsed = get_elapsed_time(args->start_time);
         printf("[Hilo %d] %s (%.1fs)\n", args->thread_index, args->thread_file_name, elapsed);
+        args->succeeded = true;
         return NULL;
 
     }
@@ -447,16 +374,20 @@ void* operationOneFile(void* arg) {
     return NULL;
 }
 
+// Leer el encabezado de un archivo generado por el programa
+static int read_header(const char* path, FileMetadata* meta) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    int r = metadata_read(fd, meta);
+    close(fd);
+    return r;
+}
+
 // Leer nombre de archivo original almacenado en los metadatos del archivo comprimido (FileMetadata común al inicio del archivo)
 static int read_original_name_from_compressed(const char* compressed_path, char* out_name, size_t out_size) {
     if (!compressed_path || !out_name) return -1;
-    int fd = open(compressed_path, O_RDONLY);
-    if (fd < 0) return -1;
     FileMetadata meta;
-    ssize_t r = read(fd, &meta, sizeof(meta));
-    close(fd);
-    if (r != sizeof(meta)) return -1;
-    if (meta.magic != METADATA_MAGIC) return -1;
+    if (read_header(compressed_path, &meta) != 0) return -1;
     // Copiar solo el nombre base
     const char* orig = get_basename(meta.originalName);
     strncpy(out_name, orig, out_size);
@@ -499,18 +430,425 @@ int move_file(const char* src, const char* dst_folder) {
     }
 }
 
-// Estructura para mantener información de cada hilo
+// Umbrales del procesamiento de directorios. Un archivo pequeño cuesta más en preparación
+// (hilo, encabezado, clave) que en datos, así que se agrupan en lotes que un mismo hilo procesa
+// uno tras otro. Un archivo grande reparte sus bloques entre todos los hilos libres
+#define DIR_SMALL_FILE   (4 * 1024)      // Por debajo, el archivo va a un lote
+#define DIR_BATCH_FILES  64              // Máximo de archivos por lote
+#define DIR_BATCH_BYTES  (256 * 1024)    // Máximo de bytes por lote
+#define DIR_SPLIT_FILE   (4u << 20)      // Desde aquí, los bloques se codifican en cualquier hilo
+#define DIR_JOB_QUEUE    256             // Capacidad inicial de cada cola
+
+#define TASK_FILES  0                    // Un archivo, o un lote de archivos pequeños
+#define TASK_SCAN   1                    // Un directorio por recorrer
+
+// Directorio recorrido. Los nombres de sus entradas quedan en un solo bloque y cada archivo
+// pendiente guarda solo la posición del suyo; se libera con la última tarea que lo usa
 typedef struct {
-    pthread_t thread;
-    ThreadArgs* args;
-} ThreadInfo;
+    atomic_int refs;
+    char* path;                 // Ruta relativa a la raíz ("" para la raíz)
+    char* names;                // Nombres de las entradas, terminados en '\0'
+    int outReady;               // La carpeta de salida correspondiente ya existe
+} DirNode;
 
-// Estructura para gestionar arrays dinámicos de hilos a través de recursión
+// Archivo pendiente. Las rutas y los ThreadArgs se arman al procesarlo, así que la memoria
+// crece con los archivos en cola y no con el árbol completo
 typedef struct {
-    ThreadInfo* threads;
+    uint32_t name;              // Posición del nombre en dir->names
+    int index;                  // Número de archivo para impresión
+    uint64_t size;
+    uint64_t mtimeNs;           // Para el manifiesto de --incremental
+    uint64_t inode;
+    uint64_t dev;               // Con inode, reconoce enlaces duros sin leer el archivo
+    uint32_t links;
+} DirFile;
+
+// Tarea de las colas; se libera en cuanto termina
+typedef struct {
+    int kind;                   // TASK_*
+    DirNode* dir;               // TASK_SCAN: directorio por recorrer; TASK_FILES: el que los contiene
     int count;
-    int capacity;
-} ThreadPool;
+    uint64_t bytes;
+    int unique;                 // Procesar sin buscar duplicados
+    DirFile files[];            // TASK_FILES
+} DirTask;
+
+// Rutas de un archivo en proceso
+typedef struct {
+    char rel[1024];
+    char in[2048];
+    char out[2048];
+    char base[2048];            // --delta-base: versión anterior del archivo
+} DirPaths;
+
+// Argumentos y rutas de un lote en proceso, uno por hilo
+typedef struct {
+    ThreadArgs args[DIR_BATCH_FILES];
+    DirPaths paths[DIR_BATCH_FILES];
+} DirScratch;
+
+typedef struct ThreadPool ThreadPool;
+
+// Hilo del pool con sus dos colas (workDeque.h): bloques de archivos grandes, que tienen
+// prioridad, y tareas. Cada hilo saca de las suyas y, sin trabajo, roba de otro elegido al azar
+typedef struct {
+    ThreadPool* pool;
+    WorkDeque jobs;
+    WorkDeque tasks;
+    uint32_t seed;
+    DirScratch* scratch;        // Se reserva con el primer archivo
+    pthread_t thread;
+} DirWorker;
+
+// Hilos fijos (uno por CPU) más el hilo que llamó, que trabaja como uno más. Recorrer un
+// directorio también es una tarea: sus subdirectorios y archivos pasan a la cola del hilo que lo
+// leyó, así que los archivos se procesan mientras el resto del árbol se sigue recorriendo en
+// otros hilos. Solo se usa el candado para dormir y despertar hilos sin trabajo
+struct ThreadPool {
+    DirWorker* workers;         // Primero el hilo que llamó y después workerCount hilos
+    int workerCount;
+    atomic_int pending;         // Elementos en alguna cola
+    atomic_int running;         // Tareas en proceso
+    atomic_int sleepers;        // Hilos esperando trabajo
+    atomic_int fileCount;       // Archivos encontrados (numera la salida)
+    int started;                // Pool completo: los hilos pueden empezar
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_key_t self;         // DirWorker del hilo actual, para pool_spawn
+    ContainerExecutor executor;
+    ThreadArgs base;            // Operación y contexto comunes a todos los archivos
+    const char* inRoot;
+    const char* outRoot;
+    int rootFd;                 // Directorio de entrada; los demás se abren relativos a él
+    int outFd;                  // Carpeta de salida; las subcarpetas se crean relativas a ella
+    Manifest* manifest;         // --incremental: corrida anterior y manifiesto nuevo
+    atomic_int skipped;         // Archivos sin cambios
+    atomic_int scanErrors;      // Directorios que no se pudieron leer
+    atomic_int failed;          // Archivos que no se pudieron procesar
+    Dedup* dedup;               // Contenidos ya vistos (dedup.h), o NULL
+    atomic_int duplicates;      // Archivos enlazados a la salida de otro igual
+};
+
+static void scan_directory(DirWorker* me, DirNode* node);
+static int prepare_file(ThreadPool* pool, const DirNode* dir, const DirFile* f, ThreadArgs* ta, DirPaths* p);
+static void record_file(ThreadPool* pool, const DirFile* f, const DirPaths* p);
+static int claim_file(DirWorker* me, DirNode* dir, const DirFile* f, const DirPaths* p, DedupEntry** original);
+static void finish_originals(DirWorker* me, DedupEntry** originals, const int* results, int n);
+
+static void node_release(DirNode* node) {
+    if (atomic_fetch_sub(&node->refs, 1) != 1) return;
+    free(node->path);
+    free(node->names);
+    free(node);
+}
+
+static void task_free(DirTask* task) {
+    node_release(task->dir);
+    free(task);
+}
+
+// Comprime un lote con una sola clave expandida y un solo buffer; el resto de las operaciones
+// procesa sus archivos uno tras otro en este hilo
+static void run_task(DirWorker* me, DirTask* task) {
+    if (task->kind == TASK_SCAN) {
+        scan_directory(me, task->dir);
+        task_free(task);
+        return;
+    }
+    if (!me->scratch && !(me->scratch = (DirScratch*)malloc(sizeof(DirScratch)))) {
+        perror("Error al reservar memoria para rutas");
+        atomic_fetch_add(&me->pool->failed, task->count);
+        task_free(task);
+        return;
+    }
+    DirScratch* s = me->scratch;
+    ThreadPool* pool = me->pool;
+    const DirFile* files[DIR_BATCH_FILES];
+    const char* inputs[DIR_BATCH_FILES];
+    const char* outputs[DIR_BATCH_FILES];
+    int results[DIR_BATCH_FILES];
+    DedupEntry* originals[DIR_BATCH_FILES];
+    int n = 0;
+    for (int i = 0; i < task->count; i++) {
+        if (prepare_file(pool, task->dir, &task->files[i], &s->args[n], &s->paths[n]) != 0) {
+            atomic_fetch_add(&pool->failed, 1);
+            continue;
+        }
+        originals[n] = NULL;
+        if (pool->dedup && !task->unique && claim_file(me, task->dir, &task->files[i], &s->paths[n], &originals[n])) continue;
+        files[n] = &task->files[i];
+        inputs[n] = s->paths[n].in;
+        outputs[n] = s->paths[n].out;
+        n++;
+    }
+    if (n == 0) {
+        task_free(task);
+        return;
+    }
+    if (n == 1 || !s->args[0].op_c || pool->base.deltaBase) {
+        for (int i = 0; i < n; i++) {
+            operationOneFile(&s->args[i]);
+            results[i] = s->args[i].succeeded ? 0 : -1;
+            if (!s->args[i].succeeded) atomic_fetch_add(&pool->failed, 1);
+            if (pool->manifest && s->args[i].succeeded) record_file(pool, files[i], &s->paths[i]);
+        }
+        finish_originals(me, originals, results, n);
+        task_free(task);
+        return;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    mcpf_compress_files(s->args[0].ctx, inputs, outputs, (size_t)n, results);
+    double elapsed = get_elapsed_time(start);
+    for (int i = 0; i < n; i++) {
+        ThreadArgs* ta = &s->args[i];
+        if (results[i] != 0) {
+            fprintf(stderr, "Error comprimiendo %s\n", ta->inPath);
+            atomic_fetch_add(&pool->failed, 1);
+            continue;
+        }
+        printf("[Hilo %d] %s (lote de %d, %.1fs)\n", ta->thread_index, ta->thread_file_name, n, elapsed);
+        if (pool->manifest) record_file(pool, files[i], &s->paths[i]);
+    }
+    finish_originals(me, originals, results, n);
+    task_free(task);
+}
+
+// Siguiente trabajo: bloques y tareas propios, o robados a partir de una víctima al azar
+static void* pool_find(DirWorker* me, int* isJob) {
+    ThreadPool* pool = me->pool;
+    void* item;
+    if ((item = deque_pop(&me->jobs)) != NULL) {
+        *isJob = 1;
+        return item;
+    }
+    if ((item = deque_pop(&me->tasks)) != NULL) {
+        *isJob = 0;
+        return item;
+    }
+    int n = pool->workerCount + 1;
+    me->seed ^= me->seed << 13;
+    me->seed ^= me->seed >> 17;
+    me->seed ^= me->seed << 5;
+    int start = (int)(me->seed % (uint32_t)n);
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < n; i++) {
+            DirWorker* victim = &pool->workers[(start + i) % n];
+            if (victim == me) continue;
+            if ((item = deque_steal(pass == 0 ? &victim->jobs : &victim->tasks)) != NULL) {
+                *isJob = pass == 0;
+                return item;
+            }
+        }
+    }
+    return NULL;
+}
+
+static void pool_wake(ThreadPool* pool, int all) {
+    pthread_mutex_lock(&pool->lock);
+    if (all) pthread_cond_broadcast(&pool->ready);
+    else pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Ejecuta trabajo hasta que no quede nada. Sin trabajo visible se duerme mientras alguna tarea
+// siga en proceso, porque un recorrido puede agregar tareas y un archivo grande, bloques
+static void pool_run(DirWorker* me) {
+    ThreadPool* pool = me->pool;
+    pthread_setspecific(pool->self, me);
+    while (1) {
+        int isJob = 0;
+        void* item = pool_find(me, &isJob);
+        if (item && isJob) {
+            atomic_fetch_sub(&pool->pending, 1);
+            container_job_run((ContainerJob*)item);
+            continue;
+        }
+        if (item) {
+            // running sube antes de que baje pending: el pool nunca parece vacío con una tarea empezando
+            atomic_fetch_add(&pool->running, 1);
+            atomic_fetch_sub(&pool->pending, 1);
+            run_task(me, (DirTask*)item);
+            if (atomic_fetch_sub(&pool->running, 1) == 1) pool_wake(pool, 1);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->pending) == 0 && atomic_load(&pool->running) > 0) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        int done = atomic_load(&pool->pending) == 0 && atomic_load(&pool->running) == 0;
+        atomic_fetch_sub(&pool->sleepers, 1);
+        pthread_mutex_unlock(&pool->lock);
+        if (done) break;
+    }
+    pthread_setspecific(pool->self, NULL);
+}
+
+static void* dir_worker(void* arg) {
+    DirWorker* me = (DirWorker*)arg;
+    ThreadPool* pool = me->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->started) pthread_cond_wait(&pool->ready, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    pool_run(me);
+    return NULL;
+}
+
+// Agrega una tarea a la cola del hilo que la creó; si la cola no puede crecer, la procesa aquí
+static void pool_push(DirWorker* me, DirTask* task) {
+    ThreadPool* pool = me->pool;
+    if (deque_push(&me->tasks, task) != 0) {
+        run_task(me, task);
+        return;
+    }
+    atomic_fetch_add(&pool->pending, 1);
+    if (atomic_load(&pool->sleepers) > 0) pool_wake(pool, 0);
+}
+
+// ContainerExecutor del pool: el escritor agrega el bloque a su propia cola, de donde lo roba
+// cualquier hilo libre. Fuera del pool, o si la cola no puede crecer, el escritor lo codifica él mismo
+static void pool_spawn(void* opaque, ContainerJob* job) {
+    ThreadPool* pool = (ThreadPool*)opaque;
+    DirWorker* me = (DirWorker*)pthread_getspecific(pool->self);
+    if (!me || deque_push(&me->jobs, job) != 0) {
+        container_job_release(job);
+        return;
+    }
+    atomic_fetch_add(&pool->pending, 1);
+    if (atomic_load(&pool->sleepers) > 0) pool_wake(pool, 0);
+}
+
+static DirTask* task_new(int kind, DirNode* dir, int files) {
+    DirTask* task = (DirTask*)calloc(1, sizeof(DirTask) + sizeof(DirFile) * (size_t)files);
+    if (!task) {
+        perror("Error al reservar memoria para tareas");
+        return NULL;
+    }
+    task->kind = kind;
+    task->dir = dir;
+    atomic_fetch_add(&dir->refs, 1);
+    return task;
+}
+
+static DirNode* node_new(char* path) {
+    DirNode* node = path ? (DirNode*)calloc(1, sizeof(DirNode)) : NULL;
+    if (!node) {
+        perror("Error al reservar memoria para el recorrido");
+        free(path);
+        return NULL;
+    }
+    node->path = path;
+    return node;
+}
+
+// Crea el pool con el recorrido de la raíz ya en la cola del hilo que llamó y lo instala como
+// ejecutor de los contenedores. Los hilos esperan a que todo esté listo
+static int pool_start(ThreadPool* pool) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    pthread_key_create(&pool->self, NULL);
+    pool->rootFd = open(pool->inRoot, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pool->rootFd < 0) {
+        fprintf(stderr, "Error abriendo directorio %s: %s\n", pool->inRoot, strerror(errno));
+        return -1;
+    }
+    pool->outFd = open(pool->outRoot, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (pool->outFd < 0) {
+        fprintf(stderr, "Error abriendo carpeta de salida %s: %s\n", pool->outRoot, strerror(errno));
+        return -1;
+    }
+    // Solo al comprimir o cifrar: al restaurar, cada archivo tiene que quedar independiente
+    // Con --delta-base cada salida depende de la versión anterior de su propia ruta: no se comparten
+    if (pool->base.dedup && !pool->base.deltaBase && (pool->base.op_c || pool->base.op_e) && !(pool->dedup = dedup_new(pool->rootFd))) {
+        fprintf(stderr, "Sin memoria para buscar duplicados: se procesan todos los archivos\n");
+    }
+    pool->workers = (DirWorker*)calloc((size_t)threads + 1, sizeof(DirWorker));
+    if (!pool->workers) {
+        perror("Error al reservar memoria para hilos");
+        return -1;
+    }
+    for (int t = 0; t <= threads; t++) {
+        DirWorker* w = &pool->workers[t];
+        w->pool = pool;
+        w->seed = 2654435761u * (uint32_t)(t + 1);
+        if (deque_init(&w->jobs, DIR_JOB_QUEUE) != 0 || deque_init(&w->tasks, DIR_JOB_QUEUE) != 0) {
+            perror("Error al reservar memoria para colas");
+            goto fail;
+        }
+    }
+    DirNode* rootDir = node_new(strdup(""));
+    DirTask* root = rootDir ? task_new(TASK_SCAN, rootDir, 0) : NULL;
+    if (!root) {
+        if (rootDir) free(rootDir->path);
+        free(rootDir);
+        goto fail;
+    }
+    rootDir->outReady = 1;
+    deque_push(&pool->workers[0].tasks, root);
+    atomic_store(&pool->pending, 1);
+
+    for (int t = 1; t <= threads; t++) {
+        if (pthread_create(&pool->workers[t].thread, NULL, dir_worker, &pool->workers[t]) != 0) break;
+        pool->workerCount++;
+    }
+    for (int t = pool->workerCount + 1; t <= threads; t++) {
+        deque_free(&pool->workers[t].jobs);
+        deque_free(&pool->workers[t].tasks);
+    }
+    // Sin hilos extra el recorrido y los archivos se procesan igual en el hilo que llamó.
+    // Los bloques de los archivos grandes se codifican en los hilos del pool
+    pool->executor.spawn = pool_spawn;
+    pool->executor.opaque = pool;
+    pool->executor.width = pool->workerCount + 1;
+    pool->executor.minBlocks = DIR_SPLIT_FILE / CONTAINER_BLOCK_SIZE;
+    // Los archivos ya se reparten entre hilos: cada contenedor se codifica en su hilo, salvo los
+    // bloques de los grandes que toma el pool. Va en el contexto de esta operación, no en el proceso
+    mcpf_context_set_threads(pool->base.ctx, 1, &pool->executor);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->started = 1;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+
+fail:
+    for (int t = 0; t <= threads; t++) {
+        deque_free(&pool->workers[t].jobs);
+        deque_free(&pool->workers[t].tasks);
+    }
+    free(pool->workers);
+    pool->workers = NULL;
+    return -1;
+}
+
+// Espera a los hilos y libera las colas (con lo que haya quedado si el pool no llegó a correr)
+static void pool_finish(ThreadPool* pool) {
+    for (int t = 1; t <= pool->workerCount; t++) pthread_join(pool->workers[t].thread, NULL);
+    if (pool->started) mcpf_context_set_threads(pool->base.ctx, 1, NULL);
+    for (int t = 0; pool->workers && t <= pool->workerCount; t++) {
+        DirWorker* w = &pool->workers[t];
+        void* item;
+        while (atomic_load(&w->jobs.array) && (item = deque_pop(&w->jobs)) != NULL) {
+            container_job_release((ContainerJob*)item);
+        }
+        while (atomic_load(&w->tasks.array) && (item = deque_pop(&w->tasks)) != NULL) task_free((DirTask*)item);
+        deque_free(&w->jobs);
+        deque_free(&w->tasks);
+        free(w->scratch);
+    }
+    free(pool->workers);
+    dedup_free(pool->dedup);
+    if (pool->rootFd >= 0) close(pool->rootFd);
+    if (pool->outFd >= 0) close(pool->outFd);
+    pthread_key_delete(pool->self);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->ready);
+}
 
 // Función auxiliar para crear carpetas padre necesarias para un archivo
 static void ensure_parent_directory_exists(const char* file_path) {
@@ -552,252 +890,567 @@ void ensure_directory_exists(const char* dir_path) {
     }
 }
 
-// Función auxiliar para obtener la ruta relativa desde la carpeta base
-// Por ejemplo: si base="/input", full="/input/sub/file.txt", retorna "sub/file.txt"
-static void get_relative_path(const char* base, const char* full, char* rel, size_t rel_size) {
-    size_t base_len = strlen(base);
-    if (strncmp(full, base, base_len) == 0) {
-        if (full[base_len] == '/') {
-            strncpy(rel, full + base_len + 1, rel_size - 1);
-        } else {
-            strncpy(rel, full + base_len, rel_size - 1);
+// "dir/name" en memoria nueva; con dir vacío, copia de name
+static char* join_path(const char* dir, const char* name) {
+    size_t dirLen = strlen(dir), nameLen = strlen(name);
+    char* path = (char*)malloc(dirLen + nameLen + 2);
+    if (!path) return NULL;
+    if (dirLen > 0) {
+        memcpy(path, dir, dirLen);
+        path[dirLen++] = '/';
+    }
+    memcpy(path + dirLen, name, nameLen + 1);
+    return path;
+}
+
+// Extensiones que agrega la compresión (incluidas las de --comp-alg auto y store)
+static bool is_codec_extension(const char* ext) {
+    return codec_find_extension(ext) != NULL || strcmp(ext, AUTOCODEC_EXTENSION) == 0 ||
+           strcmp(ext, CODEC_STORE_EXTENSION) == 0;
+}
+
+// Construye el nombre de salida de un archivo (rel: ruta relativa a la raíz) según la operación
+static void build_output_path(ThreadArgs* ta, const char* rel, const char* outRoot, char* out, size_t size) {
+    char name_noext[512];
+    strncpy(name_noext, rel, sizeof(name_noext));
+    name_noext[sizeof(name_noext)-1] = '\0';
+
+    // En descompresión, solo quitar la extensión de compresión (.rle, .lzw, .bin)
+    if (ta->op_d) {
+        char* dot = strrchr(name_noext, '.');
+        if (dot && is_codec_extension(dot + 1)) *dot = '\0';
+    } else {
+        // En compresión/encriptación, quitar toda la extensión
+        char* dot = strrchr(name_noext, '.');
+        if (dot) *dot = '\0';
+    }
+
+    if (ta->op_e && ta->op_c) {
+        // -ce: comprimir primero, luego encriptar
+        if (!ta->compAlg || ta->compAlg[0] == '\0') ta->compAlg = "rle";
+        snprintf(out, size, "%s/%s.bin", outRoot, name_noext);
+    } else if (ta->op_e) {
+        // -e: solo encriptar, sin comprimir
+        snprintf(out, size, "%s/%s.bin", outRoot, rel);
+    } else if (ta->op_u) {
+        // Cuando desencriptamos, quitamos la extensión .bin (que fue la extensión del encriptado)
+        char decrypted_name[1024];
+        strncpy(decrypted_name, rel, sizeof(decrypted_name) - 1);
+        decrypted_name[sizeof(decrypted_name) - 1] = '\0';
+        size_t len = strlen(decrypted_name);
+        if (len > 4 && strcmp(decrypted_name + len - 4, ".bin") == 0) decrypted_name[len - 4] = '\0';
+        snprintf(out, size, "%s/%s", outRoot, decrypted_name);
+    } else if (ta->op_d) {
+        // En descompresión: usar el nombre sin la extensión de compresión
+        snprintf(out, size, "%s/%s", outRoot, name_noext);
+    } else {
+        // En compresión: agregar la extensión de compresión
+        const char* ext = autocodec_extension(ta->compAlg);
+        if (ext[0] != '\0') snprintf(out, size, "%s/%s.%s", outRoot, name_noext, ext);
+        else snprintf(out, size, "%s/%s", outRoot, name_noext);
+    }
+}
+
+// Arma las rutas y los argumentos de un archivo pendiente en los buffers del hilo. La carpeta de
+// salida ya la creó el recorrido salvo que el nombre de salida cambie de carpeta (un punto en
+// un directorio y un archivo sin extensión); solo entonces se crean las carpetas padre
+// --delta-base con directorios: la versión anterior está en la misma ruta relativa de la base.
+// Al restaurar, la ruta sale del nombre original del encabezado, porque la salida cambió de
+// extensión. Un archivo sin versión anterior se procesa completo
+static void delta_base_for(ThreadPool* pool, const DirNode* dir, DirPaths* p, ThreadArgs* ta) {
+    const char* root = pool->base.deltaBase;
+    const char* sep = dir->path[0] ? "/" : "";
+    char name[MAX_FILENAME_LEN];
+    int len = -1;
+    if (ta->op_c || ta->op_e) {
+        len = snprintf(p->base, sizeof(p->base), "%s/%s", root, p->rel);
+    } else if (read_original_name_from_compressed(p->in, name, sizeof(name)) == 0) {
+        len = snprintf(p->base, sizeof(p->base), "%s/%s%s%s", root, dir->path, sep, name);
+    }
+    ta->deltaBase = len >= 0 && len < (int)sizeof(p->base) && file_exists(p->base) ? p->base : NULL;
+}
+
+static int prepare_file(ThreadPool* pool, const DirNode* dir, const DirFile* f, ThreadArgs* ta, DirPaths* p) {
+    const char* name = dir->names + f->name;
+    int relLen = snprintf(p->rel, sizeof(p->rel), "%s%s%s", dir->path, dir->path[0] ? "/" : "", name);
+    int inLen = snprintf(p->in, sizeof(p->in), "%s/%s%s%s", pool->inRoot, dir->path, dir->path[0] ? "/" : "", name);
+    if (relLen >= (int)sizeof(p->rel) || inLen >= (int)sizeof(p->in)) {
+        fprintf(stderr, "Ruta demasiado larga: %s/%s\n", dir->path, name);
+        return -1;
+    }
+    *ta = pool->base;
+    char out[sizeof(p->out)];
+    build_output_path(ta, p->rel, pool->outRoot, out, sizeof(out));
+    memcpy(p->out, out, sizeof(out));
+    ta->inPath = p->in;
+    ta->outPath = p->out;
+    ta->thread_index = f->index;
+    ta->thread_file_name = p->rel;
+    if (ta->deltaBase) delta_base_for(pool, dir, p, ta);
+
+    size_t parentLen = strlen(pool->outRoot) + (dir->path[0] ? strlen(dir->path) + 1 : 0);
+    const char* slash = strrchr(p->out, '/');
+    if (!dir->outReady || !slash || (size_t)(slash - p->out) != parentLen) {
+        ensure_parent_directory_exists(p->out);
+    }
+    return 0;
+}
+
+// --incremental: agrega al manifiesto nuevo un archivo recién procesado, con el CRC32C de su salida
+static void record_file(ThreadPool* pool, const DirFile* f, const DirPaths* p) {
+    ManifestEntry e = { p->rel, p->out + strlen(pool->outRoot) + 1, f->size, f->mtimeNs, f->inode, 0, 0 };
+    if (crc32c_file(pool->outFd, e.output, &e.outSize, &e.outCrc) != 0 || manifest_add(pool->manifest, &e) != 0) {
+        fprintf(stderr, "No se pudo registrar %s en el manifiesto\n", p->rel);
+    }
+}
+
+// Copia la salida del original cuando el sistema de archivos no admite enlaces duros
+static int copy_output(ThreadPool* pool, const char* from, const char* to) {
+    int in = openat(pool->outFd, from, O_RDONLY | O_CLOEXEC);
+    int out = in >= 0 ? openat(pool->outFd, to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, FILE_MODE) : -1;
+    unsigned char buf[64 * 1024];
+    ssize_t n = out >= 0 ? 0 : -1;
+    while (out >= 0 && (n = posix_read_full(in, buf, sizeof(buf))) > 0) {
+        if (posix_write_full(out, buf, (size_t)n) != n) {
+            n = -1;
+            break;
         }
+    }
+    if (out >= 0 && close(out) != 0) n = -1;
+    if (in >= 0) close(in);
+    return n == 0 ? 0 : -1;
+}
+
+// Duplicado con la salida del original ya escrita. Con el mismo nombre base su salida sería
+// idéntica y basta con un enlace duro; si no, se copia el contenedor con su propio nombre en el
+// encabezado, que es el que restaura -d. -1 si hay que procesarlo por su cuenta
+static int link_duplicate(ThreadPool* pool, const DirFile* f, const DirPaths* p, const DedupEntry* e) {
+    const char* out = p->out + strlen(pool->outRoot) + 1;
+    const char* from = dedup_output(e);
+    if (strcmp(out, from) == 0) {
+        // Dos entradas pueden dar el mismo nombre de salida (a.txt y a.md): ya está en su lugar
+    } else if (strcmp(get_basename(p->rel), get_basename(dedup_path(e))) == 0) {
+        if (unlinkat(pool->outFd, out, 0) != 0 && errno != ENOENT) return -1;
+        if (linkat(pool->outFd, from, pool->outFd, out, 0) != 0 && copy_output(pool, from, out) != 0) return -1;
     } else {
-        strncpy(rel, full, rel_size - 1);
+        char source[4096];
+        snprintf(source, sizeof(source), "%s/%s", pool->outRoot, from);
+        if (container_copy_renamed(source, p->out, p->rel) != 0) return -1;
     }
-    rel[rel_size - 1] = '\0';
+    atomic_fetch_add(&pool->duplicates, 1);
+    printf("[Hilo %d] %s (igual a %s)\n", f->index, p->rel, dedup_path(e));
+    if (pool->manifest) record_file(pool, f, p);
+    return 0;
 }
 
-// Función recursiva para procesar directorios y crear hilos para archivos
-static void process_directory_recursive(const char* base_input_dir, const char* current_dir, 
-                                       const char* base_output_dir, ThreadArgs myargs,
-                                       ThreadPool* pool, int* global_thread_count) {
-    DIR *dir = opendir(current_dir);
-    if (!dir) { 
-        perror("Error opening directory"); 
-        return; 
+// Busca un archivo igual ya visto. 1 si el archivo quedó resuelto como duplicado (enlazado o en
+// espera de su original); 0 si hay que procesarlo, con original = su entrada si es el primero
+static int claim_file(DirWorker* me, DirNode* dir, const DirFile* f, const DirPaths* p, DedupEntry** original) {
+    ThreadPool* pool = me->pool;
+    DedupFile df = { p->rel, p->out + strlen(pool->outRoot) + 1, f->size, f->dev, f->inode, f->links };
+    DedupEntry* e;
+    if (dedup_lookup(pool->dedup, &df, &e) == DEDUP_UNIQUE) {
+        *original = e;
+        return 0;
     }
+    // En espera queda como una tarea de un archivo, que se libera (o se procesa) al terminar el original
+    DirTask* waiter = task_new(TASK_FILES, dir, 1);
+    if (!waiter) return 0;
+    waiter->files[0] = *f;
+    waiter->count = 1;
+    waiter->bytes = f->size;
+    int rc = dedup_wait(pool->dedup, e, waiter);
+    if (rc == 1) return 1;
+    task_free(waiter);
+    return rc == 0 && link_duplicate(pool, f, p, e) == 0;
+}
 
-    struct dirent *entry;
-    
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
+// Callback de dedup_finish para cada duplicado en espera. Si el original falló o no se pudo
+// reutilizar su salida, el duplicado vuelve a la cola y se procesa por su cuenta
+static void duplicate_ready(void* opaque, void* waiter, const DedupEntry* e, int ok) {
+    DirWorker* me = (DirWorker*)opaque;
+    DirTask* task = (DirTask*)waiter;
+    ThreadArgs ta;
+    DirPaths p;
+    if (ok && prepare_file(me->pool, task->dir, &task->files[0], &ta, &p) == 0 &&
+        link_duplicate(me->pool, &task->files[0], &p, e) == 0) {
+        task_free(task);
+        return;
+    }
+    task->unique = 1;
+    pool_push(me, task);
+}
 
-        char full_path[2048];
-        snprintf(full_path, sizeof(full_path), "%s/%s", current_dir, entry->d_name);
+// Marca como terminados los originales de una tarea. Va al final porque un duplicado devuelto a
+// la cola puede procesarse en este mismo hilo y reutilizar sus buffers
+static void finish_originals(DirWorker* me, DedupEntry** originals, const int* results, int n) {
+    if (!me->pool->dedup) return;
+    for (int i = 0; i < n; i++) {
+        if (originals[i]) dedup_finish(me->pool->dedup, originals[i], results[i] == 0, duplicate_ready, me);
+    }
+}
 
-        struct stat entry_st;
-        if (stat(full_path, &entry_st) != 0)
-            continue;
+// --incremental: 1 si el archivo no cambió (tamaño, fecha de modificación e inodo) y su salida
+// sigue en su lugar con el mismo tamaño; su entrada pasa tal cual al manifiesto nuevo
+static int file_unchanged(ThreadPool* pool, const char* path, uint64_t size, uint64_t mtimeNs, uint64_t inode) {
+    const ManifestEntry* old = manifest_find(pool->manifest, path);
+    if (!old || old->size != size || old->mtimeNs != mtimeNs || old->inode != inode) return 0;
+    struct stat st;
+    if (fstatat(pool->outFd, old->output, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode) ||
+        (uint64_t)st.st_size != old->outSize) {
+        return 0;
+    }
+    return manifest_add(pool->manifest, old) == 0;
+}
 
-        // Si es un directorio: recursión + crear carpeta de salida correspondiente
-        if (S_ISDIR(entry_st.st_mode)) {
-            char rel_path[1024];
-            get_relative_path(base_input_dir, full_path, rel_path, sizeof(rel_path));
-            
-            char output_subdir[2048];
-            snprintf(output_subdir, sizeof(output_subdir), "%s/%s", base_output_dir, rel_path);
-            ensure_directory_exists(output_subdir);
-            
-            printf("Entrando en subdirectorio: %s\n", rel_path);
-            process_directory_recursive(base_input_dir, full_path, base_output_dir, myargs, pool, global_thread_count);
+// --incremental: borra la salida de un archivo que ya no está en la entrada
+static void prune_output(void* opaque, const ManifestEntry* e) {
+    ThreadPool* pool = (ThreadPool*)opaque;
+    if (unlinkat(pool->outFd, e->output, 0) == 0) {
+        printf("Eliminado %s (ya no existe %s).\n", e->output, e->path);
+    } else if (errno != ENOENT) {
+        fprintf(stderr, "No se pudo eliminar %s/%s: %s\n", pool->outRoot, e->output, strerror(errno));
+    }
+}
+
+// Salida de una corrida con otras etapas (--incremental): se borra antes de empezar de nuevo,
+// para que -d no restaure dos versiones del mismo archivo
+static void discard_output(void* opaque, const ManifestEntry* e) {
+    char path[2048];
+    snprintf(path, sizeof(path), "%s/%s", (const char*)opaque, e->output);
+    if (unlink(path) != 0 && errno != ENOENT) {
+        fprintf(stderr, "No se pudo eliminar %s: %s\n", path, strerror(errno));
+    }
+}
+
+// Entrada de un directorio; name es la posición del nombre en el buffer de nombres
+typedef struct {
+    ino_t ino;
+    unsigned char type;         // DT_* de readdir, o resuelto con fstatat
+    uint64_t size;
+    uint64_t mtimeNs;
+    uint64_t dev;
+    uint32_t links;
+    size_t name;
+} ScanEntry;
+
+static int compare_inode(const void* a, const void* b) {
+    ino_t x = ((const ScanEntry*)a)->ino;
+    ino_t y = ((const ScanEntry*)b)->ino;
+    return (x > y) - (x < y);
+}
+
+static int compare_size(const void* a, const void* b) {
+    uint64_t x = ((const ScanEntry*)a)->size;
+    uint64_t y = ((const ScanEntry*)b)->size;
+    return (x > y) - (x < y);
+}
+
+// Encola el lote en formación
+static void flush_batch(DirWorker* me, DirTask** batch) {
+    DirTask* task = *batch;
+    *batch = NULL;
+    if (!task) return;
+    printf("Lote de %d archivos pequeños (%llu bytes) en cola.\n", task->count, (unsigned long long)task->bytes);
+    pool_push(me, task);
+}
+
+// Recorre un directorio (rel: ruta relativa a la raíz) y encola su contenido en este hilo.
+// Se abre y se consulta con openat/fstatat relativos a su descriptor, sin seguir enlaces; las
+// entradas se procesan en orden de inodo (cerca del orden en disco) y solo se llama a fstatat si
+// d_type no alcanza: los directorios no lo necesitan y los archivos sí, por su tamaño.
+//
+// Orden de la cola: primero los subdirectorios, que quedan arriba y son los que roban otros hilos
+// (el árbol se sigue recorriendo en paralelo), después los lotes y por último los archivos de
+// menor a mayor, de modo que este hilo empieza por el más grande
+static void scan_directory(DirWorker* me, DirNode* node) {
+    ThreadPool* pool = me->pool;
+    const char* rel = node->path;
+    int fd = openat(pool->rootFd, rel[0] != '\0' ? rel : ".", O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : NULL;
+    if (!dir) {
+        fprintf(stderr, "Error abriendo directorio %s/%s: %s\n", pool->inRoot, rel, strerror(errno));
+        atomic_fetch_add(&pool->scanErrors, 1);
+        if (fd >= 0) close(fd);
+        return;
+    }
+
+    ScanEntry* entries = NULL;
+    size_t count = 0, capacity = 0;
+    char* names = NULL;
+    size_t namesLen = 0, namesCapacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        // El manifiesto de --incremental (y su temporal) y el almacén de fragmentos no son archivos más
+        if (rel[0] == '\0' && (strncmp(entry->d_name, MANIFEST_FILE_NAME, strlen(MANIFEST_FILE_NAME)) == 0 ||
+                                strcmp(entry->d_name, CHUNK_STORE_NAME) == 0)) continue;
+        size_t len = strlen(entry->d_name) + 1;
+        if (count == capacity) {
+            size_t grownCapacity = capacity ? capacity * 2 : 64;
+            ScanEntry* grown = (ScanEntry*)realloc(entries, grownCapacity * sizeof(ScanEntry));
+            if (!grown) break;
+            entries = grown;
+            capacity = grownCapacity;
+        }
+        if (namesLen + len > UINT32_MAX) break;
+        if (namesLen + len > namesCapacity) {
+            size_t grownCapacity = (namesLen + len) * 2;
+            char* grown = (char*)realloc(names, grownCapacity);
+            if (!grown) break;
+            names = grown;
+            namesCapacity = grownCapacity;
+        }
+        memcpy(names + namesLen, entry->d_name, len);
+        entries[count].ino = entry->d_ino;
+        entries[count].type = entry->d_type;
+        entries[count].size = 0;
+        entries[count].mtimeNs = 0;
+        entries[count].dev = 0;
+        entries[count].links = 1;
+        entries[count].name = namesLen;
+        namesLen += len;
+        count++;
+    }
+    if (entry) perror("Error al reservar memoria para el recorrido");
+    node->names = names;
+    if (count > 1) qsort(entries, count, sizeof(ScanEntry), compare_inode);
+
+    // Tipo y tamaño: fstatat solo para lo que d_type no resuelve
+    for (size_t i = 0; i < count; i++) {
+        ScanEntry* e = &entries[i];
+        if (e->type != DT_REG && e->type != DT_UNKNOWN) continue;
+        struct stat st;
+        if (fstatat(fd, names + e->name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            e->type = DT_UNKNOWN;
             continue;
         }
+        e->type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_LNK;
+        e->size = (uint64_t)st.st_size;
+        e->mtimeNs = (uint64_t)st.st_mtim.tv_sec * 1000000000u + (uint64_t)st.st_mtim.tv_nsec;
+        e->ino = st.st_ino;
+        e->dev = (uint64_t)st.st_dev;
+        e->links = (uint32_t)st.st_nlink;
+    }
+    closedir(dir);
 
-        // Si es un archivo regular: crear hilo para procesarlo
-        if (S_ISREG(entry_st.st_mode)) {
-            // Expandir arreglo si es necesario
-            if (pool->count >= pool->capacity) {
-                pool->capacity = (pool->capacity == 0) ? 20 : pool->capacity * 2;
-                pool->threads = realloc(pool->threads, pool->capacity * sizeof(ThreadInfo));
-                if (!pool->threads) {
-                    perror("Error al reservar memoria para hilos");
-                    closedir(dir);
-                    return;
-                }
+    // Subdirectorios: crear la carpeta de salida con mkdirat relativo a la de este directorio
+    // (una sola vez por carpeta: solo la crea el recorrido de su padre) y encolar su recorrido
+    int outDir = -1;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].type != DT_DIR) continue;
+        DirNode* child = node_new(join_path(rel, names + entries[i].name));
+        DirTask* task = child ? task_new(TASK_SCAN, child, 0) : NULL;
+        if (!task) {
+            if (child) free(child->path);
+            free(child);
+            continue;
+        }
+        if (node->outReady && outDir < 0) {
+            outDir = openat(pool->outFd, rel[0] != '\0' ? rel : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        if (outDir >= 0) {
+            const char* name = names + entries[i].name;
+            child->outReady = mkdirat(outDir, name, 0755) == 0 || errno == EEXIST;
+            if (!child->outReady) {
+                fprintf(stderr, "Error creando carpeta %s/%s: %s\n", pool->outRoot, child->path, strerror(errno));
             }
+        }
+        printf("Entrando en subdirectorio: %s\n", child->path);
+        pool_push(me, task);
+    }
+    if (outDir >= 0) close(outDir);
 
-            // Preparar argumentos para este archivo
-            ThreadArgs* ta = malloc(sizeof(ThreadArgs));
-            if (!ta) {
-                perror("Error al reservar memoria para ThreadArgs");
-                continue;
+    // Archivos pequeños en lotes, en orden de inodo; los grandes se compactan al principio
+    DirTask* batch = NULL;
+    size_t large = 0;
+    for (size_t i = 0; i < count; i++) {
+        ScanEntry e = entries[i];
+        if (e.type != DT_REG) {
+            if (e.type != DT_DIR && e.type != DT_UNKNOWN) {
+                fprintf(stderr, "Se omite '%s%s%s': no es un archivo regular ni un directorio\n",
+                        rel, rel[0] ? "/" : "", names + e.name);
             }
-            
-            *ta = myargs;
-            ta->inPath = strdup(full_path);
-            if (!ta->inPath) {
-                perror("Error al reservar memoria para inPath");
-                free(ta);
+            continue;
+        }
+        if (pool->manifest) {
+            char path[1024];
+            snprintf(path, sizeof(path), "%s%s%s", rel, rel[0] ? "/" : "", names + e.name);
+            if (file_unchanged(pool, path, e.size, e.mtimeNs, (uint64_t)e.ino)) {
+                atomic_fetch_add(&pool->skipped, 1);
                 continue;
             }
+        }
+        if (e.size >= DIR_SMALL_FILE) {
+            entries[large++] = e;
+            continue;
+        }
+        if (!batch && !(batch = task_new(TASK_FILES, node, DIR_BATCH_FILES))) break;
+        DirFile* f = &batch->files[batch->count++];
+        f->name = (uint32_t)e.name;
+        f->index = atomic_fetch_add(&pool->fileCount, 1) + 1;
+        f->size = e.size;
+        f->mtimeNs = e.mtimeNs;
+        f->inode = (uint64_t)e.ino;
+        f->dev = e.dev;
+        f->links = e.links;
+        batch->bytes += e.size;
+        if (batch->count == DIR_BATCH_FILES || batch->bytes >= DIR_BATCH_BYTES) flush_batch(me, &batch);
+    }
+    flush_batch(me, &batch);
 
-            // Obtener ruta relativa del archivo desde el directorio base
-            char rel_file_path[1024];
-            get_relative_path(base_input_dir, full_path, rel_file_path, sizeof(rel_file_path));
+    if (large > 1) qsort(entries, large, sizeof(ScanEntry), compare_size);
+    for (size_t i = 0; i < large; i++) {
+        DirTask* task = task_new(TASK_FILES, node, 1);
+        if (!task) break;
+        DirFile* f = &task->files[0];
+        f->name = (uint32_t)entries[i].name;
+        f->index = atomic_fetch_add(&pool->fileCount, 1) + 1;
+        f->size = entries[i].size;
+        f->mtimeNs = entries[i].mtimeNs;
+        f->inode = (uint64_t)entries[i].ino;
+        f->dev = entries[i].dev;
+        f->links = entries[i].links;
+        task->count = 1;
+        task->bytes = f->size;
+        printf("Archivo %d: '%s%s%s' en cola (%llu bytes).\n", f->index, rel, rel[0] ? "/" : "", names + f->name,
+               (unsigned long long)f->size);
+        pool_push(me, task);
+    }
+    free(entries);
+}
 
-            // Construir nombre de salida según la operación
-            char name_noext[512];
-            strncpy(name_noext, rel_file_path, sizeof(name_noext)); 
-            name_noext[sizeof(name_noext)-1] = '\0';
-            
-            // En descompresión, solo quitar la extensión de compresión (.rle, .lzw, .bin)
-            if (myargs.op_d) {
-                char* dot = strrchr(name_noext, '.');
-                if (dot) {
-                    const char* ext = dot + 1;
-                    if (strcmp(ext, "rle") == 0 || strcmp(ext, "lzw") == 0 || strcmp(ext, "bin") == 0) {
-                        *dot = '\0';
-                    }
-                }
-            } else {
-                // En compresión/encriptación, quitar toda la extensión
-                char* dot = strrchr(name_noext, '.');
-                if (dot) *dot = '\0';
-            }
+// Verificacion de archivo o carpeta.
+// Ruta de salida explícita: con '/' se usa tal cual, si no es un nombre dentro de File_Manager
+static void resolve_output_path(const char* outPath, char* dest, size_t size) {
+    if (strchr(outPath, '/') != NULL || posix_is_stdio(outPath)) {
+        snprintf(dest, size, "%s", outPath);
+    } else {
+        snprintf(dest, size, "File_Manager/%s", get_basename(outPath));
+    }
+}
 
-            char out_full[2048];
-            
-            // Si se encripta un directorio, comprimir primero y luego encriptar (solo si es -ce combinado)
-            if (myargs.op_e && myargs.op_c) {
-                // -ce: comprimir primero, luego encriptar
-                ta->op_e = true;
-                ta->op_c = true;
-                if (!ta->compAlg || ta->compAlg[0] == '\0') {
-                    ta->compAlg = "rle";
-                }
-                snprintf(out_full, sizeof(out_full), "%s/%s.bin", base_output_dir, name_noext);
-                ta->outPath = strdup(out_full);
-                if (!ta->outPath) {
-                    perror("Error al reservar memoria para outPath");
-                    free((char*)ta->inPath);
-                    free(ta);
-                    continue;
-                }
-            }
-            // Si solo se encripta (-e sin -c)
-            else if (myargs.op_e) {
-                // -e: solo encriptar, sin comprimir
-                snprintf(out_full, sizeof(out_full), "%s/%s.bin", base_output_dir, rel_file_path);
-                ta->outPath = strdup(out_full);
-                if (!ta->outPath) {
-                    perror("Error al reservar memoria para outPath");
-                    free((char*)ta->inPath);
-                    free(ta);
-                    continue;
-                }
-            }
-            // Si se desencripta
-            else if (myargs.op_u) {
-                // Cuando desencriptamos, quitamos la extensión .bin (que fue la extensión del encriptado)
-                char decrypted_name[1024];
-                strncpy(decrypted_name, rel_file_path, sizeof(decrypted_name) - 1);
-                decrypted_name[sizeof(decrypted_name) - 1] = '\0';
-                
-                // Quitar extensión .bin si existe
-                if (strlen(decrypted_name) > 4) {
-                    char* dot = decrypted_name + strlen(decrypted_name) - 4;
-                    if (strcmp(dot, ".bin") == 0) {
-                        *dot = '\0';
-                    }
-                }
-                
-                snprintf(out_full, sizeof(out_full), "%s/%s", base_output_dir, decrypted_name);
-                ta->outPath = strdup(out_full);
-                if (!ta->outPath) {
-                    perror("Error al reservar memoria para outPath");
-                    free((char*)ta->inPath);
-                    free(ta);
-                    continue;
-                }
-            } 
-            else {
-                // Compresión o descompresión normal
-                if (ta->op_d) {
-                    // En descompresión: usar el nombre sin la extensión de compresión
-                    snprintf(out_full, sizeof(out_full), "%s/%s", base_output_dir, name_noext);
-                } else {
-                    // En compresión: agregar la extensión de compresión
-                    const char* compAlg = myargs.compAlg;
-                    const char* ext = "";
-                    if (strcmp(compAlg, "huffman") == 0) ext = "bin";
-                    else if (strcmp(compAlg, "rle") == 0) ext = "rle";
-                    else if (strcmp(compAlg, "lzw") == 0) ext = "lzw";
-
-                    if (ext[0] != '\0')
-                        snprintf(out_full, sizeof(out_full), "%s/%s.%s", base_output_dir, name_noext, ext);
-                    else
-                        snprintf(out_full, sizeof(out_full), "%s/%s", base_output_dir, name_noext);
-                }
+// Archivo de directorio (.mcpa): meta NULL para crearlo desde args->inPath, o el encabezado
+// del archivo a extraer (completo, o solo args->member)
+static int operationArchive(const ThreadArgs* args, const FileMetadata* meta) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
 
-                ta->outPath = strdup(out_full);
-                if (!ta->outPath) {
-                    perror("Error al reservar memoria para outPath");
-                    free((char*)ta->inPath);
-                    free(ta);
-                    continue;
-                }
+    char dest[1024];
+    int rc;
+    if (args->outPath && args->outPath[0] != '\0') {
+        resolve_output_path(args->outPath, dest, sizeof(dest));
+    } else if (!meta) {
+        char base[512];
+        snprintf(base, sizeof(base), "%s", get_basename(args->inPath));
+        if (base[0] == '\0') snprintf(base, sizeof(base), "archivo");
+        snprintf(dest, sizeof(dest), "File_Manager/%s.%s", base, ARCHIVE_EXTENSION);
+    } else {
+        snprintf(dest, sizeof(dest), "File_Manager/%s", args->member ? get_basename(args->member) : meta->originalName);
+    }
 
-                // Detectar algoritmo por extensión en descompresión
-                if (ta->op_d) {
-                    const char* fileext = get_extension(entry->d_name);
-                    if (strcmp(fileext, "rle") == 0) {
-                        ta->compAlg = "rle";
-                    } else if (strcmp(fileext, "lzw") == 0) {
-                        ta->compAlg = "lzw";
-                    } else if (strcmp(fileext, "bin") == 0 || strcmp(fileext, "huff") == 0) {
-                        ta->compAlg = "huffman";
-                    } else {
-                        ta->compAlg = myargs.compAlg;
-                    }
-                }
-            }
+    if (!meta) {
+        rc = mcpf_archive_create(args->ctx, args->inPath, dest);
+    } else {
+        if (args->has_range) {
+            fprintf(stderr, "--range no se aplica a archivos de directorio: use --member\n");
+            return -1;
+        }
+        rc = mcpf_archive_extract(args->ctx, args->inPath, dest, args->member);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Falló el archivo de directorio: %s\n", dest);
+        return -1;
+    }
+    if (!posix_is_stdio(dest)) printf("%s -> %s (%.1fs)\n", args->inPath, dest, get_elapsed_time(start));
+    return 0;
+}
 
-            // Crear carpetas padre necesarias para el archivo de salida
-            ensure_parent_directory_exists(out_full);
-
-            // Crear hilo para procesar este archivo EN PARALELO
-            ta->thread_index = pool->count + 1;  // Asignar número de hilo
-            ta->thread_file_name = strdup(rel_file_path);  // Asignar nombre de archivo
-            if (!ta->thread_file_name) {
-                perror("Error al reservar memoria para thread_file_name");
-                free((char*)ta->inPath);
-                free((char*)ta->outPath);
-                free(ta);
-                continue;
-            }
-            
-            pool->threads[pool->count].args = ta;
-            int ret = pthread_create(&pool->threads[pool->count].thread, NULL, operationOneFile, ta);
-            if (ret != 0) {
-                fprintf(stderr, "Error creando hilo para %s: %s\n", entry->d_name, strerror(ret));
-                free((char*)ta->inPath);
-                free((char*)ta->outPath);
-                free((char*)ta->thread_file_name);
-                free(ta);
-                continue;
-            }
-            
-            printf("Hilo %d: procesando '%s' en paralelo.\n", ta->thread_index, rel_file_path);
-            pool->count++;
-            (*global_thread_count)++;
+// Modo tubería (-i - y/o -o -): un solo paso por el contenedor por bloques, sin hilos, sin
+// temporales y sin mensajes en stdout. Las rutas se usan tal cual (no se reubican en File_Manager/)
+static int operationStream(const ThreadArgs* args) {
+    const char* in = args->inPath;
+    const char* out = args->outPath && args->outPath[0] != '\0' ? args->outPath : POSIX_STDIO_PATH;
+    ContainerRange range = { args->range_offset, args->range_length };
+
+    if (args->archive) return mcpf_archive_create(args->ctx, in, out);
+    if (args->member) return mcpf_archive_extract(args->ctx, in, out, args->member);
+    if (!posix_is_stdio(in)) {
+        struct stat st;
+        if (stat(in, &st) != 0 || S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "La salida estándar requiere un archivo de entrada: %s\n", in);
+            return -1;
         }
     }
-    
-    closedir(dir);
+    if (args->op_c) return mcpf_compress_file(args->ctx, in, out);
+    if (args->op_e) return mcpf_encrypt_file(args->ctx, in, out);
+    // -d, -u y -ud: el encabezado del contenedor indica todas las etapas
+    return mcpf_unpack_file(args->ctx, in, out, args->has_range ? &range : NULL);
 }
 
-// Verificacion de archivo o carpeta.
-void initOperation(ThreadArgs myargs) {
+int initOperation(ThreadArgs myargs) {
     const char *path = myargs.inPath;
     struct stat st;
+    bool streaming = posix_is_stdio(path) || posix_is_stdio(myargs.outPath);
 
-    if (stat(path, &st) != 0) {
+    if (!streaming && stat(path, &st) != 0) {
         perror("Error accessing path");
-        return;
+        return -1;
+    }
+
+    // Un solo contexto para toda la operación: es inmutable y lo comparten todos los hilos.
+    // El compresor también sirve para leer el encabezado heredado; el cifrado solo con -e/-u
+    const char* codecName = myargs.compAlg;
+    if (myargs.op_c && myargs.op_e && (!codecName || codecName[0] == '\0')) codecName = "rle";
+    myargs.ctx = mcpf_context_create(codecName && codecName[0] != '\0' ? codecName : NULL,
+                                     (myargs.op_e || myargs.op_u) ? myargs.encAlg : NULL, myargs.key);
+    if (!myargs.ctx) return -1;
+    if (myargs.chunkStore && mcpf_context_set_chunk_store(myargs.ctx, myargs.chunkStore, myargs.op_c) != 0) {
+        mcpf_context_free(myargs.ctx);
+        return -1;
+    }
+    struct stat baseSt;
+    if (myargs.deltaBase && streaming) {
+        fprintf(stderr, "--delta-base no admite la entrada ni la salida estándar\n");
+        mcpf_context_free(myargs.ctx);
+        return -1;
+    }
+    if (myargs.deltaBase && (stat(myargs.deltaBase, &baseSt) != 0 || S_ISDIR(baseSt.st_mode) != S_ISDIR(st.st_mode))) {
+        fprintf(stderr, "--delta-base debe ser %s como la entrada: %s\n", S_ISDIR(st.st_mode) ? "un directorio" : "un archivo",
+                myargs.deltaBase);
+        mcpf_context_free(myargs.ctx);
+        return -1;
+    }
+    if (myargs.incremental && (streaming || !S_ISDIR(st.st_mode))) {
+        fprintf(stderr, "--incremental solo se aplica a directorios\n");
+        mcpf_context_free(myargs.ctx);
+        return -1;
     }
 
+    if (streaming) {
+        int rc = operationStream(&myargs);
+        mcpf_context_free(myargs.ctx);
+        return rc;
+    }
+
+    // Archivos de directorio: se crean con --archive y se reconocen por su encabezado al extraer
+    FileMetadata meta;
+    bool isArchive = S_ISREG(st.st_mode) && (myargs.op_d || myargs.op_u) &&
+                     read_header(path, &meta) == 0 && (meta.flags & META_FLAG_ARCHIVE);
+    if (myargs.archive || isArchive || myargs.member) {
+        int rc = -1;
+        if (myargs.archive && !S_ISDIR(st.st_mode)) {
+            fprintf(stderr, "--archive requiere un directorio: %s\n", path);
+        } else if (myargs.member && !isArchive) {
+            fprintf(stderr, "--member requiere un archivo .%s: %s\n", ARCHIVE_EXTENSION, path);
+        } else {
+            rc = operationArchive(&myargs, myargs.archive ? NULL : &meta);
+        }
+        mcpf_context_free(myargs.ctx);
+        return rc;
+    }
+
+    int rc = 0;
     if (S_ISREG(st.st_mode)) {
         printf("It is a file.\n");
         // Inicializar valores para archivo individual
@@ -805,7 +1458,8 @@ void initOperation(ThreadArgs myargs) {
         myargs.thread_file_name = strdup(get_basename(path));
         if (!myargs.thread_file_name) {
             perror("Error al reservar memoria para thread_file_name");
-            return;
+            mcpf_context_free(myargs.ctx);
+            return -1;
         }
         
         pthread_t thread1;
@@ -814,8 +1468,14 @@ void initOperation(ThreadArgs myargs) {
         
         // Liberar memoria
         free((char*)myargs.thread_file_name);
-        return;
+        mcpf_context_free(myargs.ctx);
+        return myargs.succeeded ? 0 : -1;
     } else if (S_ISDIR(st.st_mode)) {
+        if (myargs.has_range) {
+            fprintf(stderr, "--range solo se aplica a un archivo, no a directorios\n");
+            mcpf_context_free(myargs.ctx);
+            return -1;
+        }
         printf("Procesando archivos.\n");
 
         // Capturar tiempo de inicio para toda la carpeta
@@ -831,35 +1491,87 @@ void initOperation(ThreadArgs myargs) {
         }
         ensure_directory_exists(outFolder);
 
-        // Inicializar pool de hilos
-        ThreadPool pool = {0};
-        int global_thread_count = 0;
+        // En recorridos completos no conservar en page cache las entradas ya procesadas
+        posix_set_drop_cache(1);
 
-        // FASE 1: Recorrer recursivamente y crear hilos
-        printf("\nEscaneando directorios y creando hilos.\n");
-        process_directory_recursive(path, path, outFolder, myargs, &pool, &global_thread_count);
+        // --incremental: el manifiesto identifica las etapas; con otras, se procesa todo
+        char manifestPath[1100];
+        Manifest* manifest = NULL;
+        if (myargs.incremental) {
+            const CodecOps* codec = myargs.op_c ? codec_find_name(codecName) : NULL;
+            const CipherOps* cipher = myargs.op_e ? cipher_find_name(myargs.encAlg) : NULL;
+            uint32_t stages = (codec ? codec->id : 0) | (uint32_t)(cipher ? cipher->id : 0) << 8 |
+                              (uint32_t)((myargs.op_c ? 1 : 0) | (myargs.op_e ? 2 : 0) | (myargs.chunkStore ? 4 : 0) |
+                                         (myargs.deltaBase ? 8 : 0) |
+                                         (codecName && strcmp(codecName, AUTOCODEC_NAME) == 0 ? 16 : 0)) << 16;
+            snprintf(manifestPath, sizeof(manifestPath), "%s/%s", outFolder, MANIFEST_FILE_NAME);
+            if (!(manifest = manifest_load(manifestPath, stages))) {
+                perror("Error al reservar memoria para el manifiesto");
+                mcpf_context_free(myargs.ctx);
+                return -1;
+            }
+            manifest_discard_stale(manifest, discard_output, outFolder);
+        }
 
-        // FASE 2: Esperar a que todos los hilos terminen
-        printf("\nEsperando a que terminen %d hilos.\n", pool.count);
-        for (int i = 0; i < pool.count; i++) {
-            pthread_join(pool.threads[i].thread, NULL);
-            
-            // Liberar memoria de argumentos
-            free((char*)pool.threads[i].args->inPath);
-            free((char*)pool.threads[i].args->outPath);
-            free((char*)pool.threads[i].args->thread_file_name);
-            free(pool.threads[i].args);
+        // Inicializar pool de hilos con el recorrido de la raíz como primera tarea
+        ThreadPool pool = {0};
+        pool.base = myargs;
+        pool.inRoot = path;
+        pool.outRoot = outFolder;
+        pool.rootFd = -1;
+        pool.outFd = -1;
+        pool.manifest = manifest;
+        if (pool_start(&pool) != 0) {
+            pool_finish(&pool);
+            manifest_free(manifest);
+            posix_set_drop_cache(0);
+            mcpf_context_free(myargs.ctx);
+            return -1;
+        }
+        // Recorrer y procesar a la vez: cada directorio encola sus archivos (o lotes de archivos
+        // pequeños) mientras otros hilos recorren los demás; este hilo trabaja como uno más
+        printf("\nRecorriendo y procesando con %d hilos.\n", pool.workerCount + 1);
+        pool_run(&pool.workers[0]);
+        int failed = atomic_load(&pool.failed);
+        int processed = atomic_load(&pool.fileCount) - failed;
+        int scanErrors = atomic_load(&pool.scanErrors);
+        int skipped = atomic_load(&pool.skipped);
+        int duplicates = atomic_load(&pool.duplicates);
+        bool deduplicated = pool.dedup != NULL;
+
+        // Lo que estaba en la corrida anterior y ya no apareció se borró de la entrada; si algún
+        // directorio no se pudo leer no se sabe, así que entonces no se borra nada
+        if (manifest) {
+            if (scanErrors == 0) manifest_each_unseen(manifest, prune_output, &pool);
+            else fprintf(stderr, "Hubo directorios sin leer: no se borran salidas anteriores\n");
+            manifest_save(manifest, manifestPath);
         }
+        pool_finish(&pool);
+        manifest_free(manifest);
 
         // Calcular tiempo total transcurrido
         double folder_total_time = get_elapsed_time(folder_start_time);
 
-        // Liberar array de hilos
-        free(pool.threads);
+        posix_set_drop_cache(0);
         
-        printf("\nProcesamiento completado. %d archivos procesados.\n", pool.count);
+        printf("\nProcesamiento completado. %d archivos procesados.\n", processed);
+        if (failed > 0) fprintf(stderr, "%d archivos con errores.\n", failed);
+        if (scanErrors > 0) fprintf(stderr, "%d directorios sin leer.\n", scanErrors);
+        if (myargs.incremental) printf("%d archivos sin cambios.\n", skipped);
+        if (deduplicated) printf("%d archivos duplicados (enlazados a la salida de su original).\n", duplicates);
+        uint64_t chunksWritten, chunksReused;
+        if (mcpf_chunk_store_stats(myargs.ctx, &chunksWritten, &chunksReused) == 0 && (myargs.op_c || myargs.op_e)) {
+            printf("Fragmentos: %llu nuevos, %llu ya estaban en el almacén.\n",
+                   (unsigned long long)chunksWritten, (unsigned long long)chunksReused);
+        }
         printf("Tiempo total: %.2f segundos\n", folder_total_time);
+        // El código de salida refleja los archivos que fallaron, como con un solo archivo
+        rc = failed > 0 || scanErrors > 0 ? -1 : 0;
     } else {
         printf("No es un archivo regular o un directorio.\n");
+        mcpf_context_free(myargs.ctx);
+        return -1;
     }
+    mcpf_context_free(myargs.ctx);
+    return rc;
 }
@@ -15,6 +15,7 @@
 #include "../Compresion/lzw.h"
 #include "../Encription/vigenere.h"
 #include "../Encription/aes.h"
+#include "../mcpf.h"
 #include <dirent.h>
 #include <time.h>
 
@@ -30,10 +31,21 @@ typedef struct ThreadArgs{
     char* inPath;
     char* outPath;
     char* key;
+    McpfContext* ctx;           // Contexto de libmcpf compartido por todos los hilos
+    bool has_range;             // --range: extraer solo [range_offset, range_offset + range_length)
+    uint64_t range_offset;
+    uint64_t range_length;      // 0 = hasta el final del archivo
+    bool archive;               // --archive: empaquetar un directorio en un solo .mcpa
+    char* member;               // --member: miembro de un .mcpa a extraer (NULL = todos)
+    bool incremental;           // --incremental: en directorios, saltar lo que no cambió
+    bool dedup;                 // En directorios, procesar una sola vez cada contenido repetido
+    char* chunkStore;           // --chunk-store: carpeta del almacén de fragmentos (NULL = sin almacén)
+    char* deltaBase;            // --delta-base: versión anterior (en directorios, la de cada archivo)
     int thread_index;           // Número del hilo para impresión
     char* thread_file_name;     // Nombre del archivo siendo procesado
     struct timespec start_time; // Tiempo de inicio
     double elapsed_time;        // Tiempo transcurrido en segundos
+    bool succeeded;             // operationOneFile terminó bien
 } ThreadArgs;
 
 // Funciones auxiliares (implementadas en multiFeature.c)
@@ -42,6 +54,6 @@ void get_file_base(const char* filepath, char* base, size_t size);
 int move_file(const char* src, const char* dst);
 void ensure_directory_exists(const char* dir_path);
 void* operationOneFile(void* arg);
-void initOperation(ThreadArgs p);
+int initOperation(ThreadArgs p);   // 0 si se pudo lanzar la operación (en modo tubería: si terminó bien)
 
 #endif
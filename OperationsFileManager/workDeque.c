@@ -0,0 +1,83 @@
+#include "workDeque.h"
+#include <stdlib.h>
+
+// Las operaciones sobre top y bottom son seq_cst: hacen el papel de las barreras del algoritmo
+// original sin depender de atomic_thread_fence
+
+static WorkArray* array_new(int64_t size, WorkArray* prev) {
+    WorkArray* a = (WorkArray*)calloc(1, sizeof(WorkArray) + (size_t)size * sizeof(_Atomic(void*)));
+    if (!a) return NULL;
+    a->prev = prev;
+    a->mask = size - 1;
+    return a;
+}
+
+int deque_init(WorkDeque* d, int64_t capacity) {
+    int64_t size = 16;
+    while (size < capacity) size <<= 1;
+    WorkArray* a = array_new(size, NULL);
+    if (!a) return -1;
+    atomic_init(&d->top, 0);
+    atomic_init(&d->bottom, 0);
+    atomic_init(&d->array, a);
+    return 0;
+}
+
+void deque_free(WorkDeque* d) {
+    WorkArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    while (a) {
+        WorkArray* prev = a->prev;
+        free(a);
+        a = prev;
+    }
+    atomic_store_explicit(&d->array, NULL, memory_order_relaxed);
+}
+
+int deque_push(WorkDeque* d, void* item) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+    WorkArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    if (b - t > a->mask) {
+        // Llena: se copian los elementos vivos a un arreglo del doble de tamaño
+        WorkArray* grown = array_new((a->mask + 1) * 2, a);
+        if (!grown) return -1;
+        for (int64_t i = t; i < b; i++) {
+            void* x = atomic_load_explicit(&a->items[i & a->mask], memory_order_relaxed);
+            atomic_store_explicit(&grown->items[i & grown->mask], x, memory_order_relaxed);
+        }
+        atomic_store_explicit(&d->array, grown, memory_order_release);
+        a = grown;
+    }
+    atomic_store_explicit(&a->items[b & a->mask], item, memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+    return 0;
+}
+
+void* deque_pop(WorkDeque* d) {
+    int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    WorkArray* a = atomic_load_explicit(&d->array, memory_order_relaxed);
+    atomic_store(&d->bottom, b);
+    int64_t t = atomic_load(&d->top);
+    if (t > b) {
+        // Vacía
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+    void* item = atomic_load_explicit(&a->items[b & a->mask], memory_order_relaxed);
+    if (t == b) {
+        // Último elemento: se disputa con los ladrones
+        if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) item = NULL;
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+void* deque_steal(WorkDeque* d) {
+    int64_t t = atomic_load(&d->top);
+    int64_t b = atomic_load(&d->bottom);
+    if (t >= b) return NULL;
+    WorkArray* a = atomic_load_explicit(&d->array, memory_order_acquire);
+    void* item = atomic_load_explicit(&a->items[t & a->mask], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong(&d->top, &t, t + 1)) return NULL;
+    return item;
+}
@@ -0,0 +1,51 @@
+#ifndef WORKDEQUE_H
+#define WORKDEQUE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Cola doble de trabajo sin candados (Chase–Lev) para el pool de directorios. Solo el hilo
+// dueño agrega y saca por abajo (el trabajo más reciente); los demás hilos roban por arriba
+// (el más antiguo), con una sola operación CAS sobre top cuando compiten por el mismo elemento.
+// Cuando se llena, el dueño la duplica; los arreglos anteriores se liberan en deque_free porque
+// un ladrón todavía puede estar leyéndolos.
+
+typedef struct WorkArray {
+    struct WorkArray* prev;     // Arreglo reemplazado, pendiente de liberar
+    int64_t mask;               // Capacidad - 1 (potencia de 2)
+    _Atomic(void*) items[];
+} WorkArray;
+
+typedef struct {
+    _Atomic int64_t top;
+    _Atomic int64_t bottom;
+    _Atomic(WorkArray*) array;
+} WorkDeque;
+
+/**
+ * Reserva la cola con capacidad inicial para al menos capacity elementos
+ * @return 0 si tiene éxito, -1 si falla la memoria
+ */
+int deque_init(WorkDeque* d, int64_t capacity);
+
+void deque_free(WorkDeque* d);
+
+/**
+ * Agrega item por abajo (solo el dueño)
+ * @return 0 si tiene éxito, -1 si la cola está llena y no se pudo agrandar
+ */
+int deque_push(WorkDeque* d, void* item);
+
+/**
+ * Saca el elemento más reciente (solo el dueño)
+ * @return Elemento, o NULL si la cola está vacía
+ */
+void* deque_pop(WorkDeque* d);
+
+/**
+ * Roba el elemento más antiguo (cualquier hilo)
+ * @return Elemento, o NULL si la cola está vacía o otro hilo ganó el elemento
+ */
+void* deque_steal(WorkDeque* d);
+
+#endif
@@ -0,0 +1,465 @@
+#define _GNU_SOURCE
+#include "archive.h"
+#include "container.h"
+#include "metadata.h"
+#include "posix_utils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARCHIVE_PATH_MAX  4096
+#define ARCHIVE_TABLE_MAX (1u << 30)      // Tope de la tabla al leer (evita reservas absurdas)
+
+// Miembro del archivo: ruta relativa a la raíz y su rango en los datos concatenados
+typedef struct {
+    char* path;
+    uint32_t mode;
+    uint64_t mtime;
+    uint64_t offset;
+    uint64_t size;
+} ArchiveEntry;
+
+typedef struct {
+    ArchiveEntry* entries;
+    size_t count;
+    size_t capacity;
+    uint64_t dataBytes;         // Suma de los tamaños de los archivos regulares
+    dev_t skipDev;              // El archivo de salida, si queda dentro del árbol
+    ino_t skipIno;
+} ArchiveList;
+
+static void store_le(unsigned char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static void free_list(ArchiveList* list) {
+    for (size_t i = 0; i < list->count; i++) free(list->entries[i].path);
+    free(list->entries);
+    list->entries = NULL;
+    list->count = 0;
+}
+
+static int add_entry(ArchiveList* list, const char* rel, const struct stat* st) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        ArchiveEntry* grown = (ArchiveEntry*)realloc(list->entries, capacity * sizeof(ArchiveEntry));
+        if (!grown) return -1;
+        list->entries = grown;
+        list->capacity = capacity;
+    }
+    ArchiveEntry* e = &list->entries[list->count];
+    e->path = strdup(rel);
+    if (!e->path) return -1;
+    e->mode = (uint32_t)st->st_mode;
+    e->mtime = st->st_mtime > 0 ? (uint64_t)st->st_mtime : 0;
+    e->offset = S_ISREG(st->st_mode) ? list->dataBytes : 0;
+    e->size = S_ISREG(st->st_mode) ? (uint64_t)st->st_size : 0;
+    list->dataBytes += e->size;
+    list->count++;
+    return 0;
+}
+
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Recorre root/rel en orden alfabético: el archivo resultante no depende del orden de readdir
+static int walk(ArchiveList* list, const char* root, const char* rel) {
+    char dirPath[ARCHIVE_PATH_MAX];
+    if (snprintf(dirPath, sizeof(dirPath), "%s%s%s", root, rel[0] ? "/" : "", rel) >= (int)sizeof(dirPath)) {
+        fprintf(stderr, "Ruta demasiado larga: %s/%s\n", root, rel);
+        return -1;
+    }
+    DIR* dir = opendir(dirPath);
+    if (!dir) {
+        fprintf(stderr, "No se puede abrir el directorio '%s': %s\n", dirPath, strerror(errno));
+        return -1;
+    }
+
+    char** names = NULL;
+    size_t count = 0, capacity = 0;
+    int rc = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            char** grown = (char**)realloc(names, capacity * sizeof(char*));
+            if (!grown) { rc = -1; break; }
+            names = grown;
+        }
+        if (!(names[count] = strdup(ent->d_name))) { rc = -1; break; }
+        count++;
+    }
+    closedir(dir);
+    if (rc == 0) qsort(names, count, sizeof(char*), compare_names);
+
+    for (size_t i = 0; i < count && rc == 0; i++) {
+        char childRel[ARCHIVE_PATH_MAX], childPath[ARCHIVE_PATH_MAX];
+        if (snprintf(childRel, sizeof(childRel), "%s%s%s", rel, rel[0] ? "/" : "", names[i]) >= (int)sizeof(childRel) ||
+            snprintf(childPath, sizeof(childPath), "%s/%s", dirPath, names[i]) >= (int)sizeof(childPath)) {
+            fprintf(stderr, "Ruta demasiado larga: %s/%s\n", dirPath, names[i]);
+            rc = -1;
+            break;
+        }
+        struct stat st;
+        if (lstat(childPath, &st) == -1) {
+            fprintf(stderr, "No se puede leer '%s': %s\n", childPath, strerror(errno));
+            rc = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            rc = add_entry(list, childRel, &st) == 0 ? walk(list, root, childRel) : -1;
+        } else if (S_ISREG(st.st_mode)) {
+            if (st.st_dev == list->skipDev && st.st_ino == list->skipIno) continue;
+            rc = add_entry(list, childRel, &st);
+        } else {
+            fprintf(stderr, "Se omite '%s': no es un archivo regular ni un directorio\n", childPath);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) free(names[i]);
+    free(names);
+    return rc;
+}
+
+// Serializa la tabla y el pie, que van a continuación de los datos
+static unsigned char* encode_table(const ArchiveList* list, size_t* len) {
+    size_t cap = ARCHIVE_TRAILER_SIZE;
+    for (size_t i = 0; i < list->count; i++) cap += 5 * 10 + strlen(list->entries[i].path);
+    unsigned char* buf = (unsigned char*)malloc(cap);
+    if (!buf) return NULL;
+
+    size_t n = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        const ArchiveEntry* e = &list->entries[i];
+        size_t pathLen = strlen(e->path);
+        n += metadata_put_varint(buf + n, e->mode);
+        n += metadata_put_varint(buf + n, e->mtime);
+        n += metadata_put_varint(buf + n, e->offset);
+        n += metadata_put_varint(buf + n, e->size);
+        n += metadata_put_varint(buf + n, pathLen);
+        memcpy(buf + n, e->path, pathLen);
+        n += pathLen;
+    }
+    store_le(buf + n, list->dataBytes, 8);
+    store_le(buf + n + 8, list->count, 4);
+    store_le(buf + n + 12, ARCHIVE_MAGIC, 4);
+    *len = n + ARCHIVE_TRAILER_SIZE;
+    return buf;
+}
+
+// Origen del contenedor: el contenido de cada miembro en orden y luego la tabla
+typedef struct {
+    const ArchiveList* list;
+    const char* root;
+    size_t next;                // Siguiente miembro a abrir
+    int fd;                     // Miembro abierto (-1 si ya no hay datos que leer de él)
+    uint64_t left;              // Bytes que faltan del miembro actual
+    const ArchiveEntry* current;
+    const unsigned char* table;
+    size_t tableLen;
+    size_t tablePos;
+} ArchiveSource;
+
+static ssize_t archive_source(void* opaque, unsigned char* buf, size_t cap) {
+    ArchiveSource* src = (ArchiveSource*)opaque;
+    size_t n = 0;
+    while (n < cap) {
+        if (src->left > 0) {
+            size_t want = src->left < cap - n ? (size_t)src->left : cap - n;
+            ssize_t got = src->fd != -1 ? posix_read_full(src->fd, buf + n, want) : 0;
+            if (got < 0) return -1;
+            if ((size_t)got < want) {
+                // El archivo se acortó después del recorrido: se completa con ceros para
+                // conservar los desplazamientos ya escritos en la tabla
+                if (src->fd != -1) {
+                    fprintf(stderr, "Aviso: '%s' cambió de tamaño durante el empaquetado\n", src->current->path);
+                    posix_close_input(src->fd);
+                    src->fd = -1;
+                }
+                memset(buf + n + got, 0, want - (size_t)got);
+            }
+            n += want;
+            src->left -= want;
+            if (src->left == 0 && src->fd != -1) {
+                posix_close_input(src->fd);
+                src->fd = -1;
+            }
+        } else if (src->next < src->list->count) {
+            const ArchiveEntry* e = &src->list->entries[src->next++];
+            if (!S_ISREG(e->mode) || e->size == 0) continue;
+            char path[ARCHIVE_PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s", src->root, e->path);
+            src->fd = posix_open_read(path);
+            if (src->fd == -1) return -1;
+            src->current = e;
+            src->left = e->size;
+        } else if (src->tablePos < src->tableLen) {
+            size_t chunk = src->tableLen - src->tablePos < cap - n ? src->tableLen - src->tablePos : cap - n;
+            memcpy(buf + n, src->table + src->tablePos, chunk);
+            src->tablePos += chunk;
+            n += chunk;
+        } else {
+            break;
+        }
+    }
+    return (ssize_t)n;
+}
+
+int archive_create(const char* dirPath, const char* outputPath, uint8_t codec, uint8_t cipher, const char* key,
+                   const ContainerThreads* threads) {
+    // La raíz se guarda sin '/' finales: su nombre base es el nombre original del archivo
+    char root[ARCHIVE_PATH_MAX];
+    size_t rootLen = strlen(dirPath);
+    if (rootLen == 0 || rootLen >= sizeof(root)) return -1;
+    memcpy(root, dirPath, rootLen + 1);
+    while (rootLen > 1 && root[rootLen - 1] == '/') root[--rootLen] = '\0';
+
+    struct stat st;
+    if (stat(root, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "'%s' no es un directorio\n", root);
+        return -1;
+    }
+
+    int fd_output = posix_open_write(outputPath);
+    if (fd_output == -1) return -1;
+
+    ArchiveList list = {0};
+    if (fstat(fd_output, &st) == 0 && S_ISREG(st.st_mode)) {
+        list.skipDev = st.st_dev;
+        list.skipIno = st.st_ino;
+    }
+
+    int rc = -1;
+    size_t tableLen = 0;
+    unsigned char* table = NULL;
+    if (walk(&list, root, "") != 0) goto done;
+    if (!(table = encode_table(&list, &tableLen))) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        goto done;
+    }
+
+    FileMetadata meta;
+    metadata_init(&meta, root, list.dataBytes + tableLen, codec, cipher);
+    meta.flags = META_FLAG_ARCHIVE;
+
+    ArchiveSource src = { .list = &list, .root = root, .fd = -1, .table = table, .tableLen = tableLen };
+    rc = container_write(fd_output, &meta, archive_source, &src, key, threads);
+    if (src.fd != -1) posix_close_input(src.fd);
+
+done:
+    free(table);
+    free_list(&list);
+    posix_close(fd_output);
+    return rc;
+}
+
+// Rechaza rutas absolutas o con "..": ningún miembro puede quedar fuera del destino
+static int safe_member_path(const char* path) {
+    if (path[0] == '\0' || path[0] == '/') return 0;
+    for (const char* p = path; *p;) {
+        const char* slash = strchr(p, '/');
+        size_t len = slash ? (size_t)(slash - p) : strlen(p);
+        if (len == 0 || (len == 2 && p[0] == '.' && p[1] == '.')) return 0;
+        p += len + (slash ? 1 : 0);
+    }
+    return 1;
+}
+
+// Abre el contenedor y carga la tabla de archivos
+static ContainerReader* open_archive(const char* path, const char* key, ArchiveList* list) {
+    memset(list, 0, sizeof(*list));
+    ContainerReader* r = container_open(path, key);
+    if (!r) return NULL;
+
+    const FileMetadata* meta = container_metadata(r);
+    unsigned char trailer[ARCHIVE_TRAILER_SIZE];
+    if (!(meta->flags & META_FLAG_ARCHIVE) || meta->originalSize < ARCHIVE_TRAILER_SIZE ||
+        container_read(r, meta->originalSize - ARCHIVE_TRAILER_SIZE, trailer, sizeof(trailer)) != 0 ||
+        load_le(trailer + 12, 4) != ARCHIVE_MAGIC) {
+        fprintf(stderr, "%s no es un archivo de directorio (.%s)\n", path, ARCHIVE_EXTENSION);
+        container_close(r);
+        return NULL;
+    }
+    uint64_t tableOffset = load_le(trailer, 8);
+    uint64_t count = load_le(trailer + 8, 4);
+    uint64_t tableEnd = meta->originalSize - ARCHIVE_TRAILER_SIZE;
+    if (tableOffset > tableEnd || tableEnd - tableOffset > ARCHIVE_TABLE_MAX) {
+        fprintf(stderr, "Tabla de archivos inválida en %s\n", path);
+        container_close(r);
+        return NULL;
+    }
+
+    size_t tableLen = (size_t)(tableEnd - tableOffset);
+    unsigned char* table = (unsigned char*)malloc(tableLen > 0 ? tableLen : 1);
+    list->entries = (ArchiveEntry*)calloc(count > 0 ? count : 1, sizeof(ArchiveEntry));
+    int ok = table && list->entries && container_read(r, tableOffset, table, tableLen) == 0;
+
+    size_t n = 0;
+    for (uint64_t i = 0; ok && i < count; i++) {
+        ArchiveEntry* e = &list->entries[i];
+        uint64_t mode, pathLen;
+        size_t used;
+        ok = (used = metadata_get_varint(table + n, tableLen - n, &mode)) != 0 && mode <= UINT32_MAX;
+        n += used;
+        ok = ok && (used = metadata_get_varint(table + n, tableLen - n, &e->mtime)) != 0;
+        n += used;
+        ok = ok && (used = metadata_get_varint(table + n, tableLen - n, &e->offset)) != 0;
+        n += used;
+        ok = ok && (used = metadata_get_varint(table + n, tableLen - n, &e->size)) != 0;
+        n += used;
+        ok = ok && (used = metadata_get_varint(table + n, tableLen - n, &pathLen)) != 0 &&
+             pathLen < ARCHIVE_PATH_MAX && pathLen <= tableLen - n - used;
+        n += used;
+        ok = ok && e->size <= tableOffset && e->offset <= tableOffset - e->size &&
+             (e->path = strndup((const char*)table + n, (size_t)pathLen)) != NULL;
+        if (!ok) break;
+        e->mode = (uint32_t)mode;
+        n += (size_t)pathLen;
+        list->count++;
+        if (!safe_member_path(e->path) || strlen(e->path) != pathLen) ok = 0;
+    }
+    free(table);
+    if (!ok) {
+        fprintf(stderr, "Tabla de archivos inválida en %s\n", path);
+        free_list(list);
+        container_close(r);
+        return NULL;
+    }
+    return r;
+}
+
+int archive_list(const char* path, const char* key, FILE* out) {
+    ArchiveList list;
+    ContainerReader* r = open_archive(path, key, &list);
+    if (!r) return -1;
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        const ArchiveEntry* e = &list.entries[i];
+        char perms[11] = "----------";
+        const char* bits = "rwxrwxrwx";
+        if (S_ISDIR(e->mode)) perms[0] = 'd';
+        for (int b = 0; b < 9; b++) {
+            if (e->mode & (0400u >> b)) perms[b + 1] = bits[b];
+        }
+        char when[32];
+        time_t t = (time_t)e->mtime;
+        struct tm tm;
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M", localtime_r(&t, &tm));
+        fprintf(out, "%s %12llu %s %s%s\n", perms, (unsigned long long)e->size, when, e->path,
+                S_ISDIR(e->mode) ? "/" : "");
+        total += e->size;
+    }
+    fprintf(out, "%zu entradas, %llu bytes\n", list.count, (unsigned long long)total);
+
+    free_list(&list);
+    container_close(r);
+    return 0;
+}
+
+// Restaura permisos y fecha de modificación
+static void apply_attributes(int fd, const char* path, const ArchiveEntry* e) {
+    struct timespec times[2] = { { .tv_nsec = UTIME_OMIT }, { .tv_sec = (time_t)e->mtime } };
+    if (fd != -1) {
+        fchmod(fd, e->mode & 07777);
+        futimens(fd, times);
+    } else {
+        chmod(path, e->mode & 07777);
+        utimensat(AT_FDCWD, path, times, 0);
+    }
+}
+
+static int extract_entry(ContainerReader* r, const ArchiveEntry* e, const char* outputPath) {
+    int fd = posix_open_write(outputPath);
+    if (fd == -1) return -1;
+    int rc = container_copy(r, e->offset, e->size, fd);
+    if (rc == 0 && !posix_is_stdio(outputPath)) apply_attributes(fd, outputPath, e);
+    posix_close(fd);
+    return rc;
+}
+
+int archive_extract(const char* path, const char* outDir, const char* key) {
+    ArchiveList list;
+    ContainerReader* r = open_archive(path, key, &list);
+    if (!r) return -1;
+    if (posix_make_dirs(outDir) != 0) {
+        free_list(&list);
+        container_close(r);
+        return -1;
+    }
+
+    // Los miembros están en el orden de los datos: cada bloque se decodifica una sola vez
+    int rc = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        const ArchiveEntry* e = &list.entries[i];
+        char target[ARCHIVE_PATH_MAX * 2];
+        snprintf(target, sizeof(target), "%s/%s", outDir, e->path);
+        if (S_ISDIR(e->mode)) {
+            if (posix_make_dirs(target) != 0) rc = -1;
+            continue;
+        }
+        char* slash = strrchr(target, '/');
+        *slash = '\0';
+        int parentOk = posix_make_dirs(target) == 0;
+        *slash = '/';
+        if (!parentOk || extract_entry(r, e, target) != 0) {
+            fprintf(stderr, "Falló la extracción de %s\n", e->path);
+            rc = -1;
+        }
+    }
+    // Los directorios se ajustan al final, después de crear su contenido
+    for (size_t i = list.count; i-- > 0;) {
+        const ArchiveEntry* e = &list.entries[i];
+        if (!S_ISDIR(e->mode)) continue;
+        char target[ARCHIVE_PATH_MAX * 2];
+        snprintf(target, sizeof(target), "%s/%s", outDir, e->path);
+        apply_attributes(-1, target, e);
+    }
+
+    free_list(&list);
+    container_close(r);
+    return rc;
+}
+
+int archive_extract_member(const char* path, const char* member, const char* outputPath, const char* key) {
+    ArchiveList list;
+    ContainerReader* r = open_archive(path, key, &list);
+    if (!r) return -1;
+
+    // Se acepta la ruta con o sin "./" inicial y '/' final
+    while (strncmp(member, "./", 2) == 0) member += 2;
+    size_t len = strlen(member);
+    while (len > 0 && member[len - 1] == '/') len--;
+
+    int rc = -1;
+    const ArchiveEntry* found = NULL;
+    for (size_t i = 0; i < list.count && !found; i++) {
+        if (strlen(list.entries[i].path) == len && strncmp(list.entries[i].path, member, len) == 0) {
+            found = &list.entries[i];
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "%.*s no está en %s\n", (int)len, member, path);
+    } else if (S_ISDIR(found->mode)) {
+        fprintf(stderr, "%s es un directorio: extraiga el archivo completo\n", found->path);
+    } else {
+        rc = extract_entry(r, found, outputPath);
+    }
+
+    free_list(&list);
+    container_close(r);
+    return rc;
+}
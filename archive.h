@@ -0,0 +1,60 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "common.h"
+#include "container.h"
+
+// Archivo de directorio (.mcpa, META_FLAG_ARCHIVE): un árbol completo en un solo contenedor
+// por bloques (container.h). Los datos originales del contenedor son el contenido de todos los
+// archivos, uno tras otro, seguido de la tabla de archivos:
+//
+//   datos:  contenido de cada archivo regular, en el orden de la tabla
+//   tabla:  count x { mode | mtime | offset | size | pathLen (varint) | path (relativa, con '/') }
+//   pie:    tableOffset u64 | count u32 | ARCHIVE_MAGIC u32
+//
+// Los bloques de 1 MiB cruzan los límites entre archivos, así que los archivos pequeños se
+// comprimen juntos (modo sólido). Listar decodifica solo los bloques de la tabla y extraer un
+// miembro solo los que cubren su rango.
+
+#define ARCHIVE_EXTENSION    "mcpa"
+#define ARCHIVE_MAGIC        0x4C42544D    // "MTBL"
+#define ARCHIVE_TRAILER_SIZE 16
+
+/**
+ * Empaqueta un directorio (recursivo) en un archivo .mcpa. Se guardan archivos regulares y
+ * directorios; los enlaces simbólicos y archivos especiales se omiten con un aviso
+ *
+ * @param dirPath Directorio raíz
+ * @param outputPath Archivo a crear, o "-" para la salida estándar
+ * @param codec CODEC_ID_* (CODEC_ID_NONE para solo cifrar)
+ * @param cipher CIPHER_ID_* (CIPHER_ID_NONE para solo comprimir)
+ * @param key Clave de cifrado (ignorada sin cifrado)
+ * @param threads Reparto de la codificación, o NULL para un hilo por CPU
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int archive_create(const char* dirPath, const char* outputPath, uint8_t codec, uint8_t cipher, const char* key,
+                   const ContainerThreads* threads);
+
+/**
+ * Imprime la tabla de archivos (tipo y permisos, tamaño, fecha de modificación, ruta)
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int archive_list(const char* path, const char* key, FILE* out);
+
+/**
+ * Extrae todo el árbol dentro de outDir, con permisos y fechas de modificación
+ * @return 0 si tiene éxito, -1 si algún miembro falló
+ */
+int archive_extract(const char* path, const char* outDir, const char* key);
+
+/**
+ * Extrae un solo archivo del árbol
+ * @param member Ruta del miembro tal como la muestra archive_list
+ * @param outputPath Archivo de salida, o "-" para la salida estándar
+ * @return 0 si tiene éxito, -1 si no existe o falla la extracción
+ */
+int archive_extract_member(const char* path, const char* member, const char* outputPath, const char* key);
+
+#endif
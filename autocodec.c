@@ -0,0 +1,210 @@
+#include "autocodec.h"
+#include "registry.h"
+#include "container.h"
+#include "posix_utils.h"
+#include "Compresion/lzss.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LZW_DICT_LIMIT 4096            // Mismo tope que el diccionario de Compresion/lzw.c
+#define LZW_HASH_SIZE  8192            // Potencia de 2, al menos el doble del tope
+#define Q16            16              // Estimaciones en punto fijo de 16 bits
+
+// Formatos que suelen venir comprimidos. La firma es solo una pista: un contenedor como MP4 o
+// ZIP puede llevar datos sin comprimir, así que todavía se prueba LZSS sobre la muestra
+typedef struct {
+    unsigned offset;
+    unsigned len;
+    const char* magic;
+} MagicNumber;
+
+static const MagicNumber stored_formats[] = {
+    { 0, 8, "\x89PNG\r\n\x1a\n" },      // PNG
+    { 0, 3, "\xff\xd8\xff" },           // JPEG
+    { 0, 4, "PK\x03\x04" },             // ZIP, y con él docx, jar, apk...
+    { 4, 4, "ftyp" },                   // MP4, MOV, HEIC
+    { 0, 2, "\x1f\x8b" },               // gzip
+    { 0, 4, "\x28\xb5\x2f\xfd" },       // zstd
+    { 0, 6, "\xfd" "7zXZ\x00" },        // xz
+    { 0, 6, "7z\xbc\xaf\x27\x1c" },     // 7z
+    { 0, 3, "BZh" },                    // bzip2
+    { 0, 4, "GIF8" },                   // GIF
+    { 0, 4, "OggS" },                   // Ogg
+    { 0, 3, "ID3" },                    // MP3
+    { 0, 4, "\x1a\x45\xdf\xa3" },       // Matroska / WebM
+};
+
+static int is_stored_format(const unsigned char* data, size_t len) {
+    for (size_t i = 0; i < sizeof(stored_formats) / sizeof(stored_formats[0]); i++) {
+        const MagicNumber* m = &stored_formats[i];
+        if (len >= m->offset + m->len && memcmp(data + m->offset, m->magic, m->len) == 0) return 1;
+    }
+    return 0;
+}
+
+// log2(x) en punto fijo Q16, para x >= 1 (sin libm)
+static uint64_t log2_q16(uint32_t x) {
+    unsigned n = 0;
+    while ((x >> (n + 1)) != 0) n++;
+    uint64_t m = ((uint64_t)x << Q16) >> n;        // Mantisa en [1, 2)
+    uint64_t result = (uint64_t)n << Q16;
+    for (uint64_t bit = 1u << (Q16 - 1); bit != 0; bit >>= 1) {
+        m = (m * m) >> Q16;
+        if (m >= (2u << Q16)) {
+            m >>= 1;
+            result |= bit;
+        }
+    }
+    return result;
+}
+
+// Bits de información de orden 0 (Q16) de len bytes con las frecuencias freq
+static uint64_t entropy_bits(const uint32_t freq[256], size_t len, unsigned* symbols) {
+    uint64_t logLen = log2_q16((uint32_t)len);
+    uint64_t bits = 0;
+    *symbols = 0;
+    for (int c = 0; c < 256; c++) {
+        if (freq[c] == 0) continue;
+        (*symbols)++;
+        bits += (uint64_t)freq[c] * (logLen - log2_q16(freq[c]));
+    }
+    return bits;
+}
+
+// Tamaño de Huffman: entropía de orden 0 más la tabla (5 bytes por símbolo) por bloque
+static uint64_t estimate_huffman(const unsigned char* data, size_t len, uint64_t blockLen) {
+    uint32_t freq[256] = {0};
+    for (size_t i = 0; i < len; i++) freq[data[i]]++;
+    unsigned symbols;
+    uint64_t bits = entropy_bits(freq, len, &symbols);
+    // Los códigos tienen longitud entera: se suma un margen de 1/4 de bit por byte
+    uint64_t bytes = (bits >> Q16) / 8 + len / 32;
+    uint64_t table = 8 + 5 * (uint64_t)symbols;
+    return bytes + table * len / blockLen;
+}
+
+// Tamaño de RLE: un par de 5 bytes por racha
+static uint64_t estimate_rle(const unsigned char* data, size_t len) {
+    uint64_t runs = 1;
+    for (size_t i = 1; i < len; i++) {
+        if (data[i] != data[i - 1]) runs++;
+    }
+    return runs * 5;
+}
+
+// Tamaño de LZW: se recorre la muestra como lo haría el compresor (mismo tope de diccionario),
+// pero buscando cada frase como (código del prefijo, byte) en una tabla hash. Cada frase emite
+// un código de 2 bytes
+static uint64_t estimate_lzw(const unsigned char* data, size_t len, uint64_t blockLen) {
+    uint32_t keys[LZW_HASH_SIZE] = {0};
+    uint16_t codes[LZW_HASH_SIZE];
+    unsigned dictSize = 256;
+    uint64_t phrases = 1;
+    uint32_t w = data[0];
+    for (size_t i = 1; i < len; i++) {
+        uint32_t key = (w << 8 | data[i]) + 1;    // 0 marca un hueco libre
+        uint32_t h = (key * 2654435761u) >> 19 & (LZW_HASH_SIZE - 1);
+        while (keys[h] != 0 && keys[h] != key) h = (h + 1) & (LZW_HASH_SIZE - 1);
+        if (keys[h] == key) {
+            w = codes[h];
+            continue;
+        }
+        if (dictSize < LZW_DICT_LIMIT) {
+            keys[h] = key;
+            codes[h] = (uint16_t)dictSize++;
+        }
+        phrases++;
+        w = data[i];
+    }
+    return phrases * 2 + 4 * len / blockLen;
+}
+
+// Tamaño de LZSS: la muestra es chica, así que se comprime de verdad con el nivel por defecto
+static uint64_t estimate_lzss(const unsigned char* data, size_t len) {
+    unsigned char* out;
+    size_t outLen;
+    if (lzss_encode_buffer(data, len, &out, &outLen) != 0) return UINT64_MAX;
+    free(out);
+    return outLen;
+}
+
+// Si no se gana ni un 3%, se guarda tal cual
+static int worth_compressing(uint64_t size, size_t len) {
+    return size * 100 <= (uint64_t)len * 97;
+}
+
+uint8_t autocodec_choose(const unsigned char* sample, size_t len, uint64_t total) {
+    if (len == 0) return CODEC_ID_NONE;
+    // Con firma de formato comprimido solo se prueba LZSS, el único barato que aprovecha las
+    // repeticiones que pudieran quedar
+    if (is_stored_format(sample, len)) {
+        return worth_compressing(estimate_lzss(sample, len), len) ? CODEC_ID_LZSS : CODEC_ID_NONE;
+    }
+    uint64_t blockLen = total < CONTAINER_BLOCK_SIZE ? total : CONTAINER_BLOCK_SIZE;
+    if (blockLen < len) blockLen = len;
+
+    uint8_t best = CODEC_ID_HUFFMAN;
+    uint64_t bestSize = estimate_huffman(sample, len, blockLen);
+    uint64_t rle = estimate_rle(sample, len);
+    if (rle < bestSize) {
+        best = CODEC_ID_RLE;
+        bestSize = rle;
+    }
+    uint64_t lzss = estimate_lzss(sample, len);
+    if (lzss < bestSize) {
+        best = CODEC_ID_LZSS;
+        bestSize = lzss;
+    }
+    // LZW es mucho más lento que los demás: solo se elige si ahorra al menos un 10% más
+    uint64_t lzw = estimate_lzw(sample, len, blockLen);
+    if (lzw * 10 < bestSize * 9) {
+        best = CODEC_ID_LZW;
+        bestSize = lzw;
+    }
+    return worth_compressing(bestSize, len) ? best : CODEC_ID_NONE;
+}
+
+int autocodec_incompressible(uint8_t codecId, const unsigned char* data, size_t len) {
+    // Datos aleatorios repetidos tienen entropía máxima y aun así LZ los reduce
+    if (codecId != CODEC_ID_HUFFMAN && codecId != CODEC_ID_RLE) return 0;
+    if (len < AUTOCODEC_WHOLE) return 0;
+    uint32_t freq[256] = {0};
+    size_t offsets[3] = { 0, (len / 2) & ~(size_t)(AUTOCODEC_SAMPLE - 1), len - AUTOCODEC_SAMPLE };
+    for (int i = 0; i < 3; i++) {
+        const unsigned char* p = data + offsets[i];
+        for (size_t j = 0; j < AUTOCODEC_SAMPLE; j++) freq[p[j]]++;
+    }
+    unsigned symbols;
+    uint64_t bits = entropy_bits(freq, AUTOCODEC_WHOLE, &symbols);
+    return bits * 10 >= (uint64_t)AUTOCODEC_WHOLE * AUTOCODEC_RANDOM_BITS << Q16;
+}
+
+uint8_t autocodec_choose_file(const char* path) {
+    int fd = posix_open_read(path);
+    if (fd < 0) return CODEC_ID_HUFFMAN;
+    off_t size = posix_get_file_size(fd);
+    unsigned char buf[AUTOCODEC_WHOLE];
+    size_t len = 0;
+    if (size >= 0 && size <= AUTOCODEC_WHOLE) {
+        ssize_t n = pread(fd, buf, (size_t)size, 0);
+        if (n > 0) len = (size_t)n;
+    } else if (size > 0) {
+        // Inicio, medio y final, alineados a la muestra para no partir registros a la mitad
+        off_t offsets[3] = { 0, (size / 2) & ~(off_t)(AUTOCODEC_SAMPLE - 1), size - AUTOCODEC_SAMPLE };
+        for (int i = 0; i < 3; i++) {
+            ssize_t n = pread(fd, buf + len, AUTOCODEC_SAMPLE, offsets[i]);
+            if (n > 0) len += (size_t)n;
+        }
+    }
+    posix_close_input(fd);
+    if (size > 0 && len == 0) return CODEC_ID_HUFFMAN;
+    return autocodec_choose(buf, len, size > 0 ? (uint64_t)size : 0);
+}
+
+const char* autocodec_extension(const char* compAlg) {
+    if (compAlg && strcmp(compAlg, AUTOCODEC_NAME) == 0) return AUTOCODEC_EXTENSION;
+    if (compAlg && strcmp(compAlg, CODEC_STORE_NAME) == 0) return CODEC_STORE_EXTENSION;
+    const CodecOps* ops = compAlg ? codec_find_name(compAlg) : NULL;
+    return ops ? ops->extension : "";
+}
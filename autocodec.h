@@ -0,0 +1,54 @@
+#ifndef AUTOCODEC_H
+#define AUTOCODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Elección automática del compresor por archivo (--comp-alg auto). Se leen unos pocos KB del
+// archivo (todo si es pequeño; si no, el inicio, el medio y el final) y se estima el tamaño que
+// daría cada compresor: Huffman por la entropía de orden 0, RLE por la cantidad de rachas, LZSS
+// comprimiendo la muestra y LZW simulando su diccionario. En los formatos que suelen venir
+// comprimidos (PNG, JPEG, ZIP, MP4, gzip...), reconocidos por su número mágico, solo se prueba
+// LZSS y, si no reduce la muestra, se guardan sin comprimir. La elección queda en el
+// encabezado de cada archivo, así que la descompresión no necesita saber que fue automática.
+
+#define AUTOCODEC_NAME      "auto"
+#define AUTOCODEC_EXTENSION "mcz"      // Extensión de salida con --comp-alg auto
+#define AUTOCODEC_SAMPLE    4096       // Bytes por muestra
+#define AUTOCODEC_WHOLE     (3 * AUTOCODEC_SAMPLE)  // Hasta este tamaño se lee el archivo completo
+#define AUTOCODEC_RANDOM_BITS 79       // Décimos de bit por byte desde los que un bloque es aleatorio
+
+/**
+ * Elige el compresor para unos datos
+ * @param sample Muestra de los datos
+ * @param len Bytes de la muestra
+ * @param total Tamaño total de los datos (para repartir el costo de las tablas por bloque)
+ * @return CODEC_ID_* a usar, o CODEC_ID_NONE si no conviene comprimir
+ */
+uint8_t autocodec_choose(const unsigned char* sample, size_t len, uint64_t total);
+
+/**
+ * Elige el compresor para un archivo a partir de una muestra
+ * @return CODEC_ID_* a usar; CODEC_ID_HUFFMAN si el archivo no se puede leer (el error
+ *         aparecerá al comprimirlo)
+ */
+uint8_t autocodec_choose_file(const char* path);
+
+/**
+ * Indica si un bloque es incompresible para un compresor sin pasarlo por él: entropía de orden
+ * 0 de tres muestras (inicio, medio y final) de al menos AUTOCODEC_RANDOM_BITS décimos de bit
+ * por byte. Solo vale para Huffman y RLE: la entropía de orden 0 no ve repeticiones, así que
+ * LZSS, LZW y las cadenas siempre se intentan. El contenedor lo usa para guardar esos bloques
+ * tal cual sin gastar CPU en ellos
+ * @param codecId CODEC_ID_* del compresor del bloque
+ * @return 1 si no vale la pena comprimirlo; 0 si hay que intentarlo (siempre en bloques pequeños)
+ */
+int autocodec_incompressible(uint8_t codecId, const unsigned char* data, size_t len);
+
+/**
+ * Extensión de salida para un nombre de --comp-alg, incluidos "auto" y "store"
+ * @return Extensión sin punto, o "" si el nombre no está registrado
+ */
+const char* autocodec_extension(const char* compAlg);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC32C (polinomio de Castagnoli, el mismo de iSCSI/ext4/SSE4.2)
+ * Usa la instrucción crc32 de SSE4.2 si la CPU la tiene; si no, slicing-by-8
+ * @param crc Valor previo (0 para empezar); permite calcular por partes
+ * @param data Datos
+ * @param len Longitud en bytes
+ * @return CRC acumulado
+ */
+uint32_t crc32c(uint32_t crc, const void* data, size_t len);
+
+/**
+ * Nombre de la implementación elegida ("sse4.2" o "slicing-by-8")
+ */
+const char* crc32c_implementation(void);
+
+/**
+ * CRC32C de un archivo completo (relativo a dirFd, como en openat) y su tamaño
+ * @return 0 si tiene éxito, -1 si no se puede leer
+ */
+int crc32c_file(int dirFd, const char* path, uint64_t* size, uint32_t* crc);
+
+#endif // CHECKSUM_H
@@ -0,0 +1,443 @@
+#include "chunkstore.h"
+#include "checksum.h"
+#include "metadata.h"
+#include "posix_utils.h"
+#include "registry.h"
+#include "autocodec.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Máscaras de FastCDC con normalización de nivel 2 para CHUNK_AVG = 64 KiB (16 bits): antes del
+// promedio se exigen 18 bits en cero y después 14, así que los tamaños se concentran cerca de
+// CHUNK_AVG. Los bits están en la parte alta (44..61): con el desplazamiento de gear, cada bit
+// depende de los últimos ~60 bytes. La máscara desplazada un bit sigue cabiendo en 64 bits,
+// lo que permite procesar dos bytes por vuelta
+#define CHUNK_MASK_S   (0x3FFFFull << 44)
+#define CHUNK_MASK_L   (0x3FFFull << 48)
+
+#define CHUNK_ID_HEX   (2 * SHA256_SIZE)
+#define CHUNK_HEADER   (10 + 4)             // rawLen (varint) | crc32c
+#define RECIPE_BUFFER  (64 * 1024)
+
+struct ChunkStore {
+    int fd;                     // Directorio del almacén
+    const CodecOps* codec;      // Etapas de los fragmentos nuevos
+    const CipherOps* cipher;
+    char* password;
+    CipherKey key;
+    Sha256 salted;              // SHA-256 con la sal (un bloque de 64 bytes) ya procesada
+    atomic_uint_fast64_t written;
+    atomic_uint_fast64_t reused;
+    atomic_uint tmpCounter;
+};
+
+static uint64_t gear[256];
+static uint64_t gearShifted[256];       // gear << 1, para el byte par de cada vuelta
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+// Tabla fija (splitmix64 con semilla constante): los cortes tienen que ser los mismos en
+// todas las corridas para que el almacén sirva entre ellas
+static void gear_init(void) {
+    uint64_t x = 0x4D435046u;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+        gearShifted[i] = gear[i] << 1;
+    }
+}
+
+// Cortes de FastCDC: se saltan los primeros CHUNK_MIN bytes y el hash gear avanza dos bytes por
+// vuelta (el primero con la tabla y la máscara desplazadas), con la máscara estricta hasta
+// CHUNK_AVG y la permisiva después. El hash es secuencial; lo que se evita es el trabajo por byte
+size_t chunk_cut(const unsigned char* data, size_t len) {
+    pthread_once(&gear_once, gear_init);
+    if (len <= CHUNK_MIN) return len;
+    size_t normal = len < CHUNK_AVG ? len : CHUNK_AVG;
+    size_t end = len < CHUNK_MAX ? len : CHUNK_MAX;
+    uint64_t fp = 0;
+    size_t i = CHUNK_MIN;
+    for (; i + 2 <= normal; i += 2) {
+        fp = (fp << 2) + gearShifted[data[i]];
+        if (!(fp & (CHUNK_MASK_S << 1))) return i + 1;
+        fp += gear[data[i + 1]];
+        if (!(fp & CHUNK_MASK_S)) return i + 2;
+    }
+    for (; i + 2 <= end; i += 2) {
+        fp = (fp << 2) + gearShifted[data[i]];
+        if (!(fp & (CHUNK_MASK_L << 1))) return i + 1;
+        fp += gear[data[i + 1]];
+        if (!(fp & CHUNK_MASK_L)) return i + 2;
+    }
+    return end;
+}
+
+static void store_le(unsigned char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// "ab/cdef...": las dos primeras cifras hexadecimales forman la subcarpeta
+static void chunk_name(const unsigned char* id, char* name) {
+    static const char hex[] = "0123456789abcdef";
+    char* p = name;
+    for (int i = 0; i < SHA256_SIZE; i++) {
+        *p++ = hex[id[i] >> 4];
+        *p++ = hex[id[i] & 15];
+        if (i == 0) *p++ = '/';
+    }
+    *p = '\0';
+}
+
+ChunkStore* chunkstore_open(const char* dir, uint8_t codec, uint8_t cipher, const char* key) {
+    ChunkStore* s = (ChunkStore*)calloc(1, sizeof(ChunkStore));
+    if (!s) return NULL;
+    s->fd = -1;
+    s->codec = codec_find_id(codec);
+    s->cipher = cipher_find_id(cipher);
+    if ((codec != CODEC_ID_NONE && !s->codec) || (cipher != CIPHER_ID_NONE && !s->cipher)) {
+        fprintf(stderr, "Algoritmo no registrado para el almacén de fragmentos\n");
+        free(s);
+        return NULL;
+    }
+    if (s->cipher && (!key || key[0] == '\0')) {
+        fprintf(stderr, "El almacén de fragmentos cifrado requiere una clave\n");
+        free(s);
+        return NULL;
+    }
+    if (key && !(s->password = strdup(key))) {
+        free(s);
+        return NULL;
+    }
+    if (posix_make_dirs(dir) != 0 || (s->fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        fprintf(stderr, "No se puede abrir el almacén de fragmentos '%s': %s\n", dir, strerror(errno));
+        chunkstore_close(s);
+        return NULL;
+    }
+    if (s->cipher) s->cipher->init(&s->key, s->password);
+
+    // Sal de 32 bytes más 32 en cero: un bloque completo de SHA-256 que se procesa una sola vez
+    unsigned char salt[2 * SHA256_SIZE] = {0};
+    unsigned char stages[2] = { codec, cipher };
+    Sha256 h;
+    sha256_init(&h);
+    sha256_update(&h, "MCPF-CHUNK", 10);
+    sha256_update(&h, stages, sizeof(stages));
+    if (s->password) sha256_update(&h, s->password, strlen(s->password));
+    sha256_final(&h, salt);
+    sha256_init(&s->salted);
+    sha256_update(&s->salted, salt, sizeof(salt));
+    return s;
+}
+
+void chunkstore_close(ChunkStore* s) {
+    if (!s) return;
+    if (s->cipher) s->cipher->clear(&s->key);
+    if (s->password) {
+        volatile char* p = s->password;
+        while (*p) *p++ = 0;
+        free(s->password);
+    }
+    if (s->fd >= 0) close(s->fd);
+    free(s);
+}
+
+void chunkstore_stats(ChunkStore* s, uint64_t* written, uint64_t* reused) {
+    *written = atomic_load(&s->written);
+    *reused = atomic_load(&s->reused);
+}
+
+// Guarda un fragmento si el almacén no lo tiene. Se escribe en un temporal y se renombra: un
+// fragmento visible siempre está completo, y dos hilos que lo guardan a la vez no se estorban
+static int store_chunk(ChunkStore* s, const unsigned char* id, const unsigned char* raw, size_t len) {
+    char name[CHUNK_ID_HEX + 2];
+    chunk_name(id, name);
+    struct stat st;
+    if (fstatat(s->fd, name, &st, 0) == 0) {
+        atomic_fetch_add(&s->reused, 1);
+        return 0;
+    }
+
+    // Como en el contenedor, un fragmento que el compresor no reduce se guarda tal cual
+    unsigned char* buf = NULL;
+    size_t bufLen = len;
+    if (s->codec && !autocodec_incompressible(s->codec->id, raw, len)) {
+        if (s->codec->encode(raw, len, &buf, &bufLen) != 0) return -1;
+        if (bufLen >= len) {
+            free(buf);
+            buf = NULL;
+            bufLen = len;
+        }
+    }
+    if (s->cipher) {
+        unsigned char* enc = (unsigned char*)malloc(bufLen + s->cipher->overhead);
+        if (!enc) {
+            free(buf);
+            return -1;
+        }
+        bufLen = s->cipher->encrypt(&s->key, buf ? buf : raw, bufLen, enc);
+        free(buf);
+        buf = enc;
+    }
+    unsigned char header[CHUNK_HEADER];
+    size_t headerLen = metadata_put_varint(header, len);
+    store_le(header + headerLen, crc32c(0, raw, len), 4);
+    headerLen += 4;
+
+    name[2] = '\0';
+    if (mkdirat(s->fd, name, 0755) != 0 && errno != EEXIST) {
+        free(buf);
+        return -1;
+    }
+    name[2] = '/';
+    char tmp[sizeof(name) + 32];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%u.tmp", name, (long)getpid(), atomic_fetch_add(&s->tmpCounter, 1));
+    int fd = openat(s->fd, tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, FILE_MODE);
+    int rc = fd >= 0 && posix_write_full(fd, header, headerLen) == (ssize_t)headerLen &&
+             posix_write_full(fd, buf ? buf : raw, bufLen) == (ssize_t)bufLen ? 0 : -1;
+    if (fd >= 0 && close(fd) != 0) rc = -1;
+    if (rc == 0 && renameat(s->fd, tmp, s->fd, name) != 0) rc = -1;
+    if (rc != 0) {
+        fprintf(stderr, "No se pudo guardar el fragmento %s: %s\n", name, strerror(errno));
+        if (fd >= 0) unlinkat(s->fd, tmp, 0);
+    } else {
+        atomic_fetch_add(&s->written, 1);
+    }
+    free(buf);
+    return rc;
+}
+
+// Receta en formación: las entradas se acumulan en un buffer con su CRC
+typedef struct {
+    int fd;
+    unsigned char buf[RECIPE_BUFFER];
+    size_t len;
+    uint32_t crc;
+} RecipeWriter;
+
+static int recipe_flush(RecipeWriter* w) {
+    w->crc = crc32c(w->crc, w->buf, w->len);
+    ssize_t n = posix_write_full(w->fd, w->buf, w->len);
+    int rc = n == (ssize_t)w->len ? 0 : -1;
+    w->len = 0;
+    return rc;
+}
+
+static int recipe_add(RecipeWriter* w, uint64_t rawLen, const unsigned char* id) {
+    if (w->len + 10 + SHA256_SIZE > sizeof(w->buf) && recipe_flush(w) != 0) return -1;
+    w->len += metadata_put_varint(w->buf + w->len, rawLen);
+    if (rawLen > 0) {
+        memcpy(w->buf + w->len, id, SHA256_SIZE);
+        w->len += SHA256_SIZE;
+    }
+    return 0;
+}
+
+// Corta el archivo con una ventana de 2 x CHUNK_MAX: cada corte ve hasta CHUNK_MAX bytes salvo
+// al final del archivo
+static int write_chunks(ChunkStore* s, int fd_input, uint64_t size, RecipeWriter* w) {
+    unsigned char* data = (unsigned char*)malloc(2 * CHUNK_MAX);
+    if (!data) return -1;
+    size_t have = 0, pos = 0;
+    uint64_t total = 0;
+    int eof = 0, rc = 0;
+    while (rc == 0) {
+        if (!eof && have - pos < CHUNK_MAX) {
+            memmove(data, data + pos, have - pos);
+            have -= pos;
+            pos = 0;
+            ssize_t n = posix_read_full(fd_input, data + have, 2 * CHUNK_MAX - have);
+            if (n < 0) {
+                rc = -1;
+                break;
+            }
+            if ((size_t)n < 2 * CHUNK_MAX - have) eof = 1;
+            have += (size_t)n;
+            total += (uint64_t)n;
+        }
+        if (pos == have) break;
+        size_t len = chunk_cut(data + pos, have - pos);
+        Sha256 h = s->salted;
+        unsigned char id[SHA256_SIZE];
+        sha256_update(&h, data + pos, len);
+        sha256_final(&h, id);
+        if (store_chunk(s, id, data + pos, len) != 0 || recipe_add(w, len, id) != 0) rc = -1;
+        pos += len;
+    }
+    free(data);
+    if (rc == 0 && total != size) {
+        fprintf(stderr, "El archivo cambió de tamaño mientras se leía\n");
+        rc = -1;
+    }
+    return rc;
+}
+
+int chunkstore_write_file(ChunkStore* s, const char* inputPath, const char* outputPath) {
+    int fd_input = posix_open_read(inputPath);
+    if (fd_input == -1) return -1;
+    off_t size = posix_is_regular_file(fd_input) == 1 ? posix_get_file_size(fd_input) : -1;
+    if (size < 0) {
+        fprintf(stderr, "El almacén de fragmentos solo acepta archivos regulares: %s\n", inputPath);
+        posix_close_input(fd_input);
+        return -1;
+    }
+    RecipeWriter* w = (RecipeWriter*)malloc(sizeof(RecipeWriter));
+    int fd_output = w ? posix_open_write(outputPath) : -1;
+    if (fd_output == -1) {
+        free(w);
+        posix_close_input(fd_input);
+        return -1;
+    }
+    w->fd = fd_output;
+    w->len = 0;
+    w->crc = 0;
+
+    FileMetadata meta;
+    metadata_init(&meta, inputPath, (uint64_t)size, s->codec ? s->codec->id : CODEC_ID_NONE,
+                  s->cipher ? s->cipher->id : CIPHER_ID_NONE);
+    meta.flags = META_FLAG_CHUNKED;
+    int rc = metadata_write(fd_output, &meta);
+    if (rc == 0) rc = write_chunks(s, fd_input, (uint64_t)size, w);
+    if (rc == 0 && recipe_add(w, 0, NULL) == 0 && recipe_flush(w) == 0) {
+        unsigned char crc[4];
+        store_le(crc, w->crc, 4);
+        rc = posix_write_full(fd_output, crc, sizeof(crc)) == (ssize_t)sizeof(crc) ? 0 : -1;
+    } else {
+        rc = -1;
+    }
+    if (posix_close(fd_output) != 0) rc = -1;
+    posix_close_input(fd_input);
+    free(w);
+    return rc;
+}
+
+// Lee un fragmento del almacén y lo deja decodificado en raw (rawLen bytes exactos)
+static int load_chunk(ChunkStore* s, const unsigned char* id, size_t rawLen, const CodecOps* codec,
+                      const CipherOps* cipher, const CipherKey* key, unsigned char* stored, size_t cap,
+                      unsigned char* raw) {
+    char name[CHUNK_ID_HEX + 2];
+    chunk_name(id, name);
+    int fd = openat(s->fd, name, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    int rc = -1;
+    if (fd >= 0 && fstat(fd, &st) == 0 && (uint64_t)st.st_size <= cap &&
+        posix_read_full(fd, stored, (size_t)st.st_size) == (ssize_t)st.st_size) {
+        size_t len = (size_t)st.st_size;
+        uint64_t storedRaw;
+        size_t used = metadata_get_varint(stored, len, &storedRaw);
+        if (used > 0 && storedRaw == rawLen && len - used >= 4) {
+            uint32_t crc = (uint32_t)load_le(stored + used, 4);
+            unsigned char* data = stored + used + 4;
+            size_t plainLen = len - used - 4;
+            if (!cipher || cipher->decrypt(key, data, plainLen, data, &plainLen) == 0) {
+                if (codec && plainLen != rawLen) rc = codec->decode(data, plainLen, raw, rawLen);
+                else if (plainLen == rawLen) rc = (memcpy(raw, data, rawLen), 0);
+            }
+            if (rc == 0 && crc32c(0, raw, rawLen) != crc) rc = -1;
+        }
+    }
+    if (fd >= 0) close(fd);
+    if (rc != 0) fprintf(stderr, "Fragmento %s faltante o dañado (¿otra clave u otro almacén?)\n", name);
+    return rc;
+}
+
+// Recorre las entradas de una receta ya validada y escribe los fragmentos en orden
+static int read_chunks(ChunkStore* s, const FileMetadata* meta, const unsigned char* recipe, size_t len,
+                       int fd_output) {
+    const CodecOps* codec = codec_find_id(meta->codec);
+    const CipherOps* cipher = cipher_find_id(meta->cipher);
+    size_t cap = CHUNK_HEADER + (codec ? codec->bound(CHUNK_MAX) : CHUNK_MAX) + (cipher ? cipher->overhead : 0);
+    unsigned char* stored = (unsigned char*)malloc(cap);
+    unsigned char* raw = (unsigned char*)malloc(CHUNK_MAX);
+    CipherKey key;
+    if (cipher) cipher->init(&key, s->password);
+    int rc = stored && raw ? 0 : -1;
+    uint64_t total = 0;
+    size_t pos = 0;
+    while (rc == 0) {
+        uint64_t rawLen;
+        size_t used = metadata_get_varint(recipe + pos, len - pos, &rawLen);
+        if (used == 0 || rawLen > CHUNK_MAX) {
+            rc = -1;
+            break;
+        }
+        pos += used;
+        if (rawLen == 0) break;
+        if (len - pos < SHA256_SIZE) {
+            rc = -1;
+            break;
+        }
+        if (load_chunk(s, recipe + pos, (size_t)rawLen, codec, cipher, &key, stored, cap, raw) != 0 ||
+            posix_write_full(fd_output, raw, (size_t)rawLen) != (ssize_t)rawLen) {
+            rc = -1;
+            break;
+        }
+        pos += SHA256_SIZE;
+        total += rawLen;
+    }
+    if (rc == 0 && (pos != len || total != meta->originalSize)) {
+        fprintf(stderr, "La receta no cubre el archivo original\n");
+        rc = -1;
+    }
+    if (cipher) cipher->clear(&key);
+    free(stored);
+    free(raw);
+    return rc;
+}
+
+int chunkstore_read_file(ChunkStore* s, const char* inputPath, const char* outputPath) {
+    int fd_input = posix_open_read(inputPath);
+    if (fd_input == -1) return -1;
+    FileMetadata meta;
+    if (metadata_read(fd_input, &meta) != 0 || !(meta.flags & META_FLAG_CHUNKED) || !metadata_chain_supported(&meta)) {
+        fprintf(stderr, "Receta de fragmentos inválida: %s\n", inputPath);
+        posix_close_input(fd_input);
+        return -1;
+    }
+    if ((meta.codec != CODEC_ID_NONE && !codec_find_id(meta.codec)) ||
+        (meta.cipher != CIPHER_ID_NONE && !cipher_find_id(meta.cipher))) {
+        fprintf(stderr, "Algoritmo no registrado en %s\n", inputPath);
+        posix_close_input(fd_input);
+        return -1;
+    }
+    if (meta.cipher != CIPHER_ID_NONE && !s->password) {
+        fprintf(stderr, "%s está cifrado: se requiere -k [clave]\n", inputPath);
+        posix_close_input(fd_input);
+        return -1;
+    }
+
+    // La receta es pequeña (unos 36 bytes por fragmento): se valida completa antes de escribir
+    off_t start = lseek(fd_input, 0, SEEK_CUR);
+    off_t size = posix_get_file_size(fd_input);
+    size_t len = start >= 0 && size >= start + 5 ? (size_t)(size - start) : 0;
+    unsigned char* recipe = len ? (unsigned char*)malloc(len) : NULL;
+    int rc = recipe && posix_read_full(fd_input, recipe, len) == (ssize_t)len &&
+             crc32c(0, recipe, len - 4) == (uint32_t)load_le(recipe + len - 4, 4) ? 0 : -1;
+    posix_close_input(fd_input);
+    if (rc != 0) {
+        fprintf(stderr, "Receta de fragmentos dañada: %s\n", inputPath);
+        free(recipe);
+        return -1;
+    }
+
+    int fd_output = posix_open_write(outputPath);
+    rc = fd_output >= 0 ? read_chunks(s, &meta, recipe, len - 4, fd_output) : -1;
+    if (fd_output >= 0 && posix_close(fd_output) != 0) rc = -1;
+    free(recipe);
+    return rc;
+}
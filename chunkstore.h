@@ -0,0 +1,67 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sha256.h"
+
+// Almacén de fragmentos (--chunk-store). Cada archivo se corta en fragmentos definidos por su
+// contenido (FastCDC con hash gear), así que un cambio de pocos bytes solo mueve los cortes
+// cercanos. Cada fragmento se comprime y cifra por separado y se guarda una sola vez en el
+// almacén, con su SHA-256 como nombre; la salida de cada archivo es solo su receta. Los
+// fragmentos repetidos entre archivos y entre corridas no se vuelven a codificar ni a escribir.
+//
+//   almacén:  <dir>/<2 hex>/<62 hex>, uno por fragmento:
+//             rawLen (varint) | crc32c(raw) u32 | datos codificados (o el fragmento tal
+//             cual si el compresor no lo reduce: se reconoce porque mide rawLen)
+//   receta:   encabezado (metadata.h, META_FLAG_CHUNKED) |
+//             entrada*: rawLen (varint) | id (32 bytes) |
+//             fin: rawLen = 0 (varint) | crc32c de las entradas u32
+//
+// El id es SHA-256(sal | fragmento), con la sal derivada del compresor, el cifrado y la clave:
+// con otras etapas o con otra clave los fragmentos no se mezclan. Los cortes dependen de la
+// tabla gear, que es fija; cambiarla invalida la reutilización con almacenes anteriores.
+// El almacén solo crece: borrar recetas no borra sus fragmentos.
+
+#define CHUNK_MIN        (16 * 1024)
+#define CHUNK_AVG        (64 * 1024)
+#define CHUNK_MAX        (256 * 1024)
+#define CHUNK_STORE_NAME ".mcpf-chunks"  // Nombre sugerido dentro de la carpeta de salida
+
+typedef struct ChunkStore ChunkStore;
+
+/**
+ * Longitud del primer fragmento de data (FastCDC con cortes normalizados)
+ * @param len Bytes disponibles; si no llegan a CHUNK_MAX se supone que son los últimos
+ * @return Entre 1 y len (len si len <= CHUNK_MIN)
+ */
+size_t chunk_cut(const unsigned char* data, size_t len);
+
+/**
+ * Abre (o crea) un almacén. Se puede compartir entre hilos
+ * @param codec Etapas con que se guardan los fragmentos nuevos (CODEC_ID_* / CIPHER_ID_*)
+ * @param key Clave si hay cifrado; también se usa para leer recetas cifradas
+ * @return Almacén, o NULL si no se puede abrir o falta la clave
+ */
+ChunkStore* chunkstore_open(const char* dir, uint8_t codec, uint8_t cipher, const char* key);
+
+void chunkstore_close(ChunkStore* s);
+
+/**
+ * Corta un archivo, guarda los fragmentos que el almacén no tenga y escribe su receta
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int chunkstore_write_file(ChunkStore* s, const char* inputPath, const char* outputPath);
+
+/**
+ * Reconstruye un archivo desde su receta
+ * @return 0 si tiene éxito, -1 si falta un fragmento, está dañado o la clave no corresponde
+ */
+int chunkstore_read_file(ChunkStore* s, const char* inputPath, const char* outputPath);
+
+/**
+ * Fragmentos escritos y fragmentos reutilizados desde que se abrió el almacén
+ */
+void chunkstore_stats(ChunkStore* s, uint64_t* written, uint64_t* reused);
+
+#endif
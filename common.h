@@ -2,16 +2,71 @@
 #define COMMON_H
 
 #include <stdint.h>
+#include <string.h>
 
 #define MAX_FILENAME_LEN 256 // Nomvre de archivo maximo (256 caracteres)
 #define METADATA_MAGIC 0x4D435046  // "MCPF" en hex (Magic Compressed/Protected File), funciona como firma de archivos creados por el programa.
 
-// Estructura comun para metadatos de archivo
+// Bits de FileMetadata.flags
+#define META_FLAG_ENCRYPTED 0x02   // Contenido cifrado con AES (solo en el formato heredado)
+#define META_FLAG_SPARSE    0x04   // Tras los metadatos va el mapa de huecos; originalSize es el tamaño lógico
+#define META_FLAG_BLOCKED   0x08   // Contenido en bloques independientes con índice final (ver container.h)
+#define META_FLAG_STREAMED  0x10   // Origen sin tamaño conocido (tubería): originalSize es 0 y el tamaño sale del índice
+#define META_FLAG_ARCHIVE   0x20   // Árbol de directorios en un solo contenedor, con tabla de archivos (ver archive.h)
+#define META_FLAG_CHUNKED   0x40   // Receta de fragmentos guardados en un almacén aparte (ver chunkstore.h)
+#define META_FLAG_DELTA     0x80   // El contenedor guarda un delta contra una versión anterior (ver delta.h)
+#define META_FLAG_RAW_BLOCKS 0x100 // Los bloques que el compresor no reduce van tal cual (ver container.h)
+
+// Identificadores de algoritmos guardados en el encabezado
+#define CODEC_ID_NONE     0
+#define CODEC_ID_HUFFMAN  1
+#define CODEC_ID_RLE      2
+#define CODEC_ID_LZW      3
+#define CODEC_ID_LZSS     4        // Un ID por nivel; el formato es el mismo (ver Compresion/lzss.h)
+#define CODEC_ID_LZSS_FAST 5
+#define CODEC_ID_LZSS_MAX  6
+#define CODEC_ID_UNKNOWN  0xFF     // Encabezado heredado: el algoritmo no quedó registrado
+
+// Dos compresores encadenados (p. ej. rle+huffman). Solo existe en memoria: en el encabezado
+// se guardan como dos etapas, inner primero. Solo se encadenan compresores con ID de 1 a
+// CODEC_CHAIN_MAX_ID, que caben en CODEC_CHAIN_BITS bits cada uno
+#define CODEC_ID_CHAIN              0x40
+#define CODEC_CHAIN_BITS            3
+#define CODEC_CHAIN_MAX_ID          ((1 << CODEC_CHAIN_BITS) - 1)
+#define CODEC_CHAIN_ID(inner, outer) ((uint8_t)(CODEC_ID_CHAIN | (inner) << CODEC_CHAIN_BITS | (outer)))
+#define CODEC_IS_CHAIN(id)          (((id) & 0xC0) == CODEC_ID_CHAIN)
+#define CODEC_CHAIN_INNER(id)       ((uint8_t)(((id) >> CODEC_CHAIN_BITS) & CODEC_CHAIN_MAX_ID))
+#define CODEC_CHAIN_OUTER(id)       ((uint8_t)((id) & CODEC_CHAIN_MAX_ID))
+#define CODEC_CAN_CHAIN(id)         ((id) >= 1 && (id) <= CODEC_CHAIN_MAX_ID)
+
+// Todo CODEC_ID_* que se puede usar para comprimir (cadenas incluidas) es menor que esto; sirve
+// para tablas indexadas por compresor. CODEC_ID_UNKNOWN queda afuera
+#define CODEC_ID_LIMIT              (CODEC_ID_CHAIN << 1)
+
+#define CIPHER_ID_NONE     0
+#define CIPHER_ID_VIGENERE 1
+#define CIPHER_ID_AES      2
+#define CIPHER_ID_UNKNOWN  0xFF
+
+// Cadena de etapas registrada en el encabezado, en el orden en que se aplicaron al escribir.
+// Los compresores usan su CODEC_ID_*; los cifrados se marcan con el bit alto
+#define META_MAX_STAGES      8
+#define META_STAGE_CIPHER    0x80
+#define META_STAGE_IS_CIPHER(s) (((s) & META_STAGE_CIPHER) != 0)
+#define META_STAGE_ID(s)        ((uint8_t)((s) & 0x7F))
+
+// Estructura comun para metadatos de archivo (representación en memoria).
+// En disco se serializa con metadata_write (ver metadata.h)
 typedef struct {
     uint32_t magic;              // Guarda la firma para validar que el archivo fue creado por el programa
     uint64_t originalSize;       // Tamaño original del archivo
     char originalName[MAX_FILENAME_LEN];  // Nombre original completo
     uint32_t flags;             // Banderas para uso futuro (compresion, encriptacion, etc)
+    uint8_t version;            // Versión del encabezado leído (1 = heredado, 3 = compacto)
+    uint8_t codec;              // CODEC_ID_* con el que se comprimió (CODEC_CHAIN_ID si fueron dos)
+    uint8_t cipher;             // CIPHER_ID_* con el que se cifró
+    uint8_t stageCount;         // Etapas en chain (0 en el encabezado heredado)
+    uint8_t chain[META_MAX_STAGES]; // p. ej. { CODEC_ID_LZW, META_STAGE_CIPHER | CIPHER_ID_AES }
 } FileMetadata;
 
 // Funciones auxiliares para leer/escribir archivos binarios
@@ -26,4 +81,4 @@ static inline const char* get_basename(const char* path) { // Devuelve el nombre
     return lastSlash ? lastSlash + 1 : path;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,1258 @@
+#include "container.h"
+#include "metadata.h"
+#include "posix_utils.h"
+#include "checksum.h"
+#include "registry.h"
+#include "autocodec.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+
+// Entrada del índice en memoria
+typedef struct {
+    uint64_t compOffset;
+    uint64_t rawOffset;
+    uint32_t storedLen;
+    uint32_t rawLen;
+    uint32_t crc;
+} BlockEntry;
+
+// Tamaño máximo almacenado para un bloque: cota del compresor más lo que agrega el cifrado
+static size_t stored_bound(const CodecOps* codec, const CipherOps* cipher, size_t rawLen) {
+    return (codec ? codec->bound(rawLen) : rawLen) + (cipher ? cipher->overhead : 0);
+}
+
+static void store_le(unsigned char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static ssize_t pread_full(int fd, void* buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, (unsigned char*)buf + done, len - done, off + (off_t)done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error pread: %s\n", strerror(errno));
+            return -1;
+        }
+        if (n == 0) break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+static ssize_t pwrite_full(int fd, const void* buf, size_t len, off_t off) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, (const unsigned char*)buf + done, len - done, off + (off_t)done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            fprintf(stderr, "Error pwrite: %s\n", strerror(errno));
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
+
+// En archivos densos la posición empaquetada coincide con la lógica
+static ssize_t data_read(int fd, const PosixSparseMap* map, uint64_t pos, void* buf, size_t len) {
+    if (map->count > 0) return posix_read_packed(fd, map, pos, buf, len);
+    return pread_full(fd, buf, len, (off_t)pos);
+}
+
+static ssize_t data_write(int fd, const PosixSparseMap* map, uint64_t pos, const void* buf, size_t len) {
+    if (map->count > 0) return posix_write_packed(fd, map, pos, buf, len);
+    return pwrite_full(fd, buf, len, (off_t)pos);
+}
+
+// Comprime y luego cifra un bloque (codec o cipher NULL = etapa ausente). Si el compresor no lo
+// reduce, o la muestra ya dice que no lo hará (Huffman y RLE), el bloque va tal cual (META_FLAG_RAW_BLOCKS). *out
+// se reserva con malloc, salvo sin cifrado ni compresión efectiva: entonces es el mismo raw
+static int encode_block(const CodecOps* codec, const CipherOps* cipher, const CipherKey* key,
+                        unsigned char* raw, size_t rawLen, unsigned char** out, size_t* outLen) {
+    unsigned char* buf = NULL;
+    size_t len = rawLen;
+
+    if (codec && !autocodec_incompressible(codec->id, raw, rawLen)) {
+        if (codec->encode(raw, rawLen, &buf, &len) != 0) return -1;
+        if (len >= rawLen) {
+            free(buf);
+            buf = NULL;
+            len = rawLen;
+        }
+    }
+
+    if (cipher) {
+        unsigned char* enc = (unsigned char*)malloc(len + cipher->overhead);
+        if (!enc) { free(buf); return -1; }
+        len = cipher->encrypt(key, buf ? buf : raw, len, enc);
+        free(buf);
+        buf = enc;
+    }
+
+    *out = buf ? buf : raw;
+    *outLen = len;
+    return 0;
+}
+
+// Descifra en sitio y descomprime un bloque en raw (rawLen bytes exactos). Con rawBlocks, un
+// bloque del mismo tamaño que el original es el original: el compresor solo se usa si reduce
+static int decode_block(const CodecOps* codec, const CipherOps* cipher, const CipherKey* key, int rawBlocks,
+                        unsigned char* stored, size_t storedLen, unsigned char* raw, size_t rawLen) {
+    size_t plainLen = storedLen;
+    if (cipher && cipher->decrypt(key, stored, storedLen, stored, &plainLen) != 0) return -1;
+
+    if (codec && !(rawBlocks && plainLen == rawLen)) return codec->decode(stored, plainLen, raw, rawLen);
+    if (plainLen != rawLen) return -1;
+    memcpy(raw, stored, rawLen);
+    return 0;
+}
+
+// Bloque en tránsito entre la lectura, los hilos de codificación y la escritura en orden
+typedef struct {
+    unsigned char* raw;
+    size_t rawLen;
+    unsigned char* stored;      // Salida de encode_block; se libera al escribirlo (release_stored)
+    size_t storedLen;
+    uint32_t crc;
+    int state;                  // SLOT_*
+} EncodeSlot;
+
+#define SLOT_FREE    0
+#define SLOT_READY   1          // raw lleno, pendiente de codificar
+#define SLOT_DONE    2
+#define SLOT_FAILED  3
+
+// Libera la salida de encode_block (salvo si es el propio bloque original)
+static void release_stored(EncodeSlot* s) {
+    if (s->stored != s->raw) free(s->stored);
+    s->stored = NULL;
+}
+
+typedef struct {
+    const CodecOps* codec;
+    const CipherOps* cipher;
+    const CipherKey* key;
+    EncodeSlot* slots;
+    uint32_t slotCount;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       // Hay un bloque nuevo para codificar (o se terminó)
+    pthread_cond_t done;        // Un bloque terminó de codificarse
+    uint64_t produced;          // Bloques leídos
+    uint64_t nextEncode;        // Siguiente bloque que toma un hilo
+    int finished;
+} EncodePipeline;
+
+// Bloques de un contenedor entregados a un ContainerExecutor. Los trabajos pueden ejecutarse
+// después de que el escritor terminó: p pasa a NULL y el último que suelta la referencia libera
+struct ContainerJob {
+    pthread_mutex_t lock;
+    EncodePipeline* p;
+    int refs;
+};
+
+static void encode_slot(const EncodePipeline* p, EncodeSlot* s) {
+    s->crc = crc32c(0, s->raw, s->rawLen);
+    int ok = encode_block(p->codec, p->cipher, p->key, s->raw, s->rawLen, &s->stored, &s->storedLen) == 0;
+    s->state = ok ? SLOT_DONE : SLOT_FAILED;
+}
+
+// Toma el siguiente bloque pendiente, en el orden de lectura (con p->lock tomado)
+static EncodeSlot* take_next(EncodePipeline* p) {
+    if (p->nextEncode == p->produced) return NULL;
+    return &p->slots[p->nextEncode++ % p->slotCount];
+}
+
+// Codifica un bloque tomado con take_next; se llama sin el candado
+static void encode_taken(EncodePipeline* p, EncodeSlot* s) {
+    EncodeSlot result = *s;
+    encode_slot(p, &result);
+
+    pthread_mutex_lock(&p->lock);
+    *s = result;
+    pthread_cond_broadcast(&p->done);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Los hilos toman los bloques en el orden de lectura; el escritor los consume en el mismo orden
+static void* encode_worker(void* arg) {
+    EncodePipeline* p = (EncodePipeline*)arg;
+    pthread_mutex_lock(&p->lock);
+    while (1) {
+        while (p->nextEncode == p->produced && !p->finished) pthread_cond_wait(&p->ready, &p->lock);
+        EncodeSlot* s = take_next(p);
+        if (!s) break;
+        pthread_mutex_unlock(&p->lock);
+        encode_taken(p, s);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+void container_job_release(ContainerJob* job) {
+    pthread_mutex_lock(&job->lock);
+    int last = --job->refs == 0;
+    pthread_mutex_unlock(&job->lock);
+    if (!last) return;
+    pthread_mutex_destroy(&job->lock);
+    free(job);
+}
+
+void container_job_run(ContainerJob* job) {
+    EncodeSlot* s = NULL;
+    EncodePipeline* p;
+    pthread_mutex_lock(&job->lock);
+    if ((p = job->p) != NULL) {
+        pthread_mutex_lock(&p->lock);
+        s = take_next(p);
+        pthread_mutex_unlock(&p->lock);
+    }
+    pthread_mutex_unlock(&job->lock);
+    // El escritor no libera el pipeline mientras quede un bloque tomado sin escribir
+    if (s) encode_taken(p, s);
+    container_job_release(job);
+}
+
+// Índice en construcción: crece a medida que se escriben bloques
+typedef struct {
+    BlockEntry* blocks;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t pos;               // Posición en la salida
+    uint64_t rawOffset;         // Posición en los datos empaquetados
+} IndexBuilder;
+
+// Escribe la trama del bloque codificado y lo agrega al índice
+static int write_frame(int fd_output, IndexBuilder* ix, EncodeSlot* s) {
+    int rc = -1;
+    if (s->state != SLOT_DONE) {
+        fprintf(stderr, "Falló codificación del bloque %llu\n", (unsigned long long)ix->count);
+        goto out;
+    }
+    if (ix->count == UINT32_MAX) {
+        fprintf(stderr, "Archivo demasiado grande para el contenedor\n");
+        goto out;
+    }
+    if (ix->count == ix->capacity) {
+        uint64_t capacity = ix->capacity ? ix->capacity * 2 : 64;
+        BlockEntry* grown = (BlockEntry*)realloc(ix->blocks, capacity * sizeof(BlockEntry));
+        if (!grown) {
+            fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+            goto out;
+        }
+        ix->blocks = grown;
+        ix->capacity = capacity;
+    }
+
+    // Cabecera de trama para lectores secuenciales
+    unsigned char hdr[24];
+    size_t n = metadata_put_varint(hdr, s->rawLen);
+    n += metadata_put_varint(hdr + n, s->storedLen);
+    store_le(hdr + n, s->crc, 4);
+    n += 4;
+    if (posix_write_full(fd_output, hdr, n) != (ssize_t)n ||
+        posix_write_full(fd_output, s->stored, s->storedLen) != (ssize_t)s->storedLen) {
+        fprintf(stderr, "Falló escritura del bloque %llu\n", (unsigned long long)ix->count);
+        goto out;
+    }
+
+    BlockEntry* b = &ix->blocks[ix->count++];
+    b->compOffset = ix->pos + n;
+    b->rawOffset = ix->rawOffset;
+    b->storedLen = (uint32_t)s->storedLen;
+    b->rawLen = (uint32_t)s->rawLen;
+    b->crc = s->crc;
+    ix->pos += n + s->storedLen;
+    ix->rawOffset += s->rawLen;
+    rc = 0;
+out:
+    release_stored(s);
+    s->state = SLOT_FREE;
+    return rc;
+}
+
+// Espera a que el bloque seq termine de codificarse y lo escribe (o lo descarta tras un error)
+static int flush_slot(EncodePipeline* p, uint64_t seq, int fd_output, IndexBuilder* ix, int discard) {
+    EncodeSlot* s = &p->slots[seq % p->slotCount];
+    pthread_mutex_lock(&p->lock);
+    while (s->state == SLOT_READY) {
+        // Si ningún hilo tomó todavía el bloque, el escritor lo codifica en lugar de esperar
+        EncodeSlot* t = take_next(p);
+        if (!t) {
+            pthread_cond_wait(&p->done, &p->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&p->lock);
+        encode_taken(p, t);
+        pthread_mutex_lock(&p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    if (!discard) return write_frame(fd_output, ix, s);
+    release_stored(s);
+    s->state = SLOT_FREE;
+    return 0;
+}
+
+static int write_index(int fd_output, IndexBuilder* ix) {
+    // Marca de fin de tramas, índice y pie
+    unsigned char end = 0;
+    if (posix_write_full(fd_output, &end, 1) != 1) return -1;
+    ix->pos += 1;
+
+    size_t indexLen = ix->count * CONTAINER_INDEX_ENTRY + CONTAINER_FOOTER_SIZE;
+    unsigned char* index = (unsigned char*)malloc(indexLen);
+    if (!index) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        return -1;
+    }
+    unsigned char* p = index;
+    for (uint64_t i = 0; i < ix->count; i++, p += CONTAINER_INDEX_ENTRY) {
+        store_le(p, ix->blocks[i].compOffset, 8);
+        store_le(p + 8, ix->blocks[i].rawOffset, 8);
+        store_le(p + 16, ix->blocks[i].storedLen, 4);
+        store_le(p + 20, ix->blocks[i].rawLen, 4);
+        store_le(p + 24, ix->blocks[i].crc, 4);
+    }
+    store_le(p, ix->pos, 8);
+    store_le(p + 8, ix->count, 4);
+    store_le(p + 12, CONTAINER_FOOTER_MAGIC, 4);
+
+    int rc = posix_write_full(fd_output, index, indexLen) == (ssize_t)indexLen ? 0 : -1;
+    if (rc != 0) fprintf(stderr, "Falló escritura del índice\n");
+    free(index);
+    return rc;
+}
+
+// Etapas de codificación y recursos que se reutilizan entre archivos: la clave expandida y el
+// bloque de la codificación en línea. container_compress_file usa uno por llamada y un lote
+// (container_batch_*) lo comparte entre todos sus archivos
+struct ContainerBatch {
+    const CodecOps* codec;      // NULL si la cadena no tiene compresor
+    const CipherOps* cipher;    // NULL si no se cifra
+    CipherKey key;
+    ContainerThreads threads;   // Reparto de la codificación de cada archivo
+    unsigned char* raw;
+    size_t rawCap;
+};
+
+static int batch_init(ContainerBatch* b, uint8_t codec, uint8_t cipher, const char* key, const ContainerThreads* threads) {
+    memset(b, 0, sizeof(*b));
+    if (threads) b->threads = *threads;
+    b->codec = codec_find_id(codec);
+    b->cipher = cipher_find_id(cipher);
+    if ((codec != CODEC_ID_NONE && !b->codec) || (cipher != CIPHER_ID_NONE && !b->cipher)) {
+        fprintf(stderr, "Algoritmo no registrado (compresor %u, cifrado %u)\n", codec, cipher);
+        return -1;
+    }
+    if (b->cipher && (!key || key[0] == '\0')) {
+        fprintf(stderr, "Se requiere una clave para cifrar\n");
+        return -1;
+    }
+    if (b->cipher) b->cipher->init(&b->key, key);
+    return 0;
+}
+
+static void batch_clear(ContainerBatch* b) {
+    if (b->cipher) b->cipher->clear(&b->key);
+    free(b->raw);
+    b->raw = NULL;
+    b->rawCap = 0;
+}
+
+// Escribe encabezado, mapa de huecos, tramas e índice. La lectura y la escritura ocurren en este
+// hilo y en orden; la codificación se reparte entre hilos propios, o entre los del ejecutor externo
+// si hay uno y el archivo tiene suficientes bloques, que trabajan sobre una ventana de bloques.
+// dataBytes son los bytes que entregará source (se ignora con META_FLAG_STREAMED)
+static int write_container(int fd_output, const FileMetadata* meta, const PosixSparseMap* sparse,
+                           ContainerSource source, void* opaque, ContainerBatch* b, uint64_t dataBytes) {
+    int streamed = (meta->flags & META_FLAG_STREAMED) != 0;
+    uint64_t expectedBlocks = streamed ? 0 : (dataBytes + CONTAINER_BLOCK_SIZE - 1) / CONTAINER_BLOCK_SIZE;
+    // Un archivo pequeño no necesita un bloque completo: el buffer se ajusta a su tamaño
+    size_t blockCap = !streamed && dataBytes < CONTAINER_BLOCK_SIZE
+                    ? (dataBytes > 0 ? (size_t)dataBytes : 1) : CONTAINER_BLOCK_SIZE;
+
+    int threads = b->threads.threads;
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if (expectedBlocks > 0 && (uint64_t)threads > expectedBlocks) threads = (int)expectedBlocks;
+    // Con un solo hilo se codifica en línea; si no, dos bloques por hilo mantienen a todos ocupados
+    int workers = threads > 1 ? threads : 0;
+    const ContainerExecutor* executor = b->threads.executor;
+    if (executor && (expectedBlocks == 0 || expectedBlocks >= executor->minBlocks) && executor->width > 1) {
+        workers = executor->width;
+    } else {
+        executor = NULL;
+    }
+    int ownThreads = workers > 0 && !executor;
+
+    EncodePipeline p = { .codec = b->codec, .cipher = b->cipher, .key = &b->key,
+                         .slotCount = workers > 0 ? (uint32_t)workers * 2 : 1 };
+    IndexBuilder ix = {0};
+    ContainerJob* job = NULL;
+    pthread_t* tids = NULL;
+    int started = 0, rc = -1;
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_cond_init(&p.ready, NULL);
+    pthread_cond_init(&p.done, NULL);
+
+    if (executor) {
+        job = (ContainerJob*)malloc(sizeof(ContainerJob));
+        if (!job) {
+            fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+            goto done;
+        }
+        pthread_mutex_init(&job->lock, NULL);
+        job->p = &p;
+        job->refs = 1;
+    }
+    p.slots = (EncodeSlot*)calloc(p.slotCount, sizeof(EncodeSlot));
+    if (!p.slots) goto done;
+    if (workers == 0) {
+        // En línea se usa el bloque del lote, que crece hasta el mayor archivo que procesa
+        if (b->rawCap < blockCap) {
+            unsigned char* grown = (unsigned char*)realloc(b->raw, blockCap);
+            if (!grown) {
+                fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+                goto done;
+            }
+            b->raw = grown;
+            b->rawCap = blockCap;
+        }
+        p.slots[0].raw = b->raw;
+    }
+    for (uint32_t i = 0; workers > 0 && i < p.slotCount; i++) {
+        p.slots[i].raw = (unsigned char*)malloc(blockCap);
+        if (!p.slots[i].raw) {
+            fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+            goto done;
+        }
+    }
+
+    // Los lectores anteriores no conocen los bloques guardados tal cual: la bandera los distingue
+    FileMetadata header = *meta;
+    if (b->codec) header.flags |= META_FLAG_RAW_BLOCKS;
+    if (metadata_write(fd_output, &header) != 0 ||
+        (sparse && sparse->count > 0 && posix_write_sparse_map(fd_output, sparse) != 0)) {
+        fprintf(stderr, "Falló escritura de metadatos\n");
+        goto done;
+    }
+    ix.pos = metadata_encoded_size(&header) +
+             (sparse && sparse->count > 0 ? sizeof(uint32_t) + (uint64_t)sparse->count * sizeof(PosixExtent) : 0);
+
+    if (ownThreads) tids = (pthread_t*)malloc(sizeof(pthread_t) * workers);
+    for (int t = 0; tids && t < workers; t++) {
+        if (pthread_create(&tids[t], NULL, encode_worker, &p) != 0) break;
+        started++;
+    }
+
+    uint64_t written = 0;
+    int failed = 0;
+    while (!failed) {
+        uint64_t seq = p.produced;
+        // La ranura se reutiliza cuando su bloque anterior ya se escribió
+        if (seq >= p.slotCount && flush_slot(&p, written++, fd_output, &ix, 0) != 0) {
+            failed = 1;
+            break;
+        }
+        EncodeSlot* s = &p.slots[seq % p.slotCount];
+        ssize_t got = source(opaque, s->raw, blockCap);
+        if (got < 0) {
+            fprintf(stderr, "Falló lectura del bloque %llu\n", (unsigned long long)seq);
+            failed = 1;
+            break;
+        }
+        if (got == 0) break;
+        s->rawLen = (size_t)got;
+
+        if (job) {
+            // Cada bloque es un trabajo que puede tomar cualquier hilo libre del ejecutor
+            pthread_mutex_lock(&p.lock);
+            s->state = SLOT_READY;
+            p.produced++;
+            pthread_mutex_unlock(&p.lock);
+            pthread_mutex_lock(&job->lock);
+            job->refs++;
+            pthread_mutex_unlock(&job->lock);
+            executor->spawn(executor->opaque, job);
+        } else if (started == 0) {
+            // Sin hilos (o si no se pudieron crear) el bloque se codifica aquí
+            encode_slot(&p, s);
+            p.produced++;
+            p.nextEncode++;
+        } else {
+            pthread_mutex_lock(&p.lock);
+            s->state = SLOT_READY;
+            p.produced++;
+            pthread_cond_signal(&p.ready);
+            pthread_mutex_unlock(&p.lock);
+        }
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.finished = 1;
+    pthread_cond_broadcast(&p.ready);
+    pthread_mutex_unlock(&p.lock);
+    // Los bloques pendientes se escriben en orden, o se descartan tras un error
+    while (written < p.produced) {
+        if (flush_slot(&p, written++, fd_output, &ix, failed) != 0) failed = 1;
+    }
+    if (!failed && write_index(fd_output, &ix) == 0) rc = 0;
+
+done:
+    for (int t = 0; t < started; t++) pthread_join(tids[t], NULL);
+    free(tids);
+    if (job) {
+        // Los trabajos que queden en el ejecutor ya no encuentran bloques pendientes
+        pthread_mutex_lock(&job->lock);
+        job->p = NULL;
+        pthread_mutex_unlock(&job->lock);
+        container_job_release(job);
+    }
+    for (uint32_t i = 0; p.slots && i < p.slotCount; i++) {
+        release_stored(&p.slots[i]);
+        if (workers > 0) free(p.slots[i].raw);
+    }
+    free(p.slots);
+    free(ix.blocks);
+    pthread_mutex_destroy(&p.lock);
+    pthread_cond_destroy(&p.ready);
+    pthread_cond_destroy(&p.done);
+    return rc;
+}
+
+int container_write(int fd_output, const FileMetadata* meta, ContainerSource source, void* opaque, const char* key,
+                    const ContainerThreads* threads) {
+    ContainerBatch b;
+    if (batch_init(&b, meta->codec, meta->cipher, key, threads) != 0) return -1;
+    FileMetadata blocked = *meta;
+    blocked.flags |= META_FLAG_BLOCKED;
+    int rc = write_container(fd_output, &blocked, NULL, source, opaque, &b, meta->originalSize);
+    batch_clear(&b);
+    return rc;
+}
+
+// Origen de container_compress_file: datos empaquetados de un archivo, o una tubería hasta EOF
+typedef struct {
+    int fd;
+    const PosixSparseMap* sparse;
+    uint64_t dataBytes;
+    uint64_t pos;
+    int streamed;
+} FileSource;
+
+static ssize_t file_source(void* opaque, unsigned char* buf, size_t cap) {
+    FileSource* src = (FileSource*)opaque;
+    if (src->streamed) return posix_read_full(src->fd, buf, cap);
+    size_t len = src->dataBytes - src->pos < cap ? (size_t)(src->dataBytes - src->pos) : cap;
+    if (len == 0) return 0;
+    if (data_read(src->fd, src->sparse, src->pos, buf, len) != (ssize_t)len) return -1;
+    src->pos += len;
+    return (ssize_t)len;
+}
+
+static int compress_path(ContainerBatch* b, const char* inputPath, const char* outputPath) {
+    int fd_input = posix_open_read(inputPath);
+    if (fd_input == -1) return -1;
+
+    // Una tubería no tiene tamaño ni admite pread: se lee en orden hasta EOF
+    int streamed = posix_is_regular_file(fd_input) != 1;
+    off_t fileSize = streamed ? 0 : posix_get_file_size(fd_input);
+    if (fileSize < 0) {
+        posix_close_input(fd_input);
+        return -1;
+    }
+
+    // Solo se guardan las regiones con datos; los huecos quedan descritos por el mapa
+    PosixSparseMap sparse = {0};
+    if (!streamed) posix_sparse_map(fd_input, fileSize, &sparse);
+    uint64_t dataBytes = sparse.count > 0 ? sparse.dataBytes : (uint64_t)fileSize;
+    uint64_t blockCount = (dataBytes + CONTAINER_BLOCK_SIZE - 1) / CONTAINER_BLOCK_SIZE;
+    if (blockCount > UINT32_MAX) {
+        fprintf(stderr, "Archivo demasiado grande para el contenedor\n");
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
+        return -1;
+    }
+
+    int fd_output = posix_open_write(outputPath);
+    if (fd_output == -1) {
+        posix_close_input(fd_input);
+        posix_free_sparse_map(&sparse);
+        return -1;
+    }
+
+    FileMetadata meta;
+    metadata_init(&meta, posix_is_stdio(inputPath) ? "stdin" : inputPath, (uint64_t)fileSize,
+                  b->codec ? b->codec->id : CODEC_ID_NONE, b->cipher ? b->cipher->id : CIPHER_ID_NONE);
+    meta.flags = META_FLAG_BLOCKED | (sparse.count > 0 ? META_FLAG_SPARSE : 0) | (streamed ? META_FLAG_STREAMED : 0);
+
+    FileSource src = { .fd = fd_input, .sparse = &sparse, .dataBytes = dataBytes, .streamed = streamed };
+    int rc = write_container(fd_output, &meta, &sparse, file_source, &src, b, dataBytes);
+
+    posix_close_input(fd_input);
+    posix_close(fd_output);
+    posix_free_sparse_map(&sparse);
+    return rc;
+}
+
+int container_compress_file(const char* inputPath, const char* outputPath, uint8_t codec, uint8_t cipher, const char* key,
+                            const ContainerThreads* threads) {
+    ContainerBatch b;
+    if (batch_init(&b, codec, cipher, key, threads) != 0) return -1;
+    int rc = compress_path(&b, inputPath, outputPath);
+    batch_clear(&b);
+    return rc;
+}
+
+ContainerBatch* container_batch_open(uint8_t codec, uint8_t cipher, const char* key, const ContainerThreads* threads) {
+    ContainerBatch* b = (ContainerBatch*)malloc(sizeof(ContainerBatch));
+    if (!b) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        return NULL;
+    }
+    if (batch_init(b, codec, cipher, key, threads) != 0) {
+        free(b);
+        return NULL;
+    }
+    return b;
+}
+
+int container_batch_compress(ContainerBatch* batch, const char* inputPath, const char* outputPath) {
+    return compress_path(batch, inputPath, outputPath);
+}
+
+void container_batch_close(ContainerBatch* batch) {
+    if (!batch) return;
+    batch_clear(batch);
+    free(batch);
+}
+
+// Copia los bytes [from, to) de un descriptor a otro con pread (sin mover la posición de entrada)
+static int copy_bytes(int fd_input, uint64_t from, uint64_t to, int fd_output) {
+    unsigned char* buf = (unsigned char*)malloc(CONTAINER_BLOCK_SIZE);
+    if (!buf) return -1;
+    int rc = 0;
+    while (rc == 0 && from < to) {
+        size_t n = to - from < CONTAINER_BLOCK_SIZE ? (size_t)(to - from) : CONTAINER_BLOCK_SIZE;
+        if (pread_full(fd_input, buf, n, (off_t)from) != (ssize_t)n || posix_write_full(fd_output, buf, n) != (ssize_t)n) {
+            rc = -1;
+        }
+        from += n;
+    }
+    free(buf);
+    return rc;
+}
+
+// Las tramas no dependen de su posición: basta con desplazar el índice y el pie
+static int copy_renamed(int fd_input, FileMetadata* meta, const char* name, int fd_output) {
+    off_t framesStart = lseek(fd_input, 0, SEEK_CUR);
+    off_t fileSize = posix_get_file_size(fd_input);
+    unsigned char footer[CONTAINER_FOOTER_SIZE];
+    if (framesStart < 0 || fileSize < framesStart + CONTAINER_FOOTER_SIZE ||
+        pread_full(fd_input, footer, sizeof(footer), fileSize - CONTAINER_FOOTER_SIZE) != CONTAINER_FOOTER_SIZE ||
+        load_le(footer + 12, 4) != CONTAINER_FOOTER_MAGIC) {
+        return -1;
+    }
+    uint64_t indexOffset = load_le(footer, 8);
+    uint64_t count = load_le(footer + 8, 4);
+    if (indexOffset < (uint64_t)framesStart ||
+        indexOffset + count * CONTAINER_INDEX_ENTRY + CONTAINER_FOOTER_SIZE != (uint64_t)fileSize) {
+        return -1;
+    }
+
+    strncpy(meta->originalName, get_basename(name), MAX_FILENAME_LEN - 1);
+    meta->originalName[MAX_FILENAME_LEN - 1] = '\0';
+    unsigned char header[METADATA_MAX_SIZE];
+    size_t headerLen = metadata_encode(meta, header);
+    uint64_t shift = (uint64_t)headerLen - (uint64_t)framesStart;    // Módulo 2^64: también sirve si se achica
+    if (posix_write_full(fd_output, header, headerLen) != (ssize_t)headerLen ||
+        copy_bytes(fd_input, (uint64_t)framesStart, indexOffset, fd_output) != 0) {
+        return -1;
+    }
+
+    size_t indexLen = (size_t)count * CONTAINER_INDEX_ENTRY;
+    unsigned char* index = (unsigned char*)malloc(indexLen > 0 ? indexLen : 1);
+    if (!index || pread_full(fd_input, index, indexLen, (off_t)indexOffset) != (ssize_t)indexLen) {
+        free(index);
+        return -1;
+    }
+    for (size_t i = 0; i < (size_t)count; i++) {
+        unsigned char* entry = index + i * CONTAINER_INDEX_ENTRY;
+        store_le(entry, load_le(entry, 8) + shift, 8);
+    }
+    store_le(footer, indexOffset + shift, 8);
+    int rc = posix_write_full(fd_output, index, indexLen) == (ssize_t)indexLen &&
+             posix_write_full(fd_output, footer, sizeof(footer)) == (ssize_t)sizeof(footer) ? 0 : -1;
+    free(index);
+    return rc;
+}
+
+int container_copy_renamed(const char* inputPath, const char* outputPath, const char* name) {
+    int fd_input = open(inputPath, O_RDONLY | O_CLOEXEC);
+    if (fd_input == -1) return -1;
+    FileMetadata meta;
+    if (metadata_read(fd_input, &meta) != 0 || !(meta.flags & META_FLAG_BLOCKED) || meta.version != METADATA_VERSION) {
+        close(fd_input);
+        return -1;
+    }
+    int fd_output = posix_open_write(outputPath);
+    int rc = fd_output >= 0 ? copy_renamed(fd_input, &meta, name, fd_output) : -1;
+    if (fd_output >= 0 && posix_close(fd_output) != 0) rc = -1;
+    if (rc != 0 && fd_output >= 0) unlink(outputPath);
+    close(fd_input);
+    return rc;
+}
+
+// Estado de lectura de un contenedor: índice cargado y último bloque decodificado
+struct ContainerReader {
+    int fd;
+    FileMetadata meta;
+    PosixSparseMap sparse;
+    BlockEntry* blocks;
+    uint32_t count;
+    uint64_t dataBytes;
+    const CodecOps* codec;      // NULL si la cadena no tiene compresor
+    const CipherOps* cipher;    // NULL si no está cifrado
+    CipherKey key;
+    int rawBlocks;              // META_FLAG_RAW_BLOCKS: puede haber bloques sin comprimir
+    unsigned char* stored;
+    unsigned char* raw;
+    int64_t cached;
+};
+
+static void reader_close(ContainerReader* r) {
+    if (r->cipher) r->cipher->clear(&r->key);
+    free(r->blocks);
+    free(r->stored);
+    free(r->raw);
+    posix_free_sparse_map(&r->sparse);
+    if (r->fd != -1) posix_close_input(r->fd);
+}
+
+// Abre el contenedor y lee lo que precede a las tramas (encabezado y mapa de huecos)
+static int reader_begin(ContainerReader* r, const char* path, const char* key) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+    r->cached = -1;
+
+    r->fd = posix_open_read(path);
+    if (r->fd == -1) return -1;
+
+    if (metadata_read(r->fd, &r->meta) != 0 || !(r->meta.flags & META_FLAG_BLOCKED)) {
+        fprintf(stderr, "Contenedor por bloques inválido: %s\n", posix_is_stdio(path) ? "entrada estándar" : path);
+        return -1;
+    }
+    // El contenedor aplica uno o dos compresores seguidos de como mucho un cifrado
+    if (!metadata_chain_supported(&r->meta)) {
+        fprintf(stderr, "Cadena de etapas no soportada en %s\n", path);
+        return -1;
+    }
+    r->codec = codec_find_id(r->meta.codec);
+    r->cipher = cipher_find_id(r->meta.cipher);
+    r->rawBlocks = (r->meta.flags & META_FLAG_RAW_BLOCKS) != 0;
+    if ((r->meta.codec != CODEC_ID_NONE && !r->codec) || (r->meta.cipher != CIPHER_ID_NONE && !r->cipher)) {
+        fprintf(stderr, "Algoritmo no registrado en %s\n", path);
+        return -1;
+    }
+    if (r->cipher && (!key || key[0] == '\0')) {
+        fprintf(stderr, "El contenedor está cifrado: se requiere -k [clave]\n");
+        return -1;
+    }
+    if ((r->meta.flags & META_FLAG_SPARSE) && posix_read_sparse_map(r->fd, &r->sparse, r->meta.originalSize) != 0) {
+        return -1;
+    }
+    r->dataBytes = r->sparse.count > 0 ? r->sparse.dataBytes : r->meta.originalSize;
+
+    r->stored = (unsigned char*)malloc(stored_bound(r->codec, r->cipher, CONTAINER_BLOCK_SIZE));
+    r->raw = (unsigned char*)malloc(CONTAINER_BLOCK_SIZE);
+    if (!r->stored || !r->raw) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        return -1;
+    }
+    if (r->cipher) r->cipher->init(&r->key, key);
+    return 0;
+}
+
+// Carga el índice desde el pie (requiere un archivo con pread; ver extract_stream para tuberías)
+static int reader_index(ContainerReader* r) {
+    off_t framesStart = lseek(r->fd, 0, SEEK_CUR);
+    off_t fileSize = posix_get_file_size(r->fd);
+    if (framesStart < 0 || fileSize < framesStart + CONTAINER_FOOTER_SIZE) {
+        fprintf(stderr, "Contenedor truncado\n");
+        return -1;
+    }
+
+    unsigned char footer[CONTAINER_FOOTER_SIZE];
+    if (pread_full(r->fd, footer, sizeof(footer), fileSize - CONTAINER_FOOTER_SIZE) != CONTAINER_FOOTER_SIZE ||
+        load_le(footer + 12, 4) != CONTAINER_FOOTER_MAGIC) {
+        fprintf(stderr, "Pie del contenedor inválido\n");
+        return -1;
+    }
+    uint64_t indexOffset = load_le(footer, 8);
+    uint64_t count = load_le(footer + 8, 4);
+    if (indexOffset < (uint64_t)framesStart ||
+        indexOffset + count * CONTAINER_INDEX_ENTRY + CONTAINER_FOOTER_SIZE != (uint64_t)fileSize) {
+        fprintf(stderr, "Índice del contenedor inválido\n");
+        return -1;
+    }
+
+    size_t indexLen = count * CONTAINER_INDEX_ENTRY;
+    unsigned char* index = (unsigned char*)malloc(indexLen > 0 ? indexLen : 1);
+    r->blocks = (BlockEntry*)calloc(count > 0 ? count : 1, sizeof(BlockEntry));
+    if (!index || !r->blocks) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        free(index);
+        return -1;
+    }
+    if (pread_full(r->fd, index, indexLen, (off_t)indexOffset) != (ssize_t)indexLen) {
+        free(index);
+        return -1;
+    }
+
+    // Los bloques deben cubrir los datos de forma contigua y quedar dentro de la zona de tramas
+    uint64_t expected = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        const unsigned char* p = index + i * CONTAINER_INDEX_ENTRY;
+        BlockEntry* b = &r->blocks[i];
+        b->compOffset = load_le(p, 8);
+        b->rawOffset = load_le(p + 8, 8);
+        b->storedLen = (uint32_t)load_le(p + 16, 4);
+        b->rawLen = (uint32_t)load_le(p + 20, 4);
+        b->crc = (uint32_t)load_le(p + 24, 4);
+        if (b->rawOffset != expected || b->rawLen == 0 || b->rawLen > CONTAINER_BLOCK_SIZE ||
+            b->storedLen > stored_bound(r->codec, r->cipher, b->rawLen) || b->compOffset < (uint64_t)framesStart ||
+            b->compOffset + b->storedLen > indexOffset) {
+            fprintf(stderr, "Entrada %llu del índice inválida\n", (unsigned long long)i);
+            free(index);
+            return -1;
+        }
+        expected += b->rawLen;
+    }
+    free(index);
+    // Un origen leído de una tubería no registró su tamaño: lo define el índice
+    if (r->meta.flags & META_FLAG_STREAMED) {
+        r->meta.originalSize = expected;
+        r->dataBytes = expected;
+    }
+    if (expected != r->dataBytes) {
+        fprintf(stderr, "El índice no cubre el archivo original\n");
+        return -1;
+    }
+    r->count = (uint32_t)count;
+    return 0;
+}
+
+static int reader_open(ContainerReader* r, const char* path, const char* key) {
+    if (reader_begin(r, path, key) != 0) return -1;
+    if (posix_is_regular_file(r->fd) != 1) {
+        fprintf(stderr, "%s no admite acceso aleatorio: se necesita un archivo\n", path);
+        return -1;
+    }
+    return reader_index(r);
+}
+
+// Lee, decodifica y verifica el bloque i con los buffers del llamador (seguro entre hilos: solo pread)
+static int decode_entry(const ContainerReader* r, uint32_t i, unsigned char* stored, unsigned char* raw) {
+    const BlockEntry* b = &r->blocks[i];
+    if (pread_full(r->fd, stored, b->storedLen, (off_t)b->compOffset) != (ssize_t)b->storedLen ||
+        decode_block(r->codec, r->cipher, &r->key, r->rawBlocks, stored, b->storedLen, raw, b->rawLen) != 0) {
+        fprintf(stderr, "Bloque %u corrupto o clave incorrecta\n", i);
+        return -1;
+    }
+    if (crc32c(0, raw, b->rawLen) != b->crc) {
+        fprintf(stderr, "CRC inválido en el bloque %u\n", i);
+        return -1;
+    }
+    return 0;
+}
+
+// Decodifica el bloque i en r->raw (se conserva el último para lecturas de rango)
+static int reader_load(ContainerReader* r, uint32_t i) {
+    if (r->cached == (int64_t)i) return 0;
+    r->cached = -1;
+    if (decode_entry(r, i, r->stored, r->raw) != 0) return -1;
+    r->cached = i;
+    return 0;
+}
+
+// Bloque que contiene la posición empaquetada pos (búsqueda binaria sobre rawOffset)
+static uint32_t reader_find(const ContainerReader* r, uint64_t pos) {
+    uint32_t lo = 0, hi = r->count;
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (r->blocks[mid].rawOffset <= pos) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Copia [pos, pos + len) de los datos empaquetados a la salida
+static int copy_packed(ContainerReader* r, uint64_t pos, uint64_t len, int fd_output) {
+    while (len > 0) {
+        uint32_t i = reader_find(r, pos);
+        if (reader_load(r, i) != 0) return -1;
+        const BlockEntry* b = &r->blocks[i];
+        uint64_t within = pos - b->rawOffset;
+        size_t chunk = b->rawLen - within < len ? (size_t)(b->rawLen - within) : (size_t)len;
+        if (posix_write_full(fd_output, r->raw + within, chunk) != (ssize_t)chunk) return -1;
+        pos += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+static int write_zeros(int fd_output, uint64_t len) {
+    static const unsigned char zeros[65536];
+    while (len > 0) {
+        size_t chunk = len < sizeof(zeros) ? (size_t)len : sizeof(zeros);
+        if (posix_write_full(fd_output, zeros, chunk) != (ssize_t)chunk) return -1;
+        len -= chunk;
+    }
+    return 0;
+}
+
+// Extrae el rango lógico [start, end): los huecos del original se rellenan con ceros
+static int extract_range(ContainerReader* r, uint64_t start, uint64_t end, int fd_output) {
+    if (r->sparse.count == 0) return copy_packed(r, start, end - start, fd_output);
+
+    uint64_t pos = start, packedBase = 0;
+    for (uint32_t e = 0; e < r->sparse.count && pos < end; e++) {
+        const PosixExtent* ext = &r->sparse.extents[e];
+        uint64_t extEnd = ext->offset + ext->length;
+        if (extEnd <= pos) {
+            packedBase += ext->length;
+            continue;
+        }
+        if (ext->offset > pos) {
+            uint64_t holeEnd = ext->offset < end ? ext->offset : end;
+            if (write_zeros(fd_output, holeEnd - pos) != 0) return -1;
+            pos = holeEnd;
+            if (pos >= end) break;
+        }
+        uint64_t dataEnd = extEnd < end ? extEnd : end;
+        if (copy_packed(r, packedBase + (pos - ext->offset), dataEnd - pos, fd_output) != 0) return -1;
+        pos = dataEnd;
+        packedBase += ext->length;
+    }
+    // Hueco final
+    return pos < end ? write_zeros(fd_output, end - pos) : 0;
+}
+
+// Salida secuencial del modo tubería: recibe los datos empaquetados en orden, recrea los
+// huecos con ceros y recorta al rango lógico [start, end)
+typedef struct {
+    int fd;
+    const PosixSparseMap* map;
+    uint32_t extent;        // Extensión del mapa que recibe los próximos datos
+    uint64_t consumed;      // Bytes ya emitidos de esa extensión
+    uint64_t logical;       // Siguiente posición lógica
+    uint64_t start, end;
+} StreamOutput;
+
+// Emite [logical, logical + len) recortado al rango; data NULL = ceros
+static int stream_emit(const StreamOutput* o, uint64_t logical, const unsigned char* data, uint64_t len) {
+    if (logical >= o->end) return 0;
+    uint64_t from = logical > o->start ? logical : o->start;
+    uint64_t to = len < o->end - logical ? logical + len : o->end;
+    if (from >= to) return 0;
+    if (!data) return write_zeros(o->fd, to - from);
+    size_t chunk = (size_t)(to - from);
+    return posix_write_full(o->fd, data + (from - logical), chunk) == (ssize_t)chunk ? 0 : -1;
+}
+
+static int stream_packed(StreamOutput* o, const unsigned char* data, size_t len) {
+    if (o->map->count == 0) {
+        int rc = stream_emit(o, o->logical, data, len);
+        o->logical += len;
+        return rc;
+    }
+    while (len > 0) {
+        while (o->extent < o->map->count && o->consumed == o->map->extents[o->extent].length) {
+            o->extent++;
+            o->consumed = 0;
+        }
+        if (o->extent == o->map->count) return -1;     // Más datos de los que describe el mapa
+
+        const PosixExtent* ext = &o->map->extents[o->extent];
+        uint64_t at = ext->offset + o->consumed;
+        if (at > o->logical && stream_emit(o, o->logical, NULL, at - o->logical) != 0) return -1;
+        size_t chunk = ext->length - o->consumed < len ? (size_t)(ext->length - o->consumed) : len;
+        if (stream_emit(o, at, data, chunk) != 0) return -1;
+        o->logical = at + chunk;
+        o->consumed += chunk;
+        data += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+// Lectura de un contenedor que llega por una tubería: las tramas se decodifican en el orden en
+// que llegan y el índice final solo se comprueba. packed = 1 escribe con data_write en una salida
+// con lseek (recrea los huecos); si no, la salida es secuencial y se recorta a [start, end)
+static int extract_stream(ContainerReader* r, int fd_output, int packed, uint64_t start, uint64_t end) {
+    StreamOutput out = { .fd = fd_output, .map = &r->sparse, .start = start, .end = end };
+    int streamed = (r->meta.flags & META_FLAG_STREAMED) != 0;
+    uint64_t pos = 0;
+    uint32_t i = 0;
+
+    if (packed && !streamed) posix_preallocate_map(fd_output, &r->sparse, (off_t)r->dataBytes);
+    while (1) {
+        uint64_t rawLen, storedLen;
+        unsigned char crcBuf[4];
+        if (metadata_read_varint(r->fd, &rawLen) != 0) {
+            fprintf(stderr, "Contenedor truncado en la trama %u\n", i);
+            return -1;
+        }
+        if (rawLen == 0) break;
+        if (rawLen > CONTAINER_BLOCK_SIZE || metadata_read_varint(r->fd, &storedLen) != 0 ||
+            storedLen > stored_bound(r->codec, r->cipher, rawLen) ||
+            posix_read_full(r->fd, crcBuf, 4) != 4 ||
+            posix_read_full(r->fd, r->stored, storedLen) != (ssize_t)storedLen) {
+            fprintf(stderr, "Trama %u inválida o truncada\n", i);
+            return -1;
+        }
+        if (decode_block(r->codec, r->cipher, &r->key, r->rawBlocks, r->stored, storedLen, r->raw, rawLen) != 0) {
+            fprintf(stderr, "Bloque %u corrupto o clave incorrecta\n", i);
+            return -1;
+        }
+        if (crc32c(0, r->raw, rawLen) != (uint32_t)load_le(crcBuf, 4)) {
+            fprintf(stderr, "CRC inválido en el bloque %u\n", i);
+            return -1;
+        }
+        int rc = packed ? (data_write(fd_output, &r->sparse, pos, r->raw, rawLen) == (ssize_t)rawLen ? 0 : -1)
+                        : stream_packed(&out, r->raw, rawLen);
+        if (rc != 0) return -1;
+        pos += rawLen;
+        i++;
+    }
+    if (streamed) {
+        r->meta.originalSize = pos;
+    } else if (pos != r->dataBytes) {
+        fprintf(stderr, "Las tramas no cubren el archivo original\n");
+        return -1;
+    }
+
+    // El índice repite lo ya leído: se descarta y solo se comprueba el pie
+    for (uint64_t skip = (uint64_t)i * CONTAINER_INDEX_ENTRY; skip > 0;) {
+        size_t chunk = skip < CONTAINER_BLOCK_SIZE ? (size_t)skip : CONTAINER_BLOCK_SIZE;
+        if (posix_read_full(r->fd, r->raw, chunk) != (ssize_t)chunk) {
+            fprintf(stderr, "Índice del contenedor truncado\n");
+            return -1;
+        }
+        skip -= chunk;
+    }
+    unsigned char footer[CONTAINER_FOOTER_SIZE];
+    if (posix_read_full(r->fd, footer, sizeof(footer)) != CONTAINER_FOOTER_SIZE ||
+        load_le(footer + 12, 4) != CONTAINER_FOOTER_MAGIC || load_le(footer + 8, 4) != i) {
+        fprintf(stderr, "Pie del contenedor inválido\n");
+        return -1;
+    }
+
+    if (packed) {
+        if ((r->sparse.count > 0 || i == 0) && posix_finish_sparse(fd_output, r->meta.originalSize) != 0) return -1;
+        return 0;
+    }
+    // Hueco final del original (solo archivos dispersos)
+    return r->meta.originalSize > out.logical ? stream_emit(&out, out.logical, NULL, r->meta.originalSize - out.logical) : 0;
+}
+
+int container_extract_file(const char* inputPath, const char* outputPath, const char* key, const ContainerRange* range) {
+    ContainerReader r;
+    if (reader_begin(&r, inputPath, key) != 0) {
+        reader_close(&r);
+        return -1;
+    }
+    // Sin pread (tubería) el contenedor se recorre una sola vez en orden
+    int sequential = posix_is_regular_file(r.fd) != 1;
+    if (!sequential && reader_index(&r) != 0) {
+        reader_close(&r);
+        return -1;
+    }
+
+    // Un origen de tamaño desconocido leído en secuencia no tiene final hasta la última trama
+    uint64_t size = sequential && (r.meta.flags & META_FLAG_STREAMED) ? UINT64_MAX : r.meta.originalSize;
+    uint64_t start = 0, end = size;
+    if (range) {
+        if (range->offset > size) {
+            fprintf(stderr, "El rango empieza después del final del archivo (%llu bytes)\n",
+                    (unsigned long long)size);
+            reader_close(&r);
+            return -1;
+        }
+        start = range->offset;
+        // length 0 = hasta el final; el rango se recorta al tamaño original
+        if (range->length > 0 && range->length < end - start) end = start + range->length;
+    }
+
+    int fd_output = posix_open_write(outputPath);
+    if (fd_output == -1) {
+        reader_close(&r);
+        return -1;
+    }
+    // A una tubería solo se puede escribir en orden: los huecos se envían como ceros
+    int regular = posix_is_regular_file(fd_output) == 1;
+    int packed = !range && regular;
+
+    int rc = 0;
+    if (sequential) {
+        rc = extract_stream(&r, fd_output, packed, start, end);
+    } else if (!packed) {
+        if (regular) posix_preallocate(fd_output, (off_t)(end - start));
+        rc = extract_range(&r, start, end, fd_output);
+    } else {
+        // Archivo completo: cada bloque va a su posición y los huecos se recrean
+        posix_preallocate_map(fd_output, &r.sparse, (off_t)r.dataBytes);
+        for (uint32_t i = 0; i < r.count && rc == 0; i++) {
+            const BlockEntry* b = &r.blocks[i];
+            if (reader_load(&r, i) != 0 ||
+                data_write(fd_output, &r.sparse, b->rawOffset, r.raw, b->rawLen) != (ssize_t)b->rawLen) {
+                rc = -1;
+            }
+        }
+        if (rc == 0 && (r.sparse.count > 0 || r.count == 0) && posix_finish_sparse(fd_output, r.meta.originalSize) != 0) rc = -1;
+    }
+
+    posix_close(fd_output);
+    reader_close(&r);
+    // Un bloque corrupto, una clave incorrecta o un error de escritura no dejan un archivo a medias
+    // con el nombre final
+    if (rc != 0 && regular && !posix_is_stdio(outputPath)) unlink(outputPath);
+    return rc;
+}
+
+ContainerReader* container_open(const char* path, const char* key) {
+    ContainerReader* r = (ContainerReader*)malloc(sizeof(ContainerReader));
+    if (!r) return NULL;
+    if (reader_open(r, path, key) != 0) {
+        reader_close(r);
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+const FileMetadata* container_metadata(const ContainerReader* r) {
+    return &r->meta;
+}
+
+int container_read(ContainerReader* r, uint64_t offset, void* buf, size_t len) {
+    if (r->sparse.count > 0 || offset > r->dataBytes || len > r->dataBytes - offset) {
+        fprintf(stderr, "Lectura fuera del contenedor\n");
+        return -1;
+    }
+    unsigned char* out = (unsigned char*)buf;
+    while (len > 0) {
+        uint32_t i = reader_find(r, offset);
+        if (reader_load(r, i) != 0) return -1;
+        const BlockEntry* b = &r->blocks[i];
+        uint64_t within = offset - b->rawOffset;
+        size_t chunk = b->rawLen - within < len ? (size_t)(b->rawLen - within) : len;
+        memcpy(out, r->raw + within, chunk);
+        out += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+int container_copy(ContainerReader* r, uint64_t offset, uint64_t len, int fd_output) {
+    if (offset > r->meta.originalSize || len > r->meta.originalSize - offset) {
+        fprintf(stderr, "Rango fuera del contenedor\n");
+        return -1;
+    }
+    return extract_range(r, offset, offset + len, fd_output);
+}
+
+void container_close(ContainerReader* r) {
+    if (!r) return;
+    reader_close(r);
+    free(r);
+}
+
+// Verificación en paralelo: cada hilo toma el siguiente bloque libre con un contador compartido
+typedef struct {
+    const ContainerReader* reader;
+    pthread_mutex_t lock;
+    uint32_t next;
+    uint32_t failed;
+} VerifyJob;
+
+static void* verify_worker(void* arg) {
+    VerifyJob* job = (VerifyJob*)arg;
+    const ContainerReader* r = job->reader;
+    unsigned char* stored = (unsigned char*)malloc(stored_bound(r->codec, r->cipher, CONTAINER_BLOCK_SIZE));
+    unsigned char* raw = (unsigned char*)malloc(CONTAINER_BLOCK_SIZE);
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        uint32_t i = job->next++;
+        pthread_mutex_unlock(&job->lock);
+        if (i >= job->reader->count) break;
+
+        if (!stored || !raw || decode_entry(r, i, stored, raw) != 0) {
+            pthread_mutex_lock(&job->lock);
+            job->failed++;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+
+    free(stored);
+    free(raw);
+    return NULL;
+}
+
+int container_verify_file(const char* inputPath, const char* key, int threads) {
+    ContainerReader r;
+    if (reader_open(&r, inputPath, key) != 0) {
+        reader_close(&r);
+        return -1;
+    }
+
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int)cpus : 1;
+    }
+    if ((uint32_t)threads > r.count) threads = r.count > 0 ? (int)r.count : 1;
+
+    VerifyJob job = { .reader = &r, .next = 0, .failed = 0 };
+    pthread_mutex_init(&job.lock, NULL);
+
+    pthread_t* tids = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    int started = 0;
+    for (int t = 0; tids && t < threads; t++) {
+        if (pthread_create(&tids[t], NULL, verify_worker, &job) != 0) break;
+        started++;
+    }
+    // Sin hilos disponibles el hilo actual verifica todo
+    if (started == 0) verify_worker(&job);
+    for (int t = 0; t < started; t++) pthread_join(tids[t], NULL);
+    free(tids);
+    pthread_mutex_destroy(&job.lock);
+
+    int rc = 0;
+    if (job.failed > 0) {
+        fprintf(stderr, "%s: %u de %u bloques dañados\n", inputPath, job.failed, r.count);
+        rc = -1;
+    } else {
+        printf("%s: %u bloques verificados (CRC32C %s, %d hilos)\n", inputPath, r.count,
+               crc32c_implementation(), started > 0 ? started : 1);
+    }
+    reader_close(&r);
+    return rc;
+}
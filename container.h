@@ -0,0 +1,181 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "common.h"
+
+// Contenedor por bloques (META_FLAG_BLOCKED). Cada bloque se comprime y cifra por
+// separado, así que se puede extraer un rango sin procesar el archivo completo.
+//
+//   encabezado (metadata.h) | [mapa de huecos si META_FLAG_SPARSE]
+//   trama*:  rawLen (varint) | storedLen (varint) | crc32c(raw) (u32) | datos (storedLen)
+//   fin:     rawLen = 0 (varint)
+//   índice:  blockCount x { compOffset u64 | rawOffset u64 | storedLen u32 | rawLen u32 | crc u32 }
+//   pie:     indexOffset u64 | blockCount u32 | CONTAINER_FOOTER_MAGIC u32
+//
+// Enteros fijos en little-endian. rawOffset es la posición dentro de los datos empaquetados
+// (sin huecos) y compOffset apunta al inicio de los datos almacenados de la trama.
+//
+// El escritor nunca retrocede, así que la salida puede ser una tubería. Si la entrada también
+// lo es, el tamaño original no se conoce al escribir el encabezado: se marca META_FLAG_STREAMED
+// y el tamaño sale del índice (o de la suma de las tramas al leer en secuencia).
+//
+// Con META_FLAG_RAW_BLOCKS (todo contenedor con compresor desde que existe) un bloque que el
+// compresor no reduce, o cuya muestra ya es aleatoria para Huffman o RLE
+// (autocodec_incompressible), se guarda tal cual: antes del cifrado mide exactamente rawLen, y
+// un bloque comprimido siempre mide menos. Así ningún bloque crece más que lo que agrega el
+// cifrado, y los datos ya comprimidos no pasan por los compresores de orden 0.
+
+#define CONTAINER_BLOCK_SIZE   (1u << 20)    // 1 MiB de datos originales por bloque
+#define CONTAINER_FOOTER_MAGIC 0x58444E49    // "INDX"
+#define CONTAINER_INDEX_ENTRY  28
+#define CONTAINER_FOOTER_SIZE  16
+
+// Origen de datos de container_write: llena buf con hasta cap bytes de los datos que siguen
+// (cap completo salvo al final). Devuelve los bytes escritos, 0 al terminar o -1 en error
+typedef ssize_t (*ContainerSource)(void* opaque, unsigned char* buf, size_t cap);
+
+// Bloque listo para codificar, entregado a un ejecutor externo
+typedef struct ContainerJob ContainerJob;
+
+// Ejecutor externo (p. ej. el pool de directorios): en vez de crear sus propios hilos, el
+// escritor entrega cada bloque a spawn y cualquier hilo del pool lo codifica con
+// container_job_run. El escritor codifica él mismo los bloques que nadie tomó, así que el
+// pool puede estar ocupado sin bloquearlo
+typedef struct {
+    void (*spawn)(void* opaque, ContainerJob* job);
+    void* opaque;
+    int width;                  // Hilos del pool; hay hasta 2 x width bloques en vuelo
+    uint64_t minBlocks;         // Archivos con menos bloques se codifican en línea
+} ContainerExecutor;
+
+// Cómo reparte un escritor la codificación de sus bloques. Se pasa en cada llamada (NULL = un
+// hilo propio por CPU), así que dos contextos de la biblioteca no se pisan la configuración.
+// El ejecutor debe seguir vivo hasta que termine el último escritor que lo usa
+typedef struct {
+    int threads;                        // Hilos propios (0 = uno por CPU); el procesamiento de
+                                        // directorios usa 1 porque ya reparte archivos entre hilos
+    const ContainerExecutor* executor;  // Ejecutor externo, o NULL para usar hilos propios
+} ContainerThreads;
+
+// Lector con acceso aleatorio a un contenedor abierto
+typedef struct ContainerReader ContainerReader;
+
+// Rango lógico del archivo original a extraer
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} ContainerRange;
+
+/**
+ * Comprime y/o cifra un archivo en el contenedor por bloques
+ *
+ * @param inputPath Archivo original, o "-" para leer la entrada estándar hasta EOF
+ * @param outputPath Archivo contenedor a crear, o "-" para la salida estándar
+ * @param codec CODEC_ID_* (CODEC_ID_NONE para solo cifrar)
+ * @param cipher CIPHER_ID_* (CIPHER_ID_NONE para solo comprimir)
+ * @param key Clave de cifrado (ignorada sin cifrado)
+ * @param threads Reparto de la codificación, o NULL para un hilo por CPU
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int container_compress_file(const char* inputPath, const char* outputPath, uint8_t codec, uint8_t cipher, const char* key,
+                            const ContainerThreads* threads);
+
+// Lote de archivos que se comprimen con las mismas etapas, uno tras otro
+typedef struct ContainerBatch ContainerBatch;
+
+/**
+ * Abre un lote: la clave se expande una sola vez y el buffer de bloque se reutiliza entre
+ * archivos. Conviene para muchos archivos pequeños; un lote no se comparte entre hilos
+ * @param threads Reparto de la codificación de cada archivo (se copia), o NULL para un hilo por CPU
+ * @return Lote, o NULL si un algoritmo no está registrado o falta la clave
+ */
+ContainerBatch* container_batch_open(uint8_t codec, uint8_t cipher, const char* key, const ContainerThreads* threads);
+
+/**
+ * Igual que container_compress_file, con las etapas y los recursos del lote
+ * @return 0 si tiene éxito, -1 en caso de error (el lote sigue siendo utilizable)
+ */
+int container_batch_compress(ContainerBatch* batch, const char* inputPath, const char* outputPath);
+
+void container_batch_close(ContainerBatch* batch);
+
+/**
+ * Escribe un contenedor con los datos que entrega source (p. ej. los miembros de un archivo
+ * .mcpa concatenados). Los bloques se codifican en paralelo y se escriben en orden
+ *
+ * @param fd_output Descriptor de salida (puede ser una tubería)
+ * @param meta Encabezado: etapas, nombre y originalSize (o META_FLAG_STREAMED si no se conoce);
+ *             se agrega META_FLAG_BLOCKED
+ * @param key Clave si la cadena incluye un cifrado
+ * @param threads Reparto de la codificación, o NULL para un hilo por CPU
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int container_write(int fd_output, const FileMetadata* meta, ContainerSource source, void* opaque, const char* key,
+                    const ContainerThreads* threads);
+
+/**
+ * Codifica el siguiente bloque pendiente del contenedor (si queda alguno) y suelta el trabajo.
+ * Todo trabajo entregado a spawn debe pasar por container_job_run o container_job_release
+ */
+void container_job_run(ContainerJob* job);
+void container_job_release(ContainerJob* job);
+
+/**
+ * Copia un contenedor cambiando solo el nombre original de su encabezado. Las tramas se copian
+ * tal cual, sin decodificar ni descifrar (no hace falta la clave)
+ *
+ * @param name Ruta cuyo nombre base va al encabezado
+ * @return 0 si tiene éxito, -1 si la entrada no es un contenedor por bloques o falla la copia
+ */
+int container_copy_renamed(const char* inputPath, const char* outputPath, const char* name);
+
+/**
+ * Extrae el archivo original (o solo un rango) de un contenedor por bloques
+ *
+ * @param inputPath Archivo contenedor, o "-": sin acceso aleatorio se decodifica trama a trama
+ * @param outputPath Archivo de salida, o "-" (los huecos se escriben como ceros)
+ * @param key Clave si el contenedor está cifrado
+ * @param range Rango lógico a extraer, o NULL para el archivo completo (con sus huecos)
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int container_extract_file(const char* inputPath, const char* outputPath, const char* key, const ContainerRange* range);
+
+/**
+ * Abre un contenedor para lecturas por posición (solo decodifica los bloques que se piden)
+ * @return Lector, o NULL si el archivo no es un contenedor válido o falta la clave
+ */
+ContainerReader* container_open(const char* path, const char* key);
+
+/**
+ * Encabezado del contenedor (originalSize ya resuelto para META_FLAG_STREAMED)
+ */
+const FileMetadata* container_metadata(const ContainerReader* r);
+
+/**
+ * Copia a memoria len bytes de los datos originales desde offset (contenedores sin huecos)
+ * @return 0 si tiene éxito, -1 si el rango no existe o un bloque está dañado
+ */
+int container_read(ContainerReader* r, uint64_t offset, void* buf, size_t len);
+
+/**
+ * Escribe en fd_output len bytes de los datos originales desde offset
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int container_copy(ContainerReader* r, uint64_t offset, uint64_t len, int fd_output);
+
+void container_close(ContainerReader* r);
+
+/**
+ * Decodifica todos los bloques en paralelo y comprueba sus CRC32C sin escribir salida
+ *
+ * @param inputPath Archivo contenedor (necesita acceso aleatorio)
+ * @param key Clave si el contenedor está cifrado
+ * @param threads Número de hilos (0 = uno por CPU)
+ * @return 0 si todos los bloques son válidos, -1 si hay errores
+ */
+int container_verify_file(const char* inputPath, const char* key, int threads);
+
+#endif
@@ -0,0 +1,306 @@
+#include "dedup.h"
+#include "checksum.h"
+#include "posix_utils.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DEDUP_COMPARE_CHUNK (64 * 1024)
+
+#define HASH_NONE     0         // Tamaño único hasta ahora: no se leyó
+#define HASH_RUNNING  1         // Otro hilo lo está leyendo
+#define HASH_DONE     2
+#define HASH_FAILED   3         // No se pudo leer o cambió de tamaño
+
+#define ENTRY_RUNNING 0
+#define ENTRY_DONE    1
+#define ENTRY_FAILED  2
+
+typedef struct DedupWaiter {
+    void* waiter;
+    struct DedupWaiter* next;
+} DedupWaiter;
+
+struct DedupEntry {
+    struct DedupEntry* next;    // Misma casilla de la tabla por tamaño
+    uint64_t size;
+    uint32_t crc;
+    int hash;                   // HASH_*
+    int state;                  // ENTRY_*
+    DedupWaiter* waiters;
+    const char* output;
+    char path[];                // Seguida de la salida
+};
+
+// Archivo con varios enlaces: su inodo lleva directo al original
+typedef struct DedupInode {
+    uint64_t dev;
+    uint64_t inode;
+    DedupEntry* entry;
+    struct DedupInode* next;
+} DedupInode;
+
+struct Dedup {
+    int dirFd;
+    pthread_mutex_t lock;
+    DedupEntry** sizes;         // Tabla por tamaño con listas encadenadas
+    size_t sizeMask;
+    size_t sizeCount;
+    DedupInode** inodes;
+    size_t inodeMask;
+    size_t inodeCount;
+};
+
+static size_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+// Duplica la tabla cuando tiene tantos elementos como casillas
+static int grow_sizes(Dedup* d) {
+    size_t size = (d->sizeMask + 1) * 2;
+    DedupEntry** slots = (DedupEntry**)calloc(size, sizeof(DedupEntry*));
+    if (!slots) return -1;
+    for (size_t i = 0; i <= d->sizeMask; i++) {
+        DedupEntry* e = d->sizes[i];
+        while (e) {
+            DedupEntry* next = e->next;
+            size_t h = mix64(e->size) & (size - 1);
+            e->next = slots[h];
+            slots[h] = e;
+            e = next;
+        }
+    }
+    free(d->sizes);
+    d->sizes = slots;
+    d->sizeMask = size - 1;
+    return 0;
+}
+
+static int grow_inodes(Dedup* d) {
+    size_t size = (d->inodeMask + 1) * 2;
+    DedupInode** slots = (DedupInode**)calloc(size, sizeof(DedupInode*));
+    if (!slots) return -1;
+    for (size_t i = 0; i <= d->inodeMask; i++) {
+        DedupInode* n = d->inodes[i];
+        while (n) {
+            DedupInode* next = n->next;
+            size_t h = mix64(n->inode ^ n->dev * 0x9e3779b97f4a7c15ULL) & (size - 1);
+            n->next = slots[h];
+            slots[h] = n;
+            n = next;
+        }
+    }
+    free(d->inodes);
+    d->inodes = slots;
+    d->inodeMask = size - 1;
+    return 0;
+}
+
+static DedupEntry* inode_find(Dedup* d, uint64_t dev, uint64_t inode) {
+    size_t h = mix64(inode ^ dev * 0x9e3779b97f4a7c15ULL) & d->inodeMask;
+    for (DedupInode* n = d->inodes[h]; n; n = n->next) {
+        if (n->inode == inode && n->dev == dev) return n->entry;
+    }
+    return NULL;
+}
+
+// Sin memoria el inodo no se registra: el siguiente enlace se compara por contenido
+static void inode_add(Dedup* d, const DedupFile* f, DedupEntry* e) {
+    if (d->inodeCount > d->inodeMask && grow_inodes(d) != 0) return;
+    DedupInode* n = (DedupInode*)malloc(sizeof(DedupInode));
+    if (!n) return;
+    size_t h = mix64(f->inode ^ f->dev * 0x9e3779b97f4a7c15ULL) & d->inodeMask;
+    n->dev = f->dev;
+    n->inode = f->inode;
+    n->entry = e;
+    n->next = d->inodes[h];
+    d->inodes[h] = n;
+    d->inodeCount++;
+}
+
+static DedupEntry* entry_add(Dedup* d, const DedupFile* f, int hashed, uint32_t crc) {
+    if (d->sizeCount > d->sizeMask && grow_sizes(d) != 0) return NULL;
+    size_t pathLen = strlen(f->path) + 1, outputLen = strlen(f->output) + 1;
+    DedupEntry* e = (DedupEntry*)malloc(sizeof(DedupEntry) + pathLen + outputLen);
+    if (!e) return NULL;
+    memcpy(e->path, f->path, pathLen);
+    memcpy(e->path + pathLen, f->output, outputLen);
+    e->output = e->path + pathLen;
+    e->size = f->size;
+    e->crc = crc;
+    e->hash = hashed ? HASH_DONE : HASH_NONE;
+    e->state = ENTRY_RUNNING;
+    e->waiters = NULL;
+    size_t h = mix64(f->size) & d->sizeMask;
+    e->next = d->sizes[h];
+    d->sizes[h] = e;
+    d->sizeCount++;
+    if (f->links > 1) inode_add(d, f, e);
+    return e;
+}
+
+// CRC32C del archivo; falla también si ya no tiene el tamaño del recorrido
+static int file_crc(Dedup* d, const char* path, uint64_t expected, uint32_t* crc) {
+    uint64_t size;
+    if (crc32c_file(d->dirFd, path, &size, crc) != 0) return -1;
+    return size == expected ? 0 : -1;
+}
+
+// 1 si los dos archivos tienen exactamente los mismos bytes
+static int files_equal(Dedup* d, const char* a, const char* b, uint64_t size) {
+    int fa = openat(d->dirFd, a, O_RDONLY | O_CLOEXEC);
+    int fb = fa >= 0 ? openat(d->dirFd, b, O_RDONLY | O_CLOEXEC) : -1;
+    unsigned char* buf = fb >= 0 ? (unsigned char*)malloc(2 * DEDUP_COMPARE_CHUNK) : NULL;
+    int same = buf != NULL;
+    uint64_t left = size;
+    while (same && left > 0) {
+        size_t n = left < DEDUP_COMPARE_CHUNK ? (size_t)left : DEDUP_COMPARE_CHUNK;
+        same = posix_read_full(fa, buf, n) == (ssize_t)n && posix_read_full(fb, buf + DEDUP_COMPARE_CHUNK, n) == (ssize_t)n &&
+               memcmp(buf, buf + DEDUP_COMPARE_CHUNK, n) == 0;
+        left -= n;
+    }
+    free(buf);
+    if (fb >= 0) close(fb);
+    if (fa >= 0) close(fa);
+    return same;
+}
+
+Dedup* dedup_new(int dirFd) {
+    Dedup* d = (Dedup*)calloc(1, sizeof(Dedup));
+    if (!d) return NULL;
+    d->dirFd = dirFd;
+    d->sizeMask = 255;
+    d->inodeMask = 63;
+    d->sizes = (DedupEntry**)calloc(d->sizeMask + 1, sizeof(DedupEntry*));
+    d->inodes = (DedupInode**)calloc(d->inodeMask + 1, sizeof(DedupInode*));
+    if (!d->sizes || !d->inodes) {
+        free(d->sizes);
+        free(d->inodes);
+        free(d);
+        return NULL;
+    }
+    pthread_mutex_init(&d->lock, NULL);
+    return d;
+}
+
+// Las lecturas se hacen sin el candado; después se vuelve a mirar la tabla, que pudo cambiar.
+// Si dos hilos registran a la vez el mismo contenido quedan dos originales: solo se pierde ahorro
+int dedup_lookup(Dedup* d, const DedupFile* f, DedupEntry** entry) {
+    uint32_t crc = 0;
+    int hashed = 0;
+    *entry = NULL;
+    pthread_mutex_lock(&d->lock);
+    DedupEntry* e = f->links > 1 ? inode_find(d, f->dev, f->inode) : NULL;
+    while (!e) {
+        DedupEntry* pending = NULL;     // Del mismo tamaño y todavía sin CRC
+        DedupEntry* match = NULL;
+        int sameSize = 0;
+        for (DedupEntry* c = d->sizes[mix64(f->size) & d->sizeMask]; c; c = c->next) {
+            if (c->size != f->size) continue;
+            sameSize = 1;
+            if (c->hash == HASH_NONE && !pending) pending = c;
+            if (hashed && c->hash == HASH_DONE && c->crc == crc && c->state != ENTRY_FAILED && !match) match = c;
+        }
+        if (!sameSize) break;
+        if (!hashed) {
+            pthread_mutex_unlock(&d->lock);
+            if (file_crc(d, f->path, f->size, &crc) != 0) return DEDUP_UNIQUE;
+            hashed = 1;
+            pthread_mutex_lock(&d->lock);
+            continue;
+        }
+        if (match) {
+            // Mismo CRC: se confirma byte a byte antes de reutilizar la salida
+            pthread_mutex_unlock(&d->lock);
+            int same = files_equal(d, f->path, match->path, f->size);
+            pthread_mutex_lock(&d->lock);
+            if (same) e = match;
+            break;
+        }
+        if (!pending) break;
+        pending->hash = HASH_RUNNING;
+        pthread_mutex_unlock(&d->lock);
+        uint32_t pendingCrc = 0;
+        int ok = file_crc(d, pending->path, pending->size, &pendingCrc) == 0;
+        pthread_mutex_lock(&d->lock);
+        pending->crc = pendingCrc;
+        pending->hash = ok ? HASH_DONE : HASH_FAILED;
+    }
+    if (e) {
+        if (f->links > 1 && !inode_find(d, f->dev, f->inode)) inode_add(d, f, e);
+        *entry = e;
+        pthread_mutex_unlock(&d->lock);
+        return DEDUP_DUPLICATE;
+    }
+    *entry = entry_add(d, f, hashed, crc);
+    pthread_mutex_unlock(&d->lock);
+    return DEDUP_UNIQUE;
+}
+
+int dedup_wait(Dedup* d, DedupEntry* e, void* waiter) {
+    pthread_mutex_lock(&d->lock);
+    int rc = e->state == ENTRY_DONE ? 0 : -1;
+    if (e->state == ENTRY_RUNNING) {
+        DedupWaiter* w = (DedupWaiter*)malloc(sizeof(DedupWaiter));
+        if (w) {
+            w->waiter = waiter;
+            w->next = e->waiters;
+            e->waiters = w;
+            rc = 1;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+    return rc;
+}
+
+void dedup_finish(Dedup* d, DedupEntry* e, int ok, void (*fn)(void* opaque, void* waiter, const DedupEntry* e, int ok),
+                  void* opaque) {
+    pthread_mutex_lock(&d->lock);
+    e->state = ok ? ENTRY_DONE : ENTRY_FAILED;
+    DedupWaiter* w = e->waiters;
+    e->waiters = NULL;
+    pthread_mutex_unlock(&d->lock);
+    while (w) {
+        DedupWaiter* next = w->next;
+        fn(opaque, w->waiter, e, ok);
+        free(w);
+        w = next;
+    }
+}
+
+const char* dedup_path(const DedupEntry* e) {
+    return e->path;
+}
+
+const char* dedup_output(const DedupEntry* e) {
+    return e->output;
+}
+
+void dedup_free(Dedup* d) {
+    if (!d) return;
+    for (size_t i = 0; i <= d->sizeMask; i++) {
+        DedupEntry* e = d->sizes[i];
+        while (e) {
+            DedupEntry* next = e->next;
+            free(e);
+            e = next;
+        }
+    }
+    for (size_t i = 0; i <= d->inodeMask; i++) {
+        DedupInode* n = d->inodes[i];
+        while (n) {
+            DedupInode* next = n->next;
+            free(n);
+            n = next;
+        }
+    }
+    free(d->sizes);
+    free(d->inodes);
+    pthread_mutex_destroy(&d->lock);
+    free(d);
+}
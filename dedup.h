@@ -0,0 +1,72 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+
+// Archivos repetidos de un trabajo de directorio. Cada contenido distinto se procesa una sola
+// vez; los demás archivos con el mismo contenido reciben un enlace a esa salida.
+//
+// - Un archivo con más de un enlace (st_nlink > 1) se reconoce por dispositivo e inodo, sin leerlo.
+// - Si no, se agrupa por tamaño: mientras su tamaño sea único no se lee. Cuando aparece otro del
+//   mismo tamaño se calcula el CRC32C de ambos y, si coinciden, se comparan byte a byte.
+//
+// Los archivos llegan en cualquier orden y desde varios hilos. El primero de cada contenido es el
+// original: quien lo procesa llama a dedup_finish al terminar. Un duplicado que llega antes queda
+// en espera y se le entrega a quien llama a dedup_finish.
+
+typedef struct Dedup Dedup;
+
+// Contenido ya visto (el original y su salida)
+typedef struct DedupEntry DedupEntry;
+
+#define DEDUP_UNIQUE     0      // Procesar el archivo (y llamar a dedup_finish si hay entrada)
+#define DEDUP_DUPLICATE  1      // Mismo contenido que la entrada devuelta: ver dedup_wait
+
+typedef struct {
+    const char* path;           // Relativa a dirFd
+    const char* output;         // Salida, relativa a la carpeta de salida
+    uint64_t size;
+    uint64_t dev;
+    uint64_t inode;
+    uint32_t links;             // st_nlink
+} DedupFile;
+
+/**
+ * Crea la tabla de un trabajo
+ * @param dirFd Directorio de entrada; las rutas de DedupFile son relativas a él
+ * @return Tabla, o NULL si falta memoria
+ */
+Dedup* dedup_new(int dirFd);
+
+/**
+ * Busca un archivo con el mismo contenido que f. Puede leer f y el original (fuera del candado)
+ * @param entry DEDUP_UNIQUE: entrada nueva con f como original (NULL si no se pudo registrar);
+ *              DEDUP_DUPLICATE: entrada del original
+ * @return DEDUP_UNIQUE o DEDUP_DUPLICATE
+ */
+int dedup_lookup(Dedup* d, const DedupFile* f, DedupEntry** entry);
+
+/**
+ * Deja un duplicado esperando a su original, si todavía se está procesando
+ * @param waiter Dato del llamador que recibe el callback de dedup_finish
+ * @return 1 si queda en espera, 0 si la salida del original ya está lista,
+ *         -1 si el original falló (el duplicado se procesa por su cuenta)
+ */
+int dedup_wait(Dedup* d, DedupEntry* e, void* waiter);
+
+/**
+ * Marca el original como terminado y entrega cada duplicado en espera a fn
+ * @param ok 1 si la salida del original quedó escrita
+ */
+void dedup_finish(Dedup* d, DedupEntry* e, int ok, void (*fn)(void* opaque, void* waiter, const DedupEntry* e, int ok),
+                  void* opaque);
+
+/**
+ * Rutas del original: entrada (relativa a dirFd) y salida (relativa a la carpeta de salida)
+ */
+const char* dedup_path(const DedupEntry* e);
+const char* dedup_output(const DedupEntry* e);
+
+void dedup_free(Dedup* d);
+
+#endif
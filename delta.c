@@ -0,0 +1,429 @@
+#include "delta.h"
+#include "checksum.h"
+#include "container.h"
+#include "metadata.h"
+#include "posix_utils.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DELTA_WINDOW      (1024 * 1024)     // Ventana del archivo nuevo
+#define DELTA_MAX_INSERT  (64 * 1024)       // Inserción más larga en una sola operación
+#define DELTA_HASH_MUL    0x01000193u
+#define DELTA_NONE        UINT64_MAX
+
+// Base proyectada en memoria: las copias la leen en cualquier orden
+typedef struct {
+    int fd;
+    const unsigned char* data;
+    uint64_t size;
+    uint32_t crc;
+} DeltaBase;
+
+// Bloque de la base en la tabla; block = índice + 1 (0 = casilla vacía)
+typedef struct {
+    uint32_t hash;
+    uint32_t block;
+} DeltaSlot;
+
+typedef struct {
+    DeltaBase base;
+    size_t block;               // Tamaño de los bloques indexados
+    uint32_t outFactor;         // DELTA_HASH_MUL^block: quita el byte que sale de la ventana
+    DeltaSlot* slots;
+    size_t mask;
+    int fd;                     // Archivo nuevo
+    unsigned char* window;
+    size_t len;                 // Bytes en window
+    size_t pos;                 // Posición del recorrido
+    size_t lit;                 // Inicio de la inserción pendiente (lit <= pos)
+    int eof;
+    int finished;               // Ya se escribió el fin del flujo
+    int hashed;                 // hash corresponde a window[pos, pos + block)
+    uint32_t hash;
+    uint64_t copyOff;           // Copia pendiente: se une con la siguiente si es contigua
+    uint64_t copyLen;
+    uint64_t size;              // Del archivo nuevo, a medida que se lee
+    uint32_t crc;
+    unsigned char out[DELTA_MAX_INSERT + 128];
+    size_t outLen;
+    size_t outPos;
+} DeltaEncoder;
+
+static void store_le(unsigned char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static int base_open(const char* path, DeltaBase* b) {
+    struct stat st;
+    b->data = NULL;
+    b->size = 0;
+    b->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (b->fd < 0 || fstat(b->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "No se puede leer la base %s\n", path);
+        if (b->fd >= 0) close(b->fd);
+        return -1;
+    }
+    b->size = (uint64_t)st.st_size;
+    if (b->size > 0) {
+        void* p = mmap(NULL, (size_t)b->size, PROT_READ, MAP_PRIVATE, b->fd, 0);
+        if (p == MAP_FAILED) {
+            perror("Error al proyectar la base");
+            close(b->fd);
+            return -1;
+        }
+        b->data = (const unsigned char*)p;
+    }
+    b->crc = b->size > 0 ? crc32c(0, b->data, (size_t)b->size) : 0;
+    return 0;
+}
+
+static void base_close(DeltaBase* b) {
+    if (b->data) munmap((void*)b->data, (size_t)b->size);
+    close(b->fd);
+}
+
+static uint32_t hash_block(const unsigned char* p, size_t len) {
+    uint32_t h = 0;
+    for (size_t i = 0; i < len; i++) h = h * DELTA_HASH_MUL + p[i];
+    return h;
+}
+
+static size_t slot_of(uint32_t h, size_t mask) {
+    return (size_t)((h * 0x9e3779b97f4a7c15ULL) >> 32) & mask;
+}
+
+// Indexa los bloques alineados de la base. Con hashes repetidos queda el primero: los bloques
+// iguales (p. ej. de ceros) ocupan una sola casilla
+static int index_base(DeltaEncoder* e) {
+    e->block = DELTA_MIN_BLOCK;
+    while (e->base.size / e->block > DELTA_MAX_BLOCKS && e->block < DELTA_WINDOW / 4) e->block *= 2;
+    e->outFactor = 1;
+    for (size_t i = 0; i < e->block; i++) e->outFactor *= DELTA_HASH_MUL;
+
+    size_t count = (size_t)(e->base.size / e->block);
+    size_t size = 1;
+    while (size < 2 * count) size *= 2;
+    if (!(e->slots = (DeltaSlot*)calloc(size, sizeof(DeltaSlot)))) return -1;
+    e->mask = size - 1;
+    for (size_t k = 0; k < count; k++) {
+        uint32_t h = hash_block(e->base.data + k * e->block, e->block);
+        size_t i = slot_of(h, e->mask);
+        while (e->slots[i].block != 0 && e->slots[i].hash != h) i = (i + 1) & e->mask;
+        if (e->slots[i].block != 0) continue;
+        e->slots[i].hash = h;
+        e->slots[i].block = (uint32_t)k + 1;
+    }
+    return 0;
+}
+
+// Offset en la base de un bloque igual a p, o DELTA_NONE
+static uint64_t lookup(const DeltaEncoder* e, uint32_t h, const unsigned char* p) {
+    for (size_t i = slot_of(h, e->mask); e->slots[i].block != 0; i = (i + 1) & e->mask) {
+        if (e->slots[i].hash != h) continue;
+        uint64_t off = (uint64_t)(e->slots[i].block - 1) * e->block;
+        return memcmp(e->base.data + off, p, e->block) == 0 ? off : DELTA_NONE;
+    }
+    return DELTA_NONE;
+}
+
+static void put_varint(DeltaEncoder* e, uint64_t v) {
+    e->outLen += metadata_put_varint(e->out + e->outLen, v);
+}
+
+static void flush_copy(DeltaEncoder* e) {
+    if (e->copyLen == 0) return;
+    put_varint(e, e->copyLen << 1 | 1);
+    put_varint(e, e->copyOff);
+    e->copyLen = 0;
+}
+
+static void emit_copy(DeltaEncoder* e, uint64_t off, uint64_t len) {
+    if (e->copyLen > 0 && e->copyOff + e->copyLen == off) {
+        e->copyLen += len;
+        return;
+    }
+    flush_copy(e);
+    e->copyOff = off;
+    e->copyLen = len;
+}
+
+// Inserta len bytes desde el inicio de la inserción pendiente (len <= DELTA_MAX_INSERT)
+static void emit_insert(DeltaEncoder* e, size_t len) {
+    flush_copy(e);
+    put_varint(e, (uint64_t)len << 1);
+    memcpy(e->out + e->outLen, e->window + e->lit, len);
+    e->outLen += len;
+    e->lit += len;
+}
+
+// Descarta lo ya recorrido y lee más. La inserción pendiente se emite antes, así que la ventana
+// nunca tiene que conservar datos ya recorridos
+static int refill(DeltaEncoder* e) {
+    if (e->lit < e->pos) {
+        emit_insert(e, e->pos - e->lit);
+        return 0;
+    }
+    memmove(e->window, e->window + e->pos, e->len - e->pos);
+    e->len -= e->pos;
+    e->pos = e->lit = 0;
+    e->hashed = 0;
+    ssize_t n = posix_read_full(e->fd, e->window + e->len, DELTA_WINDOW - e->len);
+    if (n < 0) return -1;
+    e->crc = crc32c(e->crc, e->window + e->len, (size_t)n);
+    e->size += (uint64_t)n;
+    if ((size_t)n < DELTA_WINDOW - e->len) e->eof = 1;
+    e->len += (size_t)n;
+    return 0;
+}
+
+// Avanza el recorrido hasta producir salida (o extender la copia pendiente). Cada paso agrega a
+// out como mucho una inserción y dos copias, así que out nunca se desborda
+static int delta_step(DeltaEncoder* e) {
+    const unsigned char* base = e->base.data;
+    // La copia anterior llegó al final de la ventana: se sigue comparando sin buscar en la tabla
+    if (e->copyLen > 0 && e->lit == e->pos && e->pos < e->len) {
+        uint64_t from = e->copyOff + e->copyLen;
+        size_t n = 0;
+        while (e->pos + n < e->len && from + n < e->base.size && e->window[e->pos + n] == base[from + n]) n++;
+        if (n > 0) {
+            e->copyLen += n;
+            e->pos += n;
+            e->lit = e->pos;
+            e->hashed = 0;
+            return 0;
+        }
+    }
+    if (e->pos - e->lit >= DELTA_MAX_INSERT) {
+        emit_insert(e, DELTA_MAX_INSERT);
+        return 0;
+    }
+    if (e->len - e->pos < e->block) {
+        if (!e->eof) return refill(e);
+        // Cola más corta que un bloque: se inserta y se cierra el flujo
+        e->pos = e->len;
+        if (e->lit < e->len) {
+            size_t n = e->len - e->lit;
+            emit_insert(e, n < DELTA_MAX_INSERT ? n : DELTA_MAX_INSERT);
+            return 0;
+        }
+        flush_copy(e);
+        put_varint(e, 0);
+        put_varint(e, e->size);
+        store_le(e->out + e->outLen, e->crc, 4);
+        e->outLen += 4;
+        e->finished = 1;
+        return 0;
+    }
+
+    if (!e->hashed) {
+        e->hash = hash_block(e->window + e->pos, e->block);
+        e->hashed = 1;
+    }
+    size_t limit = e->lit + DELTA_MAX_INSERT;
+    while (1) {
+        uint64_t off = lookup(e, e->hash, e->window + e->pos);
+        if (off != DELTA_NONE) {
+            // La coincidencia se extiende hacia atrás (dentro de la inserción pendiente) y hacia adelante
+            size_t back = 0;
+            while (e->pos - back > e->lit && off > back && e->window[e->pos - back - 1] == base[off - back - 1]) back++;
+            size_t len = e->block;
+            while (e->pos + len < e->len && off + len < e->base.size && e->window[e->pos + len] == base[off + len]) len++;
+            e->pos -= back;
+            if (e->pos > e->lit) emit_insert(e, e->pos - e->lit);
+            emit_copy(e, off - back, back + len);
+            e->pos += back + len;
+            e->lit = e->pos;
+            e->hashed = 0;
+            return 0;
+        }
+        if (e->pos + e->block >= e->len || e->pos + 1 >= limit) {
+            e->pos++;
+            e->hashed = 0;
+            return 0;
+        }
+        e->hash = e->hash * DELTA_HASH_MUL + e->window[e->pos + e->block] - e->outFactor * e->window[e->pos];
+        e->pos++;
+    }
+}
+
+// Origen de container_write: el flujo del delta, generado a medida que se piden bloques
+static ssize_t delta_source(void* opaque, unsigned char* buf, size_t cap) {
+    DeltaEncoder* e = (DeltaEncoder*)opaque;
+    size_t n = 0;
+    while (n < cap) {
+        if (e->outPos == e->outLen) {
+            if (e->finished) break;
+            e->outPos = e->outLen = 0;
+            if (delta_step(e) != 0) return -1;
+            continue;
+        }
+        size_t take = e->outLen - e->outPos < cap - n ? e->outLen - e->outPos : cap - n;
+        memcpy(buf + n, e->out + e->outPos, take);
+        e->outPos += take;
+        n += take;
+    }
+    return (ssize_t)n;
+}
+
+int delta_encode_file(const char* basePath, const char* inputPath, const char* outputPath, uint8_t codec,
+                      uint8_t cipher, const char* key, const ContainerThreads* threads) {
+    DeltaEncoder* e = (DeltaEncoder*)calloc(1, sizeof(DeltaEncoder));
+    if (!e) return -1;
+    if (base_open(basePath, &e->base) != 0) {
+        free(e);
+        return -1;
+    }
+    int rc = -1, fd_output = -1;
+    e->fd = posix_open_read(inputPath);
+    if (e->fd == -1) goto done;
+    if (index_base(e) != 0 || !(e->window = (unsigned char*)malloc(DELTA_WINDOW))) {
+        fprintf(stderr, "Falló asignación de memoria para el delta de %s\n", inputPath);
+        goto done;
+    }
+    put_varint(e, e->base.size);
+    store_le(e->out + e->outLen, e->base.crc, 4);
+    e->outLen += 4;
+
+    fd_output = posix_open_write(outputPath);
+    if (fd_output == -1) goto done;
+    FileMetadata meta;
+    metadata_init(&meta, inputPath, 0, codec, cipher);
+    meta.flags = META_FLAG_DELTA | META_FLAG_STREAMED;
+    rc = container_write(fd_output, &meta, delta_source, e, key, threads);
+
+done:
+    if (fd_output >= 0 && posix_close(fd_output) != 0) rc = -1;
+    if (e->fd >= 0) posix_close_input(e->fd);
+    base_close(&e->base);
+    free(e->window);
+    free(e->slots);
+    free(e);
+    return rc;
+}
+
+// Lectura en orden del flujo de un delta, a través del lector del contenedor
+typedef struct {
+    ContainerReader* r;
+    uint64_t pos;               // Siguiente posición del flujo a pedir
+    uint64_t size;
+    unsigned char buf[64 * 1024];
+    size_t len;
+    size_t at;
+} DeltaReader;
+
+static int reader_fill(DeltaReader* d) {
+    size_t n = d->size - d->pos < sizeof(d->buf) ? (size_t)(d->size - d->pos) : sizeof(d->buf);
+    if (n == 0 || container_read(d->r, d->pos, d->buf, n) != 0) return -1;
+    d->pos += n;
+    d->len = n;
+    d->at = 0;
+    return 0;
+}
+
+static int reader_varint(DeltaReader* d, uint64_t* v) {
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (d->at == d->len && reader_fill(d) != 0) return -1;
+        unsigned char c = d->buf[d->at++];
+        *v |= (uint64_t)(c & 0x7F) << shift;
+        if (!(c & 0x80)) return 0;
+    }
+    return -1;
+}
+
+static int reader_u32(DeltaReader* d, uint32_t* v) {
+    *v = 0;
+    for (int i = 0; i < 4; i++) {
+        if (d->at == d->len && reader_fill(d) != 0) return -1;
+        *v |= (uint32_t)d->buf[d->at++] << (8 * i);
+    }
+    return 0;
+}
+
+// Copia len bytes del flujo a la salida
+static int reader_copy(DeltaReader* d, uint64_t len, int fd_output, uint32_t* crc) {
+    while (len > 0) {
+        if (d->at == d->len && reader_fill(d) != 0) return -1;
+        size_t n = d->len - d->at < len ? d->len - d->at : (size_t)len;
+        *crc = crc32c(*crc, d->buf + d->at, n);
+        if (posix_write_full(fd_output, d->buf + d->at, n) != (ssize_t)n) return -1;
+        d->at += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Recorre las operaciones del delta y escribe el resultado
+static int apply_ops(DeltaReader* d, const DeltaBase* base, int fd_output) {
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    while (1) {
+        uint64_t tag, off;
+        if (reader_varint(d, &tag) != 0) return -1;
+        if (tag == 0) break;
+        uint64_t len = tag >> 1;
+        if (tag & 1) {
+            if (reader_varint(d, &off) != 0 || off > base->size || len > base->size - off) return -1;
+            crc = crc32c(crc, base->data + off, (size_t)len);
+            if (posix_write_full(fd_output, base->data + off, (size_t)len) != (ssize_t)len) return -1;
+        } else if (reader_copy(d, len, fd_output, &crc) != 0) {
+            return -1;
+        }
+        total += len;
+    }
+    uint64_t size;
+    uint32_t expected;
+    if (reader_varint(d, &size) != 0 || reader_u32(d, &expected) != 0) return -1;
+    return size == total && expected == crc ? 0 : -1;
+}
+
+int delta_apply_file(const char* basePath, const char* inputPath, const char* outputPath, const char* key) {
+    ContainerReader* r = container_open(inputPath, key);
+    if (!r) return -1;
+    const FileMetadata* meta = container_metadata(r);
+    if (!(meta->flags & META_FLAG_DELTA)) {
+        fprintf(stderr, "%s no es un delta\n", inputPath);
+        container_close(r);
+        return -1;
+    }
+    DeltaBase base;
+    if (base_open(basePath, &base) != 0) {
+        container_close(r);
+        return -1;
+    }
+    DeltaReader* d = (DeltaReader*)malloc(sizeof(DeltaReader));
+    int rc = -1, fd_output = -1;
+    uint64_t baseSize;
+    uint32_t baseCrc;
+    if (!d) goto done;
+    d->r = r;
+    d->pos = 0;
+    d->size = meta->originalSize;
+    d->len = d->at = 0;
+    if (reader_varint(d, &baseSize) != 0 || reader_u32(d, &baseCrc) != 0) {
+        fprintf(stderr, "Delta dañado: %s\n", inputPath);
+        goto done;
+    }
+    if (baseSize != base.size || baseCrc != base.crc) {
+        fprintf(stderr, "%s no es la base con la que se creó %s\n", basePath, inputPath);
+        goto done;
+    }
+    fd_output = posix_open_write(outputPath);
+    if (fd_output == -1) goto done;
+    rc = apply_ops(d, &base, fd_output);
+    if (rc != 0) fprintf(stderr, "No se pudo aplicar el delta %s (dañado o error de escritura)\n", inputPath);
+
+done:
+    if (fd_output >= 0 && posix_close(fd_output) != 0) rc = -1;
+    free(d);
+    base_close(&base);
+    container_close(r);
+    return rc;
+}
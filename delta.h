@@ -0,0 +1,41 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include "container.h"
+
+// Delta contra una versión anterior del archivo (--delta-base). Se indexan los bloques alineados
+// de la base con un hash rodante y se recorre el archivo nuevo buscando esos bloques: lo que
+// coincide se extiende hacia los dos lados y se guarda como copia, lo demás como inserción. El
+// flujo resultante pasa por el compresor y el cifrado dentro del contenedor por bloques
+// (META_FLAG_BLOCKED | META_FLAG_DELTA | META_FLAG_STREAMED).
+//
+//   inicio:   baseSize (varint) | crc32c(base) u32
+//   copia:    (len << 1) | 1 (varint) | offset en la base (varint)
+//   inserción: len << 1 (varint) | len bytes
+//   fin:      0 (varint) | tamaño del resultado (varint) | crc32c del resultado u32
+//
+// Al aplicar se exige la misma base (tamaño y CRC32C); con otra se rechaza en lugar de producir
+// un archivo equivocado.
+
+#define DELTA_MIN_BLOCK   32            // Bloque indexado de la base
+#define DELTA_MAX_BLOCKS  (1u << 20)    // Con bases grandes se agranda el bloque para no pasar de aquí
+
+/**
+ * Escribe inputPath como delta de basePath en un contenedor con las etapas indicadas
+ * @param codec CODEC_ID_* (CODEC_ID_NONE para solo cifrar)
+ * @param cipher CIPHER_ID_* (CIPHER_ID_NONE para solo comprimir)
+ * @param key Clave si hay cifrado
+ * @param threads Reparto de la codificación, o NULL para un hilo por CPU
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int delta_encode_file(const char* basePath, const char* inputPath, const char* outputPath, uint8_t codec,
+                      uint8_t cipher, const char* key, const ContainerThreads* threads);
+
+/**
+ * Reconstruye el archivo a partir de basePath y el delta de inputPath
+ * @return 0 si tiene éxito, -1 si la base no corresponde, el delta está dañado o falla la escritura
+ */
+int delta_apply_file(const char* basePath, const char* inputPath, const char* outputPath, const char* key);
+
+#endif
@@ -11,6 +11,9 @@
 #include "lzw.h"
 #include "aes.h"
 #include "common.h"
+#include "mcpf.h"
+#include "registry.h"
+#include "autocodec.h"
 #include "OperationsFileManager/multiFeature.h" 
 
 // Mensaje de ayuda en la consola para el uso del programa
@@ -25,11 +28,34 @@ static void usage(const char* prog) {
         "  -ce   Comprimir y luego encriptar\n"
         "  -ud   Desencriptar y luego descomprimir (inverso de -ce)\n\n"
         "Opciones:\n"
-    "  --comp-alg [nombre]   Algoritmo de compresión (huffman, rle, lzw)\n"
+    "  --comp-alg [nombre]   Algoritmo de compresión (huffman, rle, lzw, lzss con sus\n"
+        "                        niveles lzss-fast y lzss-max; cadenas como rle+huffman,\n"
+        "                        lzw+huffman o lzss+huffman; store para no comprimir, o auto\n"
+        "                        para elegirlo por archivo según una muestra de su contenido)\n"
         "  --enc-alg  [nombre]   Algoritmo de encriptación (vigenere, aes)\n"
-        "  -i [ruta]             Archivo de entrada\n"
-        "  -o [ruta]             Archivo de salida\n"
-        "  -k [clave]            Clave para encriptar/desencriptar\n\n",
+        "  -i [ruta]             Archivo de entrada (\"-\" = entrada estándar)\n"
+        "  -o [ruta]             Archivo de salida (\"-\" = salida estándar, por defecto\n"
+        "                        con -i -; solo formato por bloques)\n"
+        "  -k [clave]            Clave para encriptar/desencriptar\n"
+        "  --range [ini:largo]   Con -d/-u/-ud: extraer solo ese rango de bytes del original\n"
+        "                        (largo 0 = hasta el final; requiere el formato por bloques)\n"
+        "  --verify              Verificar los CRC32C de todos los bloques de -i en paralelo,\n"
+        "                        sin escribir salida (-k si está cifrado)\n"
+        "  --archive             Con -c/-ce y un directorio: empaquetar todo el árbol en un\n"
+        "                        solo archivo .mcpa (-d/-u/-ud lo detectan y lo extraen)\n"
+        "  --list                Listar el contenido de un archivo .mcpa sin extraerlo\n"
+        "  --member [ruta]       Con -d/-u/-ud: extraer solo ese archivo de un .mcpa\n"
+        "  --incremental         Con -c/-e/-ce y un directorio: procesar solo lo nuevo o\n"
+        "                        modificado desde la corrida anterior (manifiesto en la\n"
+        "                        carpeta de salida) y borrar las salidas de lo eliminado\n"
+        "  --no-dedup            Con -c/-e/-ce y un directorio: procesar también los archivos\n"
+        "                        repetidos (por defecto su salida es un enlace a la del primero)\n"
+        "  --chunk-store [dir]   Con -c/-e/-ce: cortar cada archivo en fragmentos por contenido y\n"
+        "                        guardar en dir solo los fragmentos nuevos; la salida es una receta.\n"
+        "                        Con -d/-u/-ud: almacén del que se leen las recetas\n"
+        "  --delta-base [ruta]   Con -c/-e/-ce: guardar solo las diferencias con la versión\n"
+        "                        anterior del archivo (o de cada archivo, con directorios: se\n"
+        "                        emparejan por ruta relativa). Con -d/-u/-ud: esa misma versión\n\n",
         prog);
 }
 // Verificar si la ruta es un directorio
@@ -39,6 +65,20 @@ static bool is_dir(const char* path) {
     return S_ISDIR(st.st_mode);
 }
 
+// Interpreta "inicio:largo" (decimal o 0x hexadecimal)
+static int parse_range(const char* text, uint64_t* offset, uint64_t* length) {
+    char* end;
+    errno = 0;
+    unsigned long long off = strtoull(text, &end, 0);
+    if (errno != 0 || end == text || *end != ':' || text[0] == '-') return -1;
+    const char* lenText = end + 1;
+    unsigned long long len = strtoull(lenText, &end, 0);
+    if (errno != 0 || end == lenText || *end != '\0' || lenText[0] == '-') return -1;
+    *offset = off;
+    *length = len;
+    return 0;
+}
+
 // ejemplo de uso: ./app -c --comp-alg huffman -i File_Manager/input.txt -o salida.bin
 
 int main(int argc, char** argv) {
@@ -48,6 +88,13 @@ int main(int argc, char** argv) {
     char* inPath = NULL;
     char* outPath = NULL;
     char* key = NULL;
+    bool hasRange = false;
+    bool verify = false;
+    bool archive = false, list = false, incremental = false, dedup = true;
+    char* member = NULL;
+    char* chunkStore = NULL;
+    char* deltaBase = NULL;
+    uint64_t rangeOffset = 0, rangeLength = 0;
 
     if (argc <= 1) {
         usage(argv[0]);
@@ -63,6 +110,32 @@ int main(int argc, char** argv) {
             } else if (strcmp(arg, "--enc-alg") == 0) {
                 if (i + 1 >= argc) { fprintf(stderr, "Falta valor para --enc-alg\n"); return 1; }
                 encAlg = argv[++i];
+            } else if (strcmp(arg, "--range") == 0) {
+                if (i + 1 >= argc) { fprintf(stderr, "Falta valor para --range\n"); return 1; }
+                if (parse_range(argv[++i], &rangeOffset, &rangeLength) != 0) {
+                    fprintf(stderr, "Rango inválido: %s (use inicio:largo)\n", argv[i]);
+                    return 1;
+                }
+                hasRange = true;
+            } else if (strcmp(arg, "--verify") == 0) {
+                verify = true;
+            } else if (strcmp(arg, "--archive") == 0) {
+                archive = true;
+            } else if (strcmp(arg, "--incremental") == 0) {
+                incremental = true;
+            } else if (strcmp(arg, "--no-dedup") == 0) {
+                dedup = false;
+            } else if (strcmp(arg, "--chunk-store") == 0) {
+                if (i + 1 >= argc) { fprintf(stderr, "Falta carpeta para --chunk-store\n"); return 1; }
+                chunkStore = argv[++i];
+            } else if (strcmp(arg, "--delta-base") == 0) {
+                if (i + 1 >= argc) { fprintf(stderr, "Falta ruta para --delta-base\n"); return 1; }
+                deltaBase = argv[++i];
+            } else if (strcmp(arg, "--list") == 0) {
+                list = true;
+            } else if (strcmp(arg, "--member") == 0) {
+                if (i + 1 >= argc) { fprintf(stderr, "Falta ruta para --member\n"); return 1; }
+                member = argv[++i];
             } else if (strcmp(arg, "--help") == 0) {
                 usage(argv[0]);
                 return 0;
@@ -106,9 +179,59 @@ int main(int argc, char** argv) {
 
     // Validaciones básicas
     if (!inPath) { fprintf(stderr, "Falta -i [ruta_entrada]\n"); return 1; }
+    if (verify) {
+        // Solo lectura: no se combina con otras operaciones
+        if (op_c || op_d || op_e || op_u || hasRange) {
+            fprintf(stderr, "--verify no se combina con otras operaciones\n");
+            return 1;
+        }
+        McpfContext* ctx = mcpf_context_create(NULL, NULL, key);
+        if (!ctx) return 1;
+        int rc = mcpf_verify_file(ctx, inPath, 0);
+        mcpf_context_free(ctx);
+        return rc == 0 ? 0 : 1;
+    }
+    if (list) {
+        if (op_c || op_d || op_e || op_u || hasRange || archive || member) {
+            fprintf(stderr, "--list no se combina con otras operaciones\n");
+            return 1;
+        }
+        McpfContext* ctx = mcpf_context_create(NULL, NULL, key);
+        if (!ctx) return 1;
+        int rc = mcpf_archive_list(ctx, inPath, stdout);
+        mcpf_context_free(ctx);
+        return rc == 0 ? 0 : 1;
+    }
+    if (archive && !op_c) {
+        fprintf(stderr, "--archive se usa con -c o -ce (la extracción lo detecta sola)\n");
+        return 1;
+    }
+    if (incremental && (!(op_c || op_e) || archive)) {
+        fprintf(stderr, "--incremental solo se aplica a -c, -e o -ce sobre un directorio\n");
+        return 1;
+    }
+    if (chunkStore && (archive || member || hasRange)) {
+        fprintf(stderr, "--chunk-store no se combina con --archive, --member ni --range\n");
+        return 1;
+    }
+    if (strcmp(compAlg, AUTOCODEC_NAME) == 0 && (archive || chunkStore)) {
+        fprintf(stderr, "--comp-alg %s no se combina con --archive ni --chunk-store\n", AUTOCODEC_NAME);
+        return 1;
+    }
+    if (deltaBase && (archive || member || hasRange || chunkStore)) {
+        fprintf(stderr, "--delta-base no se combina con --archive, --member, --range ni --chunk-store\n");
+        return 1;
+    }
+    if (member && !(op_d || op_u)) {
+        fprintf(stderr, "--member solo se aplica a -d, -u o -ud\n");
+        return 1;
+    }
     if (op_c || op_d) {
-        if (strcmp(compAlg, "huffman") != 0 && strcmp(compAlg, "rle") != 0 && strcmp(compAlg, "lzw") != 0) {
-            fprintf(stderr, "Algoritmo de compresión no soportado: %s (use: huffman, rle o lzw)\n", compAlg);
+        if (!codec_find_name(compAlg) && strcmp(compAlg, AUTOCODEC_NAME) != 0 && strcmp(compAlg, CODEC_STORE_NAME) != 0) {
+            char names[128];
+            codec_names(names, sizeof(names));
+            fprintf(stderr, "Algoritmo de compresión no soportado: %s (use: %s, %s, %s)\n", compAlg, names,
+                    CODEC_STORE_NAME, AUTOCODEC_NAME);
             return 1;
         }
     }
@@ -134,12 +257,19 @@ int main(int argc, char** argv) {
     // Validación de encriptación (luego de manejar combinaciones)
     if (op_e || op_u) {
         if (!key) { fprintf(stderr, "-k [clave] es obligatorio para -e/-u\n"); return 1; }
-        if (strcmp(encAlg, "vigenere") != 0 && strcmp(encAlg, "aes") != 0) {
-            fprintf(stderr, "Algoritmo de encriptación no soportado: %s (use: vigenere o aes)\n", encAlg);
+        if (!cipher_find_name(encAlg)) {
+            char names[128];
+            cipher_names(names, sizeof(names));
+            fprintf(stderr, "Algoritmo de encriptación no soportado: %s (use: %s)\n", encAlg, names);
             return 1;
         }
     }
 
+    if (hasRange && !(op_d || op_u)) {
+        fprintf(stderr, "--range solo se aplica a -d, -u o -ud\n");
+        return 1;
+    }
+
     // Ejecutar operación individual o combinación
     ThreadArgs myargs = {
         .op_c = op_c, 
@@ -151,13 +281,20 @@ int main(int argc, char** argv) {
         .inPath = inPath, 
         .outPath = outPath, 
         .key = key,
+        .has_range = hasRange,
+        .range_offset = rangeOffset,
+        .range_length = rangeLength,
+        .archive = archive,
+        .member = member,
+        .incremental = incremental,
+        .dedup = dedup,
+        .chunkStore = chunkStore,
+        .deltaBase = deltaBase,
         .thread_index = 0,
         .thread_file_name = NULL,
         .elapsed_time = 0.0
     };
-    initOperation(myargs);
-
-    return 0;
+    return initOperation(myargs) == 0 ? 0 : 1;
     // No debería llegar aquí
     usage(argv[0]);
     return 1;
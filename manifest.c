@@ -0,0 +1,284 @@
+#include "manifest.h"
+#include "checksum.h"
+#include "metadata.h"
+#include "posix_utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MANIFEST_HEADER_SIZE 9
+#define MANIFEST_MAX_SIZE    (1ull << 32)    // Tope al leer (evita reservas absurdas)
+
+struct Manifest {
+    unsigned char* data;        // Manifiesto anterior; las rutas de old apuntan aquí
+    ManifestEntry* old;
+    size_t oldCount;
+    atomic_uchar* seen;         // Una marca por entrada anterior
+    size_t* slots;              // Tabla hash de old: índice + 1, 0 = libre
+    size_t mask;
+    uint32_t stages;
+    int stale;                  // old es de otras etapas: no se reutiliza, sus salidas se descartan
+    pthread_mutex_t lock;       // Protege next
+    ManifestEntry* next;        // Manifiesto nuevo (rutas propias)
+    size_t nextCount;
+    size_t nextCapacity;
+};
+
+static void store_le(unsigned char* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static size_t path_hash(const char* path) {
+    return crc32c(0, path, strlen(path));
+}
+
+// Lee una ruta con su '\0' final; devuelve los bytes consumidos o 0 si es inválida
+static size_t get_path(const unsigned char* p, size_t len, const char** out) {
+    uint64_t n;
+    size_t used = metadata_get_varint(p, len, &n);
+    if (used == 0 || n == 0 || n > len - used || p[used + n - 1] != '\0') return 0;
+    *out = (const char*)(p + used);
+    return used + (size_t)n;
+}
+
+// Interpreta el manifiesto anterior; -1 si no sirve (se procesa todo)
+static int parse(Manifest* m, size_t len) {
+    const unsigned char* p = m->data;
+    if (len < MANIFEST_HEADER_SIZE + 4) return -1;
+    if (load_le(p, 4) != MANIFEST_MAGIC || p[4] != MANIFEST_VERSION) return -1;
+    if (crc32c(0, p, len - 4) != (uint32_t)load_le(p + len - 4, 4)) return -1;
+    size_t pos = MANIFEST_HEADER_SIZE, end = len - 4;
+
+    uint64_t count;
+    size_t used = metadata_get_varint(p + pos, end - pos, &count);
+    if (used == 0 || count > (end - pos) / 10) return -1;
+    pos += used;
+    m->old = (ManifestEntry*)malloc(sizeof(ManifestEntry) * (size_t)(count ? count : 1));
+    if (!m->old) return -1;
+
+    for (uint64_t i = 0; i < count; i++) {
+        ManifestEntry* e = &m->old[i];
+        uint64_t* fields[4] = { &e->size, &e->mtimeNs, &e->inode, &e->outSize };
+        if ((used = get_path(p + pos, end - pos, &e->path)) == 0) return -1;
+        pos += used;
+        if ((used = get_path(p + pos, end - pos, &e->output)) == 0) return -1;
+        pos += used;
+        for (int f = 0; f < 4; f++) {
+            if ((used = metadata_get_varint(p + pos, end - pos, fields[f])) == 0) return -1;
+            pos += used;
+        }
+        if (end - pos < 4) return -1;
+        e->outCrc = (uint32_t)load_le(p + pos, 4);
+        pos += 4;
+    }
+    if (pos != end) return -1;
+    m->oldCount = (size_t)count;
+    m->stale = (uint32_t)load_le(p + 5, 4) != m->stages;
+    return 0;
+}
+
+// Tabla hash de direccionamiento abierto sobre las entradas anteriores
+static int build_index(Manifest* m) {
+    size_t size = 16;
+    while (size < m->oldCount * 2) size <<= 1;
+    m->slots = (size_t*)calloc(size, sizeof(size_t));
+    m->seen = (atomic_uchar*)calloc(m->oldCount ? m->oldCount : 1, sizeof(atomic_uchar));
+    if (!m->slots || !m->seen) return -1;
+    m->mask = size - 1;
+    for (size_t i = 0; i < m->oldCount; i++) {
+        size_t h = path_hash(m->old[i].path) & m->mask;
+        while (m->slots[h]) h = (h + 1) & m->mask;
+        m->slots[h] = i + 1;
+    }
+    return 0;
+}
+
+Manifest* manifest_load(const char* path, uint32_t stages) {
+    Manifest* m = (Manifest*)calloc(1, sizeof(Manifest));
+    if (!m) return NULL;
+    m->stages = stages;
+    pthread_mutex_init(&m->lock, NULL);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        off_t size = posix_get_file_size(fd);
+        if (size > 0 && (uint64_t)size < MANIFEST_MAX_SIZE && (m->data = (unsigned char*)malloc((size_t)size)) &&
+            posix_read_full(fd, m->data, (size_t)size) == (ssize_t)size && parse(m, (size_t)size) == 0) {
+            if (m->stale) {
+                printf("Manifiesto anterior de otras opciones: se reemplazan sus %zu salidas.\n", m->oldCount);
+            } else {
+                printf("Manifiesto anterior: %zu archivos.\n", m->oldCount);
+            }
+        } else {
+            fprintf(stderr, "Manifiesto '%s' inválido: se procesa todo\n", path);
+            free(m->old);
+            m->old = NULL;
+            m->oldCount = 0;
+        }
+        close(fd);
+    }
+    if (build_index(m) != 0) {
+        manifest_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+void manifest_discard_stale(Manifest* m, void (*fn)(void* opaque, const ManifestEntry* e), void* opaque) {
+    if (!m->stale) return;
+    for (size_t i = 0; i < m->oldCount; i++) fn(opaque, &m->old[i]);
+    // Sin entradas anteriores se procesa todo y al final no queda nada que comparar
+    m->oldCount = 0;
+    m->stale = 0;
+}
+
+const ManifestEntry* manifest_find(Manifest* m, const char* path) {
+    if (m->oldCount == 0 || m->stale) return NULL;
+    size_t h = path_hash(path) & m->mask;
+    while (m->slots[h]) {
+        size_t i = m->slots[h] - 1;
+        if (strcmp(m->old[i].path, path) == 0) {
+            atomic_store_explicit(&m->seen[i], 1, memory_order_relaxed);
+            return &m->old[i];
+        }
+        h = (h + 1) & m->mask;
+    }
+    return NULL;
+}
+
+int manifest_add(Manifest* m, const ManifestEntry* e) {
+    ManifestEntry copy = *e;
+    copy.path = strdup(e->path);
+    copy.output = strdup(e->output);
+    if (!copy.path || !copy.output) {
+        free((char*)copy.path);
+        free((char*)copy.output);
+        return -1;
+    }
+    pthread_mutex_lock(&m->lock);
+    if (m->nextCount == m->nextCapacity) {
+        size_t capacity = m->nextCapacity ? m->nextCapacity * 2 : 256;
+        ManifestEntry* grown = (ManifestEntry*)realloc(m->next, capacity * sizeof(ManifestEntry));
+        if (!grown) {
+            pthread_mutex_unlock(&m->lock);
+            free((char*)copy.path);
+            free((char*)copy.output);
+            return -1;
+        }
+        m->next = grown;
+        m->nextCapacity = capacity;
+    }
+    m->next[m->nextCount++] = copy;
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+// Una salida anterior que ahora produce otro archivo (p. ej. a.txt borrado y a.md nuevo, ambos
+// a.rle) no se entrega: se buscan en una tabla con las salidas del manifiesto nuevo
+void manifest_each_unseen(Manifest* m, void (*fn)(void* opaque, const ManifestEntry* e), void* opaque) {
+    size_t size = 16;
+    while (size < m->nextCount * 2) size <<= 1;
+    size_t* slots = (size_t*)calloc(size, sizeof(size_t));
+    if (!slots) {
+        fprintf(stderr, "Sin memoria para comparar manifiestos: no se borran salidas anteriores\n");
+        return;
+    }
+    for (size_t i = 0; i < m->nextCount; i++) {
+        size_t h = path_hash(m->next[i].output) & (size - 1);
+        while (slots[h]) h = (h + 1) & (size - 1);
+        slots[h] = i + 1;
+    }
+
+    for (size_t i = 0; i < m->oldCount; i++) {
+        if (atomic_load_explicit(&m->seen[i], memory_order_relaxed)) continue;
+        const char* output = m->old[i].output;
+        size_t h = path_hash(output) & (size - 1);
+        while (slots[h] && strcmp(m->next[slots[h] - 1].output, output) != 0) h = (h + 1) & (size - 1);
+        if (!slots[h]) fn(opaque, &m->old[i]);
+    }
+    free(slots);
+}
+
+static unsigned char* put_path(unsigned char* p, const char* path) {
+    size_t n = strlen(path) + 1;
+    p += metadata_put_varint(p, n);
+    memcpy(p, path, n);
+    return p + n;
+}
+
+int manifest_save(Manifest* m, const char* path) {
+    size_t size = MANIFEST_HEADER_SIZE + 10 + 4;
+    for (size_t i = 0; i < m->nextCount; i++) {
+        size += strlen(m->next[i].path) + strlen(m->next[i].output) + 2 + 2 * 10 + 4 * 10 + 4;
+    }
+    unsigned char* buf = (unsigned char*)malloc(size);
+    if (!buf) {
+        perror("Error al reservar memoria para el manifiesto");
+        return -1;
+    }
+    unsigned char* p = buf;
+    store_le(p, MANIFEST_MAGIC, 4);
+    p[4] = MANIFEST_VERSION;
+    store_le(p + 5, m->stages, 4);
+    p += MANIFEST_HEADER_SIZE;
+    p += metadata_put_varint(p, m->nextCount);
+    for (size_t i = 0; i < m->nextCount; i++) {
+        const ManifestEntry* e = &m->next[i];
+        p = put_path(p, e->path);
+        p = put_path(p, e->output);
+        p += metadata_put_varint(p, e->size);
+        p += metadata_put_varint(p, e->mtimeNs);
+        p += metadata_put_varint(p, e->inode);
+        p += metadata_put_varint(p, e->outSize);
+        store_le(p, e->outCrc, 4);
+        p += 4;
+    }
+    store_le(p, crc32c(0, buf, (size_t)(p - buf)), 4);
+    p += 4;
+
+    // Temporal y rename: una corrida interrumpida deja el manifiesto anterior intacto
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = posix_open_write(tmp);
+    int rc = -1;
+    if (fd >= 0) {
+        if (posix_write_full(fd, buf, (size_t)(p - buf)) == (ssize_t)(p - buf) && fsync(fd) == 0) rc = 0;
+        if (close(fd) != 0) rc = -1;
+        if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+        if (rc != 0) {
+            fprintf(stderr, "No se pudo escribir el manifiesto '%s': %s\n", path, strerror(errno));
+            unlink(tmp);
+        }
+    }
+    free(buf);
+    return rc;
+}
+
+void manifest_free(Manifest* m) {
+    if (!m) return;
+    for (size_t i = 0; i < m->nextCount; i++) {
+        free((char*)m->next[i].path);
+        free((char*)m->next[i].output);
+    }
+    free(m->next);
+    free(m->old);
+    free(m->data);
+    free(m->slots);
+    free(m->seen);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+}
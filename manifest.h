@@ -0,0 +1,78 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Manifiesto del modo --incremental: lo que quedó procesado en la carpeta de salida en la
+// corrida anterior. Un archivo cuyo tamaño, fecha de modificación e inodo no cambiaron y cuya
+// salida sigue en su lugar con el mismo tamaño no se vuelve a procesar.
+//
+//   encabezado: MANIFEST_MAGIC u32 | MANIFEST_VERSION u8 | etapas u32 | count (varint)
+//   entrada:    pathLen (varint) | path | outputLen (varint) | output |
+//               size | mtimeNs | inode | outSize (varint) | outCrc u32
+//   pie:        crc32c de todo lo anterior u32
+//
+// Enteros fijos en little-endian. path (relativa a la entrada) y output (relativa a la carpeta de
+// salida) se guardan con su '\0' final, incluido en la longitud.
+// Con otras etapas (compresor, cifrado u operación) el manifiesto anterior no se reutiliza: sus
+// salidas se borran antes de procesar todo de nuevo, para que no convivan p. ej. a.lzs y a.bin.
+
+#define MANIFEST_FILE_NAME ".mcpf-manifest"
+#define MANIFEST_MAGIC     0x544E464D    // "MFNT"
+#define MANIFEST_VERSION   1
+
+typedef struct {
+    const char* path;           // Relativa a la carpeta de entrada
+    const char* output;         // Relativa a la carpeta de salida
+    uint64_t size;
+    uint64_t mtimeNs;
+    uint64_t inode;
+    uint64_t outSize;
+    uint32_t outCrc;            // CRC32C del archivo de salida
+} ManifestEntry;
+
+typedef struct Manifest Manifest;
+
+/**
+ * Carga el manifiesto de la corrida anterior. Si no existe o está dañado devuelve un manifiesto
+ * vacío (se procesa todo); si es de otras etapas, sus entradas solo sirven para
+ * manifest_discard_stale
+ * @param stages Identifica compresor, cifrado y operación
+ * @return Manifiesto, o NULL si falta memoria
+ */
+Manifest* manifest_load(const char* path, uint32_t stages);
+
+/**
+ * Si el manifiesto anterior es de otras etapas, entrega cada una de sus entradas (para borrar su
+ * salida) y las olvida; si no, no hace nada
+ */
+void manifest_discard_stale(Manifest* m, void (*fn)(void* opaque, const ManifestEntry* e), void* opaque);
+
+/**
+ * Busca la entrada anterior de un archivo y la marca como vista. Solo lee la tabla cargada,
+ * así que se puede llamar desde varios hilos
+ * @return Entrada, o NULL si el archivo es nuevo
+ */
+const ManifestEntry* manifest_find(Manifest* m, const char* path);
+
+/**
+ * Agrega una entrada al manifiesto nuevo (copia las rutas); se puede llamar desde varios hilos
+ * @return 0 si tiene éxito, -1 si falta memoria
+ */
+int manifest_add(Manifest* m, const ManifestEntry* e);
+
+/**
+ * Recorre las entradas anteriores que nadie buscó (entradas borradas de la carpeta de entrada)
+ */
+void manifest_each_unseen(Manifest* m, void (*fn)(void* opaque, const ManifestEntry* e), void* opaque);
+
+/**
+ * Escribe el manifiesto nuevo en path (a través de un temporal y rename)
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int manifest_save(Manifest* m, const char* path);
+
+void manifest_free(Manifest* m);
+
+#endif
@@ -0,0 +1,486 @@
+#include "mcpf.h"
+#include "registry.h"
+#include "metadata.h"
+#include "posix_utils.h"
+#include "archive.h"
+#include "chunkstore.h"
+#include "delta.h"
+#include "autocodec.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+struct McpfContext {
+    const CodecOps* codec;      // NULL si no se comprime
+    int autoCodec;              // --comp-alg auto: se elige por archivo (codec queda en Huffman)
+    int store;                  // --comp-alg store: contenedor sin compresor (codec NULL)
+    const CipherOps* cipher;    // NULL si no se cifra
+    char* password;             // Copia propia de la clave (NULL sin clave)
+    CipherKey key;              // Clave expandida, solo lectura después de crear el contexto
+    ChunkStore* chunks;         // --chunk-store: salidas como recetas de fragmentos (NULL = contenedor)
+    ContainerThreads threads;   // Reparto de la codificación de los contenedores que escribe
+};
+
+McpfContext* mcpf_context_create(const char* codec, const char* cipher, const char* key) {
+    McpfContext* ctx = (McpfContext*)calloc(1, sizeof(McpfContext));
+    if (!ctx) return NULL;
+
+    if (codec && strcmp(codec, AUTOCODEC_NAME) == 0) {
+        // Lo que no es un archivo (buffers, flujos, entrada estándar) no se muestrea: usa Huffman
+        ctx->autoCodec = 1;
+        ctx->codec = codec_find_id(CODEC_ID_HUFFMAN);
+    } else if (codec && strcmp(codec, CODEC_STORE_NAME) == 0) {
+        ctx->store = 1;
+    } else if (codec && !(ctx->codec = codec_find_name(codec))) {
+        fprintf(stderr, "Algoritmo de compresión no soportado: %s\n", codec);
+        free(ctx);
+        return NULL;
+    }
+    if (cipher && !(ctx->cipher = cipher_find_name(cipher))) {
+        fprintf(stderr, "Algoritmo de encriptación no soportado: %s\n", cipher);
+        free(ctx);
+        return NULL;
+    }
+    if (ctx->cipher && (!key || key[0] == '\0')) {
+        fprintf(stderr, "El cifrado %s requiere una clave\n", ctx->cipher->name);
+        free(ctx);
+        return NULL;
+    }
+    if (key && !(ctx->password = strdup(key))) {
+        free(ctx);
+        return NULL;
+    }
+    if (ctx->cipher) ctx->cipher->init(&ctx->key, ctx->password);
+    return ctx;
+}
+
+int mcpf_context_set_chunk_store(McpfContext* ctx, const char* dir, int compress) {
+    if (ctx->chunks) return -1;
+    ctx->chunks = chunkstore_open(dir, compress && ctx->codec ? ctx->codec->id : CODEC_ID_NONE,
+                                  ctx->cipher ? ctx->cipher->id : CIPHER_ID_NONE, ctx->password);
+    return ctx->chunks ? 0 : -1;
+}
+
+void mcpf_context_set_threads(McpfContext* ctx, int threads, const ContainerExecutor* executor) {
+    ctx->threads.threads = threads;
+    ctx->threads.executor = executor;
+}
+
+int mcpf_chunk_store_stats(const McpfContext* ctx, uint64_t* written, uint64_t* reused) {
+    if (!ctx->chunks) return -1;
+    chunkstore_stats(ctx->chunks, written, reused);
+    return 0;
+}
+
+void mcpf_context_free(McpfContext* ctx) {
+    if (!ctx) return;
+    if (ctx->cipher) ctx->cipher->clear(&ctx->key);
+    chunkstore_close(ctx->chunks);
+    if (ctx->password) {
+        volatile char* p = ctx->password;
+        while (*p) *p++ = 0;
+        free(ctx->password);
+    }
+    free(ctx);
+}
+
+// ---- Buffers ----
+
+// Destino de un flujo en memoria: falla en lugar de escribir fuera de dst
+typedef struct {
+    unsigned char* dst;
+    size_t cap;
+    size_t len;
+    int overflow;
+} BufferSink;
+
+static int buffer_sink(void* opaque, const unsigned char* data, size_t len) {
+    BufferSink* b = (BufferSink*)opaque;
+    if (len > b->cap - b->len) {
+        b->overflow = 1;
+        return -1;
+    }
+    memcpy(b->dst + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+size_t mcpf_compress_bound(const McpfContext* ctx, size_t srcLen) {
+    if (!ctx->codec) return 0;
+    // Cada trama lleva dos varint (hasta 10 bytes cada uno); al final, el marcador de 1 byte
+    size_t full = srcLen / CODEC_STREAM_BLOCK;
+    size_t rest = srcLen % CODEC_STREAM_BLOCK;
+    size_t bound = full * (20 + ctx->codec->bound(CODEC_STREAM_BLOCK)) + 1;
+    if (rest > 0) bound += 20 + ctx->codec->bound(rest);
+    return bound;
+}
+
+size_t mcpf_encrypt_bound(const McpfContext* ctx, size_t srcLen) {
+    return ctx->cipher ? srcLen + ctx->cipher->overhead : 0;
+}
+
+// Pasa src por un flujo del compresor del contexto hacia dst
+static ssize_t run_stream(const McpfContext* ctx, int encoding, const void* src, size_t srcLen,
+                          void* dst, size_t dstCap) {
+    if (!ctx->codec) {
+        fprintf(stderr, "El contexto no tiene compresor\n");
+        return -1;
+    }
+    BufferSink sink = { (unsigned char*)dst, dstCap, 0, 0 };
+    CodecStream st;
+    if (codec_stream_open(&st, ctx->codec, encoding, buffer_sink, &sink) != 0) return -1;
+    if (codec_stream_write(&st, (const unsigned char*)src, srcLen) != 0) {
+        codec_stream_abort(&st);
+        if (sink.overflow) fprintf(stderr, "Buffer de destino insuficiente\n");
+        return -1;
+    }
+    if (codec_stream_close(&st) != 0) {
+        if (sink.overflow) fprintf(stderr, "Buffer de destino insuficiente\n");
+        return -1;
+    }
+    return (ssize_t)sink.len;
+}
+
+ssize_t mcpf_compress(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap) {
+    return run_stream(ctx, 1, src, srcLen, dst, dstCap);
+}
+
+ssize_t mcpf_decompress(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap) {
+    return run_stream(ctx, 0, src, srcLen, dst, dstCap);
+}
+
+ssize_t mcpf_encrypt(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap) {
+    if (!ctx->cipher) {
+        fprintf(stderr, "El contexto no tiene cifrado\n");
+        return -1;
+    }
+    if (dstCap < srcLen + ctx->cipher->overhead) {
+        fprintf(stderr, "Buffer de destino insuficiente\n");
+        return -1;
+    }
+    return (ssize_t)ctx->cipher->encrypt(&ctx->key, (const unsigned char*)src, srcLen, (unsigned char*)dst);
+}
+
+ssize_t mcpf_decrypt(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap) {
+    if (!ctx->cipher) {
+        fprintf(stderr, "El contexto no tiene cifrado\n");
+        return -1;
+    }
+    if (dstCap < srcLen) {
+        fprintf(stderr, "Buffer de destino insuficiente\n");
+        return -1;
+    }
+    if (dst != src) memcpy(dst, src, srcLen);
+    size_t outLen = 0;
+    if (ctx->cipher->decrypt(&ctx->key, (unsigned char*)dst, srcLen, (unsigned char*)dst, &outLen) != 0) {
+        fprintf(stderr, "Datos cifrados inválidos o clave incorrecta\n");
+        return -1;
+    }
+    return (ssize_t)outLen;
+}
+
+// ---- Flujos ----
+
+struct McpfStream {
+    CodecStream st;
+    int failed;
+};
+
+McpfStream* mcpf_stream_open(const McpfContext* ctx, int encoding, McpfSink sink, void* opaque) {
+    if (!ctx->codec) {
+        fprintf(stderr, "El contexto no tiene compresor\n");
+        return NULL;
+    }
+    McpfStream* stream = (McpfStream*)calloc(1, sizeof(McpfStream));
+    if (!stream) return NULL;
+    if (codec_stream_open(&stream->st, ctx->codec, encoding, sink, opaque) != 0) {
+        free(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+int mcpf_stream_write(McpfStream* stream, const void* data, size_t len) {
+    if (stream->failed) return -1;
+    if (codec_stream_write(&stream->st, (const unsigned char*)data, len) != 0) stream->failed = 1;
+    return stream->failed ? -1 : 0;
+}
+
+int mcpf_stream_close(McpfStream* stream) {
+    if (!stream) return -1;
+    int rc = -1;
+    if (stream->failed) codec_stream_abort(&stream->st);
+    else rc = codec_stream_close(&stream->st);
+    free(stream);
+    return rc;
+}
+
+// ---- Archivos ----
+
+static int read_header(const char* path, FileMetadata* meta) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    int r = metadata_read(fd, meta);
+    close(fd);
+    return r;
+}
+
+// Compresor registrado en el encabezado. Solo el formato heredado (versión 1, sin cadena de
+// etapas) recurre a la extensión de nameHint (si hay) y luego al compresor del contexto
+static const CodecOps* resolve_codec(const McpfContext* ctx, const FileMetadata* meta, const char* nameHint) {
+    if (meta->version == METADATA_VERSION) return codec_find_id(meta->codec);
+    if (!nameHint) return ctx->codec;
+    const char* ext = get_extension(nameHint);
+    const CodecOps* ops = codec_find_extension(ext);
+    if (!ops && strcmp(ext, "huff") == 0) ops = codec_find_id(CODEC_ID_HUFFMAN);
+    return ops ? ops : ctx->codec;
+}
+
+// Cifrado registrado en el encabezado; el heredado solo marcaba AES, así que si no consta se usa el del contexto
+static const CipherOps* resolve_cipher(const McpfContext* ctx, const FileMetadata* meta) {
+    if (meta->cipher != CIPHER_ID_UNKNOWN) return cipher_find_id(meta->cipher);
+    return ctx->cipher;
+}
+
+// Las recetas se leen y escriben con lseek y requieren el almacén del contexto
+static int chunks_write(const McpfContext* ctx, const char* in, const char* out) {
+    if (posix_is_stdio(in) || posix_is_stdio(out)) {
+        fprintf(stderr, "--chunk-store no admite la entrada ni la salida estándar\n");
+        return -1;
+    }
+    return chunkstore_write_file(ctx->chunks, in, out);
+}
+
+static int chunks_read(const McpfContext* ctx, const char* in, const char* out, const ContainerRange* range) {
+    if (!ctx->chunks) {
+        fprintf(stderr, "%s usa un almacén de fragmentos: indique --chunk-store\n", in);
+        return -1;
+    }
+    if (range) {
+        fprintf(stderr, "--range no se aplica a recetas de fragmentos: %s\n", in);
+        return -1;
+    }
+    if (posix_is_stdio(out)) {
+        fprintf(stderr, "--chunk-store no admite la entrada ni la salida estándar\n");
+        return -1;
+    }
+    return chunkstore_read_file(ctx->chunks, in, out);
+}
+
+// Las operaciones de escritura necesitan al menos una etapa; store cuenta como tal
+static int check_stages(const McpfContext* ctx, int compress) {
+    if (ctx->cipher || (compress && (ctx->codec || ctx->store))) return 0;
+    fprintf(stderr, "El contexto no tiene compresor ni cifrado\n");
+    return -1;
+}
+
+// Compresor para un archivo: el del contexto, o con --comp-alg auto el que sugiere su muestra
+static uint8_t codec_for(const McpfContext* ctx, const CodecOps* codec, const char* path) {
+    if (!codec) return CODEC_ID_NONE;
+    if (ctx->autoCodec && !posix_is_stdio(path)) return autocodec_choose_file(path);
+    return codec->id;
+}
+
+int mcpf_compress_file(const McpfContext* ctx, const char* inputPath, const char* outputPath) {
+    if (check_stages(ctx, 1) != 0) return -1;
+    if (ctx->chunks) return chunks_write(ctx, inputPath, outputPath);
+    return container_compress_file(inputPath, outputPath, codec_for(ctx, ctx->codec, inputPath),
+                                   ctx->cipher ? ctx->cipher->id : CIPHER_ID_NONE, ctx->password, &ctx->threads);
+}
+
+int mcpf_compress_files(const McpfContext* ctx, const char* const* inputPaths, const char* const* outputPaths,
+                        size_t count, int* results) {
+    if (check_stages(ctx, 1) != 0) return -1;
+    if (ctx->chunks) {
+        int rc = 0;
+        for (size_t i = 0; i < count; i++) {
+            int r = chunks_write(ctx, inputPaths[i], outputPaths[i]);
+            if (results) results[i] = r;
+            if (r != 0) rc = -1;
+        }
+        return rc;
+    }
+    // Con --comp-alg auto cada archivo puede usar otro compresor: un lote abierto por compresor
+    ContainerBatch* batches[CODEC_ID_LIMIT] = {0};
+    int rc = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint8_t codec = codec_for(ctx, ctx->codec, inputPaths[i]);
+        if (codec >= CODEC_ID_LIMIT) {
+            fprintf(stderr, "Compresor inválido (%u) para %s\n", codec, inputPaths[i]);
+            if (results) results[i] = -1;
+            rc = -1;
+            continue;
+        }
+        if (!batches[codec]) {
+            batches[codec] = container_batch_open(codec, ctx->cipher ? ctx->cipher->id : CIPHER_ID_NONE,
+                                                  ctx->password, &ctx->threads);
+        }
+        int r = batches[codec] ? container_batch_compress(batches[codec], inputPaths[i], outputPaths[i]) : -1;
+        if (results) results[i] = r;
+        if (r != 0) rc = -1;
+    }
+    for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]); i++) container_batch_close(batches[i]);
+    return rc;
+}
+
+// La entrada estándar no se puede leer dos veces (encabezado y datos) y la salida estándar no
+// admite lseek: con "-" solo sirve el contenedor por bloques, que se procesa en un solo recorrido
+static int stdio_legacy(const char* in, const char* out) {
+    if (!posix_is_stdio(out)) return 0;
+    fprintf(stderr, "%s usa el formato heredado, que no se puede escribir en la salida estándar\n", in);
+    return -1;
+}
+
+// Descomprime in con el decodificador que indica su encabezado, en un solo intento
+static int decompress_file(const McpfContext* ctx, const char* in, const char* out, const char* nameHint,
+                           const ContainerRange* range) {
+    if (posix_is_stdio(in)) return container_extract_file(in, out, ctx->password, range);
+    FileMetadata meta;
+    if (read_header(in, &meta) != 0) {
+        fprintf(stderr, "Encabezado faltante o inválido: %s\n", in);
+        return -1;
+    }
+    if (meta.flags & META_FLAG_ARCHIVE) {
+        fprintf(stderr, "%s es un archivo de directorio (.%s): use mcpf_archive_extract\n", in, ARCHIVE_EXTENSION);
+        return -1;
+    }
+    if (meta.flags & META_FLAG_CHUNKED) return chunks_read(ctx, in, out, range);
+    if (meta.flags & META_FLAG_DELTA) {
+        fprintf(stderr, "%s es un delta: indique su versión anterior con --delta-base\n", in);
+        return -1;
+    }
+    if (meta.flags & META_FLAG_BLOCKED) {
+        if (meta.cipher != CIPHER_ID_NONE && !ctx->password) {
+            fprintf(stderr, "%s está cifrado: use -ud con -k [clave]\n", in);
+            return -1;
+        }
+        return container_extract_file(in, out, ctx->password, range);
+    }
+    if (range) {
+        fprintf(stderr, "--range requiere un archivo en formato por bloques: %s\n", in);
+        return -1;
+    }
+    const CodecOps* ops = resolve_codec(ctx, &meta, nameHint);
+    if (!ops || !ops->read_file) {
+        fprintf(stderr, "Compresor no reconocido en %s\n", in);
+        return -1;
+    }
+    if (stdio_legacy(in, out) != 0) return -1;
+    return ops->read_file((char*)in, (char*)out) == 0 ? 0 : -1;
+}
+
+int mcpf_decompress_file(const McpfContext* ctx, const char* inputPath, const char* outputPath,
+                         const ContainerRange* range) {
+    return decompress_file(ctx, inputPath, outputPath, inputPath, range);
+}
+
+int mcpf_encrypt_file(const McpfContext* ctx, const char* inputPath, const char* outputPath) {
+    if (!ctx->cipher) {
+        fprintf(stderr, "El contexto no tiene cifrado\n");
+        return -1;
+    }
+    if (ctx->chunks) return chunks_write(ctx, inputPath, outputPath);
+    // Todos los cifrados escriben el contenedor por bloques sin compresor (como su encrypt_file),
+    // aquí con el reparto de hilos del contexto
+    return container_compress_file(inputPath, outputPath, CODEC_ID_NONE, ctx->cipher->id, ctx->password,
+                                   &ctx->threads);
+}
+
+int mcpf_decrypt_file(const McpfContext* ctx, const char* inputPath, const char* outputPath) {
+    if (posix_is_stdio(inputPath)) return container_extract_file(inputPath, outputPath, ctx->password, NULL);
+    FileMetadata meta;
+    if (read_header(inputPath, &meta) != 0) {
+        fprintf(stderr, "Encabezado faltante o inválido: %s\n", inputPath);
+        return -1;
+    }
+    if (meta.flags & META_FLAG_CHUNKED) return chunks_read(ctx, inputPath, outputPath, NULL);
+    const CipherOps* ops = resolve_cipher(ctx, &meta);
+    if (!ops) {
+        fprintf(stderr, "Cifrado no reconocido en %s\n", inputPath);
+        return -1;
+    }
+    if (!ctx->password) {
+        fprintf(stderr, "%s está cifrado: falta la clave\n", inputPath);
+        return -1;
+    }
+    if (!(meta.flags & META_FLAG_BLOCKED) && stdio_legacy(inputPath, outputPath) != 0) return -1;
+    return ops->decrypt_file(inputPath, outputPath, ctx->password) == 0 ? 0 : -1;
+}
+
+int mcpf_unpack_file(const McpfContext* ctx, const char* inputPath, const char* outputPath,
+                     const ContainerRange* range) {
+    if (posix_is_stdio(inputPath)) return container_extract_file(inputPath, outputPath, ctx->password, range);
+    FileMetadata meta;
+    if (read_header(inputPath, &meta) != 0) {
+        fprintf(stderr, "Encabezado faltante o inválido: %s\n", inputPath);
+        return -1;
+    }
+    // Contenedor por bloques: se descifra y descomprime bloque a bloque en un solo paso
+    if (meta.flags & META_FLAG_CHUNKED) return chunks_read(ctx, inputPath, outputPath, range);
+    if (meta.flags & META_FLAG_BLOCKED) return decompress_file(ctx, inputPath, outputPath, inputPath, range);
+    if (range) {
+        fprintf(stderr, "--range requiere un archivo en formato por bloques: %s\n", inputPath);
+        return -1;
+    }
+
+    if (stdio_legacy(inputPath, outputPath) != 0) return -1;
+
+    // Formato heredado de dos archivos anidados: descifrar a un temporal junto a la salida. La
+    // extensión del archivo externo corresponde al cifrado, así que el compresor es el del contexto
+    char decrypted[4096];
+    snprintf(decrypted, sizeof(decrypted), "%s.%lu.tmp", outputPath, (unsigned long)pthread_self());
+    int rc = mcpf_decrypt_file(ctx, inputPath, decrypted);
+    if (rc == 0) rc = decompress_file(ctx, decrypted, outputPath, NULL, NULL);
+    remove(decrypted);
+    return rc;
+}
+
+int mcpf_delta_file(const McpfContext* ctx, const char* basePath, const char* inputPath, const char* outputPath,
+                    int compress) {
+    const CodecOps* codec = compress ? ctx->codec : NULL;
+    if (check_stages(ctx, compress) != 0) return -1;
+    if (posix_is_stdio(basePath) || posix_is_stdio(inputPath) || posix_is_stdio(outputPath)) {
+        fprintf(stderr, "--delta-base no admite la entrada ni la salida estándar\n");
+        return -1;
+    }
+    return delta_encode_file(basePath, inputPath, outputPath, codec_for(ctx, codec, inputPath),
+                             ctx->cipher ? ctx->cipher->id : CIPHER_ID_NONE, ctx->password, &ctx->threads);
+}
+
+int mcpf_patch_file(const McpfContext* ctx, const char* basePath, const char* inputPath, const char* outputPath) {
+    FileMetadata meta;
+    if (posix_is_stdio(inputPath) || read_header(inputPath, &meta) != 0 || !(meta.flags & META_FLAG_DELTA)) {
+        return decompress_file(ctx, inputPath, outputPath, inputPath, NULL);
+    }
+    if (meta.cipher != CIPHER_ID_NONE && !ctx->password) {
+        fprintf(stderr, "%s está cifrado: use -ud con -k [clave]\n", inputPath);
+        return -1;
+    }
+    if (posix_is_stdio(outputPath)) {
+        fprintf(stderr, "--delta-base no admite la entrada ni la salida estándar\n");
+        return -1;
+    }
+    return delta_apply_file(basePath, inputPath, outputPath, ctx->password);
+}
+
+int mcpf_archive_create(const McpfContext* ctx, const char* dirPath, const char* outputPath) {
+    if (check_stages(ctx, 1) != 0) return -1;
+    return archive_create(dirPath, outputPath, ctx->codec ? ctx->codec->id : CODEC_ID_NONE,
+                          ctx->cipher ? ctx->cipher->id : CIPHER_ID_NONE, ctx->password, &ctx->threads);
+}
+
+int mcpf_archive_list(const McpfContext* ctx, const char* path, FILE* out) {
+    return archive_list(path, ctx->password, out);
+}
+
+int mcpf_archive_extract(const McpfContext* ctx, const char* path, const char* outputPath, const char* member) {
+    if (member) return archive_extract_member(path, member, outputPath, ctx->password);
+    return archive_extract(path, outputPath, ctx->password);
+}
+
+int mcpf_verify_file(const McpfContext* ctx, const char* inputPath, int threads) {
+    return container_verify_file(inputPath, ctx->password, threads);
+}
@@ -0,0 +1,206 @@
+#ifndef MCPF_H
+#define MCPF_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <stdio.h>
+#include "container.h"
+
+// libmcpf: compresión y cifrado de buffer a buffer, sin pasar por disco, más las
+// operaciones sobre archivos que usa la línea de comandos. Un contexto fija el compresor,
+// el cifrado y la clave; es inmutable después de crearlo, así que se puede reutilizar y
+// compartir entre hilos sin sincronización.
+//
+// Formato de mcpf_compress: tramas rawLen (varint) | encLen (varint) | bloque codificado,
+// con bloques de hasta CODEC_STREAM_BLOCK bytes y una trama final rawLen = 0 (el mismo
+// formato que codec_stream_*). mcpf_encrypt produce el cifrado directo del buffer.
+
+typedef struct McpfContext McpfContext;
+
+/**
+ * Crea un contexto
+ * @param codec Nombre del compresor ("huffman", "rle", "lzw") o NULL si no se comprime. Con
+ *              "auto" las operaciones sobre archivos eligen el compresor de cada uno (ver
+ *              autocodec.h); los buffers, los flujos y la entrada estándar usan Huffman. Con
+ *              "store" los archivos se escriben en el contenedor sin compresor
+ * @param cipher Nombre del cifrado ("vigenere", "aes") o NULL si no se cifra
+ * @param key Clave (obligatoria con cifrado); se copia
+ * @return Contexto, o NULL si algún nombre no está registrado o falta la clave
+ */
+McpfContext* mcpf_context_create(const char* codec, const char* cipher, const char* key);
+
+/**
+ * Guarda las salidas como recetas de un almacén de fragmentos (ver chunkstore.h) y lee las
+ * recetas de ese almacén. Se llama antes de compartir el contexto entre hilos
+ * @param dir Carpeta del almacén; se crea si no existe
+ * @param compress 1 si los fragmentos se comprimen con el compresor del contexto (0 con -e)
+ * @return 0 si tiene éxito, -1 si no se pudo abrir el almacén
+ */
+int mcpf_context_set_chunk_store(McpfContext* ctx, const char* dir, int compress);
+
+/**
+ * Fija cómo se reparte la codificación de los contenedores que escribe el contexto (por
+ * omisión, un hilo propio por CPU en cada archivo). Se llama antes de compartir el contexto
+ * entre hilos; cada contexto tiene su propio reparto
+ * @param threads Hilos propios por archivo (0 = uno por CPU)
+ * @param executor Ejecutor externo que codifica los bloques (ver container.h), o NULL. Debe
+ *                 seguir vivo mientras se use el contexto con él
+ */
+void mcpf_context_set_threads(McpfContext* ctx, int threads, const ContainerExecutor* executor);
+
+/**
+ * Fragmentos escritos y reutilizados por el almacén del contexto
+ * @return 0, o -1 si el contexto no tiene almacén
+ */
+int mcpf_chunk_store_stats(const McpfContext* ctx, uint64_t* written, uint64_t* reused);
+
+/**
+ * Libera el contexto, su almacén de fragmentos y borra de memoria la clave expandida
+ */
+void mcpf_context_free(McpfContext* ctx);
+
+/**
+ * Tamaño máximo que puede producir mcpf_compress / mcpf_encrypt para srcLen bytes
+ */
+size_t mcpf_compress_bound(const McpfContext* ctx, size_t srcLen);
+size_t mcpf_encrypt_bound(const McpfContext* ctx, size_t srcLen);
+
+/**
+ * Comprime src en dst con el compresor del contexto
+ * @param dstCap Capacidad de dst (mcpf_compress_bound la garantiza)
+ * @return Bytes escritos en dst, o -1 en error o si dst no alcanza
+ */
+ssize_t mcpf_compress(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap);
+
+/**
+ * Descomprime la salida de mcpf_compress
+ * @return Bytes originales escritos en dst, o -1 si los datos son inválidos o dst no alcanza
+ */
+ssize_t mcpf_decompress(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap);
+
+/**
+ * Cifra src en dst con el cifrado y la clave del contexto
+ * @param dstCap Capacidad de dst (mcpf_encrypt_bound la garantiza)
+ * @return Bytes escritos en dst, o -1 en error
+ */
+ssize_t mcpf_encrypt(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap);
+
+/**
+ * Descifra la salida de mcpf_encrypt; dst puede ser src
+ * @param dstCap Capacidad de dst; debe ser al menos srcLen (se descifra en sitio)
+ * @return Bytes descifrados, o -1 si los datos o la clave son inválidos
+ */
+ssize_t mcpf_decrypt(const McpfContext* ctx, const void* src, size_t srcLen, void* dst, size_t dstCap);
+
+// Flujo de compresión con memoria acotada (un bloque más su cota), para datos que no caben
+// en memoria. Produce y consume el mismo formato que mcpf_compress / mcpf_decompress
+typedef struct McpfStream McpfStream;
+
+// Recibe la salida de un flujo; devuelve 0 si pudo consumirla
+typedef int (*McpfSink)(void* opaque, const unsigned char* data, size_t len);
+
+/**
+ * Abre un flujo del compresor del contexto
+ * @param encoding 1 para comprimir, 0 para descomprimir
+ * @param sink Destino de la salida, llamado a medida que se completan bloques
+ * @return Flujo, o NULL en error
+ */
+McpfStream* mcpf_stream_open(const McpfContext* ctx, int encoding, McpfSink sink, void* opaque);
+
+/**
+ * Agrega datos al flujo
+ * @return 0 en éxito, -1 en error (el flujo queda inutilizable, solo se puede cerrar)
+ */
+int mcpf_stream_write(McpfStream* stream, const void* data, size_t len);
+
+/**
+ * Vacía el último bloque (o comprueba la trama final) y libera el flujo
+ * @return 0 en éxito, -1 si el flujo falló o quedó truncado
+ */
+int mcpf_stream_close(McpfStream* stream);
+
+// Operaciones sobre archivos. Toda ruta puede ser "-" (entrada o salida estándar): en ese caso
+// se escribe y se lee solo el contenedor por bloques, en un único recorrido y sin temporales
+
+/**
+ * Comprime y/o cifra un archivo en el contenedor por bloques con las etapas del contexto
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_compress_file(const McpfContext* ctx, const char* inputPath, const char* outputPath);
+
+/**
+ * Igual que mcpf_compress_file para varios archivos seguidos (p. ej. un lote de archivos
+ * pequeños): la clave expandida y los buffers se reutilizan de un archivo al siguiente
+ * @param results Resultado de cada archivo (0 o -1), o NULL
+ * @return 0 si todos tuvieron éxito, -1 si alguno falló
+ */
+int mcpf_compress_files(const McpfContext* ctx, const char* const* inputPaths, const char* const* outputPaths,
+                        size_t count, int* results);
+
+/**
+ * Descomprime un archivo con el decodificador que indica su encabezado. El compresor del
+ * contexto solo se usa con el encabezado heredado, si la extensión no lo identifica
+ * @param range Rango a extraer (solo contenedores por bloques), o NULL para todo
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_decompress_file(const McpfContext* ctx, const char* inputPath, const char* outputPath,
+                         const ContainerRange* range);
+
+/**
+ * Cifra o descifra un archivo completo (formato de -e / -u)
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_encrypt_file(const McpfContext* ctx, const char* inputPath, const char* outputPath);
+int mcpf_decrypt_file(const McpfContext* ctx, const char* inputPath, const char* outputPath);
+
+/**
+ * Descifra y descomprime la salida de mcpf_compress_file (o de -ce en versiones anteriores)
+ * @param range Rango a extraer (solo contenedores por bloques), o NULL para todo
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_unpack_file(const McpfContext* ctx, const char* inputPath, const char* outputPath,
+                     const ContainerRange* range);
+
+/**
+ * Escribe inputPath como delta de basePath, su versión anterior (ver delta.h), en un contenedor
+ * por bloques con las etapas del contexto
+ * @param compress 1 si el delta se comprime con el compresor del contexto (0 con -e)
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_delta_file(const McpfContext* ctx, const char* basePath, const char* inputPath, const char* outputPath,
+                    int compress);
+
+/**
+ * Reconstruye la salida de mcpf_delta_file sobre basePath. Si inputPath no es un delta se
+ * descomprime como con mcpf_decompress_file (p. ej. archivos que no tenían versión anterior)
+ * @return 0 si tiene éxito, -1 si la base no corresponde o en caso de error
+ */
+int mcpf_patch_file(const McpfContext* ctx, const char* basePath, const char* inputPath, const char* outputPath);
+
+/**
+ * Empaqueta un directorio en un solo archivo .mcpa con las etapas del contexto (ver archive.h)
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_archive_create(const McpfContext* ctx, const char* dirPath, const char* outputPath);
+
+/**
+ * Imprime la tabla de archivos de un .mcpa sin extraer su contenido
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_archive_list(const McpfContext* ctx, const char* path, FILE* out);
+
+/**
+ * Extrae un .mcpa completo en outputPath (directorio), o solo member en outputPath (archivo)
+ * @param member Ruta del miembro, o NULL para todo el árbol
+ * @return 0 si tiene éxito, -1 en caso de error
+ */
+int mcpf_archive_extract(const McpfContext* ctx, const char* path, const char* outputPath, const char* member);
+
+/**
+ * Comprueba todos los bloques de un contenedor (ver container_verify_file)
+ * @return 0 si todos los bloques son válidos, -1 si hay errores
+ */
+int mcpf_verify_file(const McpfContext* ctx, const char* inputPath, int threads);
+
+#endif
@@ -0,0 +1,216 @@
+#include "metadata.h"
+#include "posix_utils.h"
+#include <string.h>
+#include <unistd.h>
+#include <stdio.h>
+
+static const unsigned char MAGIC_COMPACT[4] = { 'M', 'C', 'P', 'F' };
+
+// Desplazamientos de la estructura heredada (uint32 magic, relleno, uint64 size, char[256], uint32 flags)
+#define V1_OFF_SIZE  8
+#define V1_OFF_NAME  16
+#define V1_OFF_FLAGS (V1_OFF_NAME + MAX_FILENAME_LEN)
+
+// ---- varint LEB128 ----
+size_t metadata_put_varint(unsigned char* buf, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    buf[n++] = (unsigned char)v;
+    return n;
+}
+
+size_t metadata_get_varint(const unsigned char* buf, size_t len, uint64_t* out) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < len && i < 10; i++) {
+        v |= (uint64_t)(buf[i] & 0x7F) << (7 * i);
+        if (!(buf[i] & 0x80)) {
+            *out = v;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t load_le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+void metadata_init(FileMetadata* meta, const char* path, uint64_t originalSize, uint8_t codec, uint8_t cipher) {
+    memset(meta, 0, sizeof(*meta));
+    meta->magic = METADATA_MAGIC;
+    meta->version = METADATA_VERSION;
+    meta->originalSize = originalSize;
+    uint8_t stages[3];
+    size_t count = 0;
+    if (CODEC_IS_CHAIN(codec)) {
+        stages[count++] = CODEC_CHAIN_INNER(codec);
+        stages[count++] = CODEC_CHAIN_OUTER(codec);
+    } else if (codec != CODEC_ID_NONE) {
+        stages[count++] = codec;
+    }
+    if (cipher != CIPHER_ID_NONE) stages[count++] = META_STAGE_CIPHER | cipher;
+    metadata_set_chain(meta, stages, count);
+    if (path) {
+        strncpy(meta->originalName, get_basename(path), MAX_FILENAME_LEN - 1);
+        meta->originalName[MAX_FILENAME_LEN - 1] = '\0';
+    }
+}
+
+int metadata_set_chain(FileMetadata* meta, const uint8_t* stages, size_t count) {
+    if (count > META_MAX_STAGES) return -1;
+    meta->stageCount = (uint8_t)count;
+    memcpy(meta->chain, stages, count);
+    meta->codec = CODEC_ID_NONE;
+    meta->cipher = CIPHER_ID_NONE;
+    for (size_t i = count; i-- > 0;) {
+        if (META_STAGE_IS_CIPHER(stages[i])) meta->cipher = META_STAGE_ID(stages[i]);
+        else meta->codec = stages[i];
+    }
+    // Dos compresores seguidos forman una cadena (ver CODEC_CHAIN_ID)
+    if (count >= 2 && !META_STAGE_IS_CIPHER(stages[0]) && !META_STAGE_IS_CIPHER(stages[1]) &&
+        CODEC_CAN_CHAIN(stages[0]) && CODEC_CAN_CHAIN(stages[1])) {
+        meta->codec = CODEC_CHAIN_ID(stages[0], stages[1]);
+    }
+    return 0;
+}
+
+int metadata_chain_supported(const FileMetadata* meta) {
+    size_t codecs = 0, i = 0;
+    while (i < meta->stageCount && !META_STAGE_IS_CIPHER(meta->chain[i])) {
+        i++;
+        codecs++;
+    }
+    size_t ciphers = meta->stageCount - i;
+    return codecs <= 2 && ciphers <= 1 && (codecs < 2 || CODEC_IS_CHAIN(meta->codec));
+}
+
+size_t metadata_encoded_size(const FileMetadata* meta) {
+    unsigned char tmp[METADATA_MAX_SIZE];
+    return metadata_encode(meta, tmp);
+}
+
+size_t metadata_encode(const FileMetadata* meta, unsigned char* buf) {
+    size_t nameLen = strnlen(meta->originalName, MAX_FILENAME_LEN - 1);
+    size_t n = 0;
+    memcpy(buf, MAGIC_COMPACT, sizeof(MAGIC_COMPACT));
+    n += sizeof(MAGIC_COMPACT);
+    buf[n++] = METADATA_VERSION;
+    buf[n++] = meta->stageCount;
+    memcpy(buf + n, meta->chain, meta->stageCount);
+    n += meta->stageCount;
+    n += metadata_put_varint(buf + n, meta->flags);
+    n += metadata_put_varint(buf + n, meta->originalSize);
+    n += metadata_put_varint(buf + n, nameLen);
+    memcpy(buf + n, meta->originalName, nameLen);
+    return n + nameLen;
+}
+
+// Encabezado heredado: estructura cruda de 280 bytes
+static size_t decode_v1(const unsigned char* buf, size_t len, FileMetadata* meta) {
+    if (len < METADATA_V1_SIZE) return 0;
+    memset(meta, 0, sizeof(*meta));
+    meta->magic = METADATA_MAGIC;
+    meta->version = 1;
+    meta->originalSize = load_le(buf + V1_OFF_SIZE, 8);
+    memcpy(meta->originalName, buf + V1_OFF_NAME, MAX_FILENAME_LEN);
+    meta->originalName[MAX_FILENAME_LEN - 1] = '\0';
+    meta->flags = (uint32_t)load_le(buf + V1_OFF_FLAGS, 4);
+    // El formato heredado no registraba el compresor; AES marcaba 0x02 en flags
+    meta->codec = CODEC_ID_UNKNOWN;
+    meta->cipher = (meta->flags & META_FLAG_ENCRYPTED) ? CIPHER_ID_AES : CIPHER_ID_UNKNOWN;
+    return METADATA_V1_SIZE;
+}
+
+size_t metadata_decode(const unsigned char* buf, size_t len, FileMetadata* meta) {
+    if (len >= 4 && (uint32_t)load_le(buf, 4) == METADATA_MAGIC) {
+        return decode_v1(buf, len, meta);
+    }
+    if (len < 6 || memcmp(buf, MAGIC_COMPACT, sizeof(MAGIC_COMPACT)) != 0 || buf[4] != METADATA_VERSION) {
+        return 0;
+    }
+
+    memset(meta, 0, sizeof(*meta));
+    meta->magic = METADATA_MAGIC;
+    meta->version = buf[4];
+
+    size_t count = buf[5];
+    if (count > META_MAX_STAGES || 6 + count > len) return 0;
+    metadata_set_chain(meta, buf + 6, count);
+    size_t n = 6 + count;
+
+    size_t used;
+    uint64_t flags, size, nameLen;
+    if (!(used = metadata_get_varint(buf + n, len - n, &flags)) || flags > UINT32_MAX) return 0;
+    n += used;
+    if (!(used = metadata_get_varint(buf + n, len - n, &size))) return 0;
+    n += used;
+    if (!(used = metadata_get_varint(buf + n, len - n, &nameLen)) || nameLen >= MAX_FILENAME_LEN) return 0;
+    n += used;
+    if (n + nameLen > len) return 0;
+
+    meta->flags = (uint32_t)flags;
+    meta->originalSize = size;
+    memcpy(meta->originalName, buf + n, (size_t)nameLen);
+    meta->originalName[nameLen] = '\0';
+    return n + (size_t)nameLen;
+}
+
+int metadata_write(int fd, const FileMetadata* meta) {
+    unsigned char buf[METADATA_MAX_SIZE];
+    size_t len = metadata_encode(meta, buf);
+    return posix_write_full(fd, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+// Agrega exactamente len bytes del fd a buf[*n]
+static int read_more(int fd, unsigned char* buf, size_t* n, size_t len) {
+    if (*n + len > METADATA_MAX_SIZE || posix_read_full(fd, buf + *n, len) != (ssize_t)len) return -1;
+    *n += len;
+    return 0;
+}
+
+// Agrega un varint leyendo byte a byte, sin consumir nada más del fd
+static int read_varint_bytes(int fd, unsigned char* buf, size_t* n) {
+    for (int i = 0; i < 10; i++) {
+        if (read_more(fd, buf, n, 1) != 0) return -1;
+        if (!(buf[*n - 1] & 0x80)) return 0;
+    }
+    return -1;
+}
+
+int metadata_read_varint(int fd, uint64_t* out) {
+    unsigned char buf[METADATA_MAX_SIZE];
+    size_t n = 0;
+    if (read_varint_bytes(fd, buf, &n) != 0) return -1;
+    return metadata_get_varint(buf, n, out) == n ? 0 : -1;
+}
+
+int metadata_read(int fd, FileMetadata* meta) {
+    // Se lee exactamente lo que ocupa el encabezado: el fd puede ser una tubería sin lseek
+    unsigned char buf[METADATA_MAX_SIZE];
+    size_t n = 0;
+    if (read_more(fd, buf, &n, 4) != 0) return -1;
+
+    if ((uint32_t)load_le(buf, 4) == METADATA_MAGIC) {
+        if (read_more(fd, buf, &n, METADATA_V1_SIZE - 4) != 0) return -1;
+    } else {
+        if (memcmp(buf, MAGIC_COMPACT, sizeof(MAGIC_COMPACT)) != 0 || read_more(fd, buf, &n, 2) != 0) return -1;
+        size_t stages = buf[5];
+        if (stages > META_MAX_STAGES || read_more(fd, buf, &n, stages) != 0) return -1;
+
+        // flags y originalSize; de nameLen hace falta el valor para leer el nombre
+        if (read_varint_bytes(fd, buf, &n) != 0 || read_varint_bytes(fd, buf, &n) != 0) return -1;
+        size_t nameStart = n;
+        uint64_t nameLen;
+        if (read_varint_bytes(fd, buf, &n) != 0 ||
+            metadata_get_varint(buf + nameStart, n - nameStart, &nameLen) == 0 ||
+            nameLen >= MAX_FILENAME_LEN || read_more(fd, buf, &n, (size_t)nameLen) != 0) {
+            return -1;
+        }
+    }
+    return metadata_decode(buf, n, meta) == n ? 0 : -1;
+}
@@ -0,0 +1,93 @@
+#ifndef METADATA_H
+#define METADATA_H
+
+#include <stddef.h>
+#include "common.h"
+
+// Encabezado compacto (versión 3), todos los enteros en varint LEB128:
+//   "MCPF" | version (1 byte) | stageCount (1 byte) | chain (stageCount bytes) |
+//   flags (varint) | originalSize (varint) | nameLen (varint) | name (nameLen bytes)
+// chain enumera las etapas en el orden de escritura (ver META_STAGE_* en common.h), así que
+// los lectores eligen el decodificador sin adivinar. La versión 2 no llegó a publicarse y no
+// se lee.
+// El formato heredado (versión 1) es la estructura de 280 bytes escrita en crudo,
+// con METADATA_MAGIC en little-endian ("FPCM" en disco). Todos se reconocen al leer.
+
+#define METADATA_VERSION 3
+#define METADATA_V1_SIZE 280         // sizeof de la estructura heredada en x86-64 (con relleno)
+#define METADATA_MAX_SIZE (6 + META_MAX_STAGES + 5 + 10 + 2 + MAX_FILENAME_LEN)
+
+/**
+ * Inicializa metadatos para un archivo nuevo
+ * @param meta Metadatos a llenar
+ * @param path Ruta de origen (se guarda solo el nombre base)
+ * @param originalSize Tamaño lógico del original
+ * @param codec CODEC_ID_* usado
+ * @param cipher CIPHER_ID_* usado
+ */
+void metadata_init(FileMetadata* meta, const char* path, uint64_t originalSize, uint8_t codec, uint8_t cipher);
+
+/**
+ * Reemplaza la cadena de etapas y actualiza codec/cipher (primer compresor, o CODEC_CHAIN_ID
+ * si empieza con dos, y primer cifrado)
+ * @param stages Etapas en el orden en que se aplican al escribir
+ * @param count Cantidad de etapas (como máximo META_MAX_STAGES)
+ * @return 0 en éxito, -1 si la cadena es demasiado larga
+ */
+int metadata_set_chain(FileMetadata* meta, const uint8_t* stages, size_t count);
+
+/**
+ * Indica si la cadena es de las que escriben el contenedor y el almacén de fragmentos: hasta
+ * dos compresores (una cadena CODEC_CHAIN_ID) seguidos de como mucho un cifrado
+ */
+int metadata_chain_supported(const FileMetadata* meta);
+
+/**
+ * Tamaño en bytes que ocupará el encabezado compacto
+ */
+size_t metadata_encoded_size(const FileMetadata* meta);
+
+/**
+ * Serializa el encabezado compacto en un buffer de al menos METADATA_MAX_SIZE bytes
+ * @return Bytes escritos
+ */
+size_t metadata_encode(const FileMetadata* meta, unsigned char* buf);
+
+/**
+ * Interpreta un encabezado (compacto o heredado) desde memoria
+ * @return Bytes consumidos, 0 si no hay un encabezado válido
+ */
+size_t metadata_decode(const unsigned char* buf, size_t len, FileMetadata* meta);
+
+/**
+ * Escribe el encabezado compacto en el fd
+ * @return 0 en éxito, -1 en error
+ */
+int metadata_write(int fd, const FileMetadata* meta);
+
+/**
+ * Lee un varint LEB128 del fd byte a byte (apto para tuberías)
+ * @return 0 en éxito, -1 si el fd termina antes o el varint es inválido
+ */
+int metadata_read_varint(int fd, uint64_t* out);
+
+/**
+ * Lee un encabezado (compacto o heredado) y deja el fd justo después de él. Solo consume
+ * los bytes del encabezado, así que funciona sobre tuberías
+ * @return 0 en éxito, -1 si falta o es inválido
+ */
+int metadata_read(int fd, FileMetadata* meta);
+
+/**
+ * Escribe v como varint LEB128 (hasta 10 bytes)
+ * @return Bytes escritos
+ */
+size_t metadata_put_varint(unsigned char* buf, uint64_t v);
+
+/**
+ * Lee un varint LEB128 de como máximo len bytes
+ * @return Bytes consumidos, 0 si está truncado o es inválido
+ */
+size_t metadata_get_varint(const unsigned char* buf, size_t len, uint64_t* out);
+
+#endif // METADATA_H
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include "posix_utils.h"
 #include <fcntl.h>
 #include <unistd.h>
@@ -5,18 +6,91 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
-// Abre un archivo para lectura
+// Descartar page cache de entradas ya procesadas (solo en trabajos de directorio)
+static volatile int drop_cache_enabled = 0;
+
+int posix_is_stdio(const char* path) {
+    return path && strcmp(path, POSIX_STDIO_PATH) == 0;
+}
+
+// Abre un archivo para lectura y avisa al kernel que se leerá completo y en orden
 int posix_open_read(const char* path) {
+    if (posix_is_stdio(path)) return STDIN_FILENO;
     int fd = open(path, O_RDONLY);
     if (fd == -1) {
         fprintf(stderr, "No se puede abrir '%s' para lectura: %s\n", path, strerror(errno));
+        return fd;
     }
+#ifdef POSIX_FADV_SEQUENTIAL
+    // Readahead más amplio; WILLNEED sobre todo el archivo cargaría entradas de varios GB de
+    // golpe y desalojaría la page cache. Los errores se ignoran porque son solo sugerencias
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
     return fd;
 }
 
+void posix_set_drop_cache(int enabled) {
+    drop_cache_enabled = enabled;
+}
+
+// Cierra una entrada procesada, liberando su page cache si corresponde
+int posix_close_input(int fd) {
+    if (fd < 0) return 0;
+#ifdef POSIX_FADV_DONTNEED
+    if (drop_cache_enabled) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+#endif
+    return posix_close(fd);
+}
+
+// Reserva bloques para [offset, offset + size) sin modificar el tamaño visible
+static int preallocate_range(int fd, off_t offset, off_t size) {
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, size) == -1) {
+        // EOPNOTSUPP/ENOSYS (tmpfs antiguos, NFS...) no son errores reales
+        if (errno != EOPNOTSUPP && errno != ENOSYS && errno != EINVAL) {
+            fprintf(stderr, "Advertencia: fallocate falló: %s\n", strerror(errno));
+        }
+        return -1;
+    }
+    return 0;
+#else
+    (void)fd;
+    (void)offset;
+    (void)size;
+    return -1;
+#endif
+}
+
+void posix_preallocate(int fd, off_t size) {
+    if (fd < 0 || size <= 0) return;
+    preallocate_range(fd, 0, size);
+}
+
+// En un archivo disperso solo se reservan las extensiones con datos: reservar desde 0 llenaría
+// los huecos que la restauración recrea
+void posix_preallocate_map(int fd, const PosixSparseMap* map, off_t size) {
+    if (map->count == 0) {
+        posix_preallocate(fd, size);
+        return;
+    }
+    if (fd < 0) return;
+    for (uint32_t i = 0; i < map->count; i++) {
+        const PosixExtent* ext = &map->extents[i];
+        if (ext->length > 0 && preallocate_range(fd, (off_t)ext->offset, (off_t)ext->length) != 0) return;
+    }
+}
+
 // Abre un archivo para escritura (crea o trunca)
 int posix_open_write(const char* path) {
+    if (posix_is_stdio(path)) return STDOUT_FILENO;
+    // Una salida con varios enlaces (archivos repetidos de un directorio) se reemplaza en vez de
+    // truncarse, para no cambiar también las otras rutas
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISREG(st.st_mode) && st.st_nlink > 1) unlink(path);
     int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, FILE_MODE);
     if (fd == -1) {
         fprintf(stderr, "No se puede abrir '%s' para escritura: %s\n", path, strerror(errno));
@@ -97,8 +171,8 @@ int posix_is_regular_file(int fd) {
 
 // Cierra file descriptor de forma segura
 int posix_close(int fd) {
-    if (fd < 0) {
-        return 0; // Ya está cerrado o no válido
+    if (fd <= STDERR_FILENO) {
+        return 0; // Ya está cerrado, no es válido o es un descriptor estándar
     }
     
     if (close(fd) == -1) {
@@ -108,3 +182,237 @@ int posix_close(int fd) {
     
     return 0;
 }
+
+
+// Construye el mapa de regiones con datos. Devuelve 1 si hay huecos, 0 si es denso
+int posix_sparse_map(int fd, off_t size, PosixSparseMap* map) {
+    map->extents = NULL;
+    map->count = 0;
+    map->dataBytes = 0;
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    struct stat st;
+    // Si todos los bloques están asignados no puede haber huecos: evitar los lseek
+    if (size <= 0 || fstat(fd, &st) == -1 || (off_t)st.st_blocks * 512 >= size) return 0;
+
+    uint32_t capacity = 0;
+    off_t pos = 0;
+    while (pos < size) {
+        off_t data = lseek(fd, pos, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO) break;          // El resto del archivo es hueco
+            posix_free_sparse_map(map);
+            return 0;                           // SEEK_DATA no soportado: tratar como denso
+        }
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        if (hole == -1 || hole > size) hole = size;
+
+        if (map->count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            PosixExtent* grown = realloc(map->extents, capacity * sizeof(PosixExtent));
+            if (!grown) {
+                posix_free_sparse_map(map);
+                return 0;
+            }
+            map->extents = grown;
+        }
+        map->extents[map->count].offset = (uint64_t)data;
+        map->extents[map->count].length = (uint64_t)(hole - data);
+        map->count++;
+        map->dataBytes += (uint64_t)(hole - data);
+        pos = hole;
+    }
+    lseek(fd, 0, SEEK_SET);
+
+    // Archivo formado solo por huecos: una extensión vacía distingue el caso de un archivo denso
+    if (map->count == 0) {
+        map->extents = (PosixExtent*)calloc(1, sizeof(PosixExtent));
+        if (!map->extents) return 0;
+        map->count = 1;
+        return 1;
+    }
+
+    // Una sola extensión que cubre todo el archivo: es denso
+    if (map->count == 1 && map->extents[0].offset == 0 && map->dataBytes == (uint64_t)size) {
+        posix_free_sparse_map(map);
+        return 0;
+    }
+    return 1;
+#else
+    (void)fd; (void)size;
+    return 0;
+#endif
+}
+
+// Carga solo los datos reales del archivo (empaquetados si hay huecos)
+void* posix_load_data(int fd, off_t size, size_t extra, PosixSparseMap* map, size_t* dataLen) {
+    int sparse = posix_sparse_map(fd, size, map);
+    size_t len = sparse ? (size_t)map->dataBytes : (size_t)size;
+
+    unsigned char* buf = (unsigned char*)malloc(len + extra > 0 ? len + extra : 1);
+    if (!buf) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        posix_free_sparse_map(map);
+        return NULL;
+    }
+
+    ssize_t got = sparse ? posix_read_packed(fd, map, 0, buf, len) : posix_read_full(fd, buf, len);
+    if (got != (ssize_t)len) {
+        fprintf(stderr, "Falló lectura de archivo completo: esperado %zu, obtenido %ld bytes\n", len, (long)got);
+        free(buf);
+        posix_free_sparse_map(map);
+        return NULL;
+    }
+
+    *dataLen = len;
+    return buf;
+}
+
+// Recorre las extensiones que cubren [packedPos, packedPos + len) y aplica pread/pwrite
+static ssize_t packed_io(int fd, const PosixSparseMap* map, uint64_t packedPos, void* buf, size_t len, int writing) {
+    unsigned char* ptr = (unsigned char*)buf;
+    uint64_t base = 0;
+    size_t done = 0;
+
+    for (uint32_t i = 0; i < map->count && done < len; i++) {
+        const PosixExtent* ext = &map->extents[i];
+        if (packedPos + done >= base + ext->length) {
+            base += ext->length;
+            continue;
+        }
+        uint64_t within = packedPos + done - base;
+        size_t chunk = (size_t)(ext->length - within);
+        if (chunk > len - done) chunk = len - done;
+
+        size_t moved = 0;
+        while (moved < chunk) {
+            off_t at = (off_t)(ext->offset + within + moved);
+            ssize_t n = writing ? pwrite(fd, ptr + done + moved, chunk - moved, at)
+                                : pread(fd, ptr + done + moved, chunk - moved, at);
+            if (n == -1) {
+                if (errno == EINTR) continue;
+                fprintf(stderr, "Error de %s: %s\n", writing ? "escritura" : "lectura", strerror(errno));
+                return -1;
+            }
+            if (n == 0) return (ssize_t)(done + moved);
+            moved += (size_t)n;
+        }
+        done += chunk;
+        base += ext->length;
+    }
+    return (ssize_t)done;
+}
+
+ssize_t posix_write_packed(int fd, const PosixSparseMap* map, uint64_t packedPos, const void* buf, size_t len) {
+    return packed_io(fd, map, packedPos, (void*)buf, len, 1);
+}
+
+ssize_t posix_read_packed(int fd, const PosixSparseMap* map, uint64_t packedPos, void* buf, size_t len) {
+    return packed_io(fd, map, packedPos, buf, len, 0);
+}
+
+// Fija el tamaño lógico: lo que no se escribió queda como hueco
+int posix_finish_sparse(int fd, uint64_t logicalSize) {
+    if (ftruncate(fd, (off_t)logicalSize) == -1) {
+        fprintf(stderr, "Error ftruncate: %s\n", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int posix_store_data(int fd, const PosixSparseMap* map, const void* buf, size_t len, uint64_t logicalSize) {
+    if (!map || map->count == 0) {
+        return posix_write_full(fd, buf, len) == (ssize_t)len ? 0 : -1;
+    }
+    if (posix_write_packed(fd, map, 0, buf, len) != (ssize_t)len) return -1;
+    return posix_finish_sparse(fd, logicalSize);
+}
+
+int posix_store_chunk(int fd, const PosixSparseMap* map, uint64_t packedPos, const void* buf, size_t len) {
+    if (!map || map->count == 0) {
+        return posix_write_full(fd, buf, len) == (ssize_t)len ? 0 : -1;
+    }
+    return posix_write_packed(fd, map, packedPos, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+int posix_write_sparse_map(int fd, const PosixSparseMap* map) {
+    if (posix_write_full(fd, &map->count, sizeof(uint32_t)) != sizeof(uint32_t)) return -1;
+    size_t bytes = map->count * sizeof(PosixExtent);
+    if (posix_write_full(fd, map->extents, bytes) != (ssize_t)bytes) return -1;
+    return 0;
+}
+
+int posix_read_sparse_map(int fd, PosixSparseMap* map, uint64_t logicalSize) {
+    map->extents = NULL;
+    map->count = 0;
+    map->dataBytes = 0;
+
+    uint32_t count;
+    if (posix_read_full(fd, &count, sizeof(uint32_t)) != sizeof(uint32_t) || count > POSIX_MAX_EXTENTS) {
+        fprintf(stderr, "Mapa de huecos inválido\n");
+        return -1;
+    }
+    if (count == 0) return 0;
+
+    PosixExtent* extents = (PosixExtent*)malloc(count * sizeof(PosixExtent));
+    if (!extents) {
+        fprintf(stderr, "Falló asignación de memoria: %s\n", strerror(errno));
+        return -1;
+    }
+    size_t bytes = count * sizeof(PosixExtent);
+    if (posix_read_full(fd, extents, bytes) != (ssize_t)bytes) {
+        fprintf(stderr, "Mapa de huecos truncado\n");
+        free(extents);
+        return -1;
+    }
+
+    // Las extensiones deben ser crecientes, sin solaparse y dentro del tamaño lógico
+    uint64_t end = 0, total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (extents[i].offset < end || extents[i].length > logicalSize ||
+            extents[i].offset > logicalSize - extents[i].length) {
+            fprintf(stderr, "Mapa de huecos corrupto\n");
+            free(extents);
+            return -1;
+        }
+        end = extents[i].offset + extents[i].length;
+        total += extents[i].length;
+    }
+
+    map->extents = extents;
+    map->count = count;
+    map->dataBytes = total;
+    return 0;
+}
+
+void posix_free_sparse_map(PosixSparseMap* map) {
+    if (!map) return;
+    free(map->extents);
+    map->extents = NULL;
+    map->count = 0;
+    map->dataBytes = 0;
+}
+
+int posix_make_dirs(const char* path) {
+    char buf[4096];
+    size_t len = strlen(path);
+    if (len == 0 || len >= sizeof(buf)) return -1;
+    memcpy(buf, path, len + 1);
+
+    // Cada prefijo que termina en '/' se crea en orden; los que ya existen no son error
+    for (size_t i = 1; i <= len; i++) {
+        if (buf[i] != '/' && buf[i] != '\0') continue;
+        char saved = buf[i];
+        buf[i] = '\0';
+        if (mkdir(buf, 0755) == -1 && errno != EEXIST) {
+            fprintf(stderr, "No se puede crear el directorio '%s': %s\n", buf, strerror(errno));
+            return -1;
+        }
+        buf[i] = saved;
+    }
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "'%s' no es un directorio\n", path);
+        return -1;
+    }
+    return 0;
+}
@@ -3,24 +3,85 @@
 
 #include <sys/types.h>
 #include <stddef.h>
+#include <stdint.h>
 
 // Permisos estándar para archivos nuevos: rw-r--r-- (0644)
 #define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
 
+// Ruta que designa la entrada o salida estándar (tuberías)
+#define POSIX_STDIO_PATH "-"
+
+// Máximo de extensiones de datos aceptadas al leer un mapa disperso
+#define POSIX_MAX_EXTENTS (1u << 24)
+
+// Región con datos reales de un archivo disperso (lo que no está cubierto es hueco)
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} PosixExtent;
+
+// Mapa de datos de un archivo disperso; count == 0 significa archivo denso
+typedef struct {
+    PosixExtent* extents;
+    uint32_t count;
+    uint64_t dataBytes;          // Suma de las longitudes de todas las extensiones
+} PosixSparseMap;
+
+/**
+ * Indica si la ruta es POSIX_STDIO_PATH
+ * @return 1 si designa stdin/stdout, 0 si no
+ */
+int posix_is_stdio(const char* path);
+
 /**
  * Abre un archivo para lectura (O_RDONLY)
- * @param path Ruta del archivo
+ * @param path Ruta del archivo, o POSIX_STDIO_PATH para la entrada estándar
  * @return File descriptor o -1 en error
  */
 int posix_open_read(const char* path);
 
 /**
- * Abre un archivo para escritura (O_WRONLY | O_CREAT | O_TRUNC)
- * @param path Ruta del archivo
+ * Abre un archivo para escritura (O_WRONLY | O_CREAT | O_TRUNC); si tiene varios enlaces duros,
+ * primero se quita esta ruta para no modificar las demás
+ * @param path Ruta del archivo, o POSIX_STDIO_PATH para la salida estándar
  * @return File descriptor o -1 en error
  */
 int posix_open_write(const char* path);
 
+/**
+ * Cierra un descriptor de entrada ya procesado. Si el modo de liberación de
+ * caché está activo (trabajos de directorio), descarta sus páginas con
+ * POSIX_FADV_DONTNEED antes de cerrar.
+ * @param fd File descriptor
+ * @return 0 en éxito, -1 en error
+ */
+int posix_close_input(int fd);
+
+/**
+ * Activa o desactiva el descarte de page cache de entradas procesadas
+ * @param enabled 1 para activar, 0 para desactivar
+ */
+void posix_set_drop_cache(int enabled);
+
+/**
+ * Reserva espacio en disco para la salida sin cambiar su tamaño lógico
+ * (fallocate con FALLOC_FL_KEEP_SIZE). Reduce la fragmentación de salidas grandes que se
+ * escriben por partes; antes de una sola escritura no aporta nada.
+ * Es una sugerencia: si el sistema de archivos no lo soporta no hace nada.
+ * @param fd File descriptor de salida
+ * @param size Tamaño estimado de la salida en bytes
+ */
+void posix_preallocate(int fd, off_t size);
+
+/**
+ * Como posix_preallocate, pero para restaurar un archivo disperso: con map->count > 0 solo
+ * reserva cada extensión con datos en su posición lógica, para no llenar los huecos
+ * @param fd File descriptor de salida
+ * @param map Mapa disperso del original (count == 0 = denso)
+ * @param size Tamaño a reservar si el archivo es denso
+ */
+void posix_preallocate_map(int fd, const PosixSparseMap* map, off_t size);
+
 /**
  * Lee exactamente 'count' bytes del fd (maneja lecturas parciales e EINTR)
  * @param fd File descriptor
@@ -54,10 +115,95 @@ off_t posix_get_file_size(int fd);
 int posix_is_regular_file(int fd);
 
 /**
- * Cierra un file descriptor de forma segura (verifica >= 0)
+ * Cierra un file descriptor de forma segura (verifica >= 0; stdin/stdout/stderr quedan abiertos)
  * @param fd File descriptor
  * @return 0 en éxito, -1 en error
  */
 int posix_close(int fd);
 
+/**
+ * Detecta los huecos de un archivo con lseek(SEEK_DATA/SEEK_HOLE)
+ * @param fd File descriptor de entrada
+ * @param size Tamaño lógico del archivo
+ * @param map Mapa de salida; queda vacío (count 0) si el archivo es denso
+ * @return 1 si el archivo tiene huecos, 0 si es denso o no se pudo determinar
+ */
+int posix_sparse_map(int fd, off_t size, PosixSparseMap* map);
+
+/**
+ * Carga en memoria solo las regiones con datos del archivo, detectando huecos
+ * con lseek(SEEK_DATA/SEEK_HOLE). Si el archivo tiene huecos, los datos quedan
+ * empaquetados de forma contigua y 'map' describe dónde iban; si no, map->count es 0.
+ * @param fd File descriptor de entrada
+ * @param size Tamaño lógico del archivo
+ * @param extra Bytes adicionales a reservar al final del buffer (p. ej. relleno)
+ * @param map Mapa de salida (liberar con posix_free_sparse_map)
+ * @param dataLen Bytes de datos reales cargados
+ * @return Buffer con los datos (liberar con free) o NULL en error
+ */
+void* posix_load_data(int fd, off_t size, size_t extra, PosixSparseMap* map, size_t* dataLen);
+
+/**
+ * Escribe datos empaquetados en sus posiciones lógicas y recrea los huecos.
+ * Con map->count == 0 equivale a posix_write_full.
+ * @param fd File descriptor de salida (recién creado o truncado)
+ * @param map Mapa disperso leído del contenedor
+ * @param buf Datos empaquetados
+ * @param len Bytes en buf
+ * @param logicalSize Tamaño lógico final del archivo
+ * @return 0 en éxito, -1 en error
+ */
+int posix_store_data(int fd, const PosixSparseMap* map, const void* buf, size_t len, uint64_t logicalSize);
+
+/**
+ * Versión por tramos de posix_store_data para decodificadores con memoria acotada:
+ * escribe el tramo que empieza en 'packedPos' del flujo empaquetado (secuencial si
+ * map->count == 0). Al terminar, los archivos dispersos se cierran con posix_finish_sparse
+ * @return 0 en éxito, -1 en error
+ */
+int posix_store_chunk(int fd, const PosixSparseMap* map, uint64_t packedPos, const void* buf, size_t len);
+
+/**
+ * Escribe un tramo del flujo empaquetado que empieza en 'packedPos' en las
+ * posiciones lógicas que le corresponden (pwrite), para escritores por bloques
+ * @return Bytes escritos, -1 en error
+ */
+ssize_t posix_write_packed(int fd, const PosixSparseMap* map, uint64_t packedPos, const void* buf, size_t len);
+
+/**
+ * Lee un tramo del flujo empaquetado que empieza en 'packedPos' (pread)
+ * @return Bytes leídos, -1 en error
+ */
+ssize_t posix_read_packed(int fd, const PosixSparseMap* map, uint64_t packedPos, void* buf, size_t len);
+
+/**
+ * Termina un archivo disperso: fija su tamaño lógico (el final queda como hueco)
+ * @return 0 en éxito, -1 en error
+ */
+int posix_finish_sparse(int fd, uint64_t logicalSize);
+
+/**
+ * Serializa el mapa disperso en el contenedor: [uint32 count][count x (uint64 offset, uint64 length)]
+ * @return 0 en éxito, -1 en error
+ */
+int posix_write_sparse_map(int fd, const PosixSparseMap* map);
+
+/**
+ * Lee y valida un mapa disperso serializado con posix_write_sparse_map
+ * @param logicalSize Tamaño lógico declarado en los metadatos
+ * @return 0 en éxito, -1 en error
+ */
+int posix_read_sparse_map(int fd, PosixSparseMap* map, uint64_t logicalSize);
+
+/**
+ * Libera las extensiones de un mapa disperso
+ */
+void posix_free_sparse_map(PosixSparseMap* map);
+
+/**
+ * Crea un directorio y los que le faltan en la ruta (como mkdir -p)
+ * @return 0 si el directorio existe al terminar, -1 en error
+ */
+int posix_make_dirs(const char* path);
+
 #endif // POSIX_UTILS_H
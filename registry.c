@@ -0,0 +1,357 @@
+#include "registry.h"
+#include "metadata.h"
+#include "Compresion/huffman.h"
+#include "Compresion/rle.h"
+#include "Compresion/lzw.h"
+#include "Compresion/lzss.h"
+#include "Encription/vigenere.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ---- Cotas de expansión ----
+
+// Tabla (nsym + símbolos con frecuencia + totalBits) y, como Huffman es óptimo, a lo sumo 8 bits por byte
+static size_t huffman_bound(size_t rawLen) {
+    return rawLen + 2 * sizeof(uint32_t) + 256 * (1 + sizeof(uint32_t));
+}
+
+// Peor caso: cada byte es una ejecución [uint32 count][byte]
+static size_t rle_bound(size_t rawLen) {
+    return rawLen * (sizeof(uint32_t) + 1);
+}
+
+// Un código de 16 bits por byte como máximo, más el conteo
+static size_t lzw_bound(size_t rawLen) {
+    return sizeof(uint32_t) + rawLen * sizeof(uint16_t);
+}
+
+// Niveles de LZSS: mismo formato y mismo decodificador, distinto esfuerzo al buscar
+static int lzss_fast_encode(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) {
+    return lzss_encode_level(src, len, dst, dstLen, LZSS_LEVEL_FAST);
+}
+
+static int lzss_max_encode(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) {
+    return lzss_encode_level(src, len, dst, dstLen, LZSS_LEVEL_MAX);
+}
+
+// ---- Flujo genérico por bloques ----
+// Comprimir: se acumula hasta CODEC_STREAM_BLOCK y se emite una trama por bloque.
+// Descomprimir: se acumula una trama completa, se decodifica y se entrega. La memoria
+// queda acotada por un bloque más su cota de expansión, sin importar el tamaño del flujo.
+
+static int emit_frame(CodecStream* st, const unsigned char* raw, size_t rawLen) {
+    unsigned char* enc = NULL;
+    size_t encLen = 0;
+    if (st->ops->encode(raw, rawLen, &enc, &encLen) != 0) return -1;
+
+    unsigned char hdr[20];
+    size_t n = metadata_put_varint(hdr, rawLen);
+    n += metadata_put_varint(hdr + n, encLen);
+    int rc = (st->sink(st->opaque, hdr, n) == 0 && st->sink(st->opaque, enc, encLen) == 0) ? 0 : -1;
+    free(enc);
+    return rc;
+}
+
+static int block_stream_init(CodecStream* st) {
+    st->cap = st->encoding ? CODEC_STREAM_BLOCK : 20 + st->ops->bound(CODEC_STREAM_BLOCK);
+    st->buf = (unsigned char*)malloc(st->cap);
+    st->out = st->encoding ? NULL : (unsigned char*)malloc(CODEC_STREAM_BLOCK);
+    if (!st->buf || (!st->encoding && !st->out)) {
+        free(st->buf);
+        free(st->out);
+        st->buf = st->out = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Decodifica todas las tramas completas del buffer
+static int drain_frames(CodecStream* st) {
+    size_t pos = 0;
+    while (pos < st->len && !st->finished) {
+        uint64_t rawLen, encLen;
+        size_t a = metadata_get_varint(st->buf + pos, st->len - pos, &rawLen);
+        if (a == 0) {
+            if (st->len - pos >= 10) return -1;   // varint inválido
+            break;                                // cabecera incompleta
+        }
+        if (rawLen == 0) {
+            st->finished = 1;
+            pos += a;
+            break;
+        }
+        size_t b = metadata_get_varint(st->buf + pos + a, st->len - pos - a, &encLen);
+        if (b == 0) {
+            if (st->len - pos - a >= 10) return -1;
+            break;
+        }
+        if (rawLen > CODEC_STREAM_BLOCK || encLen > st->ops->bound((size_t)rawLen)) {
+            fprintf(stderr, "Trama inválida en el flujo %s\n", st->ops->name);
+            return -1;
+        }
+        if (st->len - pos - a - b < encLen) break;  // faltan datos de la trama
+
+        const unsigned char* enc = st->buf + pos + a + b;
+        if (st->ops->decode(enc, (size_t)encLen, st->out, (size_t)rawLen) != 0 ||
+            st->sink(st->opaque, st->out, (size_t)rawLen) != 0) {
+            return -1;
+        }
+        pos += a + b + (size_t)encLen;
+    }
+    if (st->finished && pos < st->len) {
+        fprintf(stderr, "Datos sobrantes después del final del flujo\n");
+        return -1;
+    }
+    memmove(st->buf, st->buf + pos, st->len - pos);
+    st->len -= pos;
+    return 0;
+}
+
+static int block_stream_update(CodecStream* st, const unsigned char* data, size_t len) {
+    while (len > 0) {
+        if (!st->encoding && st->finished) {
+            fprintf(stderr, "Datos sobrantes después del final del flujo\n");
+            return -1;
+        }
+        size_t chunk = st->cap - st->len < len ? st->cap - st->len : len;
+        memcpy(st->buf + st->len, data, chunk);
+        st->len += chunk;
+        data += chunk;
+        len -= chunk;
+
+        if (st->encoding) {
+            if (st->len == st->cap) {
+                if (emit_frame(st, st->buf, st->len) != 0) return -1;
+                st->len = 0;
+            }
+        } else if (drain_frames(st) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int block_stream_final(CodecStream* st) {
+    if (st->encoding) {
+        if (st->len > 0 && emit_frame(st, st->buf, st->len) != 0) return -1;
+        unsigned char end = 0;
+        return st->sink(st->opaque, &end, 1);
+    }
+    if (drain_frames(st) != 0) return -1;
+    if (!st->finished || st->len != 0) {
+        fprintf(stderr, "Flujo %s truncado\n", st->ops->name);
+        return -1;
+    }
+    return 0;
+}
+
+// ---- Cadenas de compresores ----
+// outer se aplica en memoria sobre la salida de inner, sin archivos intermedios. outer necesita
+// el largo exacto de lo que reconstruye, así que el bloque lo lleva delante:
+//   midLen (varint) | bloque de outer
+
+static size_t chain_bound(uint8_t inner, uint8_t outer, size_t rawLen) {
+    return 10 + codec_find_id(outer)->bound(codec_find_id(inner)->bound(rawLen));
+}
+
+static int chain_encode(uint8_t inner, uint8_t outer, const unsigned char* src, size_t len,
+                        unsigned char** dst, size_t* dstLen) {
+    unsigned char* mid = NULL;
+    size_t midLen = 0;
+    if (codec_find_id(inner)->encode(src, len, &mid, &midLen) != 0) return -1;
+    unsigned char* enc = NULL;
+    size_t encLen = 0;
+    int rc = codec_find_id(outer)->encode(mid, midLen, &enc, &encLen);
+    free(mid);
+    if (rc != 0) return -1;
+
+    unsigned char* out = (unsigned char*)malloc(10 + encLen);
+    if (!out) {
+        free(enc);
+        return -1;
+    }
+    size_t n = metadata_put_varint(out, midLen);
+    memcpy(out + n, enc, encLen);
+    free(enc);
+    *dst = out;
+    *dstLen = n + encLen;
+    return 0;
+}
+
+static int chain_decode(uint8_t inner, uint8_t outer, const unsigned char* src, size_t srcLen,
+                        unsigned char* dst, size_t dstLen) {
+    const CodecOps* a = codec_find_id(inner);
+    uint64_t midLen;
+    size_t n = metadata_get_varint(src, srcLen, &midLen);
+    if (n == 0 || midLen > a->bound(dstLen)) return -1;
+    unsigned char* mid = (unsigned char*)malloc(midLen > 0 ? (size_t)midLen : 1);
+    if (!mid) return -1;
+    int rc = codec_find_id(outer)->decode(src + n, srcLen - n, mid, (size_t)midLen) == 0 &&
+             a->decode(mid, (size_t)midLen, dst, dstLen) == 0 ? 0 : -1;
+    free(mid);
+    return rc;
+}
+
+// Operaciones de bloque de una cadena; el flujo es el genérico por bloques
+#define CODEC_CHAIN_OPS(name, inner, outer)                                                              \
+    static size_t name##_bound(size_t rawLen) { return chain_bound(inner, outer, rawLen); }             \
+    static int name##_encode(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen) { \
+        return chain_encode(inner, outer, src, len, dst, dstLen);                                      \
+    }                                                                                                   \
+    static int name##_decode(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen) { \
+        return chain_decode(inner, outer, src, srcLen, dst, dstLen);                                   \
+    }
+
+CODEC_CHAIN_OPS(rle_huffman, CODEC_ID_RLE, CODEC_ID_HUFFMAN)
+CODEC_CHAIN_OPS(lzw_huffman, CODEC_ID_LZW, CODEC_ID_HUFFMAN)
+CODEC_CHAIN_OPS(lzss_huffman, CODEC_ID_LZSS, CODEC_ID_HUFFMAN)
+
+static const CodecOps codecs[] = {
+    { "huffman", CODEC_ID_HUFFMAN, "bin", 3, huffman_bound, huffman_encode_buffer, huffman_decode_buffer,
+      block_stream_init, block_stream_update, block_stream_final, writeHuffman, readHuffman },
+    { "rle",     CODEC_ID_RLE,     "rle", 1, rle_bound,     rle_encode_buffer,     rle_decode_buffer,
+      block_stream_init, block_stream_update, block_stream_final, writeRLE, readRLE },
+    { "lzw",     CODEC_ID_LZW,     "lzw", 40, lzw_bound,    lzw_encode_buffer,     lzw_decode_buffer,
+      block_stream_init, block_stream_update, block_stream_final, writeLZW, readLZW },
+    { "lzss",    CODEC_ID_LZSS,    "lzs", 2, lzss_bound,    lzss_encode_buffer,    lzss_decode_buffer,
+      block_stream_init, block_stream_update, block_stream_final, writeLZSS, readLZSS },
+    // Los otros niveles de LZSS solo cambian el codificador; sus archivos se leen igual que los de lzss
+    { "lzss-fast", CODEC_ID_LZSS_FAST, "lzs", 1, lzss_bound, lzss_fast_encode,      lzss_decode_buffer,
+      block_stream_init, block_stream_update, block_stream_final, NULL, readLZSS },
+    { "lzss-max", CODEC_ID_LZSS_MAX, "lzs", 10, lzss_bound,  lzss_max_encode,       lzss_decode_buffer,
+      block_stream_init, block_stream_update, block_stream_final, NULL, readLZSS },
+    // Cadenas: solo en el contenedor y en el almacén de fragmentos (no hay formato heredado)
+    { "rle+huffman", CODEC_CHAIN_ID(CODEC_ID_RLE, CODEC_ID_HUFFMAN), "bin", 1 + 3, rle_huffman_bound,
+      rle_huffman_encode, rle_huffman_decode, block_stream_init, block_stream_update, block_stream_final, NULL, NULL },
+    { "lzw+huffman", CODEC_CHAIN_ID(CODEC_ID_LZW, CODEC_ID_HUFFMAN), "bin", 40 + 3, lzw_huffman_bound,
+      lzw_huffman_encode, lzw_huffman_decode, block_stream_init, block_stream_update, block_stream_final, NULL, NULL },
+    { "lzss+huffman", CODEC_CHAIN_ID(CODEC_ID_LZSS, CODEC_ID_HUFFMAN), "bin", 2 + 3, lzss_huffman_bound,
+      lzss_huffman_encode, lzss_huffman_decode, block_stream_init, block_stream_update, block_stream_final, NULL, NULL },
+};
+
+// ---- Cifrados ----
+
+static void vigenere_key_init(CipherKey* key, const char* password) {
+    key->password = password;
+}
+
+static size_t vigenere_block_encrypt(const CipherKey* key, const unsigned char* src, size_t len, unsigned char* dst) {
+    if (dst != src) memcpy(dst, src, len);
+    vigenere_apply(dst, len, 0, key->password, 1);
+    return len;
+}
+
+static int vigenere_block_decrypt(const CipherKey* key, unsigned char* src, size_t len, unsigned char* dst, size_t* outLen) {
+    if (dst != src) memcpy(dst, src, len);
+    vigenere_apply(dst, len, 0, key->password, 0);
+    *outLen = len;
+    return 0;
+}
+
+static void vigenere_key_clear(CipherKey* key) {
+    key->password = NULL;
+}
+
+static void aes_key_init(CipherKey* key, const char* password) {
+    key->password = password;
+    aes_init(&key->aes, password);
+}
+
+static size_t aes_block_encrypt(const CipherKey* key, const unsigned char* src, size_t len, unsigned char* dst) {
+    return aes_encrypt_buffer(&key->aes, src, len, dst);
+}
+
+static int aes_block_decrypt(const CipherKey* key, unsigned char* src, size_t len, unsigned char* dst, size_t* outLen) {
+    return aes_decrypt_buffer(&key->aes, src, len, dst, outLen);
+}
+
+static void aes_key_clear(CipherKey* key) {
+    aes_clear(&key->aes);
+    key->password = NULL;
+}
+
+static const CipherOps ciphers[] = {
+    { "vigenere", CIPHER_ID_VIGENERE, 0, vigenere_key_init, vigenere_block_encrypt, vigenere_block_decrypt,
+      vigenere_key_clear, vigenere_encrypt_file, vigenere_decrypt_file },
+    { "aes",      CIPHER_ID_AES, AES_BLOCK_SIZE, aes_key_init, aes_block_encrypt, aes_block_decrypt,
+      aes_key_clear, aes_encrypt_file, aes_decrypt_file },
+};
+
+#define COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+const CodecOps* codec_find_name(const char* name) {
+    for (size_t i = 0; name && i < COUNT(codecs); i++) {
+        if (strcmp(codecs[i].name, name) == 0) return &codecs[i];
+    }
+    return NULL;
+}
+
+const CodecOps* codec_find_id(uint8_t id) {
+    for (size_t i = 0; i < COUNT(codecs); i++) {
+        if (codecs[i].id == id) return &codecs[i];
+    }
+    return NULL;
+}
+
+const CodecOps* codec_find_extension(const char* ext) {
+    for (size_t i = 0; ext && i < COUNT(codecs); i++) {
+        if (strcmp(codecs[i].extension, ext) == 0) return &codecs[i];
+    }
+    return NULL;
+}
+
+const CipherOps* cipher_find_name(const char* name) {
+    for (size_t i = 0; name && i < COUNT(ciphers); i++) {
+        if (strcmp(ciphers[i].name, name) == 0) return &ciphers[i];
+    }
+    return NULL;
+}
+
+const CipherOps* cipher_find_id(uint8_t id) {
+    for (size_t i = 0; i < COUNT(ciphers); i++) {
+        if (ciphers[i].id == id) return &ciphers[i];
+    }
+    return NULL;
+}
+
+void codec_names(char* buf, size_t size) {
+    buf[0] = '\0';
+    for (size_t i = 0; i < COUNT(codecs); i++) {
+        if (i > 0) strncat(buf, ", ", size - strlen(buf) - 1);
+        strncat(buf, codecs[i].name, size - strlen(buf) - 1);
+    }
+}
+
+void cipher_names(char* buf, size_t size) {
+    buf[0] = '\0';
+    for (size_t i = 0; i < COUNT(ciphers); i++) {
+        if (i > 0) strncat(buf, ", ", size - strlen(buf) - 1);
+        strncat(buf, ciphers[i].name, size - strlen(buf) - 1);
+    }
+}
+
+int codec_stream_open(CodecStream* st, const CodecOps* ops, int encoding, CodecSink sink, void* opaque) {
+    memset(st, 0, sizeof(*st));
+    st->ops = ops;
+    st->encoding = encoding;
+    st->sink = sink;
+    st->opaque = opaque;
+    return ops->stream_init(st);
+}
+
+int codec_stream_write(CodecStream* st, const unsigned char* data, size_t len) {
+    return st->ops->stream_update(st, data, len);
+}
+
+int codec_stream_close(CodecStream* st) {
+    int rc = st->ops->stream_final(st);
+    codec_stream_abort(st);
+    return rc;
+}
+
+void codec_stream_abort(CodecStream* st) {
+    free(st->buf);
+    free(st->out);
+    st->buf = st->out = NULL;
+}
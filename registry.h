@@ -0,0 +1,123 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common.h"
+#include "Encription/aes.h"
+
+// Registro de compresores y cifrados: un descriptor por algoritmo con su nombre, ID,
+// extensión y operaciones. La orquestación elige el algoritmo con una sola búsqueda en
+// la tabla; agregar un algoritmo es agregar su descriptor en registry.c.
+
+#define CODEC_STREAM_BLOCK (1u << 20)   // Datos originales por trama en los flujos
+
+// --comp-alg store: contenedor sin compresor (CODEC_ID_NONE), los bloques se escriben tal cual
+#define CODEC_STORE_NAME      "store"
+#define CODEC_STORE_EXTENSION "mcs"
+
+// Recibe la salida de un flujo; devuelve 0 si pudo consumirla
+typedef int (*CodecSink)(void* opaque, const unsigned char* data, size_t len);
+
+typedef struct CodecOps CodecOps;
+
+// Estado de un flujo de compresión o descompresión. Tramas: rawLen (varint) |
+// encLen (varint) | bloque codificado; una trama con rawLen = 0 cierra el flujo
+typedef struct {
+    const CodecOps* ops;
+    int encoding;               // 1 = comprimir, 0 = descomprimir
+    CodecSink sink;
+    void* opaque;
+    unsigned char* buf;         // Bloque pendiente (comprimir) o trama incompleta (descomprimir)
+    size_t len;
+    size_t cap;
+    unsigned char* out;         // Bloque decodificado (solo al descomprimir)
+    int finished;               // Se vio la trama final
+} CodecStream;
+
+struct CodecOps {
+    const char* name;           // Nombre en la línea de comandos
+    uint8_t id;                 // CODEC_ID_* guardado en el encabezado
+    const char* extension;      // Extensión de los archivos comprimidos
+    unsigned cost;              // Coste relativo por byte (RLE = 1), para estimar la carga
+
+    // Tamaño máximo del bloque codificado para rawLen bytes
+    size_t (*bound)(size_t rawLen);
+    // Bloque en memoria: encode reserva *dst con malloc; decode recibe el tamaño original exacto
+    int (*encode)(const unsigned char* src, size_t len, unsigned char** dst, size_t* dstLen);
+    int (*decode)(const unsigned char* src, size_t srcLen, unsigned char* dst, size_t dstLen);
+
+    // Flujo con memoria acotada (ver codec_stream_*)
+    int (*stream_init)(CodecStream* st);
+    int (*stream_update)(CodecStream* st, const unsigned char* data, size_t len);
+    int (*stream_final)(CodecStream* st);
+
+    // Archivo completo en el formato heredado (NULL en las cadenas, que no lo tienen; los niveles
+    // de LZSS solo traen read_file porque writeLZSS usa el nivel por defecto)
+    void (*write_file)(char inputFile[], char outputFile[]);
+    int (*read_file)(char inputFile[], char outputFile[]);
+};
+
+// Clave preparada para cifrar/descifrar bloques
+typedef struct {
+    const char* password;
+    AesContext aes;
+} CipherKey;
+
+typedef struct {
+    const char* name;
+    uint8_t id;                 // CIPHER_ID_* guardado en el encabezado
+    size_t overhead;            // Bytes que el cifrado puede agregar a cada bloque
+
+    void (*init)(CipherKey* key, const char* password);
+    // dst con capacidad para len + overhead; devuelve la longitud cifrada
+    size_t (*encrypt)(const CipherKey* key, const unsigned char* src, size_t len, unsigned char* dst);
+    // Puede descifrar en sitio (src == dst); devuelve 0 o -1 si los datos o la clave son inválidos
+    int (*decrypt)(const CipherKey* key, unsigned char* src, size_t len, unsigned char* dst, size_t* outLen);
+    void (*clear)(CipherKey* key);
+
+    int (*encrypt_file)(const char* inputPath, const char* outputPath, const char* password);
+    int (*decrypt_file)(const char* inputPath, const char* outputPath, const char* password);
+} CipherOps;
+
+/**
+ * Búsquedas en el registro
+ * @return Descriptor, o NULL si no existe
+ */
+const CodecOps* codec_find_name(const char* name);
+const CodecOps* codec_find_id(uint8_t id);
+const CodecOps* codec_find_extension(const char* ext);
+const CipherOps* cipher_find_name(const char* name);
+const CipherOps* cipher_find_id(uint8_t id);
+
+/**
+ * Escribe en buf los nombres registrados separados por ", " (para mensajes de ayuda)
+ */
+void codec_names(char* buf, size_t size);
+void cipher_names(char* buf, size_t size);
+
+/**
+ * Abre un flujo del compresor ops que entrega su salida a sink
+ * @param encoding 1 para comprimir, 0 para descomprimir
+ * @return 0 en éxito, -1 en error
+ */
+int codec_stream_open(CodecStream* st, const CodecOps* ops, int encoding, CodecSink sink, void* opaque);
+
+/**
+ * Agrega datos al flujo; la salida se entrega a sink a medida que se completan bloques
+ * @return 0 en éxito, -1 en error
+ */
+int codec_stream_write(CodecStream* st, const unsigned char* data, size_t len);
+
+/**
+ * Cierra el flujo (vacía el último bloque o comprueba la trama final) y libera su memoria
+ * @return 0 en éxito, -1 en error
+ */
+int codec_stream_close(CodecStream* st);
+
+/**
+ * Libera el flujo sin vaciarlo ni comprobar la trama final (tras un error)
+ */
+void codec_stream_abort(CodecStream* st);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// SHA-256 (FIPS 180-4) por partes. Lo usa el almacén de fragmentos para identificar contenido;
+// para detectar errores de disco basta con CRC32C (checksum.h)
+
+#define SHA256_SIZE 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length;            // Bytes procesados
+    unsigned char block[64];
+    size_t used;                // Bytes pendientes en block
+} Sha256;
+
+void sha256_init(Sha256* c);
+void sha256_update(Sha256* c, const void* data, size_t len);
+void sha256_final(Sha256* c, unsigned char out[SHA256_SIZE]);
+
+#endif